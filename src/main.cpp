@@ -1,7 +1,22 @@
+#include <pixelmatch/gpu.h>
+#include <pixelmatch/image_utils.h>
+#include <pixelmatch/pipeline.h>
 #include <pixelmatch/pixelmatch.h>
+#include <pixelmatch/pyramid.h>
+#include <pixelmatch/signature.h>
+#include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
 #define STRINGIFY(x) #x
 #define MACRO_STRINGIFY(x) STRINGIFY(x)
 
@@ -22,15 +37,127 @@ inline bool validate_buffer_info(const py::buffer_info& buf1, const py::buffer_i
   if (buf1.shape[2] != 4) {
     return false;
   }
+  if (buf1.itemsize != 1 || buf2.itemsize != 1) {
+    return false;
+  }
   return true;
 }
 
+// Returns the row stride in pixels of an (H,W,4) image if its pixels are contiguous within each
+// row, so that it can be compared in place, e.g. for a crop like `img[100:900, 200:1200]`.
+inline std::optional<size_t> row_stride_in_pixels(const py::buffer_info& buf) {
+  const py::ssize_t height = buf.shape[0];
+  const py::ssize_t width = buf.shape[1];
+  if (buf.strides[2] != 1 || (width > 1 && buf.strides[1] != 4)) {
+    return std::nullopt;
+  }
+  if (height <= 1) {
+    return static_cast<size_t>(width);
+  }
+  if (buf.strides[0] < width * 4 || buf.strides[0] % 4 != 0) {
+    return std::nullopt;
+  }
+  return static_cast<size_t>(buf.strides[0] / 4);
+}
+
+// Pixel data of the images of one comparison, in the layout pixelmatch() expects. The images are
+// viewed in place if they share a row stride, and packed into contiguous copies otherwise.
+class ImageBuffers {
+ public:
+  ImageBuffers(const py::buffer_info& img1, const py::buffer_info& img2,
+               const py::buffer_info* output)
+      : output_buffer_(output),
+        height_(static_cast<int>(img1.shape[0])),
+        width_(static_cast<int>(img1.shape[1])) {
+    const std::optional<size_t> stride = row_stride_in_pixels(img1);
+    if (stride && row_stride_in_pixels(img2) == stride &&
+        (!output || row_stride_in_pixels(*output) == stride)) {
+      // The spans end with the last pixel of the last row: a crop of a larger image does not own
+      // the rest of that stride.
+      stride_in_pixels_ = *stride;
+      const size_t size =
+          height_ > 0 ? ((height_ - 1) * stride_in_pixels_ + width_) * 4 : size_t(0);
+      img1_ = pixelmatch::span<const uint8_t>(static_cast<const uint8_t*>(img1.ptr), size);
+      img2_ = pixelmatch::span<const uint8_t>(static_cast<const uint8_t*>(img2.ptr), size);
+      if (output) {
+        output_ = pixelmatch::span<uint8_t>(static_cast<uint8_t*>(output->ptr), size);
+      }
+      return;
+    }
+
+    stride_in_pixels_ = width_;
+    const size_t size = static_cast<size_t>(width_) * height_ * 4;
+    packed_.resize(size * (output ? 3 : 2));
+    copy_pixels(img1, packed_.data(), true);
+    copy_pixels(img2, packed_.data() + size, true);
+    img1_ = pixelmatch::span<const uint8_t>(packed_.data(), size);
+    img2_ = pixelmatch::span<const uint8_t>(packed_.data() + size, size);
+    if (output) {
+      copy_pixels(*output, packed_.data() + size * 2, true);
+      output_ = pixelmatch::span<uint8_t>(packed_.data() + size * 2, size);
+    }
+  }
+
+  ImageBuffers(const ImageBuffers&) = delete;
+  ImageBuffers& operator=(const ImageBuffers&) = delete;
+  ImageBuffers(ImageBuffers&&) = default;
+  ImageBuffers& operator=(ImageBuffers&&) = default;
+
+  pixelmatch::span<const uint8_t> img1() const { return img1_; }
+  pixelmatch::span<const uint8_t> img2() const { return img2_; }
+  pixelmatch::span<uint8_t> output() const { return output_; }
+  int width() const { return width_; }
+  int height() const { return height_; }
+  size_t strideInPixels() const { return stride_in_pixels_; }
+
+  // Copies the diff back to the output buffer if it was packed. Does not need the GIL.
+  void finish() {
+    if (output_buffer_ && !packed_.empty()) {
+      // The packed output follows the packed img1 and img2.
+      copy_pixels(*output_buffer_, packed_.data() + packed_.size() / 3 * 2, false);
+    }
+  }
+
+ private:
+  // Copies between an (H,W,4) image with any strides and contiguous rows.
+  void copy_pixels(const py::buffer_info& buf, uint8_t* packed, bool pack) const {
+    for (int y = 0; y < height_; ++y) {
+      for (int x = 0; x < width_; ++x) {
+        uint8_t* pixel = static_cast<uint8_t*>(buf.ptr) + y * buf.strides[0] + x * buf.strides[1];
+        for (int c = 0; c < 4; ++c) {
+          uint8_t* packed_byte = packed + (static_cast<size_t>(y) * width_ + x) * 4 + c;
+          if (pack) {
+            *packed_byte = pixel[c * buf.strides[2]];
+          } else {
+            pixel[c * buf.strides[2]] = *packed_byte;
+          }
+        }
+      }
+    }
+  }
+
+  const py::buffer_info* output_buffer_;
+  int height_;
+  int width_;
+  size_t stride_in_pixels_ = 0;
+  std::vector<uint8_t> packed_;
+  pixelmatch::span<const uint8_t> img1_;
+  pixelmatch::span<const uint8_t> img2_;
+  pixelmatch::span<uint8_t> output_;
+};
+
 using Color = pixelmatch::Color;
+using DiffResult = pixelmatch::DiffResult;
 using Options = pixelmatch::Options;
+using Rect = pixelmatch::Rect;
 inline std::string stringify(const Color& self) {
   return "rgba(" + std::to_string(self.r) + "," + std::to_string(self.g) + "," +
          std::to_string(self.b) + "," + std::to_string(self.a) + ")";
 }
+inline std::string stringify(const Rect& self) {
+  return "Rect(" + std::to_string(self.x) + "," + std::to_string(self.y) + "," +
+         std::to_string(self.width) + "," + std::to_string(self.height) + ")";
+}
 inline std::string stringify(const Options& self) {
   return std::string("{threshold=") + std::to_string(self.threshold) +       //
          std::string(",includeAA=") + (self.includeAA ? "true" : "false") +  //
@@ -39,34 +166,888 @@ inline std::string stringify(const Options& self) {
          std::string(",diffColor=") + stringify(self.diffColor) +            //
          std::string(",diffColorAlt=") +
          (self.diffColorAlt ? stringify(*self.diffColorAlt) : std::string("None")) +  //
-         std::string(",diffMask=") + (self.diffMask ? "true" : "false") + "}";
+         std::string(",diffMask=") + (self.diffMask ? "true" : "false") +  //
+         std::string(",numThreads=") + std::to_string(self.numThreads) +  //
+         std::string(",maxDiffs=") +
+         (self.maxDiffs ? std::to_string(*self.maxDiffs) : std::string("None")) +  //
+         std::string(",ignoreRegions=") + std::to_string(self.ignoreRegions.size()) +  //
+         std::string(",engine=") +
+         (self.engine == pixelmatch::Engine::FixedPoint     ? "FixedPoint"
+          : self.engine == pixelmatch::Engine::CoarseToFine ? "CoarseToFine"
+                                                            : "Float") +  //
+         std::string(",countTiles=") + (self.countTiles ? "true" : "false") +  //
+         std::string(",collectDiffPixels=") + (self.collectDiffPixels ? "true" : "false") +
+         std::string(",collectAntialiasedPixels=") +
+         (self.collectAntialiasedPixels ? "true" : "false") +  //
+         std::string(",outputFormat=") +
+         (self.outputFormat == pixelmatch::OutputFormat::ByteMask  ? "ByteMask"
+          : self.outputFormat == pixelmatch::OutputFormat::BitMask ? "BitMask"
+                                                                   : "Rgba") +
+         "}";
+}
+inline std::string stringify(const DiffResult& self) {
+  return std::string("DiffResult(numDiffPixels=") + std::to_string(self.numDiffPixels) +  //
+         std::string(",numAntialiasedPixels=") + std::to_string(self.numAntialiasedPixels) +
+         std::string(",numDarkerPixels=") + std::to_string(self.numDarkerPixels) +    //
+         std::string(",numLighterPixels=") + std::to_string(self.numLighterPixels) +  //
+         std::string(",bounds=") + (self.bounds ? stringify(*self.bounds) : std::string("None")) +
+         ")";
+}
+
+// Returns true if the bytes of an (H,W) mask are contiguous.
+inline bool is_contiguous_mask(const py::buffer_info& buf) {
+  const py::ssize_t height = buf.shape[0];
+  const py::ssize_t width = buf.shape[1];
+  return (width <= 1 || buf.strides[1] == 1) && (height <= 1 || buf.strides[0] == width);
+}
+
+// Returns the bytes of an (H,W) ignore mask, packing them into \ref packed unless contiguous.
+inline pixelmatch::span<const uint8_t> mask_span(const py::buffer_info& buf,
+                                                 std::vector<uint8_t>& packed) {
+  const py::ssize_t height = buf.shape[0];
+  const py::ssize_t width = buf.shape[1];
+  if (is_contiguous_mask(buf)) {
+    return pixelmatch::span<const uint8_t>(static_cast<const uint8_t*>(buf.ptr), buf.size);
+  }
+
+  packed.resize(buf.size);
+  for (py::ssize_t y = 0; y < height; ++y) {
+    for (py::ssize_t x = 0; x < width; ++x) {
+      packed[y * width + x] =
+          static_cast<const uint8_t*>(buf.ptr)[y * buf.strides[0] + x * buf.strides[1]];
+    }
+  }
+  return packed;
+}
+
+// Returns the bytes of an (H,W) output mask, or of \ref packed unless contiguous, in which case
+// unpack_mask() copies them back once written. The packed bytes start as a copy of the mask, for
+// comparisons that only write some of its pixels.
+inline pixelmatch::span<uint8_t> output_mask_span(const py::buffer_info& buf,
+                                                  std::vector<uint8_t>& packed) {
+  if (is_contiguous_mask(buf)) {
+    return pixelmatch::span<uint8_t>(static_cast<uint8_t*>(buf.ptr), buf.size);
+  }
+  const py::ssize_t height = buf.shape[0];
+  const py::ssize_t width = buf.shape[1];
+  packed.resize(buf.size);
+  for (py::ssize_t y = 0; y < height; ++y) {
+    for (py::ssize_t x = 0; x < width; ++x) {
+      packed[y * width + x] =
+          static_cast<const uint8_t*>(buf.ptr)[y * buf.strides[0] + x * buf.strides[1]];
+    }
+  }
+  return packed;
+}
+
+// Copies \ref packed back to an (H,W) output mask. Does not need the GIL.
+inline void unpack_mask(const py::buffer_info& buf, const std::vector<uint8_t>& packed) {
+  const py::ssize_t height = buf.shape[0];
+  const py::ssize_t width = buf.shape[1];
+  for (py::ssize_t y = 0; y < height; ++y) {
+    for (py::ssize_t x = 0; x < width; ++x) {
+      static_cast<uint8_t*>(buf.ptr)[y * buf.strides[0] + x * buf.strides[1]] =
+          packed[y * width + x];
+    }
+  }
+}
+
+// Minimal declarations of the DLPack ABI, from dlpack/dlpack.h, for the tensors exported by the
+// __dlpack__() method of PyTorch, JAX, CuPy and NumPy arrays.
+namespace dlpack {
+
+enum DeviceType : int32_t {
+  kCPU = 1,
+  kCUDA = 2,
+  kCUDAHost = 3,
+  kCUDAManaged = 13,
+};
+
+constexpr uint8_t kUInt = 1;
+constexpr uint8_t kFloat = 2;
+
+struct Device {
+  int32_t device_type;
+  int32_t device_id;
+};
+
+struct DataType {
+  uint8_t code;
+  uint8_t bits;
+  uint16_t lanes;
+};
+
+struct Tensor {
+  void* data;
+  Device device;
+  int32_t ndim;
+  DataType dtype;
+  int64_t* shape;
+  int64_t* strides;  // In elements, or null for a compact row-major tensor.
+  uint64_t byte_offset;
+};
+
+struct ManagedTensor {
+  Tensor dl_tensor;
+  void* manager_ctx;
+  void (*deleter)(ManagedTensor* self);
+};
+
+}  // namespace dlpack
+
+// Returns the DLPack device type of \ref obj, a "dltensor" capsule or an object with
+// __dlpack_device__(), without consuming it; kCPU for anything else, such as buffers.
+inline int32_t dlpack_device_type(const py::object& obj) {
+  if (PyCapsule_IsValid(obj.ptr(), "dltensor")) {
+    return static_cast<const dlpack::ManagedTensor*>(PyCapsule_GetPointer(obj.ptr(), "dltensor"))
+        ->dl_tensor.device.device_type;
+  }
+  if (py::hasattr(obj, "__dlpack_device__")) {
+    return obj.attr("__dlpack_device__")().cast<py::tuple>()[0].cast<int32_t>();
+  }
+  return dlpack::kCPU;
+}
+
+inline bool is_cuda_device(int32_t device_type) {
+  return device_type == dlpack::kCUDA || device_type == dlpack::kCUDAManaged;
 }
 
-inline int pixelmatch_fn(const py::buffer& img1, const py::buffer& img2,
-                         const py::buffer* out = nullptr,
-                         const pixelmatch::Options& options = pixelmatch::Options()) {
+// A DLPack tensor consumed from a "dltensor" capsule, which deletes the tensor once the comparison
+// no longer needs its memory. Must be destroyed while holding the GIL.
+class DLPackTensor {
+ public:
+  // Consumes \ref obj, a capsule or an object with __dlpack__(), asking producers of CUDA tensors
+  // to synchronize with the legacy default stream, which pixelmatchDevice() runs on. Returns
+  // nullopt if it is neither.
+  static std::optional<DLPackTensor> consume(const py::object& obj) {
+    py::object capsule = obj;
+    if (!PyCapsule_CheckExact(obj.ptr())) {
+      if (!py::hasattr(obj, "__dlpack__")) {
+        return std::nullopt;
+      }
+      capsule = is_cuda_device(dlpack_device_type(obj)) ? obj.attr("__dlpack__")("stream"_a = 1)
+                                                         : obj.attr("__dlpack__")();
+    }
+    if (!PyCapsule_IsValid(capsule.ptr(), "dltensor")) {
+      return std::nullopt;
+    }
+
+    auto* managed =
+        static_cast<dlpack::ManagedTensor*>(PyCapsule_GetPointer(capsule.ptr(), "dltensor"));
+    // Renaming the capsule marks it as consumed, so that it no longer deletes the tensor.
+    PyCapsule_SetName(capsule.ptr(), "used_dltensor");
+    return DLPackTensor(managed);
+  }
+
+  DLPackTensor(const DLPackTensor&) = delete;
+  DLPackTensor& operator=(const DLPackTensor&) = delete;
+  DLPackTensor(DLPackTensor&& other) noexcept : managed_(std::exchange(other.managed_, nullptr)) {}
+  DLPackTensor& operator=(DLPackTensor&&) = delete;
+
+  ~DLPackTensor() {
+    if (managed_ && managed_->deleter) {
+      managed_->deleter(managed_);
+    }
+  }
+
+  const dlpack::Device& device() const { return managed_->dl_tensor.device; }
+
+  // Describes a uint8 or float32 tensor as a buffer, with strides in bytes. Returns false for
+  // other types.
+  bool to_buffer_info(py::buffer_info& buf) const {
+    const dlpack::Tensor& tensor = managed_->dl_tensor;
+    const bool is_uint8 = tensor.dtype.code == dlpack::kUInt && tensor.dtype.bits == 8;
+    const bool is_float32 = tensor.dtype.code == dlpack::kFloat && tensor.dtype.bits == 32;
+    if (!(is_uint8 || is_float32) || tensor.dtype.lanes != 1) {
+      return false;
+    }
+    const py::ssize_t itemsize = is_uint8 ? 1 : 4;
+    std::vector<py::ssize_t> shape(tensor.shape, tensor.shape + tensor.ndim);
+    std::vector<py::ssize_t> strides(tensor.ndim);
+    py::ssize_t compact_stride = 1;
+    for (int i = tensor.ndim - 1; i >= 0; --i) {
+      strides[i] = (tensor.strides ? tensor.strides[i] : compact_stride) * itemsize;
+      compact_stride *= shape[i];
+    }
+    buf = py::buffer_info(static_cast<uint8_t*>(tensor.data) + tensor.byte_offset, itemsize,
+                          is_uint8 ? py::format_descriptor<uint8_t>::format()
+                                   : py::format_descriptor<float>::format(),
+                          tensor.ndim, shape, strides);
+    return true;
+  }
+
+ private:
+  explicit DLPackTensor(dlpack::ManagedTensor* managed) : managed_(managed) {}
+
+  dlpack::ManagedTensor* managed_;
+};
+
+// Requests the bytes of an image, mask or delta map, given as a buffer or as a DLPack tensor in
+// host memory, which \ref tensors then keeps alive. Returns false for tensors of other devices or
+// types, or if \ref writable is set and the buffer is read-only, and throws for objects that are
+// neither.
+inline bool request_buffer(const py::object& obj, bool writable,
+                           std::vector<DLPackTensor>& tensors, py::buffer_info& buf) {
+  if (py::isinstance<py::buffer>(obj)) {
+    buf = obj.cast<py::buffer>().request(writable);
+    return !(writable && buf.readonly);
+  }
+
+  std::optional<DLPackTensor> tensor = DLPackTensor::consume(obj);
+  if (!tensor) {
+    throw py::type_error("Images and masks should be buffers, such as NumPy arrays, or DLPack "
+                         "tensors, such as torch.Tensor");
+  }
+  if ((tensor->device().device_type != dlpack::kCPU &&
+       tensor->device().device_type != dlpack::kCUDAHost) ||
+      !tensor->to_buffer_info(buf)) {
+    return false;
+  }
+  tensors.push_back(std::move(*tensor));
+  return true;
+}
+
+// Requests the buffers of a comparison, returning false if they are not RGBA images of the same
+// size. The buffer_info objects hold the buffer views, and \ref tensors the DLPack tensors,
+// keeping the images alive and unmoved until the comparison finishes.
+inline bool request_buffers(const py::object& img1, const py::object& img2, const py::object* out,
+                            std::vector<DLPackTensor>& tensors, py::buffer_info& buf1,
+                            py::buffer_info& buf2, py::buffer_info& buf) {
+  if (!request_buffer(img1, false, tensors, buf1) || !request_buffer(img2, false, tensors, buf2) ||
+      !validate_buffer_info(buf1, buf2)) {
+    return false;
+  }
+  if (out) {
+    if (!request_buffer(*out, true, tensors, buf) || !validate_buffer_info(buf, buf1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Runs \ref compare(images, output, options) without the GIL, returning \ref invalid if the
+// buffers are not valid images and masks.
+template <typename Result, typename Compare>
+inline Result compare_buffers(const py::object& img1, const py::object& img2, const py::object* out,
+                              const pixelmatch::Options& options, const py::object& ignore_mask,
+                              const pixelmatch::ImagePyramid* img1_pyramid,
+                              const pixelmatch::ImageSignature* img1_signature,
+                              const py::object& delta_map, Result invalid, Compare compare) {
+  // Copy the options while holding the GIL, another thread may modify them during the comparison.
+  Options opts = options;
+  opts.img1Pyramid = img1_pyramid;
+  opts.img1Signature = img1_signature;
+
+  // The mask formats write to an (H,W) or (H,(W+7)/8) array rather than an RGBA image.
+  const bool mask_output = out && opts.outputFormat != pixelmatch::OutputFormat::Rgba;
+  std::vector<DLPackTensor> tensors;
+  py::buffer_info buf1, buf2, buf;
+  if (!request_buffers(img1, img2, mask_output ? nullptr : out, tensors, buf1, buf2, buf)) {
+    return invalid;
+  }
+  if (img1_pyramid && (img1_pyramid->width() != buf1.shape[1] ||
+                       img1_pyramid->height() != buf1.shape[0])) {
+    return invalid;
+  }
+  if (img1_signature && (img1_signature->width() != buf1.shape[1] ||
+                         img1_signature->height() != buf1.shape[0])) {
+    return invalid;
+  }
+  ImageBuffers images(buf1, buf2, out && !mask_output ? &buf : nullptr);
+
+  pixelmatch::span<uint8_t> output = images.output();
+  std::vector<uint8_t> packed_output;
+  if (mask_output) {
+    if (!request_buffer(*out, true, tensors, buf)) {
+      return invalid;
+    }
+    const py::ssize_t row_bytes = opts.outputFormat == pixelmatch::OutputFormat::BitMask
+                                      ? (buf1.shape[1] + 7) / 8
+                                      : buf1.shape[1];
+    if (buf.ndim != 2 || buf.itemsize != 1 || buf.shape[0] != buf1.shape[0] ||
+        buf.shape[1] != row_bytes) {
+      return invalid;
+    }
+    output = output_mask_span(buf, packed_output);
+  }
+
+  py::buffer_info mask_buf;
+  std::vector<uint8_t> packed_mask;
+  if (!ignore_mask.is_none()) {
+    if (!request_buffer(ignore_mask, false, tensors, mask_buf)) {
+      return invalid;
+    }
+    if (mask_buf.ndim != 2 || mask_buf.itemsize != 1 || mask_buf.shape[0] != buf1.shape[0] ||
+        mask_buf.shape[1] != buf1.shape[1]) {
+      return invalid;
+    }
+    opts.ignoreMask = mask_span(mask_buf, packed_mask);
+  }
+
+  // The delta map is written in place, so it should be a C-contiguous (H,W) float32 array.
+  py::buffer_info delta_buf;
+  if (!delta_map.is_none()) {
+    if (!request_buffer(delta_map, true, tensors, delta_buf)) {
+      return invalid;
+    }
+    if (delta_buf.ndim != 2 || delta_buf.format != py::format_descriptor<float>::format() ||
+        delta_buf.shape[0] != buf1.shape[0] || delta_buf.shape[1] != buf1.shape[1] ||
+        delta_buf.strides[1] != 4 || delta_buf.strides[0] != delta_buf.shape[1] * 4) {
+      return invalid;
+    }
+    opts.deltaMap = pixelmatch::span<float>(static_cast<float*>(delta_buf.ptr),
+                                            static_cast<size_t>(delta_buf.size));
+  }
+
+  py::gil_scoped_release release;
+  Result result = compare(images, output, opts);
+  images.finish();
+  if (!packed_output.empty()) {
+    unpack_mask(buf, packed_output);
+  }
+  return result;
+}
+
+// Throws unless pixelmatchDevice() supports \ref options, and the module has a CUDA device.
+inline void check_device_options(const Options& options) {
+  if (!pixelmatch::gpuAvailable()) {
+    throw py::value_error("The module is not built with the CUDA backend, or no device");
+  }
+  const Options defaults;
+  if (options.engine != defaults.engine || options.outputFormat != defaults.outputFormat ||
+      options.maxDiffs || !options.ignoreRegions.empty() || options.countTiles ||
+      options.collectDiffPixels || options.collectAntialiasedPixels || !options.deltaMap.empty()) {
+    throw py::value_error(
+        "Only the Float engine and RGBA output are supported on the GPU, without maxDiffs, "
+        "ignored regions, tile counts, pixel lists or delta maps");
+  }
+}
+
+// Compares DLPack tensors in CUDA memory with pixelmatchDevice(), returning invalidResult() if
+// they are not RGBA images of the same size with the same row stride.
+inline pixelmatch::DiffResult compare_on_device(const py::object& img1, const py::object& img2,
+                                                const py::object* out, const Options& options,
+                                                const py::object& ignore_mask,
+                                                const pixelmatch::ImagePyramid* img1_pyramid,
+                                                const pixelmatch::ImageSignature* img1_signature,
+                                                const py::object& delta_map) {
+  check_device_options(options);
+  if (!ignore_mask.is_none() || img1_pyramid || img1_signature || !delta_map.is_none()) {
+    throw py::value_error(
+        "ignoreMask, img1Pyramid, img1Signature and deltaMap are not supported for CUDA tensors");
+  }
+
+  std::vector<DLPackTensor> tensors;
+  std::vector<py::buffer_info> bufs(out ? 3 : 2);
+  const py::object* objects[] = {&img1, &img2, out};
+  for (size_t i = 0; i < bufs.size(); ++i) {
+    std::optional<DLPackTensor> tensor = DLPackTensor::consume(*objects[i]);
+    if (!tensor || !is_cuda_device(tensor->device().device_type) ||
+        !tensor->to_buffer_info(bufs[i]) ||
+        (i > 0 && tensor->device().device_id != tensors[0].device().device_id)) {
+      return pixelmatch::invalidResult();
+    }
+    tensors.push_back(std::move(*tensor));
+  }
+  const std::optional<size_t> stride = row_stride_in_pixels(bufs[0]);
+  for (const py::buffer_info& buf : bufs) {
+    if (!validate_buffer_info(buf, bufs[0]) || !stride || row_stride_in_pixels(buf) != stride) {
+      return pixelmatch::invalidResult();
+    }
+  }
+
+  // Copy the options while holding the GIL, another thread may modify them during the comparison.
+  const Options opts = options;
+  py::gil_scoped_release release;
+  return pixelmatch::pixelmatchDevice(
+      static_cast<const uint8_t*>(bufs[0].ptr), static_cast<const uint8_t*>(bufs[1].ptr),
+      out ? static_cast<uint8_t*>(bufs[2].ptr) : nullptr, static_cast<int>(bufs[0].shape[1]),
+      static_cast<int>(bufs[0].shape[0]), *stride, opts);
+}
+
+inline int pixelmatch_fn(const py::object& img1, const py::object& img2,
+                         const py::object* out = nullptr,
+                         const pixelmatch::Options& options = pixelmatch::Options(),
+                         const py::object& ignore_mask = py::none(),
+                         const pixelmatch::ImagePyramid* img1_pyramid = nullptr,
+                         const pixelmatch::ImageSignature* img1_signature = nullptr,
+                         const py::object& delta_map = py::none()) {
+  if (is_cuda_device(dlpack_device_type(img1))) {
+    return compare_on_device(img1, img2, out, options, ignore_mask, img1_pyramid, img1_signature,
+                             delta_map)
+        .numDiffPixels;
+  }
+  return compare_buffers(img1, img2, out, options, ignore_mask, img1_pyramid, img1_signature,
+                         delta_map, -1,
+                         [](const ImageBuffers& images, pixelmatch::span<uint8_t> output,
+                            const Options& opts) {
+                           return pixelmatch::pixelmatch(images.img1(), images.img2(), output,
+                                                         images.width(), images.height(),
+                                                         images.strideInPixels(), opts);
+                         });
+}
+
+inline pixelmatch::DiffResult pixelmatch_stats_fn(const py::object& img1, const py::object& img2,
+                                                  const pixelmatch::Options& options,
+                                                  const py::object& ignore_mask,
+                                                  const pixelmatch::ImagePyramid* img1_pyramid,
+                                                  const pixelmatch::ImageSignature* img1_signature,
+                                                  const py::object& delta_map) {
+  if (is_cuda_device(dlpack_device_type(img1))) {
+    return compare_on_device(img1, img2, nullptr, options, ignore_mask, img1_pyramid,
+                             img1_signature, delta_map);
+  }
+  return compare_buffers(img1, img2, nullptr, options, ignore_mask, img1_pyramid, img1_signature,
+                         delta_map, pixelmatch::invalidResult(),
+                         [](const ImageBuffers& images, pixelmatch::span<uint8_t>,
+                            const Options& opts) {
+                           return pixelmatch::pixelmatch(images.img1(), images.img2(),
+                                                         images.width(), images.height(),
+                                                         images.strideInPixels(), opts);
+                         });
+}
+
+// A pixelmatch::Comparator shared between Python threads, which take turns to use it.
+struct PyComparator {
+  explicit PyComparator(const Options& options) : comparator(options) {}
+
+  int compare(const py::buffer& img1, const py::buffer& img2, const py::buffer* out) {
+    // The options select the format of the output. If another thread replaces them before the
+    // comparison starts, a mismatched output fails the size check and returns -1.
+    return compare_buffers(img1, img2, out, options(), py::none(), nullptr, nullptr, py::none(),
+                           -1,
+                           [this](const ImageBuffers& images, pixelmatch::span<uint8_t> output,
+                                  const Options&) {
+                             std::lock_guard<std::mutex> lock(mutex);
+                             return comparator.compare(images.img1(), images.img2(), output,
+                                                       images.width(), images.height(),
+                                                       images.strideInPixels());
+                           });
+  }
+
+  Options options() {
+    py::gil_scoped_release release;
+    std::lock_guard<std::mutex> lock(mutex);
+    return comparator.options();
+  }
+
+  void set_options(const Options& options) {
+    Options opts = options;
+    py::gil_scoped_release release;
+    std::lock_guard<std::mutex> lock(mutex);
+    comparator.setOptions(std::move(opts));
+  }
+
+  pixelmatch::Comparator comparator;
+  std::mutex mutex;
+};
+
+// A pixelmatch::IncrementalComparator shared between Python threads, which take turns to use it.
+struct PyIncrementalComparator {
+  explicit PyIncrementalComparator(const Options& options) : comparator(options) {}
+
+  // Runs compare(), or update() with \ref dirty_rects if set.
+  pixelmatch::DiffResult compare(const py::buffer& img1, const py::buffer& img2,
+                                 const py::buffer* out,
+                                 const std::vector<Rect>* dirty_rects) {
+    return compare_buffers(img1, img2, out, comparator.options(), py::none(), nullptr, nullptr,
+                           py::none(), pixelmatch::invalidResult(),
+                           [&](const ImageBuffers& images, pixelmatch::span<uint8_t> output,
+                               const Options&) {
+                             std::lock_guard<std::mutex> lock(mutex);
+                             if (!dirty_rects) {
+                               return comparator.compare(images.img1(), images.img2(), output,
+                                                         images.width(), images.height(),
+                                                         images.strideInPixels());
+                             }
+                             return comparator.update(images.img1(), images.img2(), output,
+                                                      images.width(), images.height(),
+                                                      images.strideInPixels(), *dirty_rects);
+                           });
+  }
+
+  pixelmatch::IncrementalComparator comparator;
+  std::mutex mutex;
+};
+
+// A pixelmatch::StreamingComparator shared between Python threads, which take turns to push rows.
+// Gathers the output rows completed by each push, to return them as an array.
+class PyStreamingComparator {
+ public:
+  PyStreamingComparator(int width, int height, const Options& options, bool output)
+      : options_(checked_options(width, height, options)),
+        comparator_(width, height, options_,
+                    output ? pixelmatch::StreamingComparator::OutputRowsFn(
+                                 [this](int, int numRows, pixelmatch::span<const uint8_t> rows) {
+                                   pending_rows_ += numRows;
+                                   pending_.insert(pending_.end(), rows.data(),
+                                                   rows.data() + rows.size());
+                                 })
+                           : nullptr),
+        output_(output) {}
+
+  // The output callback points to this object.
+  PyStreamingComparator(const PyStreamingComparator&) = delete;
+  PyStreamingComparator& operator=(const PyStreamingComparator&) = delete;
+
+  // Runs \ref fn on the comparator once no other thread is pushing rows.
+  template <typename Fn>
+  auto with_comparator(Fn fn) {
+    py::gil_scoped_release release;
+    std::lock_guard<std::mutex> lock(mutex_);
+    return fn(static_cast<const pixelmatch::StreamingComparator&>(comparator_));
+  }
+
+  // Pushes (N,W,4) rows of both images. Returns the output rows completed by the push, as an array
+  // of the shape of Options::outputFormat, or None without output.
+  py::object push_rows(const py::buffer& img1_rows, const py::buffer& img2_rows) {
+    const py::buffer_info buf1 = img1_rows.request();
+    const py::buffer_info buf2 = img2_rows.request();
+    if (!validate_buffer_info(buf1, buf2) || buf1.shape[1] != comparator_.width()) {
+      throw py::value_error("img1_rows and img2_rows should be (N,W,4) arrays of the same shape");
+    }
+
+    const ImageBuffers rows(buf1, buf2, nullptr);
+    std::vector<uint8_t> completed;
+    int completed_rows;
+    {
+      py::gil_scoped_release release;
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (comparator_.rowsPushed() + rows.height() > comparator_.height()) {
+        throw py::value_error("More rows pushed than the height of the images");
+      }
+      pending_.clear();
+      pending_rows_ = 0;
+      if (comparator_.pushRows(rows.img1(), rows.img2(), rows.height(), rows.strideInPixels()) <
+          0) {
+        throw py::value_error("Could not compare the rows");
+      }
+      completed.swap(pending_);
+      completed_rows = pending_rows_;
+    }
+    if (!output_) {
+      return py::none();
+    }
+
+    const py::ssize_t numRows = completed_rows;
+    const py::ssize_t width = comparator_.width();
+    py::array_t<uint8_t> output;
+    switch (options_.outputFormat) {
+      case pixelmatch::OutputFormat::Rgba:
+        output = py::array_t<uint8_t>({numRows, width, py::ssize_t(4)});
+        break;
+      case pixelmatch::OutputFormat::ByteMask:
+        output = py::array_t<uint8_t>({numRows, width});
+        break;
+      case pixelmatch::OutputFormat::BitMask:
+        output = py::array_t<uint8_t>({numRows, (width + 7) / 8});
+        break;
+    }
+    std::copy(completed.begin(), completed.end(), output.mutable_data());
+    return std::move(output);
+  }
+
+ private:
+  // Checks the arguments before they reach the comparator, which asserts on them.
+  static const Options& checked_options(int width, int height, const Options& options) {
+    if (width <= 0 || height <= 0 || options.numThreads < 0 ||
+        (options.maxDiffs && *options.maxDiffs < 0)) {
+      throw py::value_error("width and height should be > 0, numThreads and maxDiffs >= 0");
+    }
+    return options;
+  }
+
+  Options options_;
+  pixelmatch::StreamingComparator comparator_;
+  bool output_;
+  std::vector<uint8_t> pending_;
+  int pending_rows_ = 0;
+  std::mutex mutex_;
+};
+
+// A pixelmatch::PngRowDecoder shared between Python threads, which take turns to read rows.
+struct PyPngRowDecoder {
+  explicit PyPngRowDecoder(pixelmatch::PngRowDecoder decoder) : decoder(std::move(decoder)) {}
+
+  int rows_read() {
+    py::gil_scoped_release release;
+    std::lock_guard<std::mutex> lock(mutex);
+    return decoder.rowsRead();
+  }
+
+  pixelmatch::PngRowDecoder decoder;
+  std::mutex mutex;
+};
+
+// Decodes the next rows of a PyPngRowDecoder into an (N,W,4) array, with fewer rows at the end of
+// the image.
+inline py::array_t<uint8_t> read_png_rows(PyPngRowDecoder& self, int num_rows) {
+  if (num_rows < 0) {
+    throw py::value_error("num_rows should be >= 0");
+  }
+  // Other threads may read rows until the lock is taken, so size the array for the whole request
+  // and shrink it to the rows decoded.
+  const pixelmatch::PngRowDecoder& decoder = self.decoder;
+  num_rows = std::min(num_rows, decoder.height());
+  py::array_t<uint8_t> rows({py::ssize_t(num_rows), py::ssize_t(decoder.width()), py::ssize_t(4)});
+  pixelmatch::span<uint8_t> pixels(rows.mutable_data(), rows.size());
+  int decoded;
+  {
+    py::gil_scoped_release release;
+    std::lock_guard<std::mutex> lock(self.mutex);
+    decoded = self.decoder.readRows(pixels, num_rows);
+  }
+  if (decoded < 0) {
+    throw py::value_error("Could not decode the PNG rows, the file is truncated or corrupt");
+  }
+  if (decoded != num_rows) {
+    rows.resize({py::ssize_t(decoded), py::ssize_t(decoder.width()), py::ssize_t(4)});
+  }
+  return rows;
+}
+
+inline bool validate_batch_buffer_info(const py::buffer_info& buf1, const py::buffer_info& buf2) {
+  // should be N x RGBA images
+  if (buf1.ndim != 4 || buf2.ndim != 4) {
+    return false;
+  }
+  for (int i = 0; i < 4; ++i) {
+    if (buf1.shape[i] != buf2.shape[i]) {
+      return false;
+    }
+  }
+  if (buf1.shape[3] != 4) {
+    return false;
+  }
+  // Each image of the batch should be contiguous.
+  return buf1.strides[3] == 1 && buf1.strides[2] == 4 && buf1.strides[1] == buf1.shape[2] * 4 &&
+         buf1.strides[0] >= buf1.shape[1] * buf1.strides[1];
+}
+
+inline std::vector<int> run_batch(const std::vector<pixelmatch::ImagePair>& pairs,
+                                  const Options& options,
+                                  std::vector<ImageBuffers>* views = nullptr) {
+  // Copy the options while holding the GIL, another thread may modify them during the comparison.
+  const Options opts = options;
+  py::gil_scoped_release release;
+  std::vector<int> diffs = pixelmatch::pixelmatchBatch(pairs, opts);
+  if (views) {
+    for (ImageBuffers& view : *views) {
+      view.finish();
+    }
+  }
+  return diffs;
+}
+
+inline std::vector<int> pixelmatch_batch_fn(const py::buffer& img1, const py::buffer& img2,
+                                            const py::object& out, const Options& options) {
   auto buf1 = img1.request();
   auto buf2 = img2.request();
-  if (!validate_buffer_info(buf1, buf2)) {
-    return -1;
+  if (!validate_batch_buffer_info(buf1, buf2) || buf1.strides != buf2.strides) {
+    throw py::value_error("img1 and img2 should be contiguous (N,H,W,4) arrays of the same shape");
   }
-  pixelmatch::span<const uint8_t> image1(reinterpret_cast<const uint8_t*>(buf1.ptr), buf1.size);
-  pixelmatch::span<const uint8_t> image2(reinterpret_cast<const uint8_t*>(buf2.ptr), buf2.size);
-  pixelmatch::span<uint8_t> output(nullptr, 0);
-  if (out) {
-    auto buf = out->request(true);
-    if (buf.readonly || !validate_buffer_info(buf, buf1)) {
-      return -1;
+  py::buffer_info buf;
+  if (!out.is_none()) {
+    buf = out.cast<py::buffer>().request(true);
+    if (buf.readonly || !validate_batch_buffer_info(buf, buf1) || buf.strides != buf1.strides) {
+      throw py::value_error("output should be a writable array of the same shape as img1");
     }
-    output = pixelmatch::span<uint8_t>(reinterpret_cast<uint8_t*>(buf.ptr), buf.size);
   }
-  int height = buf1.shape[0];
-  int width = buf1.shape[1];
-  int stride_in_pixels = width;
-  return pixelmatch::pixelmatch(image1, image2, output, width, height, stride_in_pixels, options);
+
+  const size_t count = buf1.shape[0];
+  const int height = buf1.shape[1];
+  const int width = buf1.shape[2];
+  const size_t imageBytes = static_cast<size_t>(width) * height * 4;
+  std::vector<pixelmatch::ImagePair> pairs;
+  pairs.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    const size_t offset = i * buf1.strides[0];
+    pixelmatch::ImagePair pair{
+        pixelmatch::span<const uint8_t>(reinterpret_cast<const uint8_t*>(buf1.ptr) + offset,
+                                        imageBytes),
+        pixelmatch::span<const uint8_t>(reinterpret_cast<const uint8_t*>(buf2.ptr) + offset,
+                                        imageBytes),
+        pixelmatch::span<uint8_t>(), width, height, static_cast<size_t>(width)};
+    if (buf.ptr) {
+      pair.output =
+          pixelmatch::span<uint8_t>(reinterpret_cast<uint8_t*>(buf.ptr) + offset, imageBytes);
+    }
+    pairs.push_back(pair);
+  }
+  return run_batch(pairs, options);
+}
+
+inline std::vector<int> pixelmatch_batch_fn(
+    const std::vector<std::pair<py::buffer, py::buffer>>& images,
+    const std::vector<py::buffer>* outputs, const Options& options) {
+  if (outputs && outputs->size() != images.size()) {
+    throw py::value_error("outputs should have one image per pair");
+  }
+
+  // The buffer_info objects keep the images alive until the comparison finishes.
+  std::vector<py::buffer_info> buffers;
+  buffers.reserve(images.size() * 3);
+  std::vector<ImageBuffers> views;
+  views.reserve(images.size());
+  std::vector<pixelmatch::ImagePair> pairs;
+  std::vector<size_t> indices;
+  for (size_t i = 0; i < images.size(); ++i) {
+    auto& buf1 = buffers.emplace_back(images[i].first.request());
+    auto& buf2 = buffers.emplace_back(images[i].second.request());
+    if (!validate_buffer_info(buf1, buf2)) {
+      continue;
+    }
+    py::buffer_info* buf = nullptr;
+    if (outputs) {
+      buf = &buffers.emplace_back((*outputs)[i].request(true));
+      if (buf->readonly || !validate_buffer_info(*buf, buf1)) {
+        continue;
+      }
+    }
+    const ImageBuffers& view = views.emplace_back(buf1, buf2, buf);
+    pairs.push_back(pixelmatch::ImagePair{view.img1(), view.img2(), view.output(), view.width(),
+                                          view.height(), view.strideInPixels()});
+    indices.push_back(i);
+  }
+
+  // Invalid pairs return -1, as with pixelmatch().
+  const std::vector<int> diffs = run_batch(pairs, options, &views);
+  std::vector<int> results(images.size(), -1);
+  for (size_t i = 0; i < indices.size(); ++i) {
+    results[indices[i]] = diffs[i];
+  }
+  return results;
+}
+
+// Returns the (x, y) coordinates of \ref pixels as an (N,2) array.
+inline py::array_t<int32_t> pixel_coordinates(
+    const std::vector<pixelmatch::DiffPixel>& pixels) {
+  py::array_t<int32_t> coords({static_cast<py::ssize_t>(pixels.size()), py::ssize_t(2)});
+  auto c = coords.mutable_unchecked<2>();
+  for (size_t i = 0; i < pixels.size(); ++i) {
+    c(i, 0) = pixels[i].x;
+    c(i, 1) = pixels[i].y;
+  }
+  return coords;
+}
+
+// Decodes a PNG file into an (H,W,4) array that takes ownership of the decoder's buffer, so the
+// pixels are never copied.
+inline py::array_t<uint8_t> read_png(const std::string& path) {
+  std::optional<pixelmatch::DecodedImage> decoded;
+  {
+    py::gil_scoped_release release;
+    decoded = pixelmatch::decodeRgbaPngFile(path.c_str());
+  }
+  if (!decoded) {
+    throw py::value_error("Could not read PNG file: " + path);
+  }
+
+  py::capsule owner(decoded->pixels.get(), [](void* pixels) {
+    pixelmatch::DecodedPixelsDeleter()(static_cast<uint8_t*>(pixels));
+  });
+  uint8_t* pixels = decoded->pixels.release();
+  return py::array_t<uint8_t>(
+      {py::ssize_t(decoded->height), py::ssize_t(decoded->width), py::ssize_t(4)}, pixels, owner);
+}
+
+// Encodes an (H,W,4) image as a PNG into \ref png, viewing it in place when its rows are
+// contiguous.
+inline bool encode_png(const py::buffer& img, const pixelmatch::PngEncodeOptions& options,
+                       std::vector<uint8_t>& png) {
+  const py::buffer_info buf = img.request();
+  if (!validate_buffer_info(buf, buf)) {
+    throw py::value_error("img should be an (H,W,4) uint8 array");
+  }
+  if (options.compressionLevel < 0 || options.compressionLevel > 9) {
+    throw py::value_error("compressionLevel should be between 0 and 9");
+  }
+
+  const ImageBuffers view(buf, buf, nullptr);
+  py::gil_scoped_release release;
+  return pixelmatch::encodeRgbaPng(view.img1(), view.width(), view.height(),
+                                   view.strideInPixels(), png, options);
+}
+
+// Maps a raw RGBA file into a read-only (H,W,4) array whose base owns the mapping, so the pixels
+// are neither copied nor decoded; pages are read from the file as NumPy touches them.
+inline py::array_t<uint8_t> read_raw(const std::string& path) {
+  std::optional<pixelmatch::MappedImage> mapped;
+  {
+    py::gil_scoped_release release;
+    mapped = pixelmatch::MappedImage::open(path.c_str());
+  }
+  if (!mapped) {
+    throw py::value_error("Could not map raw RGBA file: " + path);
+  }
+
+  auto* image = new pixelmatch::MappedImage(std::move(*mapped));
+  py::capsule owner(image,
+                    [](void* ptr) { delete static_cast<pixelmatch::MappedImage*>(ptr); });
+  py::array_t<uint8_t> array(
+      {py::ssize_t(image->height()), py::ssize_t(image->width()), py::ssize_t(4)},
+      {py::ssize_t(image->strideInPixels() * 4), py::ssize_t(4), py::ssize_t(1)},
+      image->data().data(), owner);
+  // The mapping is read-only, writing through the array would crash.
+  array.attr("setflags")("write"_a = false);
+  return array;
+}
+
+// Writes an (H,W,4) image as a raw RGBA file, packing its rows if they are padded or strided.
+inline bool write_raw(const std::string& path, const py::buffer& img) {
+  const py::buffer_info buf = img.request();
+  if (!validate_buffer_info(buf, buf)) {
+    throw py::value_error("img should be an (H,W,4) uint8 array");
+  }
+
+  const ImageBuffers view(buf, buf, nullptr);
+  const int width = view.width();
+  const int height = view.height();
+  py::gil_scoped_release release;
+  if (view.strideInPixels() == static_cast<size_t>(width)) {
+    return pixelmatch::writeRawRgbaFile(path.c_str(), view.img1(), width, height, width);
+  }
+
+  // The file stores a full stride for each row, past the end of a view of strided rows.
+  const size_t rowBytes = static_cast<size_t>(width) * 4;
+  std::vector<uint8_t> packed(rowBytes * height);
+  for (int y = 0; y < height; ++y) {
+    std::copy_n(view.img1().data() + y * view.strideInPixels() * 4, rowBytes,
+                packed.data() + y * rowBytes);
+  }
+  return pixelmatch::writeRawRgbaFile(path.c_str(), packed, width, height, width);
+}
+
+// Runs pixelmatchFiles() on (img1, img2, output) paths without the GIL; a None output only counts.
+inline std::vector<pixelmatch::FilePairResult> pixelmatch_files_fn(
+    const std::vector<std::tuple<std::string, std::string, std::optional<std::string>>>& paths,
+    const Options& options, int max_pairs_in_flight,
+    const pixelmatch::PngEncodeOptions& png_options) {
+  if (options.numThreads < 0 || max_pairs_in_flight < 0) {
+    throw py::value_error("numThreads and maxPairsInFlight should be >= 0");
+  }
+  if (png_options.compressionLevel < 0 || png_options.compressionLevel > 9) {
+    throw py::value_error("compressionLevel should be between 0 and 9");
+  }
+  if (options.outputFormat != pixelmatch::OutputFormat::Rgba) {
+    throw py::value_error("pixelmatch_files writes RGBA diffs, outputFormat should be Rgba");
+  }
+
+  std::vector<pixelmatch::FilePair> pairs;
+  pairs.reserve(paths.size());
+  for (const auto& [img1, img2, output] : paths) {
+    pairs.push_back(pixelmatch::FilePair{img1, img2, output.value_or("")});
+  }
+
+  // Copy the options while holding the GIL, another thread may modify them during the comparison.
+  const Options opts = options;
+  const pixelmatch::PngEncodeOptions png_opts = png_options;
+  py::gil_scoped_release release;
+  return pixelmatch::pixelmatchFiles(pairs, opts, max_pairs_in_flight, png_opts);
 }
 
 PYBIND11_MODULE(_core, m) {
+
   m.doc() = R"pbdoc(
     )pbdoc";
 
@@ -116,6 +1097,104 @@ PYBIND11_MODULE(_core, m) {
       //
       .def("__str__", [](const Color& self) -> std::string { return stringify(self); });
 
+  py::class_<Rect>(m, "Rect", py::module_local())  //
+      .def(py::init<>())
+      .def(py::init<int, int, int, int>(), "x"_a, "y"_a, "width"_a, "height"_a)
+      .def_readwrite("x", &Rect::x)
+      .def_readwrite("y", &Rect::y)
+      .def_readwrite("width", &Rect::width)
+      .def_readwrite("height", &Rect::height)
+      .def("to_python",
+           [](const Rect& self) -> std::vector<int> {
+             return {self.x, self.y, self.width, self.height};
+           })
+      //
+      .def("__str__", [](const Rect& self) -> std::string { return stringify(self); });
+
+  py::enum_<pixelmatch::Engine>(m, "Engine", py::module_local())
+      .value("Float", pixelmatch::Engine::Float)
+      .value("FixedPoint", pixelmatch::Engine::FixedPoint)
+      .value("CoarseToFine", pixelmatch::Engine::CoarseToFine);
+
+  py::class_<pixelmatch::ImagePyramid>(m, "ImagePyramid", py::module_local())  //
+      .def(py::init([](const py::buffer& img) {
+             const py::buffer_info buf = img.request();
+             if (!validate_buffer_info(buf, buf)) {
+               throw py::value_error("img should be an (H,W,4) uint8 array");
+             }
+             const ImageBuffers view(buf, buf, nullptr);
+             py::gil_scoped_release release;
+             return pixelmatch::ImagePyramid(view.img1(), view.width(), view.height(),
+                                             view.strideInPixels());
+           }),
+           "img"_a,
+           R"pbdoc(
+    Per-channel color ranges of an (H,W,4) image over blocks of 4x4 to 64x64 pixels, for
+    Engine.CoarseToFine. Build it once for a golden image and pass it as img1Pyramid to compare
+    it against many candidates.
+    )pbdoc")
+      .def_property_readonly("width", &pixelmatch::ImagePyramid::width)
+      .def_property_readonly("height", &pixelmatch::ImagePyramid::height);
+
+  py::class_<pixelmatch::ImageSignature>(m, "ImageSignature", py::module_local())  //
+      .def(py::init([](const py::buffer& img) {
+             const py::buffer_info buf = img.request();
+             if (!validate_buffer_info(buf, buf)) {
+               throw py::value_error("img should be an (H,W,4) uint8 array");
+             }
+             const ImageBuffers view(buf, buf, nullptr);
+             py::gil_scoped_release release;
+             return pixelmatch::ImageSignature(view.img1(), view.width(), view.height(),
+                                               view.strideInPixels());
+           }),
+           "img"_a,
+           R"pbdoc(
+    Hash of an (H,W,4) image and of each of its 64x64 tiles, with their mean YIQ. Compute it once
+    for a golden image, or store it with serialize(), and pass it as img1Signature: comparisons then
+    skip the tiles of img2 whose hash matches without reading img1.
+    )pbdoc")
+      .def_static(
+          "deserialize",
+          [](const py::bytes& bytes) {
+            const std::string data = bytes;
+            std::optional<pixelmatch::ImageSignature> signature =
+                pixelmatch::ImageSignature::deserialize(pixelmatch::span<const uint8_t>(
+                    reinterpret_cast<const uint8_t*>(data.data()), data.size()));
+            if (!signature) {
+              throw py::value_error("bytes are not a serialized ImageSignature");
+            }
+            return std::move(*signature);
+          },
+          "bytes"_a)
+      .def("serialize",
+           [](const pixelmatch::ImageSignature& self) {
+             const std::vector<uint8_t> bytes = self.serialize();
+             return py::bytes(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+           })
+      .def(
+          "matches",
+          [](const pixelmatch::ImageSignature& self, const py::buffer& img) {
+            const py::buffer_info buf = img.request();
+            if (!validate_buffer_info(buf, buf)) {
+              throw py::value_error("img should be an (H,W,4) uint8 array");
+            }
+            const ImageBuffers view(buf, buf, nullptr);
+            py::gil_scoped_release release;
+            return pixelmatch::imageEquals(self, view.img1(), view.width(), view.height(),
+                                           view.strideInPixels());
+          },
+          "img"_a, "Whether an (H,W,4) image has this signature, reading only that image.")
+      .def_property_readonly("width", &pixelmatch::ImageSignature::width)
+      .def_property_readonly("height", &pixelmatch::ImageSignature::height)
+      .def_property_readonly("hash", &pixelmatch::ImageSignature::hash)
+      .def("__eq__", [](const pixelmatch::ImageSignature& self,
+                        const pixelmatch::ImageSignature& other) { return self == other; });
+
+  py::enum_<pixelmatch::OutputFormat>(m, "OutputFormat", py::module_local())
+      .value("Rgba", pixelmatch::OutputFormat::Rgba)
+      .value("ByteMask", pixelmatch::OutputFormat::ByteMask)
+      .value("BitMask", pixelmatch::OutputFormat::BitMask);
+
   py::class_<Options>(m, "Options", py::module_local())  //
       .def(py::init<>())
       .def_readwrite("threshold", &Options::threshold)
@@ -125,6 +1204,14 @@ PYBIND11_MODULE(_core, m) {
       .def_readwrite("diffColor", &Options::diffColor, rvp::reference_internal)
       .def_readwrite("diffColorAlt", &Options::diffColorAlt, rvp::reference_internal)
       .def_readwrite("diffMask", &Options::diffMask)
+      .def_readwrite("numThreads", &Options::numThreads)
+      .def_readwrite("maxDiffs", &Options::maxDiffs)
+      .def_readwrite("ignoreRegions", &Options::ignoreRegions)
+      .def_readwrite("engine", &Options::engine)
+      .def_readwrite("countTiles", &Options::countTiles)
+      .def_readwrite("collectDiffPixels", &Options::collectDiffPixels)
+      .def_readwrite("collectAntialiasedPixels", &Options::collectAntialiasedPixels)
+      .def_readwrite("outputFormat", &Options::outputFormat)
       .def("clone", [](const Options& self) -> Options { return self; })
       //
       .def("__str__", [](const Options& self) -> std::string { return stringify(self); });
@@ -141,18 +1228,373 @@ PYBIND11_MODULE(_core, m) {
 
   m.def(
       "pixelmatch",
-      [](const py::buffer& img1, const py::buffer& img2, const py::buffer& out,
-         const Options& options) -> int { return pixelmatch_fn(img1, img2, &out, options); },
+      [](const py::object& img1, const py::object& img2, const py::object& out,
+         const Options& options, const py::object& ignore_mask,
+         const pixelmatch::ImagePyramid* img1_pyramid,
+         const pixelmatch::ImageSignature* img1_signature, const py::object& delta_map) -> int {
+        return pixelmatch_fn(img1, img2, &out, options, ignore_mask, img1_pyramid, img1_signature,
+                             delta_map);
+      },
       "img1"_a, "img2"_a, py::kw_only(),  //
       "output"_a,                         //
-      "options"_a = Options());
+      "options"_a = Options(),            //
+      "ignoreMask"_a = py::none(),        //
+      "img1Pyramid"_a = py::none(),       //
+      "img1Signature"_a = py::none(),     //
+      "deltaMap"_a = py::none());
   m.def(
       "pixelmatch",
-      [](const py::buffer& img1, const py::buffer& img2, const Options& options) -> int {
-        return pixelmatch_fn(img1, img2, nullptr, options);
+      [](const py::object& img1, const py::object& img2, const Options& options,
+         const py::object& ignore_mask, const pixelmatch::ImagePyramid* img1_pyramid,
+         const pixelmatch::ImageSignature* img1_signature, const py::object& delta_map) -> int {
+        return pixelmatch_fn(img1, img2, nullptr, options, ignore_mask, img1_pyramid,
+                             img1_signature, delta_map);
       },
       "img1"_a, "img2"_a, py::kw_only(),  //
-      "options"_a = Options());
+      "options"_a = Options(),            //
+      "ignoreMask"_a = py::none(),        //
+      "img1Pyramid"_a = py::none(),       //
+      "img1Signature"_a = py::none(),     //
+      "deltaMap"_a = py::none());
+
+  py::class_<pixelmatch::Instrumentation>(m, "Instrumentation", py::module_local(), R"pbdoc(
+    Counters and per-phase timings of a comparison, in DiffResult.instrumentation when the module
+    is built with PIXELMATCH_ENABLE_INSTRUMENTATION. Phase times are summed across threads.
+)pbdoc")  //
+      .def_readonly("tilesSkipped", &pixelmatch::Instrumentation::tilesSkipped)
+      .def_readonly("pixelsCompared", &pixelmatch::Instrumentation::pixelsCompared)
+      .def_readonly("pixelsAboveThreshold", &pixelmatch::Instrumentation::pixelsAboveThreshold)
+      .def_readonly("spansBelowThreshold", &pixelmatch::Instrumentation::spansBelowThreshold)
+      .def_readonly("antialiasingChecks", &pixelmatch::Instrumentation::antialiasingChecks)
+      .def_readonly("siblingChecks", &pixelmatch::Instrumentation::siblingChecks)
+      .def_readonly("bandsStoppedEarly", &pixelmatch::Instrumentation::bandsStoppedEarly)
+      .def_readonly("identicalImages", &pixelmatch::Instrumentation::identicalImages)
+      .def_readonly("identicalCheckNanoseconds", &pixelmatch::Instrumentation::identicalCheckNanoseconds)
+      .def_readonly("tileSearchNanoseconds", &pixelmatch::Instrumentation::tileSearchNanoseconds)
+      .def_readonly("colorDeltaNanoseconds", &pixelmatch::Instrumentation::colorDeltaNanoseconds)
+      .def_readonly("pixelLoopNanoseconds", &pixelmatch::Instrumentation::pixelLoopNanoseconds)
+      .def_readonly("antialiasingNanoseconds", &pixelmatch::Instrumentation::antialiasingNanoseconds)
+      .def_readonly("drawingNanoseconds", &pixelmatch::Instrumentation::drawingNanoseconds)
+      .def_readonly("totalNanoseconds", &pixelmatch::Instrumentation::totalNanoseconds);
+
+  py::class_<DiffResult>(m, "DiffResult", py::module_local())  //
+      .def_readonly_static("kTileSize", &DiffResult::kTileSize)
+      .def_readonly("numDiffPixels", &DiffResult::numDiffPixels)
+      .def_readonly("numAntialiasedPixels", &DiffResult::numAntialiasedPixels)
+      .def_readonly("numDarkerPixels", &DiffResult::numDarkerPixels)
+      .def_readonly("numLighterPixels", &DiffResult::numLighterPixels)
+      .def_readonly("bounds", &DiffResult::bounds)
+      .def_readonly("tileColumns", &DiffResult::tileColumns)
+      .def_readonly("tileCounts", &DiffResult::tileCounts)
+      .def_readonly("instrumentation", &DiffResult::instrumentation,
+                    "Instrumentation of the comparison, or None unless the module is built with "
+                    "PIXELMATCH_ENABLE_INSTRUMENTATION.")
+      .def_property_readonly(
+          "diffPixels",
+          [](const DiffResult& self) { return pixel_coordinates(self.diffPixels); },
+          "(N,2) array of the (x, y) coordinates of the different pixels.")
+      .def_property_readonly(
+          "diffDeltas",
+          [](const DiffResult& self) {
+            py::array_t<float> deltas(static_cast<py::ssize_t>(self.diffPixels.size()));
+            auto d = deltas.mutable_unchecked<1>();
+            for (size_t i = 0; i < self.diffPixels.size(); ++i) {
+              d(i) = self.diffPixels[i].delta;
+            }
+            return deltas;
+          },
+          "(N,) array of the color deltas of diffPixels, negative where img2 is darker.")
+      .def_property_readonly(
+          "antialiasedPixels",
+          [](const DiffResult& self) { return pixel_coordinates(self.antialiasedPixels); },
+          "(N,2) array of the (x, y) coordinates of the anti-aliased pixels.")
+      //
+      .def("__str__", [](const DiffResult& self) -> std::string { return stringify(self); });
+
+  m.def(
+      "pixelmatch_stats",
+      [](const py::object& img1, const py::object& img2, const Options& options,
+         const py::object& ignore_mask,
+         const pixelmatch::ImagePyramid* img1_pyramid,
+         const pixelmatch::ImageSignature* img1_signature,
+         const py::object& delta_map) -> DiffResult {
+        return pixelmatch_stats_fn(img1, img2, options, ignore_mask, img1_pyramid, img1_signature,
+                                   delta_map);
+      },
+      "img1"_a, "img2"_a, py::kw_only(),  //
+      "options"_a = Options(),            //
+      "ignoreMask"_a = py::none(),        //
+      "img1Pyramid"_a = py::none(),       //
+      "img1Signature"_a = py::none(),     //
+      "deltaMap"_a = py::none(),
+      R"pbdoc(
+    Compares two images like pixelmatch(), without drawing a diff, and returns a DiffResult with the
+    number of different pixels, the anti-aliased, darker and lighter counts and the bounding box of
+    the differences. With options.countTiles, also counts the different pixels of each
+    DiffResult.kTileSize square tile, in tileCounts.
+    )pbdoc");
+
+  m.def("gpu_available", &pixelmatch::gpuAvailable, R"pbdoc(
+    Whether the module is built with the CUDA backend and a CUDA device is available.
+    )pbdoc");
+  m.def(
+      "pixelmatch_device",
+      [](uintptr_t img1, uintptr_t img2, int width, int height, size_t stride_in_pixels,
+         uintptr_t output, const Options& options, uintptr_t stream) -> DiffResult {
+        check_device_options(options);
+        if (!img1 || !img2 || width <= 0 || height <= 0 ||
+            (stride_in_pixels != 0 && stride_in_pixels < static_cast<size_t>(width))) {
+          throw py::value_error("img1 and img2 should be device pointers to (H,W,4) images");
+        }
+        const Options opts = options;
+        py::gil_scoped_release release;
+        return pixelmatch::pixelmatchDevice(
+            reinterpret_cast<const uint8_t*>(img1), reinterpret_cast<const uint8_t*>(img2),
+            reinterpret_cast<uint8_t*>(output), width, height,
+            stride_in_pixels ? stride_in_pixels : static_cast<size_t>(width), opts,
+            reinterpret_cast<void*>(stream));
+      },
+      "img1"_a, "img2"_a, "width"_a, "height"_a, py::kw_only(),  //
+      "strideInPixels"_a = 0,                                       //
+      "output"_a = 0,                                               //
+      "options"_a = Options(),                                      //
+      "stream"_a = 0,
+      R"pbdoc(
+    Compares two images in the memory of a CUDA device, given as integer device pointers such
+    as cupy's arr.data.ptr or torch's tensor.data_ptr(), like pixelmatch_stats(). Draws the diff
+    if output is a device pointer to an image of the same size, and runs on the cudaStream_t
+    stream if set. strideInPixels defaults to width. See also pixelmatch() with CUDA tensors.
+    )pbdoc");
+
+  py::class_<PyComparator>(m, "Comparator", py::module_local())  //
+      .def(py::init<const Options&>(), "options"_a = Options())
+      .def_property("options", &PyComparator::options, &PyComparator::set_options)
+      .def(
+          "compare",
+          [](PyComparator& self, const py::buffer& img1, const py::buffer& img2,
+             const py::object& output) -> int {
+            if (output.is_none()) {
+              return self.compare(img1, img2, nullptr);
+            }
+            const py::buffer out = output.cast<py::buffer>();
+            return self.compare(img1, img2, &out);
+          },
+          "img1"_a, "img2"_a, py::kw_only(),  //
+          "output"_a = py::none(),
+          R"pbdoc(
+    Same as pixelmatch(), with the options of the comparator. Keeps the thread pool and scratch
+    buffers alive between calls, so comparing images of the same size in a loop does not allocate.
+    )pbdoc");
+
+  py::class_<PyIncrementalComparator>(m, "IncrementalComparator", py::module_local())  //
+      .def(py::init([](const Options& options) {
+             if (options.numThreads < 0 || options.maxDiffs || options.collectDiffPixels ||
+                 options.collectAntialiasedPixels) {
+               throw py::value_error(
+                   "numThreads should be >= 0, maxDiffs and pixel lists are not supported");
+             }
+             return std::make_unique<PyIncrementalComparator>(options);
+           }),
+           "options"_a = Options())
+      .def_property_readonly(
+          "options", [](const PyIncrementalComparator& self) { return self.comparator.options(); })
+      .def(
+          "compare",
+          [](PyIncrementalComparator& self, const py::buffer& img1, const py::buffer& img2,
+             const py::object& output) -> DiffResult {
+            if (output.is_none()) {
+              return self.compare(img1, img2, nullptr, nullptr);
+            }
+            const py::buffer out = output.cast<py::buffer>();
+            return self.compare(img1, img2, &out, nullptr);
+          },
+          "img1"_a, "img2"_a, py::kw_only(),  //
+          "output"_a = py::none(),
+          R"pbdoc(
+    Compares two images in full, like pixelmatch_stats() but drawing the diff to output if set, and
+    keeps the result for update().
+    )pbdoc")
+      .def(
+          "update",
+          [](PyIncrementalComparator& self, const py::buffer& img1, const py::buffer& img2,
+             const std::vector<Rect>& dirty_rects, const py::object& output) -> DiffResult {
+            if (output.is_none()) {
+              return self.compare(img1, img2, nullptr, &dirty_rects);
+            }
+            const py::buffer out = output.cast<py::buffer>();
+            return self.compare(img1, img2, &out, &dirty_rects);
+          },
+          "img1"_a, "img2"_a, "dirty_rects"_a, py::kw_only(),  //
+          "output"_a = py::none(),
+          R"pbdoc(
+    Re-compares the images within dirty_rects, a list of Rect where they may have changed since
+    the previous comparison, plus a halo of two pixels, and patches the previous result and
+    output, which must hold the output of the previous comparison.
+    )pbdoc");
+
+  py::class_<PyStreamingComparator>(m, "StreamingComparator", py::module_local())  //
+      .def(py::init<int, int, const Options&, bool>(), "width"_a, "height"_a, py::kw_only(),  //
+           "options"_a = Options(),                                                           //
+           "output"_a = false)
+      .def("push_rows", &PyStreamingComparator::push_rows, "img1_rows"_a, "img2_rows"_a,
+           R"pbdoc(
+    Pushes the next (N,W,4) rows of both images, comparing the 64-row bands that they complete.
+    With output=True, returns the diff rows completed by this push, in the shape of
+    options.outputFormat, possibly none of them; otherwise returns None.
+    )pbdoc")
+      .def("result",
+           [](PyStreamingComparator& self) {
+             return self.with_comparator(
+                 [](const auto& comparator) { return comparator.result(); });
+           })
+      .def_property_readonly("rows_pushed",
+                             [](PyStreamingComparator& self) {
+                               return self.with_comparator(
+                                   [](const auto& comparator) { return comparator.rowsPushed(); });
+                             })
+      .def_property_readonly("rows_compared",
+                             [](PyStreamingComparator& self) {
+                               return self.with_comparator([](const auto& comparator) {
+                                 return comparator.rowsCompared();
+                               });
+                             })
+      .def_property_readonly("num_diff_pixels", [](PyStreamingComparator& self) {
+        return self.with_comparator(
+            [](const auto& comparator) { return comparator.numDiffPixels(); });
+      });
+
+  py::class_<PyPngRowDecoder>(m, "PngRowDecoder", py::module_local())  //
+      .def(py::init([](const std::string& path) {
+             std::optional<pixelmatch::PngRowDecoder> decoder =
+                 pixelmatch::PngRowDecoder::open(path.c_str());
+             if (!decoder) {
+               throw py::value_error("Could not read PNG file: " + path);
+             }
+             return std::make_unique<PyPngRowDecoder>(std::move(*decoder));
+           }),
+           "path"_a)
+      .def_property_readonly("width",
+                             [](const PyPngRowDecoder& self) { return self.decoder.width(); })
+      .def_property_readonly("height",
+                             [](const PyPngRowDecoder& self) { return self.decoder.height(); })
+      .def_property_readonly("rows_read", &PyPngRowDecoder::rows_read)
+      .def("read_rows", &read_png_rows, "num_rows"_a,
+           R"pbdoc(
+    Decodes the next num_rows rows into an (N,W,4) uint8 RGBA array, with fewer rows at the end of
+    the image. Raises ValueError if the file is truncated or corrupt.
+    )pbdoc");
+
+  m.def(
+      "pixelmatch_batch",
+      [](const py::buffer& img1, const py::buffer& img2, const py::object& output,
+         const Options& options) -> std::vector<int> {
+        return pixelmatch_batch_fn(img1, img2, output, options);
+      },
+      "img1"_a, "img2"_a, py::kw_only(),  //
+      "output"_a = py::none(),            //
+      "options"_a = Options(),
+      R"pbdoc(
+    Compares a batch of (N,H,W,4) image arrays, pair by pair, spreading the pairs across
+    options.numThreads threads. Returns the number of different pixels of each pair.
+    )pbdoc");
+  m.def(
+      "pixelmatch_batch",
+      [](const std::vector<std::pair<py::buffer, py::buffer>>& pairs,
+         const std::optional<std::vector<py::buffer>>& outputs,
+         const Options& options) -> std::vector<int> {
+        return pixelmatch_batch_fn(pairs, outputs ? &*outputs : nullptr, options);
+      },
+      "pairs"_a, py::kw_only(),  //
+      "outputs"_a = py::none(),  //
+      "options"_a = Options(),
+      R"pbdoc(
+    Compares a list of (img1, img2) pairs, spreading the pairs across options.numThreads threads.
+    Returns the number of different pixels of each pair, or -1 for invalid pairs.
+    )pbdoc");
+
+  py::class_<pixelmatch::FilePairResult>(m, "FilePairResult", py::module_local())  //
+      .def_readonly("numDiffPixels", &pixelmatch::FilePairResult::numDiffPixels)
+      .def_readonly("error", &pixelmatch::FilePairResult::error);
+
+  m.def("pixelmatch_files", &pixelmatch_files_fn, "pairs"_a, py::kw_only(),  //
+        "options"_a = Options(),                                              //
+        "maxPairsInFlight"_a = 0,                                             //
+        "pngOptions"_a = pixelmatch::PngEncodeOptions(),
+        R"pbdoc(
+    Compares a list of (img1, img2, output) PNG paths, writing each diff to output unless it is
+    None. Decoding, comparing and encoding of different pairs overlap on options.numThreads
+    threads, with at most maxPairsInFlight pairs in memory at once (0 uses the number of threads).
+    Returns a FilePairResult per pair, with numDiffPixels, or -1 and a non-empty error.
+    )pbdoc");
+
+  py::enum_<pixelmatch::PngFilter>(m, "PngFilter", py::module_local())
+      .value("None_", pixelmatch::PngFilter::None)
+      .value("Sub", pixelmatch::PngFilter::Sub)
+      .value("Up", pixelmatch::PngFilter::Up)
+      .value("Average", pixelmatch::PngFilter::Average)
+      .value("Paeth", pixelmatch::PngFilter::Paeth)
+      .value("Adaptive", pixelmatch::PngFilter::Adaptive);
+
+  py::class_<pixelmatch::PngEncodeOptions>(m, "PngEncodeOptions", py::module_local())  //
+      .def(py::init<>())
+      .def_readwrite("compressionLevel", &pixelmatch::PngEncodeOptions::compressionLevel)
+      .def_readwrite("filter", &pixelmatch::PngEncodeOptions::filter);
+
+  m.def(
+      "encode_png",
+      [](const py::buffer& img, const pixelmatch::PngEncodeOptions& options) -> py::bytes {
+        std::vector<uint8_t> png;
+        if (!encode_png(img, options, png)) {
+          throw py::value_error("Could not encode img");
+        }
+        return py::bytes(reinterpret_cast<const char*>(png.data()), png.size());
+      },
+      "img"_a, py::kw_only(),  //
+      "options"_a = pixelmatch::PngEncodeOptions(),
+      R"pbdoc(
+    Encodes an (H,W,4) uint8 RGBA image as PNG bytes. Level 0 of options.compressionLevel stores
+    the pixels, 1 (the default) is a fast encoder suited to diffs, and 2 to 9 use stb's deflate.
+    These are not zlib levels: each level from 2 to 9 doubles how far stb searches for matches,
+    trading speed for size.
+    )pbdoc");
+  m.def(
+      "write_png",
+      [](const std::string& path, const py::buffer& img,
+         const pixelmatch::PngEncodeOptions& options) -> bool {
+        std::vector<uint8_t> png;
+        if (!encode_png(img, options, png)) {
+          return false;
+        }
+        py::gil_scoped_release release;
+        std::ofstream output(path, std::ofstream::out | std::ofstream::binary);
+        output.write(reinterpret_cast<const char*>(png.data()),
+                     static_cast<std::streamsize>(png.size()));
+        return output.good();
+      },
+      "path"_a, "img"_a, py::kw_only(),  //
+      "options"_a = pixelmatch::PngEncodeOptions(),
+      R"pbdoc(
+    Writes an (H,W,4) uint8 RGBA image as a PNG file, see encode_png(). Returns False if the image
+    could not be encoded or the file could not be written.
+    )pbdoc");
+
+  m.def("read_png", &read_png, "path"_a,
+        R"pbdoc(
+    Decodes a PNG file to an (H,W,4) uint8 RGBA array. The array owns the decoded pixels, without
+    an intermediate copy. Raises ValueError if the file cannot be decoded.
+    )pbdoc");
+
+  m.def("write_raw", &write_raw, "path"_a, "img"_a,
+        R"pbdoc(
+    Writes an (H,W,4) uint8 RGBA image as a raw RGBA file: a 64-byte header with the width, height
+    and row stride, followed by the rows. Returns False if the file could not be written.
+    )pbdoc");
+  m.def("read_raw", &read_raw, "path"_a,
+        R"pbdoc(
+    Memory-maps a raw RGBA file written by write_raw() as a read-only (H,W,4) uint8 array, without
+    copying or decoding it. The mapping lives as long as the array or any view of it. Raises
+    ValueError if the file is not a valid raw RGBA file.
+    )pbdoc");
 
 #ifdef VERSION_INFO
   m.attr("__version__") = MACRO_STRINGIFY(VERSION_INFO);
@@ -0,0 +1,132 @@
+#include "pixelmatch/fixed_point.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "pixelmatch/yiq.h"
+
+namespace pixelmatch::detail {
+
+namespace {
+
+// YIQ coefficients scaled by 2^12, and delta weights scaled by 2^8.
+constexpr int kCoefficientBits = 12;
+constexpr int kWeightBits = 8;
+
+// Components are rounded to 1/16 before squaring, so that the weighted sum of squares, at most
+// 35215 * 2^16, fits in 32 bits.
+constexpr int kComponentBits = 4;
+constexpr int kDeltaBits = 2 * kComponentBits + kWeightBits;
+
+template <typename T>
+constexpr T fixed(float value, int bits) {
+  return static_cast<T>(value * (1 << bits) + 0.5f);
+}
+
+constexpr int16_t coefficient(float value) {
+  return fixed<int16_t>(value, kCoefficientBits);
+}
+
+constexpr int16_t kY[3] = {coefficient(kRgb2Y[0]), coefficient(kRgb2Y[1]), coefficient(kRgb2Y[2])};
+constexpr int16_t kI[3] = {coefficient(kRgb2I[0]), coefficient(kRgb2I[1]), coefficient(kRgb2I[2])};
+constexpr int16_t kQ[3] = {coefficient(kRgb2Q[0]), coefficient(kRgb2Q[1]), coefficient(kRgb2Q[2])};
+constexpr uint32_t kWeights[3] = {fixed<uint32_t>(kDeltaWeights[0], kWeightBits),
+                                  fixed<uint32_t>(kDeltaWeights[1], kWeightBits),
+                                  fixed<uint32_t>(kDeltaWeights[2], kWeightBits)};
+
+/// Same as blend(c, a / 255.0f), exactly, for all channel and alpha values. The division by 255 is
+/// a multiply and shift, exact for numerators below 2^16, so the loop below can vectorize.
+inline int16_t blendFixed(uint8_t c, uint8_t a) {
+  const uint16_t n = static_cast<uint16_t>((255 - c) * a + 254);
+  return static_cast<int16_t>(255 - static_cast<uint16_t>((n * 0x8081u) >> 23));
+}
+
+/// Rounds a component from the coefficient scale to the component scale.
+inline int32_t roundComponent(int32_t value) {
+  constexpr int kShift = kCoefficientBits - kComponentBits;
+  return (value + (1 << (kShift - 1))) >> kShift;
+}
+
+/// Implements fixedPointColorDelta(), returning the brightness difference through \ref y. With
+/// \ref kOpaque, both pixels must be opaque, and the blend is skipped.
+template <bool kOpaque>
+inline uint32_t colorDeltaFixed(const uint8_t* px1, const uint8_t* px2, int32_t& y) {
+  // Channel differences and coefficients fit in 16 bits, so that the products below map to
+  // widening 16-bit multiplies.
+  int16_t dr;
+  int16_t dg;
+  int16_t db;
+  if constexpr (kOpaque) {
+    dr = static_cast<int16_t>(px1[0] - px2[0]);
+    dg = static_cast<int16_t>(px1[1] - px2[1]);
+    db = static_cast<int16_t>(px1[2] - px2[2]);
+  } else {
+    dr = blendFixed(px1[0], px1[3]) - blendFixed(px2[0], px2[3]);
+    dg = blendFixed(px1[1], px1[3]) - blendFixed(px2[1], px2[3]);
+    db = blendFixed(px1[2], px1[3]) - blendFixed(px2[2], px2[3]);
+  }
+
+  y = kY[0] * dr + kY[1] * dg + kY[2] * db;
+  const int32_t i = roundComponent(kI[0] * dr - kI[1] * dg - kI[2] * db);
+  const int32_t q = roundComponent(kQ[0] * dr - kQ[1] * dg + kQ[2] * db);
+  const int32_t yRounded = roundComponent(y);
+
+  return kWeights[0] * static_cast<uint32_t>(yRounded * yRounded) +
+         kWeights[1] * static_cast<uint32_t>(i * i) + kWeights[2] * static_cast<uint32_t>(q * q);
+}
+
+/// Implements colorDeltaRowFixedPoint(), and its opaque variant with \ref kOpaque.
+template <bool kOpaque>
+bool colorDeltaRowFixed(const uint8_t* row1, const uint8_t* row2, size_t count, float maxDelta,
+                        float* deltas) {
+  const uint32_t maxFixed = fixedPointMaxDelta(maxDelta);
+
+  // Deltas above the fixed-point threshold must stay above maxDelta after rounding to float, and
+  // the others must not exceed it.
+  const float aboveMin = std::nextafter(maxDelta, INFINITY);
+  // Reduce to the largest delta rather than a flag, which the compiler does not vectorize.
+  uint32_t largest = 0;
+  for (size_t x = 0; x < count; ++x) {
+    int32_t y = 0;
+    const uint32_t delta = colorDeltaFixed<kOpaque>(row1 + x * 4, row2 + x * 4, y);
+
+    // The signed conversion vectorizes on every target; dropping the lowest bit keeps it in range.
+    const float magnitude =
+        static_cast<float>(static_cast<int32_t>(delta >> 1)) * (1.0f / (1 << (kDeltaBits - 1)));
+    const float clamped =
+        delta > maxFixed ? std::max(magnitude, aboveMin) : std::min(magnitude, maxDelta);
+    deltas[x] = y > 0 ? -clamped : clamped;
+    largest = std::max(largest, delta);
+  }
+
+  return largest > maxFixed;
+}
+
+}  // namespace
+
+uint32_t fixedPointColorDelta(const uint8_t* px1, const uint8_t* px2, bool& darker) {
+  int32_t y = 0;
+  const uint32_t delta = colorDeltaFixed<false>(px1, px2, y);
+
+  // Encode whether the pixel lightens or darkens in the sign.
+  darker = y > 0;
+  return delta;
+}
+
+uint32_t fixedPointMaxDelta(float maxDelta) {
+  const double scaled = std::floor(static_cast<double>(maxDelta) * (1 << kDeltaBits));
+  return static_cast<uint32_t>(std::clamp(scaled, 0.0, 4294967295.0));
+}
+
+bool colorDeltaRowFixedPoint(const uint8_t* row1, const uint8_t* row2, size_t count,
+                             float maxDelta, float* deltas) {
+  return colorDeltaRowFixed<false>(row1, row2, count, maxDelta, deltas);
+}
+
+const SimdKernels& fixedPointKernels() {
+  static constexpr SimdKernels kFixedPointKernels{"fixed-point", &colorDeltaRowFixed<false>,
+                                                  &colorDeltaRowFixed<true>};
+  return kFixedPointKernels;
+}
+
+}  // namespace pixelmatch::detail
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <pixelmatch/simd.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace pixelmatch::detail {
+
+/**
+ * Fixed-point color delta of two RGBA-encoded pixels, approximating colorDelta() with integer
+ * arithmetic only.
+ *
+ * The alpha blend is exact. The Y, I and Q differences are rounded to 1/16, and the squared
+ * distance is scaled by 2^16 with weights rounded to 1/256, so it fits in 32 bits. Relative to
+ * colorDelta(), the magnitude diverges by less than 1% plus 0.25 for any pair of pixels, out of a
+ * maximum of 35215. The sign can differ when the brightness difference is close to zero.
+ *
+ * @param px1 First pixel.
+ * @param px2 Second pixel.
+ * @param[out] darker Set to whether img2 is darker, the sign of colorDelta().
+ * @return The magnitude of the delta, scaled by 2^16.
+ */
+uint32_t fixedPointColorDelta(const uint8_t* px1, const uint8_t* px2, bool& darker);
+
+/// Converts a colorDelta() threshold to the scale of \ref fixedPointColorDelta.
+uint32_t fixedPointMaxDelta(float maxDelta);
+
+/**
+ * Implements \ref ColorDeltaRowFn with \ref fixedPointColorDelta. The deltas written are
+ * approximate, but compare against \ref maxDelta exactly like the fixed-point deltas do.
+ */
+bool colorDeltaRowFixedPoint(const uint8_t* row1, const uint8_t* row2, size_t count,
+                             float maxDelta, float* deltas);
+
+/// Returns \ref colorDeltaRowFixedPoint and its variant for opaque pixels, which drops the blend
+/// with white and gives the same deltas.
+const SimdKernels& fixedPointKernels();
+
+}  // namespace pixelmatch::detail
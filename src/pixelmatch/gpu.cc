@@ -0,0 +1,58 @@
+#include <pixelmatch/gpu.h>
+
+#include <cassert>
+
+namespace pixelmatch {
+
+namespace detail {
+
+bool checkDeviceArguments(const uint8_t* img1, const uint8_t* img2, int width, int height,
+                          size_t strideInPixels, const Options& options) {
+  if (!img1 || !img2) {
+    assert(img1 && img2 && "Images must not be null");
+    return false;
+  }
+
+  if (width <= 0 || height <= 0 || strideInPixels < static_cast<size_t>(width)) {
+    assert(width > 0);
+    assert(height > 0);
+    assert(strideInPixels >= static_cast<size_t>(width) && "Stride must be greater than width");
+    return false;
+  }
+
+  if (options.engine != Engine::Float || options.outputFormat != OutputFormat::Rgba ||
+      options.maxDiffs || !options.ignoreRegions.empty() || !options.ignoreMask.empty() ||
+      options.countTiles || options.collectDiffPixels || options.collectAntialiasedPixels ||
+      !options.deltaMap.empty()) {
+    assert(options.engine == Engine::Float && "Only Engine::Float is supported on the GPU");
+    assert(options.outputFormat == OutputFormat::Rgba &&
+           "Only OutputFormat::Rgba is supported on the GPU");
+    assert(!options.maxDiffs && "maxDiffs is not supported on the GPU");
+    assert(options.ignoreRegions.empty() && options.ignoreMask.empty() &&
+           "Ignored pixels are not supported on the GPU");
+    assert(!options.countTiles && !options.collectDiffPixels &&
+           !options.collectAntialiasedPixels &&
+           "Pixel lists and tile counts are not supported on the GPU");
+    assert(options.deltaMap.empty() && "deltaMap is not supported on the GPU");
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace detail
+
+#ifndef PIXELMATCH_ENABLE_CUDA
+
+// Without the CUDA backend, see gpu_cuda.cu.
+
+bool gpuAvailable() { return false; }
+
+DiffResult pixelmatchDevice(const uint8_t*, const uint8_t*, uint8_t*, int, int, size_t,
+                            const Options&, void*) {
+  return invalidResult();
+}
+
+#endif
+
+}  // namespace pixelmatch
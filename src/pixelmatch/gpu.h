@@ -0,0 +1,45 @@
+#pragma once
+
+#include <pixelmatch/pixelmatch.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace pixelmatch {
+
+/// Whether pixelmatch was built with the CUDA backend (PIXELMATCH_ENABLE_CUDA) and a CUDA device
+/// is available.
+bool gpuAvailable();
+
+/**
+ * Same as pixelmatch(), on images in the memory of a CUDA device, running on the device holding
+ * img1. Each pixel is compared by its own thread, and the per-block counts are reduced into a
+ * single DiffResult.
+ *
+ * Returns the same result and output as pixelmatch() with Engine::Float. Only the threshold,
+ * includeAA, alpha, aaColor, diffColor, diffColorAlt and diffMask options are supported, with an
+ * RGBA output; the others must keep their defaults.
+ *
+ * @param img1 Device pointer to the first image, strideInPixels * height * 4 bytes long.
+ * @param img2 Device pointer to the second image, with the same size as img1.
+ * @param output (Optional) Device pointer to the RGBA output, with the same size as img1.
+ * @param stream (Optional) cudaStream_t to run on; the call returns once it is complete.
+ * @return The result, with numDiffPixels -1 if a precondition fails or if the GPU backend is not
+ *          available.
+ */
+DiffResult pixelmatchDevice(const uint8_t* img1, const uint8_t* img2, uint8_t* output, int width,
+                            int height, size_t strideInPixels, const Options& options = Options(),
+                            void* stream = nullptr);
+
+namespace detail {
+
+/**
+ * Checks the preconditions of pixelmatchDevice() on its arguments.
+ * Asserts in debug builds; in release builds, returns false so that the comparison returns -1.
+ */
+bool checkDeviceArguments(const uint8_t* img1, const uint8_t* img2, int width, int height,
+                          size_t strideInPixels, const Options& options);
+
+}  // namespace detail
+
+}  // namespace pixelmatch
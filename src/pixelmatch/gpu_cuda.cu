@@ -0,0 +1,138 @@
+// CUDA backend of pixelmatchDevice(), built with PIXELMATCH_ENABLE_CUDA. Compile with
+// --fmad=false, the counterpart of -ffp-contract=off, so that the deltas match the CPU exactly.
+
+#include <cuda_runtime.h>
+#include <pixelmatch/gpu.h>
+#include <pixelmatch/gpu_kernels.h>
+
+namespace pixelmatch {
+
+namespace {
+
+using detail::gpu::GpuComparison;
+using detail::gpu::GpuCounts;
+using detail::gpu::PixelClass;
+
+constexpr int kBlockWidth = 32;
+constexpr int kBlockHeight = 8;
+
+/**
+ * Classifies and draws one pixel per thread, then reduces the counts and bounds of the block in
+ * shared memory, so that only its first thread updates \ref counts.
+ */
+__global__ void compareKernel(GpuComparison c, GpuCounts* counts) {
+  __shared__ int bounds[4];
+  const int thread = threadIdx.y * kBlockWidth + threadIdx.x;
+  if (thread == 0) {
+    bounds[0] = bounds[1] = 0x7fffffff;
+    bounds[2] = bounds[3] = -1;
+  }
+
+  const int x = blockIdx.x * kBlockWidth + threadIdx.x;
+  const int y = blockIdx.y * kBlockHeight + threadIdx.y;
+  PixelClass pixelClass = PixelClass::Similar;
+  if (x < c.width && y < c.height) {
+    pixelClass = detail::gpu::classifyPixel(c, x, y);
+    detail::gpu::drawPixel(c, x, y, pixelClass);
+  }
+
+  const bool isDiff = pixelClass == PixelClass::Darker || pixelClass == PixelClass::Lighter;
+  const int antialiased = __syncthreads_count(pixelClass == PixelClass::Antialiased);
+  const int darker = __syncthreads_count(pixelClass == PixelClass::Darker);
+  const int lighter = __syncthreads_count(pixelClass == PixelClass::Lighter);
+  if (antialiased + darker + lighter == 0) {
+    return;
+  }
+
+  if (isDiff) {
+    atomicMin(&bounds[0], x);
+    atomicMin(&bounds[1], y);
+    atomicMax(&bounds[2], x);
+    atomicMax(&bounds[3], y);
+  }
+  __syncthreads();
+
+  if (thread == 0) {
+    atomicAdd(&counts->antialiased, antialiased);
+    atomicAdd(&counts->darker, darker);
+    atomicAdd(&counts->lighter, lighter);
+    if (darker + lighter != 0) {
+      atomicMin(&counts->minX, bounds[0]);
+      atomicMin(&counts->minY, bounds[1]);
+      atomicMax(&counts->maxX, bounds[2]);
+      atomicMax(&counts->maxY, bounds[3]);
+    }
+  }
+}
+
+/// Makes the device holding a pointer current for the lifetime of the guard, then restores the
+/// previous device.
+class DeviceGuard {
+public:
+  explicit DeviceGuard(const void* pointer) {
+    cudaPointerAttributes attributes;
+    if (cudaGetDevice(&previous_) != cudaSuccess ||
+        cudaPointerGetAttributes(&attributes, pointer) != cudaSuccess || attributes.device < 0) {
+      return;
+    }
+    valid_ = attributes.device == previous_ || cudaSetDevice(attributes.device) == cudaSuccess;
+    switched_ = valid_ && attributes.device != previous_;
+  }
+
+  ~DeviceGuard() {
+    if (switched_) {
+      cudaSetDevice(previous_);
+    }
+  }
+
+  bool valid() const { return valid_; }
+
+private:
+  int previous_ = 0;
+  bool valid_ = false;
+  bool switched_ = false;
+};
+
+}  // namespace
+
+bool gpuAvailable() {
+  int count = 0;
+  return cudaGetDeviceCount(&count) == cudaSuccess && count > 0;
+}
+
+DiffResult pixelmatchDevice(const uint8_t* img1, const uint8_t* img2, uint8_t* output, int width,
+                            int height, size_t strideInPixels, const Options& options,
+                            void* stream) {
+  if (!detail::checkDeviceArguments(img1, img2, width, height, strideInPixels, options)) {
+    return invalidResult();
+  }
+
+  const DeviceGuard device(img1);
+  if (!device.valid()) {
+    return invalidResult();
+  }
+
+  const cudaStream_t cudaStream = static_cast<cudaStream_t>(stream);
+  GpuCounts counts = detail::gpu::emptyCounts();
+  GpuCounts* deviceCounts = nullptr;
+  if (cudaMallocAsync(&deviceCounts, sizeof(GpuCounts), cudaStream) != cudaSuccess) {
+    return invalidResult();
+  }
+
+  const GpuComparison comparison = detail::gpu::comparisonFor(img1, img2, output, width, height,
+                                                              strideInPixels, options);
+  const dim3 blocks((width + kBlockWidth - 1) / kBlockWidth,
+                    (height + kBlockHeight - 1) / kBlockHeight);
+  cudaMemcpyAsync(deviceCounts, &counts, sizeof(GpuCounts), cudaMemcpyHostToDevice, cudaStream);
+  compareKernel<<<blocks, dim3(kBlockWidth, kBlockHeight), 0, cudaStream>>>(comparison,
+                                                                            deviceCounts);
+  cudaMemcpyAsync(&counts, deviceCounts, sizeof(GpuCounts), cudaMemcpyDeviceToHost, cudaStream);
+  cudaFreeAsync(deviceCounts, cudaStream);
+  if (cudaStreamSynchronize(cudaStream) != cudaSuccess || cudaGetLastError() != cudaSuccess) {
+    return invalidResult();
+  }
+
+  return detail::gpu::toDiffResult(counts);
+}
+
+}  // namespace pixelmatch
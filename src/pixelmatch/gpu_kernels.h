@@ -0,0 +1,298 @@
+#pragma once
+
+#include <pixelmatch/pixelmatch.h>
+#include <pixelmatch/yiq.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// Per-pixel steps of the GPU backend, written once for the device kernels in gpu_cuda.cu and for
+// the host, where the tests check them against pixelmatch().
+#ifdef __CUDACC__
+#define PIXELMATCH_HOST_DEVICE __host__ __device__
+#else
+#define PIXELMATCH_HOST_DEVICE
+#endif
+
+namespace pixelmatch::detail::gpu {
+
+// Device code cannot read the coefficient arrays of yiq.h, only scalar constants.
+constexpr float kY0 = kRgb2Y[0];
+constexpr float kY1 = kRgb2Y[1];
+constexpr float kY2 = kRgb2Y[2];
+constexpr float kI0 = kRgb2I[0];
+constexpr float kI1 = kRgb2I[1];
+constexpr float kI2 = kRgb2I[2];
+constexpr float kQ0 = kRgb2Q[0];
+constexpr float kQ1 = kRgb2Q[1];
+constexpr float kQ2 = kRgb2Q[2];
+constexpr float kWeightY = kDeltaWeights[0];
+constexpr float kWeightI = kDeltaWeights[1];
+constexpr float kWeightQ = kDeltaWeights[2];
+
+/// Images and options of a comparison on the GPU, passed by value to each kernel.
+struct GpuComparison {
+  const uint8_t* img1;
+  const uint8_t* img2;
+  uint8_t* output;  //!< RGBA output with the stride of the images, or nullptr.
+  int width;
+  int height;
+  size_t strideInPixels;
+  float maxDelta;
+  float alpha;
+  bool includeAA;
+  bool diffMask;
+  bool hasDiffColorAlt;
+  Color aaColor;
+  Color diffColor;
+  Color diffColorAlt;
+};
+
+/// The comparison of pixelmatchDevice() for its arguments.
+inline GpuComparison comparisonFor(const uint8_t* img1, const uint8_t* img2, uint8_t* output,
+                                   int width, int height, size_t strideInPixels,
+                                   const Options& options) {
+  return GpuComparison{img1,
+                       img2,
+                       output,
+                       width,
+                       height,
+                       strideInPixels,
+                       35215.0f * options.threshold * options.threshold,
+                       options.alpha,
+                       options.includeAA,
+                       options.diffMask,
+                       options.diffColorAlt.has_value(),
+                       options.aaColor,
+                       options.diffColor,
+                       options.diffColorAlt.value_or(options.diffColor)};
+}
+
+/// Class of a compared pixel, as counted in DiffResult.
+enum class PixelClass : uint8_t {
+  Similar,      //!< At or below the threshold.
+  Antialiased,  //!< Above the threshold, detected as anti-aliasing.
+  Darker,       //!< Different, img2 is darker.
+  Lighter,      //!< Different, img2 is lighter or equally bright.
+};
+
+PIXELMATCH_HOST_DEVICE inline const uint8_t* pixelAt(const uint8_t* img, const GpuComparison& c,
+                                                     int x, int y) {
+  return img + (static_cast<size_t>(y) * c.strideInPixels + x) * 4;
+}
+
+PIXELMATCH_HOST_DEVICE inline uint8_t blendWithWhite(uint8_t c, float a) {
+  return static_cast<uint8_t>(255.0f + (static_cast<float>(c) - 255.0f) * a);
+}
+
+PIXELMATCH_HOST_DEVICE inline float yOf(uint8_t r, uint8_t g, uint8_t b) {
+  return r * kY0 + g * kY1 + b * kY2;
+}
+
+/// Same as blendedY().
+PIXELMATCH_HOST_DEVICE inline float lumaOf(const uint8_t* pixel) {
+  uint8_t r = pixel[0];
+  uint8_t g = pixel[1];
+  uint8_t b = pixel[2];
+  if (pixel[3] < 255) {
+    const float alpha = pixel[3] / 255.0f;
+    r = blendWithWhite(r, alpha);
+    g = blendWithWhite(g, alpha);
+    b = blendWithWhite(b, alpha);
+  }
+  return yOf(r, g, b);
+}
+
+/// Same as colorDelta() with yOnly unset.
+PIXELMATCH_HOST_DEVICE inline float colorDeltaOf(const uint8_t* px1, const uint8_t* px2) {
+  uint8_t r1 = px1[0];
+  uint8_t g1 = px1[1];
+  uint8_t b1 = px1[2];
+  uint8_t r2 = px2[0];
+  uint8_t g2 = px2[1];
+  uint8_t b2 = px2[2];
+  if (r1 == r2 && g1 == g2 && b1 == b2 && px1[3] == px2[3]) {
+    return 0;
+  }
+
+  if (px1[3] < 255) {
+    const float alpha = px1[3] / 255.0f;
+    r1 = blendWithWhite(r1, alpha);
+    g1 = blendWithWhite(g1, alpha);
+    b1 = blendWithWhite(b1, alpha);
+  }
+  if (px2[3] < 255) {
+    const float alpha = px2[3] / 255.0f;
+    r2 = blendWithWhite(r2, alpha);
+    g2 = blendWithWhite(g2, alpha);
+    b2 = blendWithWhite(b2, alpha);
+  }
+
+  const float y1 = yOf(r1, g1, b1);
+  const float y2 = yOf(r2, g2, b2);
+  const float y = y1 - y2;
+  const float i = (r1 * kI0 - g1 * kI1 - b1 * kI2) - (r2 * kI0 - g2 * kI1 - b2 * kI2);
+  const float q = (r1 * kQ0 - g1 * kQ1 + b1 * kQ2) - (r2 * kQ0 - g2 * kQ1 + b2 * kQ2);
+  const float delta = kWeightY * y * y + kWeightI * i * i + kWeightQ * q * q;
+  return y1 > y2 ? -delta : delta;
+}
+
+/// Same as hasManySiblings() in pixelmatch.cc.
+PIXELMATCH_HOST_DEVICE inline bool hasManySiblings(const uint8_t* img, const GpuComparison& c,
+                                                   int x1, int y1) {
+  const int x0 = x1 > 0 ? x1 - 1 : 0;
+  const int y0 = y1 > 0 ? y1 - 1 : 0;
+  const int x2 = x1 < c.width - 1 ? x1 + 1 : c.width - 1;
+  const int y2 = y1 < c.height - 1 ? y1 + 1 : c.height - 1;
+  const uint8_t* center = pixelAt(img, c, x1, y1);
+
+  int zeroes = x1 == x0 || x1 == x2 || y1 == y0 || y1 == y2 ? 1 : 0;
+  for (int x = x0; x <= x2; ++x) {
+    for (int y = y0; y <= y2; ++y) {
+      if (x == x1 && y == y1) {
+        continue;
+      }
+
+      const uint8_t* sibling = pixelAt(img, c, x, y);
+      if (center[0] == sibling[0] && center[1] == sibling[1] && center[2] == sibling[2] &&
+          center[3] == sibling[3]) {
+        zeroes++;
+      }
+      if (zeroes > 2) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/// Same as antialiased() in pixelmatch.cc, computing the brightness of the neighbors in place of
+/// reading it from a plane.
+PIXELMATCH_HOST_DEVICE inline bool antialiased(const uint8_t* img, const uint8_t* img2,
+                                               const GpuComparison& c, int x1, int y1) {
+  const int x0 = x1 > 0 ? x1 - 1 : 0;
+  const int y0 = y1 > 0 ? y1 - 1 : 0;
+  const int x2 = x1 < c.width - 1 ? x1 + 1 : c.width - 1;
+  const int y2 = y1 < c.height - 1 ? y1 + 1 : c.height - 1;
+  const float centerLuma = lumaOf(pixelAt(img, c, x1, y1));
+
+  int zeroes = x1 == x0 || x1 == x2 || y1 == y0 || y1 == y2 ? 1 : 0;
+  float minDelta = 0.0f;
+  float maxDelta = 0.0f;
+  int minX = 0;
+  int minY = 0;
+  int maxX = 0;
+  int maxY = 0;
+  for (int x = x0; x <= x2; ++x) {
+    for (int y = y0; y <= y2; ++y) {
+      if (x == x1 && y == y1) {
+        continue;
+      }
+
+      const float delta = centerLuma - lumaOf(pixelAt(img, c, x, y));
+      if (delta == 0) {
+        zeroes++;
+        if (zeroes > 2) {
+          return false;
+        }
+      } else if (delta < minDelta) {
+        minDelta = delta;
+        minX = x;
+        minY = y;
+      } else if (delta > maxDelta) {
+        maxDelta = delta;
+        maxX = x;
+        maxY = y;
+      }
+    }
+  }
+
+  if (minDelta == 0.0f || maxDelta == 0.0f) {
+    return false;
+  }
+  return (hasManySiblings(img, c, minX, minY) && hasManySiblings(img2, c, minX, minY)) ||
+         (hasManySiblings(img, c, maxX, maxY) && hasManySiblings(img2, c, maxX, maxY));
+}
+
+/// Classifies the pixel at (\ref x, \ref y), like the pixel loop of pixelmatch().
+PIXELMATCH_HOST_DEVICE inline PixelClass classifyPixel(const GpuComparison& c, int x, int y) {
+  const float delta = colorDeltaOf(pixelAt(c.img1, c, x, y), pixelAt(c.img2, c, x, y));
+  if ((delta < 0.0f ? -delta : delta) <= c.maxDelta) {
+    return PixelClass::Similar;
+  }
+  if (!c.includeAA &&
+      (antialiased(c.img1, c.img2, c, x, y) || antialiased(c.img2, c.img1, c, x, y))) {
+    return PixelClass::Antialiased;
+  }
+  return delta < 0.0f ? PixelClass::Darker : PixelClass::Lighter;
+}
+
+PIXELMATCH_HOST_DEVICE inline void drawColor(uint8_t* pixel, Color color) {
+  pixel[0] = color.r;
+  pixel[1] = color.g;
+  pixel[2] = color.b;
+  pixel[3] = color.a;
+}
+
+/// Draws the pixel at (\ref x, \ref y) of class \ref pixelClass into the output, if any.
+PIXELMATCH_HOST_DEVICE inline void drawPixel(const GpuComparison& c, int x, int y,
+                                             PixelClass pixelClass) {
+  if (!c.output) {
+    return;
+  }
+
+  uint8_t* pixel = c.output + (static_cast<size_t>(y) * c.strideInPixels + x) * 4;
+  switch (pixelClass) {
+    case PixelClass::Similar:
+      if (!c.diffMask) {
+        const uint8_t* px = pixelAt(c.img1, c, x, y);
+        const uint8_t val = blendWithWhite(yOf(px[0], px[1], px[2]),
+                                           c.alpha * static_cast<float>(px[3]) / 255.0f);
+        drawColor(pixel, Color{val, val, val, 255});
+      }
+      break;
+    case PixelClass::Antialiased:
+      if (!c.diffMask) {
+        drawColor(pixel, c.aaColor);
+      }
+      break;
+    case PixelClass::Darker:
+      drawColor(pixel, c.hasDiffColorAlt ? c.diffColorAlt : c.diffColor);
+      break;
+    case PixelClass::Lighter:
+      drawColor(pixel, c.diffColor);
+      break;
+  }
+}
+
+/// Counts and bounds of the classified pixels, reduced over the whole image.
+struct GpuCounts {
+  unsigned int antialiased;
+  unsigned int darker;
+  unsigned int lighter;
+  int minX;
+  int minY;
+  int maxX;
+  int maxY;
+};
+
+/// Counts before any pixel is added, with empty bounds.
+PIXELMATCH_HOST_DEVICE inline GpuCounts emptyCounts() {
+  return GpuCounts{0, 0, 0, 0x7fffffff, 0x7fffffff, -1, -1};
+}
+
+/// The counts and bounds of a DiffResult.
+inline DiffResult toDiffResult(const GpuCounts& counts) {
+  DiffResult result;
+  result.numDiffPixels = static_cast<int>(counts.darker + counts.lighter);
+  result.numAntialiasedPixels = static_cast<int>(counts.antialiased);
+  result.numDarkerPixels = static_cast<int>(counts.darker);
+  result.numLighterPixels = static_cast<int>(counts.lighter);
+  if (counts.maxX >= 0) {
+    result.bounds = Rect{counts.minX, counts.minY, counts.maxX - counts.minX + 1,
+                         counts.maxY - counts.minY + 1};
+  }
+  return result;
+}
+
+}  // namespace pixelmatch::detail::gpu
@@ -3,47 +3,1503 @@
 #include <stb/stb_image.h>
 #include <stb/stb_image_write.h>
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>  // For memcmp.
 #include <fstream>
+#include <iterator>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Defined by the stb_image_write implementation, but not declared in its header.
+extern "C" unsigned char* stbi_zlib_compress(unsigned char* data, int data_len, int* out_len,
+                                             int quality);
 
 namespace pixelmatch {
 
-std::optional<Image> readRgbaImageFromPngFile(const char* filename) {
+namespace {
+
+constexpr uint8_t kPngSignature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+void putLittleEndian32(uint8_t* dest, uint32_t value) {
+  dest[0] = static_cast<uint8_t>(value);
+  dest[1] = static_cast<uint8_t>(value >> 8);
+  dest[2] = static_cast<uint8_t>(value >> 16);
+  dest[3] = static_cast<uint8_t>(value >> 24);
+}
+
+uint32_t getLittleEndian32(const uint8_t* src) {
+  return uint32_t(src[0]) | uint32_t(src[1]) << 8 | uint32_t(src[2]) << 16 |
+         uint32_t(src[3]) << 24;
+}
+
+uint32_t getBigEndian32(const uint8_t* src) {
+  return uint32_t(src[0]) << 24 | uint32_t(src[1]) << 16 | uint32_t(src[2]) << 8 | uint32_t(src[3]);
+}
+
+void putBigEndian32(uint8_t* dest, uint32_t value) {
+  dest[0] = static_cast<uint8_t>(value >> 24);
+  dest[1] = static_cast<uint8_t>(value >> 16);
+  dest[2] = static_cast<uint8_t>(value >> 8);
+  dest[3] = static_cast<uint8_t>(value);
+}
+
+/// CRC-32 of PNG chunks, see https://www.w3.org/TR/png/#D-CRCAppendix. Processes four bytes per
+/// step with the slicing-by-4 tables, since uncompressed IDAT chunks span the whole image.
+uint32_t crc32(const uint8_t* data, size_t size) {
+  static const auto kTables = [] {
+    std::array<std::array<uint32_t, 256>, 4> tables{};
+    for (uint32_t n = 0; n < 256; ++n) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; ++k) {
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      }
+      tables[0][n] = c;
+    }
+    for (uint32_t n = 0; n < 256; ++n) {
+      for (size_t t = 1; t < 4; ++t) {
+        tables[t][n] = tables[0][tables[t - 1][n] & 0xFF] ^ (tables[t - 1][n] >> 8);
+      }
+    }
+    return tables;
+  }();
+
+  uint32_t crc = 0xFFFFFFFFu;
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    crc ^= uint32_t(data[i]) | uint32_t(data[i + 1]) << 8 | uint32_t(data[i + 2]) << 16 |
+           uint32_t(data[i + 3]) << 24;
+    crc = kTables[3][crc & 0xFF] ^ kTables[2][(crc >> 8) & 0xFF] ^ kTables[1][(crc >> 16) & 0xFF] ^
+          kTables[0][crc >> 24];
+  }
+  for (; i < size; ++i) {
+    crc = kTables[0][(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc ^ 0xFFFFFFFFu;
+}
+
+void writeChunk(std::vector<uint8_t>& png, const char type[4], const uint8_t* data, size_t size) {
+  uint8_t length[4];
+  putBigEndian32(length, static_cast<uint32_t>(size));
+  png.insert(png.end(), std::begin(length), std::end(length));
+
+  const size_t start = png.size();
+  png.insert(png.end(), type, type + 4);
+  if (size > 0) {
+    png.insert(png.end(), data, data + size);
+  }
+
+  uint8_t crc[4];
+  putBigEndian32(crc, crc32(&png[start], size + 4));
+  png.insert(png.end(), std::begin(crc), std::end(crc));
+}
+
+/// Adler-32 checksum of the zlib stream, see RFC 1950.
+class Adler32 {
+public:
+  void update(const uint8_t* data, size_t size) {
+    // 5552 is the largest block for which b cannot overflow before the modulo.
+    while (size > 0) {
+      const size_t block = std::min<size_t>(size, 5552);
+      for (size_t i = 0; i < block; ++i) {
+        a_ += data[i];
+        b_ += a_;
+      }
+      a_ %= 65521;
+      b_ %= 65521;
+      data += block;
+      size -= block;
+    }
+  }
+
+  uint32_t value() const { return (b_ << 16) | a_; }
+
+private:
+  uint32_t a_ = 1;
+  uint32_t b_ = 0;
+};
+
+/// The Paeth predictor of PNG filter 4, from the bytes to the left, above and above left.
+uint8_t paeth(int a, int b, int c) {
+  const int p = a + b - c;
+  const int pa = std::abs(p - a);
+  const int pb = std::abs(p - b);
+  const int pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc) {
+    return static_cast<uint8_t>(a);
+  }
+  return static_cast<uint8_t>(pb <= pc ? b : c);
+}
+
+/// The quality argument of stbi_zlib_compress() for \ref PngEncodeOptions::compressionLevel 2 to 9.
+/// stb keeps up to twice that many earlier positions per hash bucket to search for matches, and
+/// raises anything below 5 to 5, so each level from 2 doubles the search from the minimum.
+int stbQuality(int compressionLevel) { return 5 << (compressionLevel - 2); }
+
+/// Applies the PNG filter to each row in turn, producing scanlines prefixed with the filter type.
+class RowFilter {
+public:
+  RowFilter(span<const uint8_t> rgbaPixels, int width, int height, size_t strideInPixels,
+            PngFilter filter)
+      : pixels_(rgbaPixels.data()),
+        rowBytes_(static_cast<size_t>(width) * 4),
+        strideBytes_(strideInPixels * 4),
+        height_(height),
+        filter_(filter),
+        zeros_(rowBytes_, 0) {
+    const size_t candidates = filter == PngFilter::Adaptive ? 5 : 1;
+    scanlines_.resize(candidates * scanlineBytes());
+  }
+
+  size_t scanlineBytes() const { return rowBytes_ + 1; }
+
+  /// Returns the next filtered scanline, or nullptr after the last row.
+  const uint8_t* next() {
+    if (y_ == height_) {
+      return nullptr;
+    }
+
+    const uint8_t* row = pixels_ + y_ * strideBytes_;
+    const uint8_t* prev = y_ > 0 ? row - strideBytes_ : zeros_.data();
+    ++y_;
+
+    if (filter_ != PngFilter::Adaptive) {
+      apply(filter_, row, prev, scanlines_.data());
+      return scanlines_.data();
+    }
+
+    // Pick the filter with the smallest sum of absolute values, as libpng and stb do.
+    const uint8_t* best = nullptr;
+    uint64_t bestCost = 0;
+    for (int type = 0; type < 5; ++type) {
+      uint8_t* scanline = scanlines_.data() + type * scanlineBytes();
+      apply(static_cast<PngFilter>(type), row, prev, scanline);
+
+      uint64_t cost = 0;
+      for (size_t i = 1; i < scanlineBytes(); ++i) {
+        cost += static_cast<uint64_t>(std::abs(static_cast<int8_t>(scanline[i])));
+      }
+      if (!best || cost < bestCost) {
+        best = scanline;
+        bestCost = cost;
+      }
+    }
+    return best;
+  }
+
+private:
+  void apply(PngFilter filter, const uint8_t* row, const uint8_t* prev, uint8_t* scanline) const {
+    constexpr size_t kBytesPerPixel = 4;
+    scanline[0] = static_cast<uint8_t>(filter);
+    uint8_t* out = scanline + 1;
+
+    switch (filter) {
+      case PngFilter::None: std::memcpy(out, row, rowBytes_); break;
+      case PngFilter::Sub:
+        for (size_t i = 0; i < rowBytes_; ++i) {
+          out[i] = row[i] - (i >= kBytesPerPixel ? row[i - kBytesPerPixel] : 0);
+        }
+        break;
+      case PngFilter::Up:
+        for (size_t i = 0; i < rowBytes_; ++i) {
+          out[i] = row[i] - prev[i];
+        }
+        break;
+      case PngFilter::Average:
+        for (size_t i = 0; i < rowBytes_; ++i) {
+          const int left = i >= kBytesPerPixel ? row[i - kBytesPerPixel] : 0;
+          out[i] = static_cast<uint8_t>(row[i] - ((left + prev[i]) >> 1));
+        }
+        break;
+      case PngFilter::Paeth:
+        for (size_t i = 0; i < rowBytes_; ++i) {
+          const bool first = i < kBytesPerPixel;
+          out[i] = row[i] - paeth(first ? 0 : row[i - kBytesPerPixel], prev[i],
+                                  first ? 0 : prev[i - kBytesPerPixel]);
+        }
+        break;
+      case PngFilter::Adaptive: assert(false && "Adaptive is resolved per row"); break;
+    }
+  }
+
+  const uint8_t* pixels_;
+  const size_t rowBytes_;
+  const size_t strideBytes_;
+  const int height_;
+  const PngFilter filter_;
+  const std::vector<uint8_t> zeros_;  //!< The row above the first row.
+  std::vector<uint8_t> scanlines_;
+  int y_ = 0;
+};
+
+// Base lengths and extra bits of the deflate length codes 257 to 285, RFC 1951 section 3.2.5.
+constexpr uint16_t kLengthBase[29] = {3,  4,  5,  6,  7,  8,  9,  10,  11,  13,  15,  17,  19, 23,
+                                      27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227,
+                                      258};
+constexpr uint8_t kLengthExtraBits[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                          2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+
+/// Order of the code length code lengths in a dynamic block header, RFC 1951 section 3.2.7.
+constexpr uint8_t kCodeLengthOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2,
+                                          14, 1, 15};
+
+/**
+ * Streams deflate data (RFC 1951), either as stored blocks or as dynamic-Huffman blocks whose
+ * matches are only repeats of the previous byte or pixel. Filtered rows of diffs are mostly such
+ * runs and small values, so this compresses them well at a fraction of the cost of a full LZ77
+ * search, like fpng does.
+ */
+class FastDeflate {
+public:
+  FastDeflate(std::vector<uint8_t>& out, bool stored) : out_(out), stored_(stored) {}
+
+  void add(const uint8_t* data, size_t size, bool last) {
+    if (stored_) {
+      addStored(data, size, last);
+      return;
+    }
+
+    size_t i = 0;
+    while (i < size) {
+      size_t bestLength = 0;
+      size_t bestDistance = 0;
+      for (const size_t distance : {size_t(1), size_t(4)}) {
+        if (total_ + i < distance || data[i] != at(data, i, distance)) {
+          continue;
+        }
+        const size_t maxLength = std::min<size_t>(size - i, kMaxMatch);
+        size_t length = 1;
+        while (length < maxLength && data[i + length] == at(data, i + length, distance)) {
+          ++length;
+        }
+        if (length > bestLength) {
+          bestLength = length;
+          bestDistance = distance;
+        }
+      }
+
+      if (bestLength >= kMinMatch) {
+        addMatch(bestLength, bestDistance);
+        i += bestLength;
+      } else {
+        tokens_.push_back(Token{data[i], 0});
+        ++literalCounts_[data[i]];
+        ++i;
+      }
+    }
+
+    // Keep the last pixel, which the next call can match against.
+    for (size_t k = 0; k < 4; ++k) {
+      history_[k] = size + k >= 4 ? data[size + k - 4] : history_[k + size];
+    }
+    total_ += size;
+
+    if (last || tokens_.size() >= kBlockTokens) {
+      writeBlock(last);
+    }
+  }
+
+  /// Flushes the remaining bits, padding the last byte.
+  void finish() {
+    for (; bitCount_ > 0; bitCount_ -= 8) {
+      out_.push_back(static_cast<uint8_t>(bitBuffer_));
+      bitBuffer_ >>= 8;
+    }
+    bitCount_ = 0;
+  }
+
+private:
+  static constexpr size_t kMinMatch = 3;
+  static constexpr size_t kMaxMatch = 258;
+  static constexpr size_t kBlockTokens = size_t(1) << 16;
+  static constexpr int kEndOfBlock = 256;
+  static constexpr int kLiteralSymbols = 286;
+  static constexpr int kDistanceSymbols = 30;
+
+
+  /// A literal byte if \ref distance is 0, otherwise a match of \ref value bytes.
+  struct Token {
+    uint16_t value;
+    uint16_t distance;
+  };
+
+  /// A canonical Huffman code table, with the codes bit-reversed for the LSB-first stream.
+  struct HuffmanTable {
+    std::vector<uint8_t> lengths;
+    std::vector<uint16_t> codes;
+  };
+
+  static int lengthIndex(size_t length) {
+    int index = 28;
+    while (kLengthBase[index] > length) {
+      --index;
+    }
+    return index;
+  }
+
+  /// Builds code lengths of at most \ref maxLength bits from symbol counts.
+  static HuffmanTable buildTable(const uint32_t* counts, int numSymbols, int maxLength) {
+    HuffmanTable table{std::vector<uint8_t>(numSymbols, 0), std::vector<uint16_t>(numSymbols, 0)};
+
+    std::vector<int> symbols;
+    for (int symbol = 0; symbol < numSymbols; ++symbol) {
+      if (counts[symbol] > 0) {
+        symbols.push_back(symbol);
+      }
+    }
+    if (symbols.empty()) {
+      return table;
+    }
+    if (symbols.size() == 1) {
+      // A single code still takes one bit.
+      table.lengths[symbols[0]] = 1;
+      return table;
+    }
+
+    // Huffman's algorithm over symbols sorted by count; nodes are merged in increasing weight, so
+    // the merged nodes form a second sorted queue.
+    std::sort(symbols.begin(), symbols.end(), [&](int a, int b) {
+      return counts[a] < counts[b] || (counts[a] == counts[b] && a < b);
+    });
+    const size_t n = symbols.size();
+    std::vector<uint64_t> weights(2 * n - 1);
+    std::vector<size_t> parents(2 * n - 1);
+    for (size_t i = 0; i < n; ++i) {
+      weights[i] = counts[symbols[i]];
+    }
+    size_t leaf = 0;
+    size_t merged = n;
+    for (size_t node = n; node < 2 * n - 1; ++node) {
+      size_t children[2];
+      for (size_t& child : children) {
+        const bool takeLeaf = leaf < n && (merged == node || weights[leaf] <= weights[merged]);
+        child = takeLeaf ? leaf++ : merged++;
+        parents[child] = node;
+      }
+      weights[node] = weights[children[0]] + weights[children[1]];
+    }
+
+    // Depths of the leaves, counted per length, with lengths over the limit folded in.
+    std::vector<int> depths(2 * n - 1, 0);
+    std::vector<uint32_t> lengthCounts(std::max<size_t>(maxLength, n) + 1, 0);
+    for (size_t node = 2 * n - 2; node-- > 0;) {
+      depths[node] = depths[parents[node]] + 1;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      ++lengthCounts[std::min(depths[i], maxLength)];
+    }
+
+    // Restore the Kraft equality after folding, by lengthening the deepest shorter codes.
+    uint64_t kraft = 0;
+    for (int length = 1; length <= maxLength; ++length) {
+      kraft += static_cast<uint64_t>(lengthCounts[length]) << (maxLength - length);
+    }
+    while (kraft > (uint64_t(1) << maxLength)) {
+      --lengthCounts[maxLength];
+      for (int length = maxLength - 1; length > 0; --length) {
+        if (lengthCounts[length] > 0) {
+          --lengthCounts[length];
+          lengthCounts[length + 1] += 2;
+          break;
+        }
+      }
+      --kraft;
+    }
+
+    // The most frequent symbols get the shortest codes.
+    size_t next = n;
+    for (int length = 1; length <= maxLength; ++length) {
+      for (uint32_t k = 0; k < lengthCounts[length]; ++k) {
+        table.lengths[symbols[--next]] = static_cast<uint8_t>(length);
+      }
+    }
+
+    assignCodes(table, maxLength);
+    return table;
+  }
+
+  static void assignCodes(HuffmanTable& table, int maxLength) {
+    std::vector<uint16_t> nextCode(maxLength + 2, 0);
+    std::vector<uint16_t> lengthCounts(maxLength + 1, 0);
+    for (uint8_t length : table.lengths) {
+      ++lengthCounts[length];
+    }
+    lengthCounts[0] = 0;
+    for (int length = 1; length <= maxLength; ++length) {
+      nextCode[length + 1] = static_cast<uint16_t>((nextCode[length] + lengthCounts[length]) << 1);
+    }
+    for (size_t symbol = 0; symbol < table.lengths.size(); ++symbol) {
+      const int length = table.lengths[symbol];
+      if (length > 0) {
+        table.codes[symbol] = reverse(nextCode[length]++, length);
+      }
+    }
+  }
+
+  static uint16_t reverse(uint32_t code, int length) {
+    uint32_t result = 0;
+    for (int i = 0; i < length; ++i) {
+      result |= ((code >> i) & 1) << (length - 1 - i);
+    }
+    return static_cast<uint16_t>(result);
+  }
+
+  /// The byte \ref distance bytes before data[i], which may be in an earlier call.
+  uint8_t at(const uint8_t* data, size_t i, size_t distance) const {
+    return i >= distance ? data[i - distance] : history_[4 + i - distance];
+  }
+
+  void addMatch(size_t length, size_t distance) {
+    tokens_.push_back(Token{static_cast<uint16_t>(length), static_cast<uint16_t>(distance)});
+    ++literalCounts_[257 + lengthIndex(length)];
+    ++distanceCounts_[distance - 1];  // Distances 1 and 4 are codes 0 and 3, without extra bits.
+  }
+
+  void putBits(uint32_t bits, int count) {
+    bitBuffer_ |= static_cast<uint64_t>(bits) << bitCount_;
+    bitCount_ += count;
+    if (bitCount_ >= 32) {
+      const uint8_t bytes[4] = {
+          static_cast<uint8_t>(bitBuffer_), static_cast<uint8_t>(bitBuffer_ >> 8),
+          static_cast<uint8_t>(bitBuffer_ >> 16), static_cast<uint8_t>(bitBuffer_ >> 24)};
+      out_.insert(out_.end(), std::begin(bytes), std::end(bytes));
+      bitBuffer_ >>= 32;
+      bitCount_ -= 32;
+    }
+  }
+
+  void putCode(const HuffmanTable& table, int symbol) {
+    putBits(table.codes[symbol], table.lengths[symbol]);
+  }
+
+  /// Writes the buffered tokens as one dynamic-Huffman block, RFC 1951 section 3.2.7.
+  void writeBlock(bool last) {
+    literalCounts_[kEndOfBlock] = 1;
+    const HuffmanTable literals = buildTable(literalCounts_.data(), kLiteralSymbols, 15);
+    const HuffmanTable distances = buildTable(distanceCounts_.data(), kDistanceSymbols, 15);
+
+    int numLiterals = kLiteralSymbols;
+    while (literals.lengths[numLiterals - 1] == 0) {
+      --numLiterals;
+    }
+    int numDistances = kDistanceSymbols;
+    while (numDistances > 1 && distances.lengths[numDistances - 1] == 0) {
+      --numDistances;
+    }
+
+    // Run-length encode both sets of code lengths with the code length alphabet.
+    std::vector<uint8_t> lengths(literals.lengths.begin(), literals.lengths.begin() + numLiterals);
+    lengths.insert(lengths.end(), distances.lengths.begin(),
+                   distances.lengths.begin() + numDistances);
+    std::vector<Token> runs;  // Code length symbol and its extra bits.
+    uint32_t runCounts[19] = {};
+    for (size_t i = 0; i < lengths.size();) {
+      size_t run = 1;
+      while (i + run < lengths.size() && lengths[i + run] == lengths[i]) {
+        ++run;
+      }
+
+      if (lengths[i] == 0 && run >= 11) {
+        run = std::min<size_t>(run, 138);
+        runs.push_back(Token{18, static_cast<uint16_t>(run - 11)});
+      } else if (lengths[i] == 0 && run >= 3) {
+        runs.push_back(Token{17, static_cast<uint16_t>(run - 3)});
+      } else if (lengths[i] != 0 && run >= 4) {
+        runs.push_back(Token{lengths[i], 0});
+        run = std::min<size_t>(run - 1, 6) + 1;
+        runs.push_back(Token{16, static_cast<uint16_t>(run - 4)});
+      } else {
+        run = 1;
+        runs.push_back(Token{lengths[i], 0});
+      }
+      i += run;
+    }
+    for (const Token& token : runs) {
+      ++runCounts[token.value];
+    }
+
+    const HuffmanTable codeLengths = buildTable(runCounts, 19, 7);
+    int numCodeLengths = 19;
+    while (numCodeLengths > 4 && codeLengths.lengths[kCodeLengthOrder[numCodeLengths - 1]] == 0) {
+      --numCodeLengths;
+    }
+
+    putBits(last ? 1 : 0, 1);  // BFINAL.
+    putBits(2, 2);             // BTYPE, dynamic Huffman codes.
+    putBits(numLiterals - 257, 5);
+    putBits(numDistances - 1, 5);
+    putBits(numCodeLengths - 4, 4);
+    for (int i = 0; i < numCodeLengths; ++i) {
+      putBits(codeLengths.lengths[kCodeLengthOrder[i]], 3);
+    }
+    for (const Token& token : runs) {
+      putCode(codeLengths, token.value);
+      if (token.value >= 16) {
+        static constexpr int kExtraBits[3] = {2, 3, 7};
+        putBits(token.distance, kExtraBits[token.value - 16]);
+      }
+    }
+
+    for (const Token& token : tokens_) {
+      if (token.distance == 0) {
+        putCode(literals, token.value);
+        continue;
+      }
+      const int index = lengthIndex(token.value);
+      putCode(literals, 257 + index);
+      putBits(token.value - kLengthBase[index], kLengthExtraBits[index]);
+      putCode(distances, token.distance - 1);
+    }
+    putCode(literals, kEndOfBlock);
+
+    tokens_.clear();
+    literalCounts_.fill(0);
+    distanceCounts_.fill(0);
+  }
+
+  void addStored(const uint8_t* data, size_t size, bool last) {
+    do {
+      const size_t block = std::min<size_t>(size, 65535);
+      const bool final = last && block == size;
+      out_.push_back(final ? 1 : 0);  // BFINAL and BTYPE 00, padded to a byte.
+      out_.insert(out_.end(), {static_cast<uint8_t>(block), static_cast<uint8_t>(block >> 8),
+                               static_cast<uint8_t>(~block), static_cast<uint8_t>(~block >> 8)});
+      out_.insert(out_.end(), data, data + block);
+      data += block;
+      size -= block;
+    } while (size > 0);
+  }
+
+  std::vector<uint8_t>& out_;
+  const bool stored_;
+  uint64_t bitBuffer_ = 0;
+  int bitCount_ = 0;
+  uint8_t history_[4] = {};
+  size_t total_ = 0;
+
+  std::vector<Token> tokens_;
+  std::array<uint32_t, kLiteralSymbols> literalCounts_{};
+  std::array<uint32_t, kDistanceSymbols> distanceCounts_{};
+};
+
+// Base distances and extra bits of the deflate distance codes 0 to 29, RFC 1951 section 3.2.5.
+constexpr uint16_t kDistanceBase[30] = {
+    1,   2,   3,   4,   5,    7,    9,    13,   17,   25,   33,   49,    65,    97,    129,
+    193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+constexpr uint8_t kDistanceExtraBits[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                            6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+/// Reads the image data of a PNG file: the contents of its consecutive IDAT chunks.
+class IdatReader {
+public:
+  /// Starts reading from the data of an IDAT chunk of \ref chunkSize bytes, at the current
+  /// position of \ref file.
+  IdatReader(std::ifstream& file, uint32_t chunkSize)
+      : file_(file), chunkRemaining_(chunkSize), buffer_(kBufferSize) {}
+
+  /// Returns the next byte of the image data, or -1 after the last IDAT chunk.
+  int next() { return pos_ < end_ ? buffer_[pos_++] : refill(); }
+
+private:
+  static constexpr size_t kBufferSize = size_t(1) << 16;
+
+  int refill() {
+    while (chunkRemaining_ == 0) {
+      // Skip the CRC, then continue with the next chunk if it is an IDAT chunk too.
+      uint8_t header[12];
+      if (!file_.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+          std::memcmp(header + 8, "IDAT", 4) != 0) {
+        return -1;
+      }
+      chunkRemaining_ = getBigEndian32(header + 4);
+    }
+
+    const size_t wanted = std::min<size_t>(chunkRemaining_, kBufferSize);
+    file_.read(reinterpret_cast<char*>(buffer_.data()), static_cast<std::streamsize>(wanted));
+    end_ = static_cast<size_t>(file_.gcount());
+    if (end_ == 0) {
+      return -1;
+    }
+    chunkRemaining_ -= static_cast<uint32_t>(end_);
+    pos_ = 1;
+    return buffer_[0];
+  }
+
+  std::ifstream& file_;
+  uint32_t chunkRemaining_;
+  std::vector<uint8_t> buffer_;
+  size_t pos_ = 0;
+  size_t end_ = 0;
+};
+
+/// A canonical Huffman code of deflate, decoded through a table for codes of up to kFastBits bits
+/// and bit by bit beyond.
+class HuffmanDecoder {
+public:
+  /// Builds the code for the code lengths of \ref numSymbols symbols, 0 for unused symbols. Returns
+  /// false if the lengths are over-subscribed; incomplete codes are allowed.
+  bool build(const uint8_t* lengths, int numSymbols) {
+    counts_.fill(0);
+    for (int symbol = 0; symbol < numSymbols; ++symbol) {
+      ++counts_[lengths[symbol]];
+    }
+    counts_[0] = 0;
+
+    int left = 1;
+    for (int length = 1; length <= kMaxBits; ++length) {
+      left = (left << 1) - counts_[length];
+      if (left < 0) {
+        return false;
+      }
+    }
+
+    // Symbols sorted by code length, then by value, which is the order of their codes.
+    std::array<uint16_t, kMaxBits + 1> offsets{};
+    for (int length = 1; length < kMaxBits; ++length) {
+      offsets[length + 1] = offsets[length] + counts_[length];
+    }
+    for (int symbol = 0; symbol < numSymbols; ++symbol) {
+      if (lengths[symbol] != 0) {
+        symbols_[offsets[lengths[symbol]]++] = static_cast<uint16_t>(symbol);
+      }
+    }
+
+    // Codes are read LSB-first, so the table is indexed by the bit-reversed codes.
+    fast_.fill(0);
+    int code = 0;
+    int index = 0;
+    for (int length = 1; length <= kFastBits; ++length) {
+      for (int k = 0; k < counts_[length]; ++k, ++code) {
+        int reversed = 0;
+        for (int bit = 0; bit < length; ++bit) {
+          reversed |= ((code >> bit) & 1) << (length - 1 - bit);
+        }
+        const uint16_t entry = static_cast<uint16_t>(length << 9 | symbols_[index + k]);
+        for (int i = reversed; i < (1 << kFastBits); i += 1 << length) {
+          fast_[i] = entry;
+        }
+      }
+      index += counts_[length];
+      code <<= 1;
+    }
+    return true;
+  }
+
+  /// Decodes the symbol at the start of \ref bits, which must hold at least kMaxBits bits, and
+  /// sets \ref length to the length of its code. Returns -1 for an unused code.
+  int decode(uint64_t bits, int& length) const {
+    const uint16_t entry = fast_[bits & ((1 << kFastBits) - 1)];
+    if (entry != 0) {
+      length = entry >> 9;
+      return entry & 511;
+    }
+
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (int len = 1; len <= kMaxBits; ++len) {
+      code |= static_cast<int>(bits >> (len - 1)) & 1;
+      if (code - first < counts_[len]) {
+        length = len;
+        return symbols_[index + code - first];
+      }
+      index += counts_[len];
+      first = (first + counts_[len]) << 1;
+      code <<= 1;
+    }
+    return -1;
+  }
+
+  static constexpr int kMaxBits = 15;
+
+private:
+  static constexpr int kFastBits = 10;
+
+  std::array<uint16_t, 1 << kFastBits> fast_{};  //!< Length << 9 | symbol, or 0 if longer.
+  std::array<uint16_t, kMaxBits + 1> counts_{};  //!< Number of codes of each length.
+  std::array<uint16_t, 288> symbols_{};
+};
+
+/**
+ * Decompresses a zlib stream (RFC 1950 and 1951) incrementally, keeping only the 32 KiB window
+ * that deflate matches can refer to. The Adler-32 checksum is not verified, as by stb_image.
+ */
+class Inflater {
+public:
+  explicit Inflater(IdatReader& input) : input_(input), window_(kWindowSize) {}
+
+  /// Decompresses the next \ref size bytes into \ref out. Returns false if the stream is corrupt
+  /// or ends before.
+  bool read(uint8_t* out, size_t size) {
+    size_t written = 0;
+    auto put = [&](uint8_t byte) {
+      out[written++] = byte;
+      window_[windowPos_++ & (kWindowSize - 1)] = byte;
+    };
+
+    while (written < size) {
+      if (matchLength_ > 0) {
+        const size_t count = std::min(matchLength_, size - written);
+        for (size_t i = 0; i < count; ++i) {
+          put(window_[(windowPos_ - matchDistance_) & (kWindowSize - 1)]);
+        }
+        matchLength_ -= count;
+        continue;
+      }
+
+      switch (state_) {
+        case State::Header: {
+          const uint32_t cmf = bits(8);
+          const uint32_t flg = bits(8);
+          // Deflate with a window of up to 32 KiB, and no preset dictionary.
+          if ((cmf & 15) != 8 || (cmf >> 4) > 7 || (cmf << 8 | flg) % 31 != 0 || (flg & 32)) {
+            return false;
+          }
+          state_ = State::BlockHeader;
+          break;
+        }
+
+        case State::BlockHeader:
+          if (finalBlock_ || !readBlockHeader()) {
+            return false;
+          }
+          break;
+
+        case State::Stored:
+          if (storedRemaining_ == 0) {
+            state_ = State::BlockHeader;
+            break;
+          }
+          for (; storedRemaining_ > 0 && written < size; --storedRemaining_) {
+            put(static_cast<uint8_t>(bits(8)));
+          }
+          break;
+
+        case State::Huffman:
+          while (written < size && matchLength_ == 0) {
+            const int symbol = decode(literals_);
+            if (symbol < 256) {
+              if (symbol < 0) {
+                return false;
+              }
+              put(static_cast<uint8_t>(symbol));
+              continue;
+            }
+            if (symbol == 256) {
+              state_ = State::BlockHeader;
+              break;
+            }
+
+            const int lengthIndex = symbol - 257;
+            if (lengthIndex >= 29) {
+              return false;
+            }
+            matchLength_ = kLengthBase[lengthIndex] + bits(kLengthExtraBits[lengthIndex]);
+            const int distanceIndex = decode(distances_);
+            if (distanceIndex < 0 || distanceIndex >= 30) {
+              return false;
+            }
+            matchDistance_ =
+                kDistanceBase[distanceIndex] + bits(kDistanceExtraBits[distanceIndex]);
+            if (matchDistance_ > windowPos_) {
+              return false;
+            }
+          }
+          break;
+      }
+
+      if (bitCount_ < paddingBits_) {
+        // Read past the end of the image data.
+        return false;
+      }
+    }
+    return true;
+  }
+
+private:
+  static constexpr size_t kWindowSize = size_t(1) << 15;
+
+  enum class State { Header, BlockHeader, Stored, Huffman };
+
+  /// Tops up the bit buffer to at least 57 bits, with zeros past the end of the data.
+  void refill() {
+    while (bitCount_ <= 56) {
+      int byte = input_.next();
+      if (byte < 0) {
+        byte = 0;
+        paddingBits_ += 8;
+      }
+      bitBuffer_ |= static_cast<uint64_t>(byte) << bitCount_;
+      bitCount_ += 8;
+    }
+  }
+
+  /// Returns and consumes the next \ref count bits, up to 16.
+  uint32_t bits(int count) {
+    if (bitCount_ < count) {
+      refill();
+    }
+    const uint32_t value = static_cast<uint32_t>(bitBuffer_ & ((uint64_t(1) << count) - 1));
+    bitBuffer_ >>= count;
+    bitCount_ -= count;
+    return value;
+  }
+
+  int decode(const HuffmanDecoder& code) {
+    if (bitCount_ < HuffmanDecoder::kMaxBits) {
+      refill();
+    }
+    int length = 0;
+    const int symbol = code.decode(bitBuffer_, length);
+    bitBuffer_ >>= length;
+    bitCount_ -= length;
+    return symbol;
+  }
+
+  /// Reads the header of the next block, RFC 1951 section 3.2.3, and its Huffman codes.
+  bool readBlockHeader() {
+    finalBlock_ = bits(1) != 0;
+    switch (bits(2)) {
+      case 0: {
+        // Stored block, starting at the next byte boundary.
+        bits(bitCount_ % 8);
+        const uint32_t length = bits(16);
+        const uint32_t complement = bits(16);
+        if ((length ^ complement) != 0xFFFF) {
+          return false;
+        }
+        storedRemaining_ = length;
+        state_ = State::Stored;
+        return true;
+      }
+
+      case 1: {
+        // Fixed Huffman codes, RFC 1951 section 3.2.6.
+        uint8_t lengths[288 + 30];
+        std::fill(lengths, lengths + 144, uint8_t(8));
+        std::fill(lengths + 144, lengths + 256, uint8_t(9));
+        std::fill(lengths + 256, lengths + 280, uint8_t(7));
+        std::fill(lengths + 280, lengths + 288, uint8_t(8));
+        std::fill(lengths + 288, lengths + 318, uint8_t(5));
+        literals_.build(lengths, 288);
+        distances_.build(lengths + 288, 30);
+        state_ = State::Huffman;
+        return true;
+      }
+
+      case 2: {
+        // Dynamic Huffman codes, RFC 1951 section 3.2.7.
+        const int numLiterals = static_cast<int>(bits(5)) + 257;
+        const int numDistances = static_cast<int>(bits(5)) + 1;
+        const int numCodeLengths = static_cast<int>(bits(4)) + 4;
+        if (numLiterals > 286 || numDistances > 30) {
+          return false;
+        }
+
+        uint8_t codeLengthLengths[19] = {};
+        for (int i = 0; i < numCodeLengths; ++i) {
+          codeLengthLengths[kCodeLengthOrder[i]] = static_cast<uint8_t>(bits(3));
+        }
+        HuffmanDecoder codeLengths;
+        if (!codeLengths.build(codeLengthLengths, 19)) {
+          return false;
+        }
+
+        uint8_t lengths[286 + 30];
+        const int numLengths = numLiterals + numDistances;
+        for (int i = 0; i < numLengths;) {
+          const int symbol = decode(codeLengths);
+          if (symbol < 0) {
+            return false;
+          }
+          if (symbol < 16) {
+            lengths[i++] = static_cast<uint8_t>(symbol);
+            continue;
+          }
+
+          uint8_t value = 0;
+          int repeat = 0;
+          if (symbol == 16) {
+            if (i == 0) {
+              return false;
+            }
+            value = lengths[i - 1];
+            repeat = 3 + static_cast<int>(bits(2));
+          } else if (symbol == 17) {
+            repeat = 3 + static_cast<int>(bits(3));
+          } else {
+            repeat = 11 + static_cast<int>(bits(7));
+          }
+          if (i + repeat > numLengths) {
+            return false;
+          }
+          std::fill(lengths + i, lengths + i + repeat, value);
+          i += repeat;
+        }
+
+        // The end-of-block code must exist.
+        if (lengths[256] == 0 || !literals_.build(lengths, numLiterals) ||
+            !distances_.build(lengths + numLiterals, numDistances)) {
+          return false;
+        }
+        state_ = State::Huffman;
+        return true;
+      }
+
+      default:
+        return false;
+    }
+  }
+
+  IdatReader& input_;
+  std::vector<uint8_t> window_;  //!< The last kWindowSize bytes written, as a ring buffer.
+  size_t windowPos_ = 0;         //!< Number of bytes written so far.
+  State state_ = State::Header;
+  bool finalBlock_ = false;
+  uint32_t storedRemaining_ = 0;
+  size_t matchLength_ = 0;
+  size_t matchDistance_ = 0;
+  HuffmanDecoder literals_;
+  HuffmanDecoder distances_;
+  uint64_t bitBuffer_ = 0;
+  int bitCount_ = 0;
+  int paddingBits_ = 0;  //!< Zero bits at the end of bitBuffer_, past the end of the data.
+};
+
+/// Reverses the PNG filter \ref type of a scanline in place, given the previous, unfiltered one.
+bool unfilter(int type, uint8_t* row, const uint8_t* prev, size_t size, size_t bytesPerPixel) {
+  switch (type) {
+    case 0: break;
+    case 1:
+      for (size_t i = bytesPerPixel; i < size; ++i) {
+        row[i] += row[i - bytesPerPixel];
+      }
+      break;
+    case 2:
+      for (size_t i = 0; i < size; ++i) {
+        row[i] += prev[i];
+      }
+      break;
+    case 3:
+      for (size_t i = 0; i < size; ++i) {
+        const int left = i >= bytesPerPixel ? row[i - bytesPerPixel] : 0;
+        row[i] += static_cast<uint8_t>((left + prev[i]) >> 1);
+      }
+      break;
+    case 4:
+      for (size_t i = 0; i < size; ++i) {
+        const bool first = i < bytesPerPixel;
+        row[i] += paeth(first ? 0 : row[i - bytesPerPixel], prev[i],
+                        first ? 0 : prev[i - bytesPerPixel]);
+      }
+      break;
+    default: return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+void DecodedPixelsDeleter::operator()(uint8_t* pixels) const {
+  stbi_image_free(pixels);
+}
+
+std::optional<DecodedImage> decodeRgbaPngFile(const char* filename) {
   int width, height, channels;
-  auto data = stbi_load(filename, &width, &height, &channels, 4);
+  uint8_t* data = stbi_load(filename, &width, &height, &channels, 4);
   if (!data) {
     return std::nullopt;
   }
 
-  Image result{width, height, static_cast<size_t>(width),
-               std::vector<uint8_t>(data, data + width * height * 4)};
-  stbi_image_free(data);
-  return result;
+  return DecodedImage{width, height, std::unique_ptr<uint8_t[], DecodedPixelsDeleter>(data)};
 }
 
-bool writeRgbaPixelsToPngFile(const char* filename, span<const uint8_t> rgbaPixels, int width,
-                              int height, size_t strideInPixels) {
-  struct Context {
-    std::ofstream output;
+std::optional<Image> readRgbaImageFromPngFile(const char* filename) {
+  auto decoded = decodeRgbaPngFile(filename);
+  if (!decoded) {
+    return std::nullopt;
+  }
+
+  const uint8_t* data = decoded->pixels.get();
+  const size_t bytes = static_cast<size_t>(decoded->width) * decoded->height * 4;
+  return Image{decoded->width, decoded->height, static_cast<size_t>(decoded->width),
+               std::vector<uint8_t>(data, data + bytes)};
+}
+
+struct PngRowDecoder::State {
+  State(std::ifstream&& pngFile, uint32_t firstIdatSize)
+      : file(std::move(pngFile)), idat(file, firstIdatSize), inflater(idat) {}
+
+  /// Converts the unfiltered scanline \ref current to RGBA, as stb_image does.
+  void toRgba(uint8_t* rgba) const;
+
+  std::ifstream file;
+  IdatReader idat;
+  Inflater inflater;
+
+  int width = 0;
+  int height = 0;
+  int bitDepth = 0;
+  int colorType = 0;
+  int channels = 0;
+  size_t scanlineBytes = 0;
+  size_t bytesPerPixel = 0;  //!< Distance to the corresponding byte of the pixel on the left.
+  std::vector<uint8_t> previous;
+  std::vector<uint8_t> current;
+
+  std::array<uint8_t, 256 * 4> palette{};  //!< RGBA colors of the palette, with alpha from tRNS.
+  bool hasTransparentColor = false;        //!< The tRNS chunk of a gray or RGB image.
+  uint16_t transparentColor[3] = {};
+  int rowsRead = 0;
+  bool failed = false;
+};
+
+void PngRowDecoder::State::toRgba(uint8_t* rgba) const {
+  const uint8_t* row = current.data();
+  if (bitDepth < 8) {
+    // Gray or palette indices packed from the most significant bits; gray levels are scaled to 8
+    // bits, including the transparent one, which only keeps its low byte.
+    static constexpr uint8_t kScale[9] = {0, 0xFF, 0x55, 0, 0x11, 0, 0, 0, 1};
+    const int mask = (1 << bitDepth) - 1;
+    const uint8_t transparent =
+        static_cast<uint8_t>((transparentColor[0] & 0xFF) * kScale[bitDepth]);
+    for (int x = 0; x < width; ++x, rgba += 4) {
+      const int bit = x * bitDepth;
+      const int value = (row[bit / 8] >> (8 - bitDepth - bit % 8)) & mask;
+      if (colorType == 3) {
+        std::memcpy(rgba, &palette[value * 4], 4);
+        continue;
+      }
+      const uint8_t gray = static_cast<uint8_t>(value * kScale[bitDepth]);
+      rgba[0] = rgba[1] = rgba[2] = gray;
+      rgba[3] = hasTransparentColor && gray == transparent ? 0 : 255;
+    }
+    return;
+  }
+
+  // 16-bit samples keep their high byte, but are compared to the transparent color in full.
+  const size_t sampleBytes = static_cast<size_t>(bitDepth / 8);
+  auto sample = [&](int x, int c) -> uint16_t {
+    const uint8_t* bytes = row + (static_cast<size_t>(x) * channels + c) * sampleBytes;
+    return sampleBytes == 2 ? static_cast<uint16_t>(bytes[0] << 8 | bytes[1]) : bytes[0];
   };
+  const int shift = bitDepth - 8;
+  const uint16_t transparentMask = bitDepth == 16 ? 0xFFFF : 0xFF;
+  for (int x = 0; x < width; ++x, rgba += 4) {
+    switch (colorType) {
+      case 0: {
+        const uint16_t gray = sample(x, 0);
+        rgba[0] = rgba[1] = rgba[2] = static_cast<uint8_t>(gray >> shift);
+        const bool transparent =
+            hasTransparentColor && gray == (transparentColor[0] & transparentMask);
+        rgba[3] = transparent ? 0 : 255;
+        break;
+      }
+      case 2: {
+        bool transparent = hasTransparentColor;
+        for (int c = 0; c < 3; ++c) {
+          const uint16_t value = sample(x, c);
+          rgba[c] = static_cast<uint8_t>(value >> shift);
+          transparent = transparent && value == (transparentColor[c] & transparentMask);
+        }
+        rgba[3] = transparent ? 0 : 255;
+        break;
+      }
+      case 3: std::memcpy(rgba, &palette[row[x] * 4], 4); break;
+      case 4:
+        rgba[0] = rgba[1] = rgba[2] = static_cast<uint8_t>(sample(x, 0) >> shift);
+        rgba[3] = static_cast<uint8_t>(sample(x, 1) >> shift);
+        break;
+      default:
+        for (int c = 0; c < 4; ++c) {
+          rgba[c] = static_cast<uint8_t>(sample(x, c) >> shift);
+        }
+        break;
+    }
+  }
+}
+
+std::optional<PngRowDecoder> PngRowDecoder::open(const char* filename) {
+  std::ifstream file(filename, std::ifstream::in | std::ifstream::binary);
+  uint8_t signature[sizeof(kPngSignature)];
+  if (!file.read(reinterpret_cast<char*>(signature), sizeof(signature)) ||
+      std::memcmp(signature, kPngSignature, sizeof(signature)) != 0) {
+    return std::nullopt;
+  }
+
+  // Read the chunks before the image data, skipping those that do not affect the pixels.
+  uint8_t header[13] = {};
+  bool hasHeader = false;
+  std::array<uint8_t, 256 * 4> palette{};
+  bool hasPalette = false;
+  std::vector<uint8_t> transparency;
+  while (true) {
+    uint8_t chunk[8];
+    if (!file.read(reinterpret_cast<char*>(chunk), sizeof(chunk))) {
+      return std::nullopt;
+    }
+    const uint32_t size = getBigEndian32(chunk);
+    const uint8_t* type = chunk + 4;
+    if (std::memcmp(type, "IDAT", 4) == 0) {
+      if (!hasHeader || (header[9] == 3 && !hasPalette)) {
+        return std::nullopt;
+      }
+
+      auto state = std::make_unique<State>(std::move(file), size);
+      State& s = *state;
+      s.width = static_cast<int>(getBigEndian32(header));
+      s.height = static_cast<int>(getBigEndian32(header + 4));
+      s.bitDepth = header[8];
+      s.colorType = header[9];
+      s.channels = s.colorType == 0 || s.colorType == 3 ? 1
+                   : s.colorType == 4                   ? 2
+                   : s.colorType == 2                   ? 3
+                                                        : 4;
+      const size_t bitsPerPixel = static_cast<size_t>(s.channels) * s.bitDepth;
+      s.scanlineBytes = (static_cast<size_t>(s.width) * bitsPerPixel + 7) / 8;
+      s.bytesPerPixel = std::max<size_t>(bitsPerPixel / 8, 1);
+      s.previous.assign(s.scanlineBytes, 0);
+      s.current.resize(s.scanlineBytes);
+
+      s.palette = palette;
+      if (s.colorType == 3) {
+        for (size_t i = 0; i < transparency.size() && i < 256; ++i) {
+          s.palette[i * 4 + 3] = transparency[i];
+        }
+      } else if (!transparency.empty()) {
+        const size_t samples = s.colorType == 0 ? 1 : 3;
+        if (transparency.size() < samples * 2) {
+          return std::nullopt;
+        }
+        s.hasTransparentColor = true;
+        for (size_t c = 0; c < samples; ++c) {
+          s.transparentColor[c] = static_cast<uint16_t>(transparency[c * 2] << 8 |
+                                                        transparency[c * 2 + 1]);
+        }
+      }
+      return PngRowDecoder(std::move(state));
+    }
+
+    const bool isHeader = std::memcmp(type, "IHDR", 4) == 0;
+    const bool isPalette = std::memcmp(type, "PLTE", 4) == 0;
+    const bool isTransparency = std::memcmp(type, "tRNS", 4) == 0;
+    if (std::memcmp(type, "IEND", 4) == 0 ||
+        ((isHeader || isPalette || isTransparency) && size > palette.size())) {
+      return std::nullopt;
+    }
+
+    // Keep the data of the chunks that affect the pixels, and skip the CRC.
+    std::vector<uint8_t> data;
+    if (isHeader || isPalette || isTransparency) {
+      data.resize(size);
+      file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(size));
+    } else {
+      file.ignore(static_cast<std::streamsize>(size));
+    }
+    if (!file.ignore(4)) {
+      return std::nullopt;
+    }
+
+    if (isHeader) {
+      if (hasHeader || size != sizeof(header)) {
+        return std::nullopt;
+      }
+      std::memcpy(header, data.data(), sizeof(header));
+      hasHeader = true;
+
+      // Bit depths allowed for each color type, bit n for a depth of n, see
+      // https://www.w3.org/TR/png/#11IHDR.
+      static constexpr uint32_t kBitDepths[7] = {0x10116, 0, 0x10100, 0x116, 0x10100, 0, 0x10100};
+      const uint32_t width = getBigEndian32(header);
+      const uint32_t height = getBigEndian32(header + 4);
+      const int bitDepth = header[8];
+      const int colorType = header[9];
+      const bool validDepth =
+          bitDepth <= 16 && colorType <= 6 && (kBitDepths[colorType] >> bitDepth & 1) != 0;
+      // Interlaced images are not decoded, since their rows are not stored in order.
+      if (width == 0 || height == 0 || width > 0x7FFFFFFF || height > 0x7FFFFFFF || !validDepth ||
+          header[10] != 0 || header[11] != 0 || header[12] != 0) {
+        return std::nullopt;
+      }
+    } else if (isPalette) {
+      if (size % 3 != 0 || size > 256 * 3) {
+        return std::nullopt;
+      }
+      for (size_t i = 0; i < size / 3; ++i) {
+        palette[i * 4 + 0] = data[i * 3 + 0];
+        palette[i * 4 + 1] = data[i * 3 + 1];
+        palette[i * 4 + 2] = data[i * 3 + 2];
+        palette[i * 4 + 3] = 255;
+      }
+      hasPalette = true;
+    } else if (isTransparency) {
+      transparency = std::move(data);
+    }
+  }
+}
+
+PngRowDecoder::PngRowDecoder(std::unique_ptr<State> state) : state_(std::move(state)) {}
+PngRowDecoder::~PngRowDecoder() = default;
+PngRowDecoder::PngRowDecoder(PngRowDecoder&& other) noexcept = default;
+PngRowDecoder& PngRowDecoder::operator=(PngRowDecoder&& other) noexcept = default;
+
+int PngRowDecoder::width() const { return state_->width; }
+int PngRowDecoder::height() const { return state_->height; }
+int PngRowDecoder::rowsRead() const { return state_->rowsRead; }
+
+int PngRowDecoder::readRows(span<uint8_t> rgbaRows, int numRows) {
+  State& s = *state_;
+  const size_t rowBytes = static_cast<size_t>(s.width) * 4;
+  if (numRows < 0 || rgbaRows.size() != rowBytes * numRows) {
+    assert(numRows >= 0 && "numRows must be >= 0");
+    assert(rgbaRows.size() == rowBytes * numRows && "Rows data size does not match numRows");
+    return -1;
+  }
+
+  const int rows = std::min(numRows, s.height - s.rowsRead);
+  for (int row = 0; row < rows && !s.failed; ++row) {
+    uint8_t filter = 0;
+    s.failed = !s.inflater.read(&filter, 1) ||
+               !s.inflater.read(s.current.data(), s.scanlineBytes) ||
+               !unfilter(filter, s.current.data(), s.previous.data(), s.scanlineBytes,
+                         s.bytesPerPixel);
+    if (!s.failed) {
+      s.toRgba(&rgbaRows[row * rowBytes]);
+      std::swap(s.current, s.previous);
+    }
+  }
+
+  if (s.failed) {
+    return -1;
+  }
+  s.rowsRead += rows;
+  return rows;
+}
 
+bool encodeRgbaPng(span<const uint8_t> rgbaPixels, int width, int height, size_t strideInPixels,
+                   std::vector<uint8_t>& png, const PngEncodeOptions& options) {
+  if (options.compressionLevel < 0 || options.compressionLevel > 9 || width <= 0 || height <= 0) {
+    assert(options.compressionLevel >= 0 && options.compressionLevel <= 9 &&
+           "compressionLevel must be between 0 and 9");
+    return false;
+  }
+  assert(isImageSize(rgbaPixels.size(), width, height, strideInPixels));
+
+  png.clear();
+  png.insert(png.end(), std::begin(kPngSignature), std::end(kPngSignature));
+
+  uint8_t header[13] = {};
+  putBigEndian32(header, static_cast<uint32_t>(width));
+  putBigEndian32(header + 4, static_cast<uint32_t>(height));
+  header[8] = 8;  // Bit depth.
+  header[9] = 6;  // Color type RGBA.
+  writeChunk(png, "IHDR", header, sizeof(header));
+
+  // The image data goes into a single IDAT chunk, compressed straight into the output.
+  const size_t idatStart = png.size();
+  png.insert(png.end(), {0, 0, 0, 0, 'I', 'D', 'A', 'T'});
+
+  RowFilter rows(rgbaPixels, width, height, strideInPixels, options.filter);
+  if (options.compressionLevel >= 2) {
+    std::vector<uint8_t> filtered;
+    filtered.reserve(rows.scanlineBytes() * height);
+    while (const uint8_t* scanline = rows.next()) {
+      filtered.insert(filtered.end(), scanline, scanline + rows.scanlineBytes());
+    }
+
+    int compressedBytes = 0;
+    uint8_t* compressed = stbi_zlib_compress(filtered.data(), static_cast<int>(filtered.size()),
+                                             &compressedBytes, stbQuality(options.compressionLevel));
+    if (!compressed) {
+      return false;
+    }
+    png.insert(png.end(), compressed, compressed + compressedBytes);
+    std::free(compressed);
+  } else {
+    // Zlib header for deflate with a 32K window and no preset dictionary.
+    png.insert(png.end(), {0x78, 0x01});
+    Adler32 adler;
+    FastDeflate deflate(png, options.compressionLevel == 0);
+    for (int y = 0; y < height; ++y) {
+      const uint8_t* scanline = rows.next();
+      adler.update(scanline, rows.scanlineBytes());
+      deflate.add(scanline, rows.scanlineBytes(), y == height - 1);
+    }
+    deflate.finish();
+
+    uint8_t checksum[4];
+    putBigEndian32(checksum, adler.value());
+    png.insert(png.end(), std::begin(checksum), std::end(checksum));
+  }
+
+  const size_t idatBytes = png.size() - idatStart - 8;
+  putBigEndian32(&png[idatStart], static_cast<uint32_t>(idatBytes));
+  uint8_t crc[4];
+  putBigEndian32(crc, crc32(&png[idatStart + 4], idatBytes + 4));
+  png.insert(png.end(), std::begin(crc), std::end(crc));
+
+  writeChunk(png, "IEND", nullptr, 0);
+  return true;
+}
+
+bool writeRgbaPixelsToPngFile(const char* filename, span<const uint8_t> rgbaPixels, int width,
+                              int height, size_t strideInPixels, const PngEncodeOptions& options) {
+  std::vector<uint8_t> png;
+  if (!encodeRgbaPng(rgbaPixels, width, height, strideInPixels, png, options)) {
+    return false;
+  }
+
+  std::ofstream output(filename, std::ofstream::out | std::ofstream::binary);
+  if (!output) {
+    return false;
+  }
+
+  output.write(reinterpret_cast<const char*>(png.data()), static_cast<std::streamsize>(png.size()));
+  return output.good();
+}
+
+bool writeRawRgbaFile(const char* filename, span<const uint8_t> rgbaPixels, int width, int height,
+                      size_t strideInPixels) {
   assert(rgbaPixels.size() == strideInPixels * height * 4);
+  if (width <= 0 || height <= 0 || strideInPixels < static_cast<size_t>(width) ||
+      strideInPixels > UINT32_MAX) {
+    return false;
+  }
+
+  uint8_t header[kRawRgbaHeaderSize] = {};
+  std::memcpy(header, kRawRgbaMagic, sizeof(kRawRgbaMagic));
+  putLittleEndian32(header + 8, kRawRgbaVersion);
+  putLittleEndian32(header + 12, static_cast<uint32_t>(width));
+  putLittleEndian32(header + 16, static_cast<uint32_t>(height));
+  putLittleEndian32(header + 20, static_cast<uint32_t>(strideInPixels));
 
-  Context context;
-  context.output = std::ofstream(filename, std::ofstream::out | std::ofstream::binary);
-  if (!context.output) {
+  std::ofstream output(filename, std::ofstream::out | std::ofstream::binary);
+  if (!output) {
     return false;
   }
 
-  stbi_write_png_to_func(
-      [](void* context, void* data, int len) {
-        Context* contextObj = reinterpret_cast<Context*>(context);
-        contextObj->output.write(static_cast<const char*>(data), len);
-      },
-      &context, width, height, 4, rgbaPixels.data(), strideInPixels * 4);
+  output.write(reinterpret_cast<const char*>(header), sizeof(header));
+  output.write(reinterpret_cast<const char*>(rgbaPixels.data()),
+               static_cast<std::streamsize>(rgbaPixels.size()));
+  return output.good();
+}
+
+std::optional<MappedImage> MappedImage::open(const char* filename) {
+  MappedImage result;
 
-  return context.output.good();
+#ifdef _WIN32
+  HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return std::nullopt;
+  }
+
+  LARGE_INTEGER fileSize;
+  HANDLE mapping = nullptr;
+  if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart >= LONGLONG(kRawRgbaHeaderSize)) {
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  }
+  if (mapping) {
+    result.mapping_ = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    result.mappingSize_ = static_cast<size_t>(fileSize.QuadPart);
+    // The view keeps the mapping alive.
+    CloseHandle(mapping);
+  }
+  CloseHandle(file);
+#else
+  const int fd = ::open(filename, O_RDONLY);
+  if (fd < 0) {
+    return std::nullopt;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(kRawRgbaHeaderSize)) {
+    void* mapping = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED) {
+      result.mapping_ = mapping;
+      result.mappingSize_ = static_cast<size_t>(st.st_size);
+      posix_madvise(mapping, result.mappingSize_, POSIX_MADV_WILLNEED);
+    }
+  }
+  // The mapping stays valid after closing the file.
+  close(fd);
+#endif
+
+  if (!result.mapping_) {
+    return std::nullopt;
+  }
+
+  const uint8_t* header = static_cast<const uint8_t*>(result.mapping_);
+  if (std::memcmp(header, kRawRgbaMagic, sizeof(kRawRgbaMagic)) != 0 ||
+      getLittleEndian32(header + 8) != kRawRgbaVersion) {
+    return std::nullopt;
+  }
+
+  const uint32_t width = getLittleEndian32(header + 12);
+  const uint32_t height = getLittleEndian32(header + 16);
+  const uint32_t stride = getLittleEndian32(header + 20);
+  if (width == 0 || height == 0 || width > INT32_MAX || height > INT32_MAX || stride < width) {
+    return std::nullopt;
+  }
+
+  // Reject truncated files, without overflowing for corrupt sizes.
+  const uint64_t bytes = uint64_t(stride) * height * 4;
+  if (bytes / height / 4 != stride || bytes > result.mappingSize_ - kRawRgbaHeaderSize) {
+    return std::nullopt;
+  }
+
+  result.width_ = static_cast<int>(width);
+  result.height_ = static_cast<int>(height);
+  result.strideInPixels_ = stride;
+  result.data_ = span<const uint8_t>(header + kRawRgbaHeaderSize, static_cast<size_t>(bytes));
+  return result;
+}
+
+MappedImage::~MappedImage() {
+  unmap();
+}
+
+MappedImage::MappedImage(MappedImage&& other) noexcept {
+  *this = std::move(other);
+}
+
+MappedImage& MappedImage::operator=(MappedImage&& other) noexcept {
+  if (this != &other) {
+    unmap();
+    mapping_ = std::exchange(other.mapping_, nullptr);
+    mappingSize_ = std::exchange(other.mappingSize_, 0);
+    width_ = std::exchange(other.width_, 0);
+    height_ = std::exchange(other.height_, 0);
+    strideInPixels_ = std::exchange(other.strideInPixels_, 0);
+    data_ = std::exchange(other.data_, span<const uint8_t>());
+  }
+  return *this;
+}
+
+void MappedImage::unmap() {
+  if (!mapping_) {
+    return;
+  }
+
+#ifdef _WIN32
+  UnmapViewOfFile(mapping_);
+#else
+  munmap(mapping_, mappingSize_);
+#endif
+  mapping_ = nullptr;
 }
 
 bool imageEquals(span<const uint8_t> img1, span<const uint8_t> img2, int width, int height,
@@ -59,4 +1515,27 @@ bool imageEquals(span<const uint8_t> img1, span<const uint8_t> img2, int width,
   return true;
 }
 
+bool imageEquals(const ImageSignature& signature, span<const uint8_t> img, int width, int height,
+                 size_t strideInPixels) {
+  if (signature.width() != width || signature.height() != height) {
+    return false;
+  }
+
+  for (int tileY = 0; tileY < signature.tileRows(); ++tileY) {
+    const int y = tileY * detail::kSignatureTileSize;
+    const int rows = std::min(detail::kSignatureTileSize, height - y);
+    for (int tileX = 0; tileX < signature.tileColumns(); ++tileX) {
+      const int x = tileX * detail::kSignatureTileSize;
+      const int columns = std::min(detail::kSignatureTileSize, width - x);
+      const uint8_t* tile = &img[(y * strideInPixels + x) * 4];
+      if (detail::hashTile(tile, columns, rows, strideInPixels) !=
+          signature.tileHash(tileX, tileY)) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
 }  // namespace pixelmatch
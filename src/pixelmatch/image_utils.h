@@ -1,7 +1,9 @@
 #pragma once
 
 #include <pixelmatch/pixelmatch.h>
+#include <pixelmatch/signature.h>
 
+#include <memory>
 #include <vector>
 
 namespace pixelmatch {
@@ -16,6 +18,33 @@ struct Image {
   std::vector<uint8_t> data;  //!< Image data as RGBA-encoded pixels, unpremultiplied.
 };
 
+/**
+ * Frees pixels decoded by \ref decodeRgbaPngFile.
+ */
+struct DecodedPixelsDeleter {
+  void operator()(uint8_t* pixels) const;
+};
+
+/**
+ * Image decoded by \ref decodeRgbaPngFile, in the buffer allocated by the decoder.
+ */
+struct DecodedImage {
+  int width;   //!< Image width in pixels.
+  int height;  //!< Image height in pixels.
+  /// Image data as width * height RGBA-encoded pixels, unpremultiplied, without padding.
+  std::unique_ptr<uint8_t[], DecodedPixelsDeleter> pixels;
+};
+
+/**
+ * Decodes a PNG file to RGBA without copying the pixels out of the decoder's buffer, so that the
+ * caller can take ownership of them, e.g. to hand them to NumPy.
+ *
+ * @param filename Filename to load.
+ * @return std::optional<DecodedImage> containing the image, or std::nullopt if the file could not
+ *         be read.
+ */
+std::optional<DecodedImage> decodeRgbaPngFile(const char* filename);
+
 /**
  * Reads an image from a PNG file, in a format that can be used by pixelmatch.
  *
@@ -24,6 +53,93 @@ struct Image {
  */
 std::optional<Image> readRgbaImageFromPngFile(const char* filename);
 
+/**
+ * Decodes a PNG file progressively, a few rows at a time, e.g. to feed a
+ * \ref StreamingComparator. Only the file buffer, the 32 KiB deflate window and two scanlines are
+ * held in memory, regardless of the size of the image.
+ *
+ * Supports all bit depths and color types, converted to RGBA as \ref decodeRgbaPngFile does, but
+ * not interlaced PNGs, whose rows are spread across the whole file.
+ */
+class PngRowDecoder {
+public:
+  /**
+   * Opens a PNG file and reads its header.
+   *
+   * @param filename Filename to load.
+   * @return std::optional<PngRowDecoder> positioned at the first row, or std::nullopt if the file
+   *         could not be read, is not a valid PNG or is interlaced.
+   */
+  static std::optional<PngRowDecoder> open(const char* filename);
+
+  ~PngRowDecoder();
+  PngRowDecoder(PngRowDecoder&& other) noexcept;
+  PngRowDecoder& operator=(PngRowDecoder&& other) noexcept;
+
+  int width() const;     //!< Image width in pixels.
+  int height() const;    //!< Image height in pixels.
+  int rowsRead() const;  //!< Number of rows decoded so far.
+
+  /**
+   * Decodes the next rows.
+   *
+   * @param rgbaRows Destination, numRows * width * 4 bytes long, for RGBA-encoded pixels,
+   *                 unpremultiplied, without padding.
+   * @param numRows Maximum number of rows to decode.
+   * @return The number of rows decoded, fewer than numRows only at the end of the image, or -1 if a
+   *         precondition fails or the file is truncated or corrupt.
+   */
+  int readRows(span<uint8_t> rgbaRows, int numRows);
+
+private:
+  struct State;
+
+  explicit PngRowDecoder(std::unique_ptr<State> state);
+
+  std::unique_ptr<State> state_;
+};
+
+/**
+ * PNG row filters, applied before compression. See https://www.w3.org/TR/png/#9Filters.
+ */
+enum class PngFilter {
+  None,
+  Sub,
+  Up,
+  Average,
+  Paeth,
+  Adaptive,  //!< Picks the filter of each row with the smallest sum of absolute filtered bytes.
+};
+
+/**
+ * Options for encoding PNGs with \ref encodeRgbaPng and \ref writeRgbaPixelsToPngFile.
+ */
+struct PngEncodeOptions {
+  /**
+   * 0 stores the filtered pixels without compression. 1 uses a fast run-length deflate encoder,
+   * which suits flat images such as diffs. 2 to 9 use the deflate encoder of stb_image_write, which
+   * is slower but compresses busy images better. Unlike zlib levels, they only set how far back it
+   * searches for matches, doubling the search at each level, so that higher levels are slower and
+   * compress better.
+   */
+  int compressionLevel = 1;
+  PngFilter filter = PngFilter::Up;  //!< Up turns the flat rows of diffs into runs of zeros.
+};
+
+/**
+ * Encodes an image as a PNG into \ref png, reusing its capacity.
+ *
+ * @param rgbaPixels Pixel data, as RGBA-encoded pixels. Alpha should be unpremultiplied.
+ * @param width Width of the image.
+ * @param height Height of the image.
+ * @param strideInPixels Stride of the image pixel data, should be greater than \ref width.
+ * @param png Destination, replaced with the encoded PNG.
+ * @param options Encoder options.
+ * @return true If the image was encoded; false if the options are invalid.
+ */
+bool encodeRgbaPng(span<const uint8_t> rgbaPixels, int width, int height, size_t strideInPixels,
+                   std::vector<uint8_t>& png, const PngEncodeOptions& options = PngEncodeOptions());
+
 /**
  * Save an image as a PNG file.
  *
@@ -32,10 +148,79 @@ std::optional<Image> readRgbaImageFromPngFile(const char* filename);
  * @param width Width of the image.
  * @param height Height of the image.
  * @param strideInPixels Stride of the image pixel data, should be greater than \ref width.
+ * @param options Encoder options.
  * @return true If the image was successfully saved.
  */
 bool writeRgbaPixelsToPngFile(const char* filename, span<const uint8_t> rgbaPixels, int width,
-                              int height, size_t strideInPixels);
+                              int height, size_t strideInPixels,
+                              const PngEncodeOptions& options = PngEncodeOptions());
+
+/**
+ * Raw RGBA files store uncompressed pixels, so that they can be memory-mapped with
+ * \ref MappedImage instead of decoded, e.g. for a baseline that is compared many times.
+ *
+ * The file starts with a \ref kRawRgbaHeaderSize byte header: the 8-byte \ref kRawRgbaMagic, then
+ * the little-endian uint32 version, width, height and stride in pixels, zero-padded. The rows
+ * follow, strideInPixels * height RGBA-encoded pixels.
+ */
+constexpr char kRawRgbaMagic[8] = {'P', 'X', 'M', 'R', 'G', 'B', 'A', '\0'};
+constexpr uint32_t kRawRgbaVersion = 1;    //!< Version written by \ref writeRawRgbaFile.
+constexpr size_t kRawRgbaHeaderSize = 64;  //!< Keeps the rows 64-byte aligned in the mapping.
+
+/**
+ * Saves an image as a raw RGBA file, see \ref kRawRgbaMagic.
+ *
+ * @param filename Destination filename.
+ * @param rgbaPixels Pixel data, as RGBA-encoded pixels. Alpha should be unpremultiplied.
+ * @param width Width of the image.
+ * @param height Height of the image.
+ * @param strideInPixels Stride of the image pixel data, stored in the file and kept by
+ *                       \ref MappedImage::strideInPixels.
+ * @return true If the image was successfully saved.
+ */
+bool writeRawRgbaFile(const char* filename, span<const uint8_t> rgbaPixels, int width, int height,
+                      size_t strideInPixels);
+
+/**
+ * A read-only memory mapping of a raw RGBA file, whose pixels can be passed to pixelmatch without
+ * copying or decoding. The pixels stay valid until the MappedImage is destroyed.
+ */
+class MappedImage {
+public:
+  /**
+   * Maps a file written by \ref writeRawRgbaFile.
+   *
+   * @param filename Filename to map.
+   * @return std::optional<MappedImage> with the mapping, or std::nullopt if the file could not be
+   *         opened or is not a valid raw RGBA file.
+   */
+  static std::optional<MappedImage> open(const char* filename);
+
+  ~MappedImage();
+  MappedImage(MappedImage&& other) noexcept;
+  MappedImage& operator=(MappedImage&& other) noexcept;
+
+  MappedImage(const MappedImage&) = delete;
+  MappedImage& operator=(const MappedImage&) = delete;
+
+  int width() const { return width_; }                       //!< Image width in pixels.
+  int height() const { return height_; }                     //!< Image height in pixels.
+  size_t strideInPixels() const { return strideInPixels_; }  //!< Image stride, in pixels.
+
+  /// Image data as strideInPixels * height RGBA-encoded pixels, in the mapping.
+  span<const uint8_t> data() const { return data_; }
+
+private:
+  MappedImage() = default;
+  void unmap();
+
+  void* mapping_ = nullptr;
+  size_t mappingSize_ = 0;
+  int width_ = 0;
+  int height_ = 0;
+  size_t strideInPixels_ = 0;
+  span<const uint8_t> data_;
+};
 
 /**
  * Returns true if two images are bit-identical.
@@ -51,4 +236,19 @@ bool writeRgbaPixelsToPngFile(const char* filename, span<const uint8_t> rgbaPixe
 bool imageEquals(span<const uint8_t> img1, span<const uint8_t> img2, int width, int height,
                  size_t strideInPixels);
 
+/**
+ * Returns true if an image has the given signature, such as that of a golden image, hashing the
+ * tiles of \ref img until one differs without reading the signed image. The hashes are not
+ * cryptographic, see ImageSignature.
+ *
+ * @param signature Signature of the first image.
+ * @param img Second image, as 4-byte pixels, strideInPixels * height * 4 bytes.
+ * @param width Image width, in pixels.
+ * @param height Image height, in pixels.
+ * @param strideInPixels Stride, must be >= width.
+ * @return true If the image is the size of the signature and has the same tile hashes.
+ */
+bool imageEquals(const ImageSignature& signature, span<const uint8_t> img, int width, int height,
+                 size_t strideInPixels);
+
 }  // namespace pixelmatch
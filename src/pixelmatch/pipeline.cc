@@ -0,0 +1,221 @@
+#include "pixelmatch/pipeline.h"
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+#include "pixelmatch/thread_pool.h"
+
+namespace pixelmatch {
+
+namespace {
+
+enum class Stage { Decode1, Decode2, Compare, Encode };
+
+struct Task {
+  Stage stage;
+  size_t index;
+};
+
+/// Images of a pair between decoding and encoding.
+struct PairState {
+  std::optional<DecodedImage> img1;
+  std::optional<DecodedImage> img2;
+  int pendingDecodes = 2;
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> diff;
+};
+
+bool writeFile(const std::string& filename, const std::vector<uint8_t>& data) {
+  std::ofstream output(filename, std::ofstream::out | std::ofstream::binary);
+  output.write(reinterpret_cast<const char*>(data.data()),
+               static_cast<std::streamsize>(data.size()));
+  return output.good();
+}
+
+class FilePipeline {
+public:
+  FilePipeline(span<const FilePair> pairs, Options options, size_t maxPairsInFlight,
+               const PngEncodeOptions& pngOptions, size_t numThreads)
+      : pairs_(pairs),
+        results_(pairs.size()),
+        states_(pairs.size()),
+        encoded_(numThreads),
+        maxPairsInFlight_(maxPairsInFlight),
+        pngOptions_(pngOptions) {
+    options.numThreads = 1;
+    comparators_.reserve(numThreads);
+    for (size_t i = 0; i < numThreads; ++i) {
+      comparators_.emplace_back(options);
+    }
+  }
+
+  /// Runs tasks until every pair is finished; called once from each thread of the pool.
+  void work(size_t thread) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      std::optional<Task> task;
+      wake_.wait(lock, [&] { return (task = nextTask()) || finished_ == pairs_.size(); });
+      if (!task) {
+        return;
+      }
+
+      lock.unlock();
+      const bool done = run(*task, thread);
+      lock.lock();
+
+      if (done) {
+        states_[task->index] = PairState();
+        --pairsInFlight_;
+        ++finished_;
+      }
+      wake_.notify_all();
+    }
+  }
+
+  std::vector<FilePairResult> takeResults() { return std::move(results_); }
+
+private:
+  /// Picks the next task, later stages first so that pairs in flight drain before new ones start.
+  std::optional<Task> nextTask() {
+    for (std::deque<Task>* queue : {&encode_, &compare_, &decode_}) {
+      if (!queue->empty()) {
+        const Task task = queue->front();
+        queue->pop_front();
+        return task;
+      }
+    }
+
+    if (nextPair_ < pairs_.size() && pairsInFlight_ < maxPairsInFlight_) {
+      // Admit a new pair; the second image can be decoded by another thread meanwhile.
+      ++pairsInFlight_;
+      const size_t index = nextPair_++;
+      decode_.push_back(Task{Stage::Decode2, index});
+      return Task{Stage::Decode1, index};
+    }
+
+    return std::nullopt;
+  }
+
+  /// Runs a task, queueing the next stage of its pair. Returns true if the pair is finished.
+  bool run(const Task& task, size_t thread) {
+    const FilePair& pair = pairs_[task.index];
+    PairState& state = states_[task.index];
+    FilePairResult& result = results_[task.index];
+
+    switch (task.stage) {
+      case Stage::Decode1:
+      case Stage::Decode2: {
+        const bool first = task.stage == Stage::Decode1;
+        std::optional<DecodedImage> decoded = decodeRgbaPngFile(first ? pair.img1.c_str()
+                                                                      : pair.img2.c_str());
+        std::lock_guard<std::mutex> guard(mutex_);
+        (first ? state.img1 : state.img2) = std::move(decoded);
+        if (--state.pendingDecodes == 0) {
+          compare_.push_back(Task{Stage::Compare, task.index});
+        }
+        return false;
+      }
+
+      case Stage::Compare: {
+        if (!state.img1 || !state.img2) {
+          result.error = "Could not read " + (state.img1 ? pair.img2 : pair.img1);
+          return true;
+        }
+        if (state.img1->width != state.img2->width || state.img1->height != state.img2->height) {
+          result.error = "Image sizes do not match";
+          return true;
+        }
+
+        state.width = state.img1->width;
+        state.height = state.img1->height;
+        const size_t bytes = static_cast<size_t>(state.width) * state.height * 4;
+        if (!pair.output.empty()) {
+          state.diff.resize(bytes);
+        }
+
+        result.numDiffPixels = comparators_[thread].compare(
+            span<const uint8_t>(state.img1->pixels.get(), bytes),
+            span<const uint8_t>(state.img2->pixels.get(), bytes), state.diff, state.width,
+            state.height, state.width);
+
+        // Only the diff is needed from here on.
+        state.img1.reset();
+        state.img2.reset();
+        if (pair.output.empty()) {
+          return true;
+        }
+
+        std::lock_guard<std::mutex> guard(mutex_);
+        encode_.push_back(Task{Stage::Encode, task.index});
+        return false;
+      }
+
+      case Stage::Encode: {
+        // Each thread encodes into its own buffer, reused across pairs.
+        std::vector<uint8_t>& png = encoded_[thread];
+        if (!encodeRgbaPng(state.diff, state.width, state.height, state.width, png, pngOptions_) ||
+            !writeFile(pair.output, png)) {
+          result.error = "Could not write " + pair.output;
+        }
+        return true;
+      }
+    }
+
+    return true;
+  }
+
+  const span<const FilePair> pairs_;
+  std::vector<FilePairResult> results_;
+  std::vector<PairState> states_;
+  std::vector<Comparator> comparators_;
+  std::vector<std::vector<uint8_t>> encoded_;
+  const size_t maxPairsInFlight_;
+  const PngEncodeOptions pngOptions_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<Task> decode_;
+  std::deque<Task> compare_;
+  std::deque<Task> encode_;
+  size_t nextPair_ = 0;
+  size_t pairsInFlight_ = 0;
+  size_t finished_ = 0;
+};
+
+}  // namespace
+
+std::vector<FilePairResult> pixelmatchFiles(span<const FilePair> pairs, Options options,
+                                            int maxPairsInFlight,
+                                            const PngEncodeOptions& pngOptions) {
+  const bool validLevel = pngOptions.compressionLevel >= 0 && pngOptions.compressionLevel <= 9;
+  if (options.numThreads < 0 || maxPairsInFlight < 0 ||
+      options.outputFormat != OutputFormat::Rgba || !options.deltaMap.empty() || !validLevel) {
+    assert(options.numThreads >= 0 && "numThreads must be >= 0");
+    assert(maxPairsInFlight >= 0 && "maxPairsInFlight must be >= 0");
+    assert(options.outputFormat == OutputFormat::Rgba && "Diff PNGs must use OutputFormat::Rgba");
+    assert(options.deltaMap.empty() && "deltaMap is not supported for files");
+    assert(validLevel && "compressionLevel must be between 0 and 9");
+    return std::vector<FilePairResult>(pairs.size(), FilePairResult{-1, "Invalid options"});
+  }
+
+  if (pairs.size() == 0) {
+    return {};
+  }
+
+  detail::ThreadPool pool(detail::ThreadPool::resolveNumThreads(options.numThreads));
+  const size_t numThreads = pool.numThreads();
+  FilePipeline pipeline(pairs, std::move(options),
+                        maxPairsInFlight > 0 ? static_cast<size_t>(maxPairsInFlight) : numThreads,
+                        pngOptions, numThreads);
+  pool.parallelFor(numThreads, [&](size_t, size_t thread) { pipeline.work(thread); });
+  return pipeline.takeResults();
+}
+
+}  // namespace pixelmatch
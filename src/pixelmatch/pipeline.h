@@ -0,0 +1,51 @@
+#pragma once
+
+#include <pixelmatch/image_utils.h>
+#include <pixelmatch/pixelmatch.h>
+
+#include <string>
+#include <vector>
+
+namespace pixelmatch {
+
+/**
+ * A pair of PNG files to compare with \ref pixelmatchFiles.
+ */
+struct FilePair {
+  std::string img1;    //!< Path of the first image.
+  std::string img2;    //!< Path of the second image, must have the same size as \ref img1.
+  std::string output;  //!< Path to write the diff PNG to, or empty to only count the differences.
+};
+
+/**
+ * Result of comparing one \ref FilePair.
+ */
+struct FilePairResult {
+  /// Number of different pixels, or -1 if the images could not be read or have different sizes.
+  int numDiffPixels = -1;
+  /// Empty on success, otherwise describes why reading, comparing or writing the pair failed.
+  std::string error;
+};
+
+/**
+ * Compares pairs of PNG files and writes their diffs, as a pipeline that overlaps decoding,
+ * comparing and encoding of different pairs.
+ *
+ * Each stage of a pair runs as a task on a pool of Options::numThreads threads (0 uses the hardware
+ * concurrency), with finishing pairs taking priority over starting new ones. At most
+ * \ref maxPairsInFlight pairs are between decoding and encoding at any time, each holding up to
+ * three images, which caps memory regardless of the number of pairs.
+ *
+ * @param pairs The pairs to compare.
+ * @param options Comparison options, as for \ref pixelmatch. Each pair is compared on a single
+ *                thread, and Options::outputFormat must be OutputFormat::Rgba.
+ * @param maxPairsInFlight Maximum number of pairs decoded but not yet written; 0 uses the number of
+ *                         threads.
+ * @param pngOptions Encoder options for the diff PNGs.
+ * @return The result of each pair, in order.
+ */
+std::vector<FilePairResult> pixelmatchFiles(
+    span<const FilePair> pairs, Options options = Options(), int maxPairsInFlight = 0,
+    const PngEncodeOptions& pngOptions = PngEncodeOptions());
+
+}  // namespace pixelmatch
@@ -2,8 +2,23 @@
 #include "pixelmatch/pixelmatch.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cstring>  // For memcmp.
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#include "pixelmatch/fixed_point.h"
+#include "pixelmatch/pyramid.h"
+#include "pixelmatch/signature.h"
+#include "pixelmatch/simd.h"
+#include "pixelmatch/thread_pool.h"
+#include "pixelmatch/yiq.h"
 
 namespace pixelmatch {
 
@@ -11,98 +26,104 @@ namespace {
 
 static constexpr size_t kPixelBytes = 4;
 
-inline float rgb2y(uint8_t r, uint8_t g, uint8_t b) {
-  return r * 0.29889531f + g * 0.58662247f + b * 0.11448223f;
-}
+using detail::blend;
+using detail::blendedY;
+using detail::rgb2y;
 
-inline float rgb2i(uint8_t r, uint8_t g, uint8_t b) {
-  return r * 0.59597799f - g * 0.27417610f - b * 0.32180189f;
-}
+#ifdef PIXELMATCH_ENABLE_INSTRUMENTATION
+constexpr bool kInstrumented = true;
+#else
+constexpr bool kInstrumented = false;  //!< Otherwise, the counters and timers below compile away.
+#endif
 
-inline float rgb2q(uint8_t r, uint8_t g, uint8_t b) {
-  return r * 0.21147017f - g * 0.52261711f + b * 0.31114694f;
+/// Adds \ref n to a counter of Instrumentation, if instrumented.
+inline void addCount(int64_t& counter, int64_t n = 1) {
+  if constexpr (kInstrumented) {
+    counter += n;
+  }
 }
 
-/**
- * Blend semi-transparent color with white.
- *
- * @param color The color to blend.
- * @param alpha The alpha value of the color, between 0 and 1.
- * @return The blended color.
- */
-inline uint8_t blend(uint8_t c, float a) {
-  return static_cast<uint8_t>(255.0f + (static_cast<float>(c) - 255.0f) * a);
-}
+/// Measures the time since construction, if instrumented.
+class Stopwatch {
+public:
+  Stopwatch() {
+    if constexpr (kInstrumented) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
 
-/**
- * Calculate color difference according to the paper "Measuring perceived color difference
- * using YIQ NTSC transmission color space in mobile applications" by Y. Kotsarenko and F. Ramos
- *
- * @param img1 The first image, with RGBA-encoded pixels with unpremultiplied alpha.
- * @param img2 The second image with the same size and format as img1.
- * @param pos1 The position in the \ref img1 buffer to start, in bytes. Should point to the start of
- *              an RGBA-encoded pixel.
- * @param pos2 The position in the \ref img2 buffer, same as \ref pos1.
- * @param yOnly Check for brightness difference only.
- * @return the delta, with sign indicating whether the pixel lightens or darkens the pixel lightens
- *          or darkens (positive if img2 lightens). Returns 0 if the pixels are identical.
- */
-float colorDelta(span<const uint8_t> img1, span<const uint8_t> img2, size_t pos1, size_t pos2,
-                 bool yOnly) {
-  uint8_t r1 = img1[pos1 + 0];
-  uint8_t g1 = img1[pos1 + 1];
-  uint8_t b1 = img1[pos1 + 2];
-  const uint8_t a1 = img1[pos1 + 3];
-
-  uint8_t r2 = img2[pos2 + 0];
-  uint8_t g2 = img2[pos2 + 1];
-  uint8_t b2 = img2[pos2 + 2];
-  const uint8_t a2 = img2[pos2 + 3];
-
-  if (r1 == r2 && g1 == g2 && b1 == b2 && a1 == a2) {
+  /// Returns the time since construction in nanoseconds, or 0 if not instrumented.
+  int64_t elapsedNanoseconds() const {
+    if constexpr (kInstrumented) {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::steady_clock::now() - start_)
+          .count();
+    }
     return 0;
   }
 
-  // If there's alpha, blend with a white background.
-  if (a1 < 255) {
-    const float alpha = a1 / 255.0f;
-    r1 = blend(r1, alpha);
-    g1 = blend(g1, alpha);
-    b1 = blend(b1, alpha);
-  }
+private:
+  std::chrono::steady_clock::time_point start_;
+};
 
-  if (a2 < 255) {
-    const float alpha = a2 / 255.0f;
-    r2 = blend(r2, alpha);
-    g2 = blend(g2, alpha);
-    b2 = blend(b2, alpha);
-  }
+/// Adds the time from construction to destruction to a phase of Instrumentation, if instrumented.
+class PhaseTimer {
+public:
+  explicit PhaseTimer(int64_t& nanoseconds) : nanoseconds_(nanoseconds) {}
+  ~PhaseTimer() { addCount(nanoseconds_, stopwatch_.elapsedNanoseconds()); }
 
-  const float y1 = rgb2y(r1, g1, b1);
-  const float y2 = rgb2y(r2, g2, b2);
-  const float y = y1 - y2;
+  PhaseTimer(const PhaseTimer&) = delete;
+  PhaseTimer& operator=(const PhaseTimer&) = delete;
 
-  if (yOnly) {
-    return y;  // Brightness difference only.
+private:
+  int64_t& nanoseconds_;
+  Stopwatch stopwatch_;
+};
+
+/// Adds the counters and timings of \ref from to DiffResult::instrumentation, if instrumented.
+void addInstrumentation(const Instrumentation& from, DiffResult& result) {
+  if constexpr (!kInstrumented) {
+    return;
   }
 
-  const float i = rgb2i(r1, g1, b1) - rgb2i(r2, g2, b2);
-  const float q = rgb2q(r1, g1, b1) - rgb2q(r2, g2, b2);
+  Instrumentation& to = result.instrumentation ? *result.instrumentation
+                                               : result.instrumentation.emplace();
+  to.tilesSkipped += from.tilesSkipped;
+  to.pixelsCompared += from.pixelsCompared;
+  to.pixelsAboveThreshold += from.pixelsAboveThreshold;
+  to.spansBelowThreshold += from.spansBelowThreshold;
+  to.antialiasingChecks += from.antialiasingChecks;
+  to.siblingChecks += from.siblingChecks;
+  to.bandsStoppedEarly += from.bandsStoppedEarly;
+  to.identicalImages = to.identicalImages || from.identicalImages;
+  to.identicalCheckNanoseconds += from.identicalCheckNanoseconds;
+  to.tileSearchNanoseconds += from.tileSearchNanoseconds;
+  to.colorDeltaNanoseconds += from.colorDeltaNanoseconds;
+  to.pixelLoopNanoseconds += from.pixelLoopNanoseconds;
+  to.antialiasingNanoseconds += from.antialiasingNanoseconds;
+  to.drawingNanoseconds += from.drawingNanoseconds;
+  to.totalNanoseconds += from.totalNanoseconds;
+}
 
-  const float delta = 0.5053f * y * y + 0.299f * i * i + 0.1957f * q * q;
+/// Brightness of the pixels of an image blended with white, over a window of rows starting at
+/// \ref firstRow.
+struct LumaPlane {
+  const float* data;
+  int firstRow;
+  int width;
 
-  // Encode whether the pixel lightens or darkens in the sign.
-  return y1 > y2 ? -delta : delta;
-}
+  float at(int x, int y) const { return data[static_cast<size_t>(y - firstRow) * width + x]; }
+};
 
-/// Check if a pixel has 3+ adjacent pixels of the same color.
-bool hasManySiblings(span<const uint8_t> img, int x1, int y1, int width, int height,
+/// Check if a pixel has 3+ adjacent pixels of the same color, in an image holding the rows from
+/// \ref firstRow.
+bool hasManySiblings(span<const uint8_t> img, int firstRow, int x1, int y1, int width, int height,
                      size_t strideInPixels) {
   const int x0 = std::max(x1 - 1, 0);
   const int y0 = std::max(y1 - 1, 0);
   const int x2 = std::min(x1 + 1, width - 1);
   const int y2 = std::min(y1 + 1, height - 1);
-  const size_t pos = (y1 * strideInPixels + x1) * kPixelBytes;
+  const size_t pos = (static_cast<size_t>(y1 - firstRow) * strideInPixels + x1) * kPixelBytes;
 
   size_t zeroes = x1 == x0 || x1 == x2 || y1 == y0 || y1 == y2 ? 1 : 0;
 
@@ -113,7 +134,7 @@ bool hasManySiblings(span<const uint8_t> img, int x1, int y1, int width, int hei
         continue;
       }
 
-      const size_t pos2 = (y * strideInPixels + x) * kPixelBytes;
+      const size_t pos2 = (static_cast<size_t>(y - firstRow) * strideInPixels + x) * kPixelBytes;
       if (img[pos] == img[pos2] && img[pos + 1] == img[pos2 + 1] && img[pos + 2] == img[pos2 + 2] &&
           img[pos + 3] == img[pos2 + 3]) {
         zeroes++;
@@ -132,13 +153,15 @@ bool hasManySiblings(span<const uint8_t> img, int x1, int y1, int width, int hei
  * Check if a pixel is likely a part of anti-aliasing;
  * based on "Anti-aliased Pixel and Intensity Slope Detector" paper by V. Vysniauskas, 2009
  */
-bool antialiased(span<const uint8_t> img, int x1, int y1, int width, int height,
-                 size_t strideInPixels, span<const uint8_t> img2) {
+bool antialiased(span<const uint8_t> img, int firstRow, const LumaPlane& luma, int x1, int y1,
+                 int width, int height, size_t strideInPixels, span<const uint8_t> img2,
+                 Instrumentation& counters) {
+  addCount(counters.antialiasingChecks);
   const int x0 = std::max(x1 - 1, 0);
   const int y0 = std::max(y1 - 1, 0);
   const int x2 = std::min(x1 + 1, width - 1);
   const int y2 = std::min(y1 + 1, height - 1);
-  const size_t pos = (y1 * strideInPixels + x1) * kPixelBytes;
+  const float centerLuma = luma.at(x1, y1);
 
   size_t zeroes = x1 == x0 || x1 == x2 || y1 == y0 || y1 == y2 ? 1 : 0;
   float minDelta = 0.0f;
@@ -155,8 +178,9 @@ bool antialiased(span<const uint8_t> img, int x1, int y1, int width, int height,
         continue;
       }
 
-      // Brightness delta between the center pixel and adjacent one.
-      const float delta = colorDelta(img, img, pos, (y * strideInPixels + x) * kPixelBytes, true);
+      // Brightness delta between the center pixel and adjacent one, equal to
+      // colorDelta(img, img, pos, pos2, true).
+      const float delta = centerLuma - luma.at(x, y);
 
       // Count the number of equal, darker and brighter adjacent pixels.
       if (delta == 0) {
@@ -188,10 +212,12 @@ bool antialiased(span<const uint8_t> img, int x1, int y1, int width, int height,
 
   // If either the darkest or the brightest pixel has 3+ equal siblings in both images
   // (definitely not anti-aliased), this pixel is anti-aliased.
-  return (hasManySiblings(img, minX, minY, width, height, strideInPixels) &&
-          hasManySiblings(img2, minX, minY, width, height, strideInPixels)) ||
-         (hasManySiblings(img, maxX, maxY, width, height, strideInPixels) &&
-          hasManySiblings(img2, maxX, maxY, width, height, strideInPixels));
+  const auto siblings = [&](span<const uint8_t> image, int x, int y) {
+    addCount(counters.siblingChecks);
+    return hasManySiblings(image, firstRow, x, y, width, height, strideInPixels);
+  };
+  return (siblings(img, minX, minY) && siblings(img2, minX, minY)) ||
+         (siblings(img, maxX, maxY) && siblings(img2, maxX, maxY));
 }
 
 inline void drawPixel(span<uint8_t> output, size_t pos, Color color) {
@@ -209,105 +235,1624 @@ void drawGrayPixel(span<const uint8_t> img, size_t pos, float alpha, span<uint8_
   drawPixel(output, pos, Color{val, val, val, 255});
 }
 
-}  // namespace
+/// Rows per band when splitting a comparison across threads.
+constexpr int kBandRows = 64;
 
-int pixelmatch(span<const uint8_t> img1, span<const uint8_t> img2, span<uint8_t> output, int width,
-               int height, size_t strideInPixels, Options options) {
-  // In release builds, return -1 if a precondition fails since the asserts will not trigger.
+/// Rows on each side of a band read by the anti-aliasing detection of its pixels: the neighbors of
+/// a pixel, and theirs.
+constexpr int kContextRows = 2;
+
+// Bands are split into tiles of this many columns, and only tiles that differ are compared.
+constexpr int kTileColumns = 64;
+
+// Each band fills one row of DiffResult::tileCounts, so bands never count into the same tile.
+static_assert(DiffResult::kTileSize == kBandRows && DiffResult::kTileSize == kTileColumns,
+              "DiffResult tiles must match the bands");
+
+// Each changed tile of a band is one tile of the ImagePyramid.
+static_assert(detail::kPyramidTileSize == kBandRows && detail::kPyramidTileSize == kTileColumns,
+              "ImagePyramid tiles must match the bands");
+
+// Each tile of a band is one tile of the ImageSignature.
+static_assert(detail::kSignatureTileSize == kBandRows &&
+                  detail::kSignatureTileSize == kTileColumns,
+              "ImageSignature tiles must match the bands");
+
+/// Columns [begin, end) of a row.
+struct ColumnSpan {
+  int begin;
+  int end;
+};
+
+/// Classes of the pixels recorded in Comparison::pixelClasses.
+constexpr uint8_t kSimilarPixel = 0;  //!< Identical, similar or ignored.
+constexpr uint8_t kLighterPixel = 1;
+constexpr uint8_t kDarkerPixel = 2;
+constexpr uint8_t kAntialiasedPixel = 3;
+
+/// Inputs shared by all bands of a comparison.
+struct Comparison {
+  /// Index of the first pixel of row \ref y in img1, img2 and an RGBA output.
+  size_t rowStartIndex(int y) const { return static_cast<size_t>(y - firstRow) * strideInPixels; }
+
+  span<const uint8_t> img1;
+  span<const uint8_t> img2;
+  span<uint8_t> output;
+  int width;
+  int height;
+  size_t strideInPixels;
+  const Options& options;
+  float maxDelta;
+  const detail::SimdKernels& kernels;  //!< Color delta kernels for Options::engine.
+  int maxDiffs;             //!< Stop once more than this many different pixels are found.
+  std::atomic<int>& found;  //!< Different pixels found so far, across all bands.
+  int* tileCounts;          //!< DiffResult::tileCounts, or nullptr if not counted.
+  int tileColumns;          //!< DiffResult::tileColumns.
+  bool coarseToFine;        //!< Only compare the candidate blocks, for Engine::CoarseToFine.
+  const ImagePyramid* img1Pyramid;  //!< Options::img1Pyramid, or nullptr to compute its tiles.
+  const uint8_t* matchingTiles;  //!< (Optional) One flag per tile of the bands of the image, set
+                                 //!< for the tiles of img2 matching Options::img1Signature.
+  int firstRow;  //!< First row held by img1, img2 and output: 0, unless they only hold a window of
+                 //!< rows for a StreamingComparator.
+  ColumnSpan columns;  //!< Columns compared and drawn: all of them, unless an IncrementalComparator
+                       //!< only compares its dirty rectangles.
+  uint8_t* pixelClasses;  //!< (Optional) width * height bytes, receiving the class of each
+                          //!< different and anti-aliased pixel; the others are left untouched.
+};
+
+/// Statistics gathered by one thread across its bands, merged into a DiffResult at the end.
+struct Stats {
+  Instrumentation counters;  //!< Only gathered if instrumented.
+  int antialiased = 0;
+  int darker = 0;
+  int lighter = 0;
+  int minX = std::numeric_limits<int>::max();
+  int minY = std::numeric_limits<int>::max();
+  int maxX = -1;
+  int maxY = -1;
+
+  /// Counts a different pixel at (\ref x, \ref y).
+  void addDiff(int x, int y, bool isDarker) {
+    ++(isDarker ? darker : lighter);
+    minX = std::min(minX, x);
+    minY = std::min(minY, y);
+    maxX = std::max(maxX, x);
+    maxY = std::max(maxY, y);
+  }
+
+  /// Adds these statistics to the counts and bounds of \ref result.
+  void mergeInto(DiffResult& result) const {
+    addInstrumentation(counters, result);
+    result.numAntialiasedPixels += antialiased;
+    result.numDarkerPixels += darker;
+    result.numLighterPixels += lighter;
+    if (maxX < 0) {
+      return;
+    }
+
+    if (!result.bounds) {
+      result.bounds = Rect{minX, minY, maxX - minX + 1, maxY - minY + 1};
+      return;
+    }
+
+    Rect& bounds = *result.bounds;
+    const int x0 = std::min(bounds.x, minX);
+    const int y0 = std::min(bounds.y, minY);
+    const int x1 = std::max(bounds.x + bounds.width - 1, maxX);
+    const int y1 = std::max(bounds.y + bounds.height - 1, maxY);
+    bounds = Rect{x0, y0, x1 - x0 + 1, y1 - y0 + 1};
+  }
+};
+
+/**
+ * Brightness of both images over the rows of a band and the row on each side of it, computed
+ * lazily: a row is only computed once the anti-aliasing detection needs it, and only for the
+ * changed tiles of the band plus a column on each side, since it never looks further.
+ */
+class LumaCache {
+public:
+  /// Starts caching rows [yBegin - 1, yEnd], clamped to the image.
+  void reset(const Comparison& c, int yBegin, int yEnd) {
+    firstRow_ = std::max(yBegin - 1, 0);
+    const int numRows = std::min(yEnd + 1, c.height) - firstRow_;
+
+    // Reserve for the tallest band, so that reusing the cache across bands does not allocate.
+    rowReady_.reserve(kBandRows + 2);
+    rowReady_.assign(numRows, false);
+    for (std::vector<float>& plane : planes_) {
+      plane.reserve(static_cast<size_t>(kBandRows + 2) * c.width);
+      plane.resize(static_cast<size_t>(numRows) * c.width);
+    }
+  }
+
+  /// Returns the planes of img1 and img2, with rows \ref y - 1 to \ref y + 1 computed.
+  std::array<LumaPlane, 2> rowsAround(const Comparison& c, int y,
+                                      const std::vector<ColumnSpan>& changedSpans) {
+    for (int row = std::max(y - 1, 0); row <= std::min(y + 1, c.height - 1); ++row) {
+      if (!rowReady_[row - firstRow_]) {
+        computeRow(c, row, changedSpans);
+        rowReady_[row - firstRow_] = true;
+      }
+    }
+
+    return {LumaPlane{planes_[0].data(), firstRow_, c.width},
+            LumaPlane{planes_[1].data(), firstRow_, c.width}};
+  }
+
+private:
+  void computeRow(const Comparison& c, int y, const std::vector<ColumnSpan>& changedSpans) {
+    const size_t rowStartIndex = c.rowStartIndex(y);
+    const size_t planeStartIndex = static_cast<size_t>(y - firstRow_) * c.width;
+    for (const ColumnSpan& columns : changedSpans) {
+      const int xBegin = std::max(columns.begin - 1, 0);
+      const int xEnd = std::min(columns.end + 1, c.width);
+      for (int x = xBegin; x < xEnd; ++x) {
+        const size_t pos = (rowStartIndex + x) * kPixelBytes;
+        planes_[0][planeStartIndex + x] = blendedY(c.img1.data() + pos);
+        planes_[1][planeStartIndex + x] = blendedY(c.img2.data() + pos);
+      }
+    }
+  }
+
+  int firstRow_ = 0;
+  std::vector<bool> rowReady_;
+  std::array<std::vector<float>, 2> planes_;
+};
+
+/// Per-thread scratch buffers.
+struct Scratch {
+  LumaCache luma;
+  std::vector<float> deltas;
+  std::vector<ColumnSpan> ignoredSpans;
+  std::vector<ColumnSpan> unignoredSpans;
+  std::vector<ColumnSpan> changedSpans;
+  std::vector<ColumnSpan> spans;
+  Stats stats;
+  std::vector<DiffPixel> diffPixels;
+  std::vector<DiffPixel> antialiasedPixels;
+  /// With Engine::CoarseToFine, the candidate blocks of the band as spans of each row of blocks,
+  /// and the pyramid tiles computed on the fly.
+  std::array<std::vector<ColumnSpan>, detail::kPyramidTileBlocks> candidateSpans;
+  std::vector<detail::ColorRange> ranges1;
+  std::vector<detail::ColorRange> ranges2;
+
+  /// Reserves the buffers for the largest possible row of \ref c, so that reusing them across
+  /// bands and comparisons of the same size does not allocate.
+  void reserve(const Comparison& c) {
+    const size_t numTiles = (c.width + kTileColumns - 1) / kTileColumns;
+    const size_t numRegions = c.options.ignoreRegions.size();
+    deltas.resize(c.width);
+    ignoredSpans.reserve(numRegions);
+    unignoredSpans.reserve(numRegions + 1);
+    changedSpans.reserve(numTiles);
+    spans.reserve(numTiles + numRegions + 1);
+    if (c.coarseToFine) {
+      // Candidate blocks alternate with skipped ones at worst.
+      for (std::vector<ColumnSpan>& blockSpans : candidateSpans) {
+        blockSpans.reserve(c.width / (2 * detail::kPyramidBlockSize) + 1);
+      }
+      ranges1.resize(detail::kPyramidTileRanges);
+      ranges2.resize(detail::kPyramidTileRanges);
+    }
+  }
+};
+
+/// Values of the pixels of an OutputFormat::ByteMask output.
+constexpr uint8_t kMaskDiff = 1;
+constexpr uint8_t kMaskAntialiased = 2;
+
+/// Bytes per row of an output in one of the mask formats.
+size_t maskRowBytes(OutputFormat format, int width) {
+  return format == OutputFormat::BitMask ? (static_cast<size_t>(width) + 7) / 8
+                                         : static_cast<size_t>(width);
+}
+
+/// Clears the compared columns of row \ref y of an output in one of the mask formats, which are
+/// then only written to for different and anti-aliased pixels. Clearing up to the last column also
+/// clears the padding bits of OutputFormat::BitMask.
+void clearMaskRow(const Comparison& c, int y) {
+  span<uint8_t> output = c.output;
+  const size_t rowBytes = maskRowBytes(c.options.outputFormat, c.width);
+  const size_t rowStart = (y - c.firstRow) * rowBytes;
+  if (c.options.outputFormat == OutputFormat::ByteMask) {
+    std::memset(&output[rowStart + c.columns.begin], 0, c.columns.end - c.columns.begin);
+    return;
+  }
+
+  const int end = c.columns.end == c.width ? static_cast<int>(rowBytes) * 8 : c.columns.end;
+  for (int x = c.columns.begin; x < end;) {
+    if (x % 8 == 0 && x + 8 <= end) {
+      const int bytes = (end - x) / 8;
+      std::memset(&output[rowStart + x / 8], 0, bytes);
+      x += bytes * 8;
+    } else {
+      output[rowStart + x / 8] &= static_cast<uint8_t>(~(1u << (x % 8)));
+      ++x;
+    }
+  }
+}
+
+/// Marks pixel (\ref x, \ref y) of an output in one of the mask formats with \ref value.
+void markPixel(const Comparison& c, int x, int y, uint8_t value) {
+  span<uint8_t> output = c.output;
+  if (c.options.outputFormat == OutputFormat::ByteMask) {
+    output[static_cast<size_t>(y - c.firstRow) * c.width + x] = value;
+  } else if (value == kMaskDiff) {
+    const size_t rowBytes = maskRowBytes(OutputFormat::BitMask, c.width);
+    output[(y - c.firstRow) * rowBytes + x / 8] |= uint8_t(1) << (x % 8);
+  }
+}
+
+/// Fills columns [xBegin, xEnd) of row \ref y of the output with the grayscale image.
+void drawGrayPixels(const Comparison& c, int y, int xBegin, int xEnd) {
+  const size_t rowStartIndex = c.rowStartIndex(y);
+  for (int x = xBegin; x < xEnd; ++x) {
+    const size_t pos = (rowStartIndex + x) * kPixelBytes;
+    drawGrayPixel(c.img1, pos, c.options.alpha, c.output);
+  }
+}
+
+/// Fills rows [yBegin, yEnd) of the output with the grayscale image, for identical images.
+void drawGrayRows(const Comparison& c, int yBegin, int yEnd) {
+  for (int y = yBegin; y < yEnd; ++y) {
+    drawGrayPixels(c, y, 0, c.width);
+  }
+}
+
+/// Finds the tiles of rows [yBegin, yEnd) where the images differ, merging adjacent tiles into
+/// spans. Identical pixels have a delta of zero, so other tiles can never contain differences; the
+/// anti-aliasing detection of pixels near a tile edge still reads the neighboring tiles.
+/// With Comparison::matchingTiles, the rows must be a band of the image.
+void findChangedTiles(const Comparison& c, int yBegin, int yEnd, Scratch& scratch) {
+  std::vector<ColumnSpan>& changed = scratch.changedSpans;
+  changed.clear();
+  const int tileColumns = (c.width + kTileColumns - 1) / kTileColumns;
+  for (int xBegin = c.columns.begin; xBegin < c.columns.end; xBegin += kTileColumns) {
+    const int xEnd = std::min(xBegin + kTileColumns, c.columns.end);
+    bool tileChanged = false;
+    if (c.matchingTiles) {
+      tileChanged = !c.matchingTiles[(yBegin / kBandRows) * tileColumns + xBegin / kTileColumns];
+    }
+    for (int y = yBegin; y < yEnd && !tileChanged && !c.matchingTiles; ++y) {
+      const size_t pos = (c.rowStartIndex(y) + xBegin) * kPixelBytes;
+      tileChanged =
+          std::memcmp(c.img1.data() + pos, c.img2.data() + pos, (xEnd - xBegin) * kPixelBytes) != 0;
+    }
+
+    if (!tileChanged) {
+      addCount(scratch.stats.counters.tilesSkipped);
+      continue;
+    }
+
+    if (!changed.empty() && changed.back().end == xBegin) {
+      changed.back().end = xEnd;
+    } else {
+      changed.push_back(ColumnSpan{xBegin, xEnd});
+    }
+  }
+}
+
+/// With Engine::CoarseToFine, finds the blocks of the changed tiles of the band starting at
+/// \ref yBegin that may hold pixels above the threshold, as spans of each row of blocks. Other
+/// pixels can neither be different nor anti-aliased, since both require a delta above it.
+void findCandidateSpans(const Comparison& c, int yBegin, Scratch& scratch) {
+  for (std::vector<ColumnSpan>& blockSpans : scratch.candidateSpans) {
+    blockSpans.clear();
+  }
+
+  const int tileY = yBegin / detail::kPyramidTileSize;
+  const int rows = std::min(detail::kPyramidTileSize, c.height - yBegin);
+  for (const ColumnSpan& columns : scratch.changedSpans) {
+    for (int xBegin = columns.begin; xBegin < columns.end; xBegin += kTileColumns) {
+      const int tileX = xBegin / kTileColumns;
+      const int tileColumns = std::min(kTileColumns, c.width - xBegin);
+      const size_t pos = (c.rowStartIndex(yBegin) + xBegin) * kPixelBytes;
+      const detail::ColorRange* ranges1 = scratch.ranges1.data();
+      if (c.img1Pyramid) {
+        ranges1 = c.img1Pyramid->tileRanges(tileX, tileY);
+      } else {
+        detail::computeTileRanges(c.img1.data() + pos, tileColumns, rows, c.strideInPixels,
+                                  scratch.ranges1.data());
+      }
+      detail::computeTileRanges(c.img2.data() + pos, tileColumns, rows, c.strideInPixels,
+                                scratch.ranges2.data());
+
+      uint16_t flagged[detail::kPyramidTileBlocks];
+      detail::findCandidateBlocks(ranges1, scratch.ranges2.data(), c.maxDelta, flagged);
+      for (int row = 0; row < detail::kPyramidTileBlocks; ++row) {
+        std::vector<ColumnSpan>& blockSpans = scratch.candidateSpans[row];
+        for (int block = 0; block < detail::kPyramidTileBlocks; ++block) {
+          if ((flagged[row] >> block & 1) == 0) {
+            continue;
+          }
+
+          // Blocks past the edges of the image are never flagged.
+          const int begin = xBegin + block * detail::kPyramidBlockSize;
+          const int end = std::min(begin + detail::kPyramidBlockSize, c.width);
+          if (!blockSpans.empty() && blockSpans.back().end == begin) {
+            blockSpans.back().end = end;
+          } else {
+            blockSpans.push_back(ColumnSpan{begin, end});
+          }
+        }
+      }
+    }
+  }
+}
+
+/// Computes the spans of row \ref y that are not covered by Options::ignoreRegions.
+void findUnignoredSpans(const Comparison& c, int y, Scratch& scratch) {
+  std::vector<ColumnSpan>& ignored = scratch.ignoredSpans;
+  ignored.clear();
+  for (const Rect& rect : c.options.ignoreRegions) {
+    if (y >= rect.y && int64_t(y) - rect.y < rect.height) {
+      const int begin = std::max(rect.x, 0);
+      const int end = static_cast<int>(std::min<int64_t>(int64_t(rect.x) + rect.width, c.width));
+      if (begin < end) {
+        ignored.push_back(ColumnSpan{begin, end});
+      }
+    }
+  }
+
+  std::sort(ignored.begin(), ignored.end(),
+            [](const ColumnSpan& a, const ColumnSpan& b) { return a.begin < b.begin; });
+
+  std::vector<ColumnSpan>& spans = scratch.unignoredSpans;
+  spans.clear();
+  int x = 0;
+  for (const ColumnSpan& columns : ignored) {
+    if (columns.begin > x) {
+      spans.push_back(ColumnSpan{x, columns.begin});
+    }
+    x = std::max(x, columns.end);
+  }
+
+  if (x < c.width) {
+    spans.push_back(ColumnSpan{x, c.width});
+  }
+}
+
+/// Computes the spans of row \ref y to compare, in order: the changed tiles of the band, or their
+/// candidate blocks with Engine::CoarseToFine, with Options::ignoreRegions cut out. Expects
+/// \ref findChangedTiles and \ref findCandidateSpans to have run for the band.
+void spansToCompare(const Comparison& c, int y, Scratch& scratch) {
+  std::vector<ColumnSpan>& spans = scratch.spans;
+  const std::vector<ColumnSpan>& changed =
+      c.coarseToFine ? scratch.candidateSpans[(y % kBandRows) / detail::kPyramidBlockSize]
+                     : scratch.changedSpans;
+  if (c.options.ignoreRegions.empty()) {
+    spans = changed;
+    return;
+  }
+
+  findUnignoredSpans(c, y, scratch);
+
+  // Intersect the two sorted lists of spans.
+  spans.clear();
+  const std::vector<ColumnSpan>& unignored = scratch.unignoredSpans;
+  size_t i = 0;
+  size_t j = 0;
+  while (i < changed.size() && j < unignored.size()) {
+    const int begin = std::max(changed[i].begin, unignored[j].begin);
+    const int end = std::min(changed[i].end, unignored[j].end);
+    if (begin < end) {
+      spans.push_back(ColumnSpan{begin, end});
+    }
+
+    if (changed[i].end < unignored[j].end) {
+      ++i;
+    } else {
+      ++j;
+    }
+  }
+}
+
+/// What \ref compareRows draws for each pixel.
+enum class Drawing {
+  None,          //!< No output.
+  Rgba,          //!< OutputFormat::Rgba, with the grayscale image in the background.
+  RgbaDiffMask,  //!< OutputFormat::Rgba with Options::diffMask: only different pixels are drawn.
+  Mask,          //!< OutputFormat::ByteMask or OutputFormat::BitMask.
+};
+
+Drawing drawingFor(const Comparison& c) {
+  if (c.output.empty()) {
+    return Drawing::None;
+  }
+  if (c.options.outputFormat != OutputFormat::Rgba) {
+    return Drawing::Mask;
+  }
+  return c.options.diffMask ? Drawing::RgbaDiffMask : Drawing::Rgba;
+}
+
+/// Returns true if the pixels of both images are all opaque within the changed tiles of rows
+/// [yBegin, yEnd), which \ref findChangedTiles must have found.
+bool changedTilesOpaque(const Comparison& c, int yBegin, int yEnd, const Scratch& scratch) {
+  for (int y = yBegin; y < yEnd; ++y) {
+    const size_t rowStartIndex = c.rowStartIndex(y);
+    for (const ColumnSpan& columns : scratch.changedSpans) {
+      // AND the pixels together, which vectorizes, then check the alpha of the result.
+      uint32_t all = ~0u;
+      for (int x = columns.begin; x < columns.end; ++x) {
+        const size_t pos = (rowStartIndex + x) * kPixelBytes;
+        uint32_t px1;
+        uint32_t px2;
+        std::memcpy(&px1, c.img1.data() + pos, sizeof(px1));
+        std::memcpy(&px2, c.img2.data() + pos, sizeof(px2));
+        all &= px1 & px2;
+      }
+
+      uint8_t bytes[kPixelBytes];
+      std::memcpy(bytes, &all, sizeof(bytes));
+      if (bytes[3] != 255) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+/// Compares rows [yBegin, yEnd), adding the number of different pixels to \ref Comparison::found.
+/// Only writes to these rows of the output, but reads the neighboring rows for anti-aliasing
+/// detection. Returns early once \ref Comparison::maxDiffs is exceeded, by any band.
+///
+/// The options tested for each pixel are template parameters, so that each combination compiles
+/// to a loop without them; \ref compareRowsFor picks the one matching a comparison.
+template <Drawing kDrawing, bool kIncludeAA, bool kDiffColorAlt>
+void compareRows(const Comparison& c, int yBegin, int yEnd, Scratch& scratch) {
+  const Options& options = c.options;
+  const span<const uint8_t> img1 = c.img1;
+  const span<const uint8_t> img2 = c.img2;
+  const span<uint8_t> output = c.output;
+  const int width = c.width;
+  const int height = c.height;
+  const size_t strideInPixels = c.strideInPixels;
+
+  constexpr bool kRgbaOutput = kDrawing == Drawing::Rgba || kDrawing == Drawing::RgbaDiffMask;
+  constexpr bool kMaskOutput = kDrawing == Drawing::Mask;
+  constexpr bool kDrawBackground = kDrawing == Drawing::Rgba;
+
+  Instrumentation& counters = scratch.stats.counters;
+  scratch.reserve(c);
+  detail::ColorDeltaRowFn colorDeltaRow;
+  {
+    PhaseTimer timer(counters.tileSearchNanoseconds);
+    findChangedTiles(c, yBegin, yEnd, scratch);
+    // Most screenshots are opaque, and their deltas need no blend with white.
+    colorDeltaRow = changedTilesOpaque(c, yBegin, yEnd, scratch) ? c.kernels.colorDeltaRowOpaque
+                                                                 : c.kernels.colorDeltaRow;
+    if (c.coarseToFine) {
+      findCandidateSpans(c, yBegin, scratch);
+    }
+  }
+  // The brightness still covers the changed tiles, for the anti-aliasing detection of pixels at the
+  // edges of candidate blocks.
+  scratch.luma.reset(c, yBegin, yEnd);
+
+  for (int y = yBegin; y < yEnd; ++y) {
+    // Differences found so far by all bands, including this one.
+    const int found = c.found.load(std::memory_order_relaxed);
+    if (found > c.maxDiffs) {
+      addCount(counters.bandsStoppedEarly);
+      return;
+    }
+
+    const int remaining = c.maxDiffs - found;
+    const size_t rowStartIndex = c.rowStartIndex(y);
+    const uint8_t* ignoreMaskRow =
+        options.ignoreMask.empty() ? nullptr : options.ignoreMask.data() + size_t(y) * width;
+    if (kMaskOutput) {
+      PhaseTimer timer(counters.drawingNanoseconds);
+      clearMaskRow(c, y);
+    }
+    std::optional<std::array<LumaPlane, 2>> luma;
+    int diff = 0;
+    // The deltas are computed straight into the row of the delta map, if there is one.
+    float* deltaMapRow =
+        options.deltaMap.empty() ? nullptr : options.deltaMap.data() + size_t(y) * width;
+    float* deltas = deltaMapRow ? deltaMapRow : scratch.deltas.data();
+
+    // Identical tiles and ignored regions are skipped entirely, and only drawn as background.
+    spansToCompare(c, y, scratch);
+    int drawnEnd = c.columns.begin;
+    for (const ColumnSpan& columns : scratch.spans) {
+      if (kDrawBackground) {
+        PhaseTimer timer(counters.drawingNanoseconds);
+        drawGrayPixels(c, y, drawnEnd, columns.begin);
+      }
+      if (deltaMapRow) {
+        std::fill(deltaMapRow + drawnEnd, deltaMapRow + columns.begin, 0.0f);
+      }
+      drawnEnd = columns.end;
+
+      // Squared YUV distance between colors at each pixel position of the span, negative if the
+      // img2 pixel is darker.
+      const size_t startIndex = rowStartIndex + columns.begin;
+      bool aboveThreshold;
+      {
+        PhaseTimer timer(counters.colorDeltaNanoseconds);
+        aboveThreshold = colorDeltaRow(
+            img1.data() + startIndex * kPixelBytes, img2.data() + startIndex * kPixelBytes,
+            columns.end - columns.begin, c.maxDelta, deltas + columns.begin);
+      }
+      if (deltaMapRow && ignoreMaskRow) {
+        for (int x = columns.begin; x < columns.end; ++x) {
+          if (ignoreMaskRow[x]) {
+            deltaMapRow[x] = 0.0f;
+          }
+        }
+      }
+      addCount(counters.pixelsCompared, columns.end - columns.begin);
+      if (!aboveThreshold) {
+        addCount(counters.spansBelowThreshold);
+        if (!kDrawBackground) {
+          continue;
+        }
+      }
+
+      PhaseTimer pixelLoopTimer(counters.pixelLoopNanoseconds);
+      for (int x = columns.begin; x < columns.end; ++x) {
+        const size_t pos = (rowStartIndex + x) * kPixelBytes;
+        const float delta = deltas[x];
+
+        // The color difference is above the threshold.
+        if (std::abs(delta) > c.maxDelta && !(ignoreMaskRow && ignoreMaskRow[x])) {
+          addCount(counters.pixelsAboveThreshold);
+          // Check it's a real rendering difference or just anti-aliasing.
+          bool isAntialiased = false;
+          if (!kIncludeAA) {
+            PhaseTimer timer(counters.antialiasingNanoseconds);
+            if (!luma) {
+              luma = scratch.luma.rowsAround(c, y, scratch.changedSpans);
+            }
+            isAntialiased = antialiased(img1, c.firstRow, (*luma)[0], x, y, width, height,
+                                        strideInPixels, img2, counters) ||
+                            antialiased(img2, c.firstRow, (*luma)[1], x, y, width, height,
+                                        strideInPixels, img1, counters);
+          }
+          if (isAntialiased) {
+            // One of the pixels is anti-aliasing; draw as yellow and do not count as difference
+            // note that we do not include such pixels in a mask.
+            if (kDrawBackground) {
+              drawPixel(output, pos, options.aaColor);
+            } else if (kMaskOutput) {
+              markPixel(c, x, y, kMaskAntialiased);
+            }
+            ++scratch.stats.antialiased;
+            if (c.pixelClasses) {
+              c.pixelClasses[size_t(y) * width + x] = kAntialiasedPixel;
+            }
+            if (options.collectAntialiasedPixels) {
+              scratch.antialiasedPixels.push_back(DiffPixel{x, y, delta});
+            }
+          } else {
+            // Found substantial difference not caused by anti-aliasing; draw it as such.
+            if (kRgbaOutput) {
+              drawPixel(output, pos,
+                        kDiffColorAlt && delta < 0.0f ? *options.diffColorAlt : options.diffColor);
+            } else if (kMaskOutput) {
+              markPixel(c, x, y, kMaskDiff);
+            }
+            scratch.stats.addDiff(x, y, delta < 0.0f);
+            if (c.pixelClasses) {
+              c.pixelClasses[size_t(y) * width + x] = delta < 0.0f ? kDarkerPixel : kLighterPixel;
+            }
+            if (options.collectDiffPixels) {
+              scratch.diffPixels.push_back(DiffPixel{x, y, delta});
+            }
+            if (c.tileCounts) {
+              ++c.tileCounts[(y / kBandRows) * c.tileColumns + x / kTileColumns];
+            }
+            diff++;
+            if (diff > remaining) {
+              addCount(counters.bandsStoppedEarly);
+              c.found.fetch_add(diff, std::memory_order_relaxed);
+              return;
+            }
+          }
+
+        } else if (kDrawBackground) {
+          // Pixels are similar or ignored; draw background as grayscale image blended with white.
+          drawGrayPixel(img1, pos, options.alpha, output);
+        }
+      }
+    }
+
+    if (kDrawBackground) {
+      PhaseTimer timer(counters.drawingNanoseconds);
+      drawGrayPixels(c, y, drawnEnd, c.columns.end);
+    }
+    if (deltaMapRow) {
+      std::fill(deltaMapRow + drawnEnd, deltaMapRow + c.columns.end, 0.0f);
+    }
+
+    if (diff != 0) {
+      c.found.fetch_add(diff, std::memory_order_relaxed);
+    }
+  }
+}
+
+using CompareRowsFn = void (*)(const Comparison& c, int yBegin, int yEnd, Scratch& scratch);
+
+template <Drawing kDrawing, bool kIncludeAA>
+CompareRowsFn selectDiffColorAlt(const Comparison& c) {
+  // Only RGBA outputs draw the darker pixels in another color.
+  if constexpr (kDrawing == Drawing::Rgba || kDrawing == Drawing::RgbaDiffMask) {
+    if (c.options.diffColorAlt) {
+      return &compareRows<kDrawing, kIncludeAA, true>;
+    }
+  }
+  return &compareRows<kDrawing, kIncludeAA, false>;
+}
+
+template <Drawing kDrawing>
+CompareRowsFn selectIncludeAA(const Comparison& c) {
+  return c.options.includeAA ? selectDiffColorAlt<kDrawing, true>(c)
+                             : selectDiffColorAlt<kDrawing, false>(c);
+}
+
+/// Returns the instantiation of \ref compareRows for the options of \ref c.
+CompareRowsFn compareRowsFor(const Comparison& c) {
+  switch (drawingFor(c)) {
+    case Drawing::None:
+      return selectIncludeAA<Drawing::None>(c);
+    case Drawing::Rgba:
+      return selectIncludeAA<Drawing::Rgba>(c);
+    case Drawing::RgbaDiffMask:
+      return selectIncludeAA<Drawing::RgbaDiffMask>(c);
+    case Drawing::Mask:
+      return selectIncludeAA<Drawing::Mask>(c);
+  }
+  return nullptr;
+}
+
+/// Appends the pixels listed by each thread to \ref pixels, in row-major order. The pixels must
+/// follow those already in \ref pixels.
+void mergePixels(span<Scratch> scratch, std::vector<DiffPixel> Scratch::*list,
+                 std::vector<DiffPixel>& pixels) {
+  const size_t merged = pixels.size();
+  for (size_t thread = 0; thread < scratch.size(); ++thread) {
+    const std::vector<DiffPixel>& threadPixels = scratch[thread].*list;
+    pixels.insert(pixels.end(), threadPixels.begin(), threadPixels.end());
+  }
+
+  // Each thread lists its bands in order, but threads pick up bands in any order.
+  std::sort(pixels.begin() + merged, pixels.end(), [](const DiffPixel& a, const DiffPixel& b) {
+    return a.y != b.y ? a.y < b.y : a.x < b.x;
+  });
+}
+
+/// Number of bands of rows [yBegin, yEnd), counted from \ref yBegin.
+int numBandsIn(int yBegin, int yEnd) { return (yEnd - yBegin + kBandRows - 1) / kBandRows; }
+
+/// Runs \ref fn(yBegin, yEnd, band, thread) for each band of rows [yBegin, yEnd), counted from
+/// \ref yBegin, on \ref pool if set.
+template <typename Fn>
+void forEachBand(int yBegin, int yEnd, detail::ThreadPool* pool, Fn&& fn) {
+  const size_t numBands = numBandsIn(yBegin, yEnd);
+  // Small enough a capture for the std::function of the pool not to allocate.
+  auto runBand = [&fn, yBegin, yEnd](size_t band, size_t thread) {
+    const int bandBegin = yBegin + static_cast<int>(band) * kBandRows;
+    fn(bandBegin, std::min(bandBegin + kBandRows, yEnd), band, thread);
+  };
+
+  if (pool) {
+    pool->parallelFor(numBands, runBand);
+  } else {
+    for (size_t band = 0; band < numBands; ++band) {
+      runBand(band, 0);
+    }
+  }
+}
+
+/// Reusable resources for comparisons: per-thread scratch buffers, and a thread pool created on
+/// first use.
+class Workspace {
+public:
+  /// Creates a workspace for up to \ref numThreads threads, where 0 is the hardware concurrency.
+  explicit Workspace(int numThreads)
+      : numThreads_(detail::ThreadPool::resolveNumThreads(numThreads)) {}
+
+  /// Returns the maximum number of threads, with 0 resolved to the hardware concurrency.
+  int numThreads() const { return numThreads_; }
+
+  /// Returns a pool to split \ref numBands bands across, or nullptr to run them on this thread.
+  detail::ThreadPool* poolFor(int numBands) {
+    const int wanted = std::min(numThreads_, numBands);
+    if (wanted <= 1) {
+      return nullptr;
+    }
+
+    if (!pool_ || pool_->numThreads() < static_cast<size_t>(wanted)) {
+      pool_.reset();
+      pool_ = std::make_unique<detail::ThreadPool>(wanted);
+    }
+
+    return pool_.get();
+  }
+
+  /// Returns scratch buffers for each thread of \ref pool, or for this thread if it is nullptr.
+  span<Scratch> scratchFor(const detail::ThreadPool* pool) {
+    scratch_.resize(pool ? pool->numThreads() : 1);
+    return scratch_;
+  }
+
+  /// Flags of the tiles of img2 matching Options::img1Signature, see Comparison::matchingTiles.
+  std::vector<uint8_t>& matchingTiles() { return matchingTiles_; }
+
+  /// Lower bounds of the different pixels of each tile, from the signatures of both images.
+  std::vector<int>& tileMinDiffs() { return tileMinDiffs_; }
+
+private:
+  int numThreads_;
+  std::unique_ptr<detail::ThreadPool> pool_;
+  std::vector<Scratch> scratch_;
+  std::vector<uint8_t> matchingTiles_;
+  std::vector<int> tileMinDiffs_;
+};
+
+/// Maximum acceptable square distance between two colors;
+/// 35215 is the maximum possible value for the YIQ difference metric
+float maxDeltaFor(const Options& options) {
+  return 35215.0f * options.threshold * options.threshold;
+}
+
+/// Whether a comparison only computes the deltas of the candidate blocks of Engine::CoarseToFine,
+/// which it cannot do when the delta map needs them all.
+bool usesCoarseToFine(const Options& options) {
+  return options.engine == Engine::CoarseToFine && options.deltaMap.empty();
+}
+
+const detail::SimdKernels& kernelsFor(const Options& options) {
+  return options.engine == Engine::FixedPoint ? detail::fixedPointKernels()
+                                              : detail::bestKernels();
+}
+
+/// Returns DiffResult::numDiffPixels for the number of different pixels found. Bands stopping early
+/// may overshoot the limit together.
+int clampDiffs(int found, int maxDiffs) { return found > maxDiffs ? maxDiffs + 1 : found; }
+
+/// Compares the bands of rows [yBegin, yEnd) on the threads of \ref workspace, and merges their
+/// statistics and pixels into \ref result. With Engine::CoarseToFine, \ref yBegin must start a
+/// band of the image, so that the bands are tiles of the ImagePyramid.
+void compareBands(const Comparison& c, int yBegin, int yEnd, Workspace& workspace,
+                  DiffResult& result) {
+  detail::ThreadPool* pool = workspace.poolFor(numBandsIn(yBegin, yEnd));
+  span<Scratch> scratch = workspace.scratchFor(pool);
+  for (size_t thread = 0; thread < scratch.size(); ++thread) {
+    scratch[thread].stats = Stats();
+    scratch[thread].diffPixels.clear();
+    scratch[thread].antialiasedPixels.clear();
+  }
+
+  // Compare each pixel of one image against the other one.
+  const CompareRowsFn compareBand = compareRowsFor(c);
+  forEachBand(yBegin, yEnd, pool, [&](int bandBegin, int bandEnd, size_t, size_t thread) {
+    compareBand(c, bandBegin, bandEnd, scratch[thread]);
+  });
+
+  for (size_t thread = 0; thread < scratch.size(); ++thread) {
+    scratch[thread].stats.mergeInto(result);
+  }
+
+  if (c.options.collectDiffPixels) {
+    mergePixels(scratch, &Scratch::diffPixels, result.diffPixels);
+  }
+  if (c.options.collectAntialiasedPixels) {
+    mergePixels(scratch, &Scratch::antialiasedPixels, result.antialiasedPixels);
+  }
+}
+
+/**
+ * Checks the preconditions of pixelmatch() on its arguments, other than Options::numThreads.
+ * Asserts in debug builds; in release builds, returns false so that the comparison returns -1.
+ */
+bool checkArguments(span<const uint8_t> img1, span<const uint8_t> img2, span<uint8_t> output,
+                    int width, int height, size_t strideInPixels, const Options& options) {
   if (width <= 0 || height <= 0 || strideInPixels < static_cast<size_t>(width)) {
     assert(width > 0);
     assert(height > 0);
     assert(strideInPixels >= static_cast<size_t>(width) && "Stride must be greater than width");
-    return -1;
+    return false;
   }
 
-  if (img1.size() != strideInPixels * height * kPixelBytes || img1.size() != img2.size()) {
-    assert(img1.size() == strideInPixels * height * kPixelBytes &&
-           "Image data size does not match width/height");
-    assert(img2.size() == strideInPixels * height * kPixelBytes &&
+  if (!isImageSize(img1.size(), width, height, strideInPixels) || img1.size() != img2.size()) {
+    assert(isImageSize(img1.size(), width, height, strideInPixels) &&
            "Image data size does not match width/height");
-    return -1;
+    assert(img2.size() == img1.size() && "Image data size does not match width/height");
+    return false;
   }
 
-  if (output.size() != img1.size() && !output.empty()) {
-    assert(img1.size() == output.size() || output.empty());
-    return -1;
+  const size_t outputSize = options.outputFormat == OutputFormat::Rgba
+                                ? img1.size()
+                                : maskRowBytes(options.outputFormat, width) * height;
+  if (output.size() != outputSize && !output.empty()) {
+    assert((options.outputFormat != OutputFormat::Rgba || img1.size() == output.size() ||
+            output.empty()) &&
+           "Output size does not match img1");
+    assert((options.outputFormat == OutputFormat::Rgba || output.size() == outputSize) &&
+           "Mask output size does not match width/height");
+    return false;
+  }
+
+  if (!options.ignoreMask.empty() &&
+      options.ignoreMask.size() != static_cast<size_t>(width) * height) {
+    assert(options.ignoreMask.size() == static_cast<size_t>(width) * height &&
+           "Ignore mask size does not match width/height");
+    return false;
+  }
+
+  if (!options.deltaMap.empty() &&
+      options.deltaMap.size() != static_cast<size_t>(width) * height) {
+    assert(options.deltaMap.size() == static_cast<size_t>(width) * height &&
+           "Delta map size does not match width/height");
+    return false;
+  }
+
+  if (options.maxDiffs && *options.maxDiffs < 0) {
+    assert(*options.maxDiffs >= 0 && "maxDiffs must be >= 0");
+    return false;
+  }
+
+  const ImagePyramid* img1Pyramid =
+      options.engine == Engine::CoarseToFine ? options.img1Pyramid : nullptr;
+  if (img1Pyramid && (img1Pyramid->width() != width || img1Pyramid->height() != height)) {
+    assert(img1Pyramid->width() == width && img1Pyramid->height() == height &&
+           "img1Pyramid size does not match width/height");
+    return false;
+  }
+
+  const ImageSignature* img1Signature = options.img1Signature;
+  if (img1Signature && (img1Signature->width() != width || img1Signature->height() != height)) {
+    assert(img1Signature->width() == width && img1Signature->height() == height &&
+           "img1Signature size does not match width/height");
+    return false;
   }
 
-  // Check for identical images, respecting stride.
+  return true;
+}
+
+/// Returns true if \ref rect, a tile of the image, overlaps Options::ignoreRegions.
+bool overlapsIgnoreRegions(const Rect& rect, const Options& options) {
+  return std::any_of(options.ignoreRegions.begin(), options.ignoreRegions.end(),
+                     [&](const Rect& region) {
+                       return int64_t(region.x) < rect.x + rect.width &&
+                              int64_t(region.x) + region.width > rect.x &&
+                              int64_t(region.y) < rect.y + rect.height &&
+                              int64_t(region.y) + region.height > rect.y;
+                     });
+}
+
+/**
+ * Hashes the tiles of img2 on the threads of \ref workspace, flagging those that match
+ * Options::img1Signature in Workspace::matchingTiles. Only reads img2.
+ *
+ * If \ref minDiffs is set, also computes the mean YIQ of the tiles that do not match, to bound the
+ * number of different pixels from below. Only the tiles without ignored pixels count, since the
+ * bound holds for pixels above the threshold, which are all different pixels with
+ * Options::includeAA.
+ *
+ * @return True if all tiles match, so that the images are identical.
+ */
+bool matchSignature(span<const uint8_t> img2, int width, int height, size_t strideInPixels,
+                    const Options& options, Workspace& workspace, int64_t* minDiffs) {
+  const ImageSignature& signature = *options.img1Signature;
+  const size_t numTiles = static_cast<size_t>(signature.tileColumns()) * signature.tileRows();
+  std::vector<uint8_t>& matching = workspace.matchingTiles();
+  std::vector<int>& tileMinDiffs = workspace.tileMinDiffs();
+  matching.assign(numTiles, 0);
+  tileMinDiffs.assign(minDiffs ? numTiles : 0, 0);
+
+  const float maxDelta = maxDeltaFor(options);
+  forEachBand(0, height, workspace.poolFor(numBandsIn(0, height)),
+              [&](int yBegin, int yEnd, size_t tileY, size_t) {
+                for (int tileX = 0; tileX < signature.tileColumns(); ++tileX) {
+                  const Rect rect{tileX * kTileColumns, yBegin,
+                                  std::min(kTileColumns, width - tileX * kTileColumns),
+                                  yEnd - yBegin};
+                  const uint8_t* pixels =
+                      img2.data() + (yBegin * strideInPixels + rect.x) * kPixelBytes;
+                  const size_t tile = tileY * signature.tileColumns() + tileX;
+                  const uint64_t hash =
+                      detail::hashTile(pixels, rect.width, rect.height, strideInPixels);
+                  matching[tile] = hash == signature.tileHash(tileX, int(tileY));
+                  if (minDiffs && !matching[tile] && !overlapsIgnoreRegions(rect, options)) {
+                    tileMinDiffs[tile] = detail::minPixelsAboveThreshold(
+                        signature.tileMean(tileX, int(tileY)),
+                        detail::meanTileYiq(pixels, rect.width, rect.height, strideInPixels),
+                        rect.width * rect.height, maxDelta);
+                  }
+                }
+              });
+
+  if (minDiffs) {
+    *minDiffs = std::accumulate(tileMinDiffs.begin(), tileMinDiffs.end(), int64_t(0));
+  }
+  return std::all_of(matching.begin(), matching.end(), [](uint8_t match) { return match != 0; });
+}
+
+/**
+ * Implements both overloads of pixelmatch(), using \ref workspace for scratch memory and threads.
+ * If set, \ref pixelClasses receives the class of each different and anti-aliased pixel.
+ */
+DiffResult compareImages(span<const uint8_t> img1, span<const uint8_t> img2, span<uint8_t> output,
+                         int width, int height, size_t strideInPixels, const Options& options,
+                         Workspace& workspace, uint8_t* pixelClasses = nullptr) {
+  if (!checkArguments(img1, img2, output, width, height, strideInPixels, options)) {
+    return invalidResult();
+  }
+
+  const Stopwatch total;
+  Instrumentation counters;
+  const bool coarseToFine = usesCoarseToFine(options);
+  const ImagePyramid* img1Pyramid = coarseToFine ? options.img1Pyramid : nullptr;
+
+  // With Options::maxDiffs, a signature of img1 may show that too many pixels differ before
+  // comparing any of them.
+  const ImageSignature* img1Signature = options.img1Signature;
+  const bool boundDiffs = img1Signature && options.maxDiffs && options.includeAA &&
+                          options.ignoreMask.empty() && options.deltaMap.empty();
+  int64_t minDiffs = 0;
+
+  // Check for identical images, respecting stride. With a signature of img1, only img2 is read.
   bool identical = true;
-  for (int y = 0; y < height; ++y) {
-    const size_t rowStartIndex = y * strideInPixels;
-    if (std::memcmp(&img1[rowStartIndex * kPixelBytes], &img2[rowStartIndex * kPixelBytes],
-                    width * 4) != 0) {
-      identical = false;
-      break;
+  if (img1Signature) {
+    PhaseTimer timer(counters.identicalCheckNanoseconds);
+    identical = matchSignature(img2, width, height, strideInPixels, options, workspace,
+                               boundDiffs ? &minDiffs : nullptr);
+  } else {
+    PhaseTimer timer(counters.identicalCheckNanoseconds);
+    for (int y = 0; y < height; ++y) {
+      const size_t rowStartIndex = y * strideInPixels;
+      if (std::memcmp(&img1[rowStartIndex * kPixelBytes], &img2[rowStartIndex * kPixelBytes],
+                      width * 4) != 0) {
+        identical = false;
+        break;
+      }
     }
   }
+  counters.identicalImages = identical;
+  if (identical && !options.deltaMap.empty()) {
+    std::fill_n(options.deltaMap.data(), options.deltaMap.size(), 0.0f);
+  }
+
+  DiffResult result;
+  // Adds the counters of this thread to the result, once it is complete.
+  const auto finish = [&]() {
+    counters.totalNanoseconds = total.elapsedNanoseconds();
+    addInstrumentation(counters, result);
+  };
+  if (options.countTiles) {
+    result.tileColumns = (width + DiffResult::kTileSize - 1) / DiffResult::kTileSize;
+    const int tileRows = (height + DiffResult::kTileSize - 1) / DiffResult::kTileSize;
+    result.tileCounts.assign(static_cast<size_t>(result.tileColumns) * tileRows, 0);
+  }
+
+  // Fast path if identical and there is nothing to draw.
+  if (identical && options.outputFormat != OutputFormat::Rgba) {
+    if (!output.empty()) {
+      PhaseTimer timer(counters.drawingNanoseconds);
+      std::memset(&output[0], 0, output.size());
+    }
+    finish();
+    return result;
+  }
+  if (identical && (output.empty() || options.diffMask)) {
+    finish();
+    return result;
+  }
+
+  const int maxDiffs = options.maxDiffs.value_or(std::numeric_limits<int>::max());
+  if (minDiffs > maxDiffs) {
+    result.numDiffPixels = maxDiffs + 1;
+    finish();
+    return result;
+  }
+
+  std::atomic<int> found{0};
+  const Comparison comparison{img1,
+                              img2,
+                              output,
+                              width,
+                              height,
+                              strideInPixels,
+                              options,
+                              maxDeltaFor(options),
+                              kernelsFor(options),
+                              maxDiffs,
+                              found,
+                              result.tileCounts.empty() ? nullptr : result.tileCounts.data(),
+                              result.tileColumns,
+                              coarseToFine,
+                              img1Pyramid,
+                              img1Signature ? workspace.matchingTiles().data() : nullptr,
+                              0,
+                              ColumnSpan{0, width},
+                              pixelClasses};
 
-  // Fast path if identical.
+  // Split the image into bands of rows. Each band only depends on its own rows and the two rows
+  // around it, and each thread picks up the next band when it finishes one.
   if (identical) {
-    // Update output image, filling with gray pixels.
-    if (!output.empty() && !options.diffMask) {
-      for (int y = 0; y < height; ++y) {
-        const size_t rowStartIndex = y * strideInPixels;
-        for (int x = 0; x < width; ++x) {
-          const size_t pos = (rowStartIndex + x) * kPixelBytes;
-          drawGrayPixel(img1, pos, options.alpha, output);
-        }
+    // Fast path if identical, update output image, filling with gray pixels.
+    detail::ThreadPool* pool = workspace.poolFor(numBandsIn(0, height));
+    span<Scratch> scratch = workspace.scratchFor(pool);
+    for (size_t thread = 0; thread < scratch.size(); ++thread) {
+      scratch[thread].stats.counters = Instrumentation();
+    }
+    forEachBand(0, height, pool, [&](int yBegin, int yEnd, size_t, size_t thread) {
+      PhaseTimer timer(scratch[thread].stats.counters.drawingNanoseconds);
+      drawGrayRows(comparison, yBegin, yEnd);
+    });
+    for (size_t thread = 0; thread < scratch.size(); ++thread) {
+      addCount(counters.drawingNanoseconds, scratch[thread].stats.counters.drawingNanoseconds);
+    }
+    finish();
+    return result;
+  }
+
+  compareBands(comparison, 0, height, workspace, result);
+
+  // Return the number of different pixels.
+  result.numDiffPixels = clampDiffs(found.load(), maxDiffs);
+  finish();
+  return result;
+}
+
+}  // namespace
+
+int pixelmatch(span<const uint8_t> img1, span<const uint8_t> img2, span<uint8_t> output, int width,
+               int height, size_t strideInPixels, Options options) {
+  if (options.numThreads < 0) {
+    assert(options.numThreads >= 0 && "numThreads must be >= 0");
+    return -1;
+  }
+
+  Workspace workspace(options.numThreads);
+  return compareImages(img1, img2, output, width, height, strideInPixels, options, workspace)
+      .numDiffPixels;
+}
+
+DiffResult pixelmatch(span<const uint8_t> img1, span<const uint8_t> img2, int width, int height,
+                      size_t strideInPixels, Options options) {
+  if (options.numThreads < 0) {
+    assert(options.numThreads >= 0 && "numThreads must be >= 0");
+    return invalidResult();
+  }
+
+  Workspace workspace(options.numThreads);
+  return compareImages(img1, img2, span<uint8_t>(), width, height, strideInPixels, options,
+                       workspace);
+}
+
+std::vector<int> pixelmatchBatch(span<const ImagePair> pairs, Options options) {
+  std::vector<int> results(pairs.size(), -1);
+  if (options.numThreads < 0) {
+    assert(options.numThreads >= 0 && "numThreads must be >= 0");
+    return results;
+  }
+
+  if (!options.deltaMap.empty() && pairs.size() > 1) {
+    assert(options.deltaMap.empty() && "deltaMap is not supported for more than one pair");
+    return results;
+  }
+
+  // A single pair can still be split into bands.
+  if (pairs.size() == 1) {
+    results[0] = pixelmatch(pairs[0].img1, pairs[0].img2, pairs[0].output, pairs[0].width,
+                            pairs[0].height, pairs[0].strideInPixels, options);
+    return results;
+  }
+
+  // Otherwise compare each pair on a single thread, with one workspace per thread so that scratch
+  // buffers are reused across pairs.
+  const int numThreads = std::min(detail::ThreadPool::resolveNumThreads(options.numThreads),
+                                  static_cast<int>(pairs.size()));
+  std::unique_ptr<detail::ThreadPool> pool;
+  if (numThreads > 1) {
+    pool = std::make_unique<detail::ThreadPool>(numThreads);
+  }
+
+  const size_t numWorkspaces = pool ? pool->numThreads() : 1;
+  std::vector<Workspace> workspaces;
+  workspaces.reserve(numWorkspaces);
+  for (size_t i = 0; i < numWorkspaces; ++i) {
+    workspaces.emplace_back(1);
+  }
+
+  auto comparePair = [&](size_t index, size_t thread) {
+    const ImagePair& pair = pairs[index];
+    results[index] = compareImages(pair.img1, pair.img2, pair.output, pair.width, pair.height,
+                                   pair.strideInPixels, options, workspaces[thread])
+                         .numDiffPixels;
+  };
+
+  if (pool) {
+    pool->parallelFor(pairs.size(), comparePair);
+  } else {
+    for (size_t i = 0; i < pairs.size(); ++i) {
+      comparePair(i, 0);
+    }
+  }
+
+  return results;
+}
+
+struct Comparator::Impl {
+  explicit Impl(int numThreads) : workspace(numThreads) {}
+
+  Workspace workspace;
+};
+
+Comparator::Comparator(Options options)
+    : options_(std::move(options)),
+      impl_(std::make_unique<Impl>(std::max(options_.numThreads, 0))) {}
+
+Comparator::~Comparator() = default;
+Comparator::Comparator(Comparator&&) noexcept = default;
+Comparator& Comparator::operator=(Comparator&&) noexcept = default;
+
+void Comparator::setOptions(Options options) {
+  if (options.numThreads != options_.numThreads) {
+    impl_ = std::make_unique<Impl>(std::max(options.numThreads, 0));
+  }
+
+  options_ = std::move(options);
+}
+
+int Comparator::compare(span<const uint8_t> img1, span<const uint8_t> img2, span<uint8_t> output,
+                        int width, int height, size_t strideInPixels) {
+  if (options_.numThreads < 0) {
+    assert(options_.numThreads >= 0 && "numThreads must be >= 0");
+    return -1;
+  }
+
+  return compareImages(img1, img2, output, width, height, strideInPixels, options_,
+                       impl_->workspace)
+      .numDiffPixels;
+}
+
+DiffResult Comparator::compare(span<const uint8_t> img1, span<const uint8_t> img2, int width,
+                               int height, size_t strideInPixels) {
+  if (options_.numThreads < 0) {
+    assert(options_.numThreads >= 0 && "numThreads must be >= 0");
+    return invalidResult();
+  }
+
+  return compareImages(img1, img2, span<uint8_t>(), width, height, strideInPixels, options_,
+                       impl_->workspace);
+}
+
+// A pixel is classified from the pixels up to kContextRows away, in any direction.
+static_assert(IncrementalComparator::kHaloPixels == kContextRows,
+              "The halo must cover the pixels read by the anti-aliasing detection");
+
+struct IncrementalComparator::Impl {
+  explicit Impl(int numThreads) : workspace(numThreads) {}
+
+  /// Adds the pixels of \ref rect to the counts of the result if \ref sign is 1, or removes them
+  /// and resets their class if it is -1.
+  void count(const Rect& rect, int sign);
+
+  /// Recomputes DiffResult::bounds from the counts of the rows and columns.
+  void updateBounds();
+
+  Workspace workspace;
+  int width = 0;  //!< Size of the images of the previous comparison, 0 if there is none.
+  int height = 0;
+  std::vector<uint8_t> pixelClasses;  //!< Class of each pixel, width * height bytes.
+  std::vector<int> rowDiffs;          //!< Different pixels of each row.
+  std::vector<int> columnDiffs;       //!< Different pixels of each column.
+  DiffResult result;
+};
+
+void IncrementalComparator::Impl::count(const Rect& rect, int sign) {
+  for (int y = rect.y; y < rect.y + rect.height; ++y) {
+    uint8_t* classes = pixelClasses.data() + static_cast<size_t>(y) * width;
+    for (int x = rect.x; x < rect.x + rect.width; ++x) {
+      const uint8_t pixelClass = classes[x];
+      if (pixelClass == kSimilarPixel) {
+        continue;
+      }
+
+      if (sign < 0) {
+        classes[x] = kSimilarPixel;
+      }
+      if (pixelClass == kAntialiasedPixel) {
+        result.numAntialiasedPixels += sign;
+        continue;
+      }
+
+      result.numDiffPixels += sign;
+      (pixelClass == kDarkerPixel ? result.numDarkerPixels : result.numLighterPixels) += sign;
+      rowDiffs[y] += sign;
+      columnDiffs[x] += sign;
+      if (!result.tileCounts.empty()) {
+        result.tileCounts[(y / DiffResult::kTileSize) * result.tileColumns +
+                          x / DiffResult::kTileSize] += sign;
       }
     }
+  }
+}
 
-    return 0;
+void IncrementalComparator::Impl::updateBounds() {
+  const auto nonZero = [](int diffs) { return diffs != 0; };
+  const auto firstRow = std::find_if(rowDiffs.begin(), rowDiffs.end(), nonZero);
+  if (firstRow == rowDiffs.end()) {
+    result.bounds = std::nullopt;
+    return;
   }
 
-  // Maximum acceptable square distance between two colors;
-  // 35215 is the maximum possible value for the YIQ difference metric
-  const float kMaxDelta = 35215.0f * options.threshold * options.threshold;
-  int diff = 0;
+  const auto lastRow = std::find_if(rowDiffs.rbegin(), rowDiffs.rend(), nonZero);
+  const auto firstColumn = std::find_if(columnDiffs.begin(), columnDiffs.end(), nonZero);
+  const auto lastColumn = std::find_if(columnDiffs.rbegin(), columnDiffs.rend(), nonZero);
+  const int x = static_cast<int>(firstColumn - columnDiffs.begin());
+  const int y = static_cast<int>(firstRow - rowDiffs.begin());
+  result.bounds = Rect{x, y, static_cast<int>(columnDiffs.rend() - lastColumn) - x,
+                       static_cast<int>(rowDiffs.rend() - lastRow) - y};
+}
 
-  // Compare each pixel of one image against the other one.
-  for (int y = 0; y < height; ++y) {
-    const size_t rowStartIndex = y * strideInPixels;
-
-    for (int x = 0; x < width; ++x) {
-      const size_t pos = (rowStartIndex + x) * kPixelBytes;
-
-      // Squared YUV distance between colors at this pixel position, negative if the img2 pixel is
-      // darker.
-      const float delta = colorDelta(img1, img2, pos, pos, false);
-
-      // The color difference is above the threshold.
-      if (std::abs(delta) > kMaxDelta) {
-        // Check it's a real rendering difference or just anti-aliasing.
-        if (!options.includeAA && (antialiased(img1, x, y, width, height, strideInPixels, img2) ||
-                                   antialiased(img2, x, y, width, height, strideInPixels, img1))) {
-          // One of the pixels is anti-aliasing; draw as yellow and do not count as difference
-          // note that we do not include such pixels in a mask.
-          if (!output.empty() && !options.diffMask) {
-            drawPixel(output, pos, options.aaColor);
-          }
-        } else {
-          // Found substantial difference not caused by anti-aliasing; draw it as such.
-          if (!output.empty()) {
-            drawPixel(
-                output, pos,
-                delta < 0.0f && options.diffColorAlt ? *options.diffColorAlt : options.diffColor);
-          }
-          diff++;
-        }
+namespace {
 
-      } else if (!output.empty()) {
-        // Pixels are similar; draw background as grayscale image blended with white.
-        if (!options.diffMask) {
-          drawGrayPixel(img1, pos, options.alpha, output);
-        }
+/// Checks the options that IncrementalComparator does not support.
+bool checkIncrementalOptions(const Options& options) {
+  if (options.numThreads < 0 || options.maxDiffs || options.collectDiffPixels ||
+      options.collectAntialiasedPixels) {
+    assert(options.numThreads >= 0 && "numThreads must be >= 0");
+    assert(!options.maxDiffs && "maxDiffs is not supported");
+    assert(!options.collectDiffPixels && "collectDiffPixels is not supported");
+    assert(!options.collectAntialiasedPixels && "collectAntialiasedPixels is not supported");
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace
+
+IncrementalComparator::IncrementalComparator(Options options)
+    : options_(std::move(options)),
+      impl_(std::make_unique<Impl>(std::max(options_.numThreads, 0))) {}
+
+IncrementalComparator::~IncrementalComparator() = default;
+IncrementalComparator::IncrementalComparator(IncrementalComparator&&) noexcept = default;
+IncrementalComparator& IncrementalComparator::operator=(IncrementalComparator&&) noexcept =
+    default;
+
+DiffResult IncrementalComparator::compare(span<const uint8_t> img1, span<const uint8_t> img2,
+                                          span<uint8_t> output, int width, int height,
+                                          size_t strideInPixels) {
+  Impl& s = *impl_;
+  s.width = 0;
+  s.height = 0;
+  if (!checkIncrementalOptions(options_) ||
+      !checkArguments(img1, img2, output, width, height, strideInPixels, options_)) {
+    return invalidResult();
+  }
+
+  s.pixelClasses.assign(static_cast<size_t>(width) * height, kSimilarPixel);
+  DiffResult compared = compareImages(img1, img2, output, width, height, strideInPixels, options_,
+                                      s.workspace, s.pixelClasses.data());
+  if (compared.numDiffPixels < 0) {
+    return invalidResult();
+  }
+
+  // Count the classes rather than keep the result, so that it is patched the same way.
+  s.width = width;
+  s.height = height;
+  s.rowDiffs.assign(height, 0);
+  s.columnDiffs.assign(width, 0);
+  s.result = DiffResult();
+  if (options_.countTiles) {
+    s.result.tileColumns = (width + DiffResult::kTileSize - 1) / DiffResult::kTileSize;
+    const int tileRows = (height + DiffResult::kTileSize - 1) / DiffResult::kTileSize;
+    s.result.tileCounts.assign(static_cast<size_t>(s.result.tileColumns) * tileRows, 0);
+  }
+  s.count(Rect{0, 0, width, height}, 1);
+  s.updateBounds();
+  s.result.instrumentation = compared.instrumentation;
+  return s.result;
+}
+
+DiffResult IncrementalComparator::update(span<const uint8_t> img1, span<const uint8_t> img2,
+                                         span<uint8_t> output, int width, int height,
+                                         size_t strideInPixels, span<const Rect> dirtyRects) {
+  Impl& s = *impl_;
+  if (width != s.width || height != s.height) {
+    return compare(img1, img2, output, width, height, strideInPixels);
+  }
+
+  if (!checkIncrementalOptions(options_) ||
+      !checkArguments(img1, img2, output, width, height, strideInPixels, options_)) {
+    return invalidResult();
+  }
+
+  // The pyramid tiles are aligned to the bands of the image, unlike the dirty rectangles, and
+  // Engine::CoarseToFine gives the same results as Engine::Float.
+  const Stopwatch total;
+  std::atomic<int> found{0};
+  const Comparison full{img1,
+                        img2,
+                        output,
+                        width,
+                        height,
+                        strideInPixels,
+                        options_,
+                        maxDeltaFor(options_),
+                        kernelsFor(options_),
+                        std::numeric_limits<int>::max(),
+                        found,
+                        nullptr,
+                        0,
+                        false,
+                        nullptr,
+                        nullptr,
+                        0,
+                        ColumnSpan{0, width},
+                        s.pixelClasses.data()};
+
+  const bool clearOutput =
+      !output.empty() && options_.outputFormat == OutputFormat::Rgba && options_.diffMask;
+  // Only the instrumentation of the comparisons is kept; the counts are patched from the classes.
+  DiffResult compared;
+  for (size_t i = 0; i < dirtyRects.size(); ++i) {
+    const Rect& dirty = dirtyRects[i];
+    if (dirty.width <= 0 || dirty.height <= 0) {
+      continue;
+    }
+
+    const int64_t x0 = std::max<int64_t>(int64_t(dirty.x) - kHaloPixels, 0);
+    const int64_t y0 = std::max<int64_t>(int64_t(dirty.y) - kHaloPixels, 0);
+    const int64_t x1 = std::min<int64_t>(int64_t(dirty.x) + dirty.width + kHaloPixels, width);
+    const int64_t y1 = std::min<int64_t>(int64_t(dirty.y) + dirty.height + kHaloPixels, height);
+    if (x0 >= x1 || y0 >= y1) {
+      continue;
+    }
+
+    const Rect rect{int(x0), int(y0), int(x1 - x0), int(y1 - y0)};
+    s.count(rect, -1);
+    if (clearOutput) {
+      for (int y = rect.y; y < rect.y + rect.height; ++y) {
+        const size_t pos = (y * strideInPixels + rect.x) * kPixelBytes;
+        std::memset(&output[pos], 0, rect.width * kPixelBytes);
       }
     }
+
+    Comparison c = full;
+    c.columns = ColumnSpan{rect.x, rect.x + rect.width};
+    compareBands(c, rect.y, rect.y + rect.height, s.workspace, compared);
+    s.count(rect, 1);
   }
 
-  // Return the number of different pixels.
-  return diff;
+  s.updateBounds();
+  Instrumentation counters;
+  counters.totalNanoseconds = total.elapsedNanoseconds();
+  addInstrumentation(counters, compared);
+  s.result.instrumentation = compared.instrumentation;
+  return s.result;
+}
+
+struct StreamingComparator::Impl {
+  Impl(int imageWidth, int imageHeight, Options comparisonOptions, OutputRowsFn outputRowsFn);
+
+  /// Compares the buffered rows [rowsCompared, yEnd), passes them to onOutputRows, then drops the
+  /// rows that the next bands do not read.
+  void compareUpTo(int yEnd);
+
+  const int width;
+  const int height;
+  const Options options;
+  const OutputRowsFn onOutputRows;
+  bool valid = false;
+  Workspace workspace;
+  int windowBands = 1;                //!< Bands compared at a time.
+  size_t outputRowBytes = 0;          //!< Bytes per row of the output.
+  std::vector<uint8_t> window1;       //!< Rows [windowFirstRow, rowsPushed) of img1, unpadded.
+  std::vector<uint8_t> window2;       //!< The same rows of img2.
+  std::vector<uint8_t> outputWindow;  //!< The output of the same rows, if onOutputRows is set.
+  int windowFirstRow = 0;
+  int rowsPushed = 0;
+  int rowsCompared = 0;
+  int maxDiffs = 0;
+  std::atomic<int> found{0};
+  DiffResult result;
+};
+
+StreamingComparator::Impl::Impl(int imageWidth, int imageHeight, Options comparisonOptions,
+                                OutputRowsFn outputRowsFn)
+    : width(imageWidth),
+      height(imageHeight),
+      options(std::move(comparisonOptions)),
+      onOutputRows(std::move(outputRowsFn)),
+      workspace(std::max(options.numThreads, 0)) {
+  // Leave the comparator invalid if a precondition fails, so that pushRows() returns -1.
+  if (width <= 0 || height <= 0) {
+    assert(width > 0);
+    assert(height > 0);
+    return;
+  }
+
+  if (options.numThreads < 0) {
+    assert(options.numThreads >= 0 && "numThreads must be >= 0");
+    return;
+  }
+
+  if (!options.ignoreMask.empty() &&
+      options.ignoreMask.size() != static_cast<size_t>(width) * height) {
+    assert(options.ignoreMask.size() == static_cast<size_t>(width) * height &&
+           "Ignore mask size does not match width/height");
+    return;
+  }
+
+  if (!options.deltaMap.empty() &&
+      options.deltaMap.size() != static_cast<size_t>(width) * height) {
+    assert(options.deltaMap.size() == static_cast<size_t>(width) * height &&
+           "Delta map size does not match width/height");
+    return;
+  }
+
+  if (options.maxDiffs && *options.maxDiffs < 0) {
+    assert(*options.maxDiffs >= 0 && "maxDiffs must be >= 0");
+    return;
+  }
+
+  const ImagePyramid* img1Pyramid = options.img1Pyramid;
+  if (options.engine == Engine::CoarseToFine && img1Pyramid &&
+      (img1Pyramid->width() != width || img1Pyramid->height() != height)) {
+    assert(img1Pyramid->width() == width && img1Pyramid->height() == height &&
+           "img1Pyramid size does not match width/height");
+    return;
+  }
+
+  valid = true;
+  maxDiffs = options.maxDiffs.value_or(std::numeric_limits<int>::max());
+  if (options.countTiles) {
+    result.tileColumns = (width + DiffResult::kTileSize - 1) / DiffResult::kTileSize;
+    const int tileRows = (height + DiffResult::kTileSize - 1) / DiffResult::kTileSize;
+    result.tileCounts.assign(static_cast<size_t>(result.tileColumns) * tileRows, 0);
+  }
+
+  // The windows hold the bands being compared and the context rows on each side of them.
+  windowBands = std::min(workspace.numThreads(), numBandsIn(0, height));
+  const size_t windowRows = std::min(windowBands * kBandRows + 2 * kContextRows, height);
+  window1.resize(windowRows * width * kPixelBytes);
+  window2.resize(window1.size());
+  outputRowBytes = options.outputFormat == OutputFormat::Rgba
+                       ? static_cast<size_t>(width) * kPixelBytes
+                       : maskRowBytes(options.outputFormat, width);
+  if (onOutputRows) {
+    outputWindow.resize(windowRows * outputRowBytes);
+  }
+}
+
+void StreamingComparator::Impl::compareUpTo(int yEnd) {
+  const int yBegin = rowsCompared;
+  const size_t windowRows = rowsPushed - windowFirstRow;
+  const size_t rowBytes = static_cast<size_t>(width) * kPixelBytes;
+  const size_t outputStart = (yBegin - windowFirstRow) * outputRowBytes;
+  const size_t outputSize = (yEnd - yBegin) * outputRowBytes;
+
+  span<uint8_t> output;
+  if (!outputWindow.empty()) {
+    // Pixels that are not drawn are left zero, as in a zero-initialized output of pixelmatch().
+    output = span<uint8_t>(outputWindow.data(), windowRows * outputRowBytes);
+    std::memset(outputWindow.data() + outputStart, 0, outputSize);
+  }
+
+  const bool coarseToFine = usesCoarseToFine(options);
+  const Comparison comparison{span<const uint8_t>(window1.data(), windowRows * rowBytes),
+                              span<const uint8_t>(window2.data(), windowRows * rowBytes),
+                              output,
+                              width,
+                              height,
+                              static_cast<size_t>(width),
+                              options,
+                              maxDeltaFor(options),
+                              kernelsFor(options),
+                              maxDiffs,
+                              found,
+                              result.tileCounts.empty() ? nullptr : result.tileCounts.data(),
+                              result.tileColumns,
+                              coarseToFine,
+                              coarseToFine ? options.img1Pyramid : nullptr,
+                              nullptr,
+                              windowFirstRow,
+                              ColumnSpan{0, width},
+                              nullptr};
+  compareBands(comparison, yBegin, yEnd, workspace, result);
+  rowsCompared = yEnd;
+
+  if (onOutputRows) {
+    onOutputRows(yBegin, yEnd - yBegin,
+                 span<const uint8_t>(outputWindow.data() + outputStart, outputSize));
+  }
+
+  // Keep the rows above the next band for its anti-aliasing detection.
+  const int keptFirstRow = std::max(yEnd - kContextRows, windowFirstRow);
+  const size_t dropped = (keptFirstRow - windowFirstRow) * rowBytes;
+  const size_t kept = (rowsPushed - keptFirstRow) * rowBytes;
+  std::memmove(window1.data(), window1.data() + dropped, kept);
+  std::memmove(window2.data(), window2.data() + dropped, kept);
+  windowFirstRow = keptFirstRow;
+}
+
+StreamingComparator::StreamingComparator(int width, int height, Options options,
+                                         OutputRowsFn onOutputRows)
+    : impl_(std::make_unique<Impl>(width, height, std::move(options), std::move(onOutputRows))) {}
+
+StreamingComparator::~StreamingComparator() = default;
+StreamingComparator::StreamingComparator(StreamingComparator&&) noexcept = default;
+StreamingComparator& StreamingComparator::operator=(StreamingComparator&&) noexcept = default;
+
+int StreamingComparator::width() const { return impl_->width; }
+int StreamingComparator::height() const { return impl_->height; }
+int StreamingComparator::rowsPushed() const { return impl_->rowsPushed; }
+int StreamingComparator::rowsCompared() const { return impl_->rowsCompared; }
+
+int StreamingComparator::numDiffPixels() const {
+  return clampDiffs(impl_->found.load(), impl_->maxDiffs);
+}
+
+int StreamingComparator::pushRows(span<const uint8_t> img1Rows, span<const uint8_t> img2Rows,
+                                  int numRows, size_t strideInPixels) {
+  Impl& s = *impl_;
+  if (!s.valid) {
+    return -1;
+  }
+
+  if (numRows < 0 || numRows > s.height - s.rowsPushed ||
+      strideInPixels < static_cast<size_t>(s.width)) {
+    assert(numRows >= 0 && "numRows must be >= 0");
+    assert(numRows <= s.height - s.rowsPushed && "More rows pushed than the height");
+    assert(strideInPixels >= static_cast<size_t>(s.width) && "Stride must be greater than width");
+    return -1;
+  }
+
+  const auto isRowsSize = [&](size_t bytes) {
+    return numRows == 0 ? bytes == 0 : isImageSize(bytes, s.width, numRows, strideInPixels);
+  };
+  if (!isRowsSize(img1Rows.size()) || !isRowsSize(img2Rows.size())) {
+    assert(isRowsSize(img1Rows.size()) && "Rows data size does not match numRows");
+    assert(isRowsSize(img2Rows.size()) && "Rows data size does not match numRows");
+    return -1;
+  }
+  if (img2Rows.size() != img1Rows.size()) {
+    assert(img2Rows.size() == img1Rows.size() && "img2Rows must be the same size as img1Rows");
+    return -1;
+  }
+
+  const size_t rowBytes = static_cast<size_t>(s.width) * kPixelBytes;
+  for (int row = 0; row < numRows;) {
+    // Buffer the next bands and the context rows below them, then compare the bands.
+    const int compareEnd = std::min(s.rowsCompared + s.windowBands * kBandRows, s.height);
+    const int bufferEnd = std::min(compareEnd + kContextRows, s.height);
+    const int rows = std::min(numRows - row, bufferEnd - s.rowsPushed);
+    for (int i = 0; i < rows; ++i) {
+      const size_t source = (row + i) * strideInPixels * kPixelBytes;
+      const size_t dest = (s.rowsPushed + i - s.windowFirstRow) * rowBytes;
+      std::memcpy(s.window1.data() + dest, img1Rows.data() + source, rowBytes);
+      std::memcpy(s.window2.data() + dest, img2Rows.data() + source, rowBytes);
+    }
+
+    row += rows;
+    s.rowsPushed += rows;
+    if (s.rowsPushed == bufferEnd) {
+      s.compareUpTo(compareEnd);
+    }
+  }
+
+  return s.rowsCompared;
+}
+
+DiffResult StreamingComparator::result() const {
+  const Impl& s = *impl_;
+  if (!s.valid || s.rowsPushed != s.height) {
+    return invalidResult();
+  }
+
+  DiffResult result = s.result;
+  result.numDiffPixels = numDiffPixels();
+  return result;
 }
 
 }  // namespace pixelmatch
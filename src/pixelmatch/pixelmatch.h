@@ -1,7 +1,10 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
+#include <memory>
 #include <optional>
+#include <vector>
 
 #if __cplusplus > 201703L
 #include <span>
@@ -35,7 +38,7 @@ public:
   span(const span&) = default;
   span& operator=(const span&) = default;
 
-  const T* data() const { return data_; }
+  T* data() const { return data_; }
   size_t size() const { return size_; }
   bool empty() const { return size_ == 0; }
 
@@ -48,6 +51,17 @@ private:
 };
 #endif
 
+/**
+ * Returns true if \ref bytes is a valid size for an image of \ref height rows of \ref width RGBA
+ * pixels, \ref strideInPixels pixels apart, which must all be > 0. The image may end with the last
+ * pixel of its last row, as a view of part of a larger image does, or hold up to a full stride for
+ * each row.
+ */
+inline bool isImageSize(size_t bytes, int width, int height, size_t strideInPixels) {
+  const size_t lastRowEnd = (static_cast<size_t>(height) - 1) * strideInPixels + width;
+  return bytes >= lastRowEnd * 4 && bytes <= strideInPixels * height * 4;
+}
+
 /**
  * RGBA-ordered 32-bit color.
  */
@@ -58,6 +72,43 @@ struct Color {
   uint8_t a;
 };
 
+/**
+ * Axis-aligned rectangle of pixels, from (x, y) inclusive to (x + width, y + height) exclusive.
+ */
+struct Rect {
+  int x;
+  int y;
+  int width;
+  int height;
+};
+
+class ImagePyramid;
+class ImageSignature;
+
+/**
+ * Implementation of the per-pixel color delta.
+ */
+enum class Engine {
+  Float,         //!< Floating-point YIQ delta, as in the reference implementation.
+  FixedPoint,    //!< Integer-only YIQ delta. Differs from Float by less than 1% of the delta plus
+                 //!< 0.25, out of a maximum of 35215, so only pixels within that margin of the
+                 //!< threshold may be classified differently.
+  CoarseToFine,  //!< Float deltas, computed only in the 4x4 blocks that the ImagePyramid of both
+                 //!< images cannot rule out. Gives the same results as Float: a block is skipped
+                 //!< only if no pair of colors in its ranges is above the threshold.
+};
+
+/**
+ * Format of the output buffer of \ref pixelmatch.
+ */
+enum class OutputFormat {
+  Rgba,      //!< RGBA diff image, the same size as the input images.
+  ByteMask,  //!< One byte per pixel, width * height bytes long: 0 for identical or ignored pixels,
+             //!< 1 for different pixels and 2 for anti-aliased pixels.
+  BitMask,   //!< One bit per pixel, set for different pixels. Each row is (width + 7) / 8 bytes
+             //!< long, with pixel x in bit x % 8 of byte x / 8.
+};
+
 /**
  * Pixelmatch options.
  *
@@ -74,24 +125,338 @@ struct Options {
       std::nullopt;  //!< Whether to detect dark on light differences between img1 and img2 and set
                      //!< an alternative color to differentiate between the two
   bool diffMask = false;  //!< Draw the diff over a transparent background (a mask)
+  int numThreads = 1;     //!< Number of threads to split the comparison across, in bands of rows;
+                          //!< 0 uses the hardware concurrency
+  std::optional<int> maxDiffs =
+      std::nullopt;  //!< Stop comparing once more than this many different pixels are found, and
+                     //!< return maxDiffs + 1; the output is then only partially drawn
+  std::vector<Rect> ignoreRegions;  //!< Regions to skip, treated as identical pixels; may extend
+                                    //!< past the edges of the image
+  span<const uint8_t> ignoreMask;   //!< (Optional) One byte per pixel, width * height bytes long;
+                                    //!< pixels with a non-zero value are skipped like ignoreRegions
+  Engine engine = Engine::Float;    //!< Implementation of the color delta
+  const ImagePyramid* img1Pyramid = nullptr;  //!< (Optional) With Engine::CoarseToFine, the
+                                              //!< pyramid of img1, reused across comparisons;
+                                              //!< otherwise computed for the changed tiles only
+  const ImageSignature* img1Signature = nullptr;  //!< (Optional) Signature of img1, such as that
+                                                  //!< of a golden image: the tiles of img2 with
+                                                  //!< the same hash are skipped without reading
+                                                  //!< img1, see ImageSignature; not used by
+                                                  //!< IncrementalComparator::update() or
+                                                  //!< StreamingComparator
+  bool countTiles = false;  //!< Count the different pixels of each tile in DiffResult::tileCounts
+  bool collectDiffPixels = false;  //!< List the different pixels in DiffResult::diffPixels
+  bool collectAntialiasedPixels =
+      false;  //!< List the anti-aliased pixels in DiffResult::antialiasedPixels
+  OutputFormat outputFormat = OutputFormat::Rgba;  //!< Format of the output buffer; the mask
+                                                   //!< formats ignore the colors and diffMask
+  span<float> deltaMap;  //!< (Optional) One float per pixel, width * height floats long, receiving
+                         //!< the color delta of each pixel as computed for the threshold: signed
+                         //!< like DiffPixel::delta, and 0 for identical and ignored pixels
 };
 
+/**
+ * A pixel listed in \ref DiffResult.
+ */
+struct DiffPixel {
+  int x;
+  int y;
+  float delta;  //!< Color delta, negative if the img2 pixel is darker
+};
+
+/**
+ * Counters and timings of the phases of a comparison, to tell where its time goes. Only gathered
+ * when the library is built with PIXELMATCH_ENABLE_INSTRUMENTATION defined, which slows it down.
+ *
+ * The time of each phase is summed across threads, and can exceed \ref totalNanoseconds when the
+ * comparison runs on several of them.
+ */
+struct Instrumentation {
+  int64_t tilesSkipped = 0;          //!< Tiles of the bands identical in both images, not compared
+  int64_t pixelsCompared = 0;        //!< Pixels whose color delta was computed
+  int64_t pixelsAboveThreshold = 0;  //!< Pixels with a delta above the threshold, not ignored
+  int64_t spansBelowThreshold = 0;   //!< Runs of compared pixels all below the threshold, whose
+                                     //!< pixels are skipped unless the background is drawn
+  int64_t antialiasingChecks = 0;    //!< Calls to the anti-aliasing detection, once per image
+  int64_t siblingChecks = 0;         //!< Neighbors checked for 3+ equal siblings by the detection
+  int64_t bandsStoppedEarly = 0;     //!< Bands that stopped once Options::maxDiffs was exceeded,
+                                     //!< including those that then compared nothing
+  bool identicalImages = false;      //!< The images were identical, so nothing was compared
+
+  int64_t identicalCheckNanoseconds = 0;  //!< Checking whether the images are identical
+  int64_t tileSearchNanoseconds = 0;      //!< Finding the changed tiles and candidate blocks
+  int64_t colorDeltaNanoseconds = 0;      //!< Computing the color deltas
+  int64_t pixelLoopNanoseconds = 0;       //!< Classifying and drawing the compared pixels,
+                                          //!< including the anti-aliasing detection
+  int64_t antialiasingNanoseconds = 0;    //!< Detecting anti-aliasing, with its brightness rows
+  int64_t drawingNanoseconds = 0;         //!< Drawing the pixels not compared, and clearing masks
+  int64_t totalNanoseconds = 0;           //!< Wall time of the whole comparison
+};
+
+/**
+ * Statistics of a comparison, gathered in the same pass as the number of different pixels.
+ *
+ * If Options::maxDiffs is exceeded, the comparison stops early and only covers the pixels compared
+ * so far.
+ */
+struct DiffResult {
+  /// Size of the square tiles of \ref tileCounts, in pixels.
+  static constexpr int kTileSize = 64;
+
+  int numDiffPixels = 0;  //!< Same as the result of \ref pixelmatch, -1 if a precondition fails
+  int numAntialiasedPixels = 0;  //!< Pixels above the threshold detected as anti-aliasing; always
+                                 //!< 0 with Options::includeAA
+  int numDarkerPixels = 0;   //!< Different pixels where img2 is darker, drawn with diffColorAlt
+  int numLighterPixels = 0;  //!< Different pixels where img2 is lighter or equally bright
+  std::optional<Rect> bounds = std::nullopt;  //!< Bounding box of the different pixels, if any
+  int tileColumns = 0;          //!< Number of tiles per row of \ref tileCounts
+  std::vector<int> tileCounts;  //!< If Options::countTiles is set, the number of different pixels
+                                //!< of each kTileSize x kTileSize tile, in row-major order
+  std::vector<DiffPixel> diffPixels;  //!< If Options::collectDiffPixels is set, the different
+                                      //!< pixels, in row-major order
+  std::vector<DiffPixel> antialiasedPixels;  //!< If Options::collectAntialiasedPixels is set, the
+                                             //!< anti-aliased pixels, in row-major order
+  /// Set if the library is built with PIXELMATCH_ENABLE_INSTRUMENTATION defined.
+  std::optional<Instrumentation> instrumentation = std::nullopt;
+};
+
+/// Returns the result of a comparison whose preconditions failed: DiffResult::numDiffPixels is -1
+/// and the other fields are left empty.
+inline DiffResult invalidResult() {
+  DiffResult result;
+  result.numDiffPixels = -1;
+  return result;
+}
+
 /**
  * Compares two images, optionally detecting anti-aliased pixels and using perceptual color
  * difference metrics.
  *
  * @param img1 First image, as a raw RGBA-ordered pixel buffer. Must be strideInElements * height *
- *              4 bytes long. Assumes that alpha is unpremultiplied.
+ *              4 bytes long, or end with the last pixel of the last row, see \ref isImageSize.
+ *              Assumes that alpha is unpremultiplied.
  * @param img2 Second image, must be the same size as img1.
- * @param output (Optional) Output image buffer, of the same size as img1, or an empty span.
+ * @param output (Optional) Output buffer, or an empty span. With OutputFormat::Rgba, the same size
+ *               as img1; otherwise, see \ref OutputFormat for its size.
  * @param width in pixels, must be > 0.
  * @param height in pixels, must be > 0.
  * @param strideInElements Stride of the image, in pixels, must be >= width.
  * @param options Configuration options for the pixel comparison algorithm.
- * @return 0 if the images are identical or the number of different pixels if not. If a precondition
- *         fails, returns -1.
+ * @return 0 if the images are identical or the number of different pixels if not. If
+ *         Options::maxDiffs is set and exceeded, returns maxDiffs + 1. If a precondition fails,
+ *         returns -1.
  */
 int pixelmatch(span<const uint8_t> img1, span<const uint8_t> img2, span<uint8_t> output, int width,
                int height, size_t strideInPixels, Options options = Options());
 
+/**
+ * Compares two images like \ref pixelmatch, without drawing a diff, and returns statistics of the
+ * different pixels.
+ *
+ * @return The statistics of the comparison. If a precondition fails, DiffResult::numDiffPixels is
+ *         -1 and the other fields are left empty.
+ */
+DiffResult pixelmatch(span<const uint8_t> img1, span<const uint8_t> img2, int width, int height,
+                      size_t strideInPixels, Options options = Options());
+
+/**
+ * A pair of images to compare with \ref pixelmatchBatch, with the same requirements as the
+ * arguments of \ref pixelmatch.
+ */
+struct ImagePair {
+  span<const uint8_t> img1;  //!< First image, as a raw RGBA-ordered pixel buffer.
+  span<const uint8_t> img2;  //!< Second image, must be the same size as img1.
+  span<uint8_t> output;      //!< (Optional) Output image buffer, or an empty span.
+  int width;                 //!< Width in pixels, must be > 0.
+  int height;                //!< Height in pixels, must be > 0.
+  size_t strideInPixels;     //!< Stride of the images, in pixels, must be >= width.
+};
+
+/**
+ * Compares a batch of image pairs with shared options.
+ *
+ * Pairs are spread across \ref Options::numThreads threads, each pair being compared on a single
+ * thread that reuses its scratch buffers from one pair to the next. Pairs may have different sizes.
+ *
+ * @param pairs Image pairs to compare.
+ * @param options Configuration options, shared by all pairs.
+ * @return The result of \ref pixelmatch for each pair, in order.
+ */
+std::vector<int> pixelmatchBatch(span<const ImagePair> pairs, Options options = Options());
+
+/**
+ * Compares images with fixed options, keeping the thread pool and scratch buffers of
+ * \ref pixelmatch alive between comparisons. Scratch buffers grow to fit the largest image seen so
+ * far, so comparing images of the same size does not allocate after the first comparison.
+ *
+ * A Comparator runs one comparison at a time; use one per thread to compare concurrently.
+ */
+class Comparator {
+public:
+  /// Creates a comparator, see \ref pixelmatch for \ref options.
+  explicit Comparator(Options options = Options());
+  ~Comparator();
+
+  Comparator(Comparator&&) noexcept;
+  Comparator& operator=(Comparator&&) noexcept;
+
+  /// Returns the options used for comparisons.
+  const Options& options() const { return options_; }
+
+  /// Replaces the options, keeping the thread pool unless Options::numThreads changes.
+  void setOptions(Options options);
+
+  /**
+   * Compares two images, with the same arguments and result as \ref pixelmatch.
+   */
+  int compare(span<const uint8_t> img1, span<const uint8_t> img2, span<uint8_t> output, int width,
+              int height, size_t strideInPixels);
+
+  /**
+   * Compares two images without drawing a diff, with the same arguments and result as the
+   * \ref DiffResult overload of \ref pixelmatch.
+   */
+  DiffResult compare(span<const uint8_t> img1, span<const uint8_t> img2, int width, int height,
+                     size_t strideInPixels);
+
+private:
+  struct Impl;
+
+  Options options_;
+  std::unique_ptr<Impl> impl_;
+};
+
+/**
+ * Compares images that change a few rectangles at a time, e.g. the frames of a live preview,
+ * keeping the result and the class of each pixel of the previous comparison. \ref update only
+ * re-compares the dirty rectangles and the pixels around them, then patches the result and the
+ * output in place, so its cost depends on the changed area rather than on the size of the images.
+ *
+ * The anti-aliasing detection of a pixel reads the pixels up to two pixels away, so the rectangles
+ * are grown by \ref kHaloPixels on each side. Memory holds one byte per pixel, plus a count per row
+ * and per column to keep DiffResult::bounds up to date.
+ *
+ * Options::maxDiffs, Options::collectDiffPixels and Options::collectAntialiasedPixels are not
+ * supported, since the result of a partial comparison or the pixel lists could not be patched.
+ */
+class IncrementalComparator {
+public:
+  /// Pixels around each dirty rectangle that are compared again.
+  static constexpr int kHaloPixels = 2;
+
+  /// Creates a comparator, see \ref pixelmatch for \ref options.
+  explicit IncrementalComparator(Options options = Options());
+  ~IncrementalComparator();
+
+  IncrementalComparator(IncrementalComparator&&) noexcept;
+  IncrementalComparator& operator=(IncrementalComparator&&) noexcept;
+
+  /// Returns the options used for comparisons.
+  const Options& options() const { return options_; }
+
+  /**
+   * Compares two images in full, with the same arguments as \ref pixelmatch, and keeps the result
+   * for \ref update.
+   *
+   * @return The statistics of the comparison, as the \ref DiffResult overload of \ref pixelmatch.
+   *         If a precondition fails, DiffResult::numDiffPixels is -1 and the previous result is
+   *         dropped.
+   */
+  DiffResult compare(span<const uint8_t> img1, span<const uint8_t> img2, span<uint8_t> output,
+                     int width, int height, size_t strideInPixels);
+
+  /**
+   * Re-compares the images within \ref dirtyRects, where they may have changed since the previous
+   * comparison, and patches the previous result and \ref output. The output must hold the output
+   * of the previous comparison; only the pixels within kHaloPixels of a dirty rectangle are
+   * written, and with Options::diffMask, those that are not drawn are cleared to zero.
+   *
+   * Compares the images in full, as \ref compare, if there is no previous result for images of
+   * this size.
+   *
+   * @param dirtyRects Rectangles where the images may have changed; may extend past the edges of
+   *                   the images.
+   * @return The statistics of the comparison, the same as comparing the images in full. If a
+   *         precondition fails, DiffResult::numDiffPixels is -1 and the previous result is kept.
+   */
+  DiffResult update(span<const uint8_t> img1, span<const uint8_t> img2, span<uint8_t> output,
+                    int width, int height, size_t strideInPixels, span<const Rect> dirtyRects);
+
+private:
+  struct Impl;
+
+  Options options_;
+  std::unique_ptr<Impl> impl_;
+};
+
+/**
+ * Compares two images row by row as they are read, e.g. from a \ref PngRowDecoder, holding only a
+ * window of rows of each image instead of the whole images.
+ *
+ * Rows are compared in bands of 64, since the anti-aliasing detection of a pixel reads the pixels
+ * up to two rows away: a band is compared once the two rows below it have been pushed, and the two
+ * rows above it are kept from the previous band. Options::numThreads bands are buffered and
+ * compared in parallel at a time. The results are the same as those of \ref pixelmatch with the
+ * same options.
+ */
+class StreamingComparator {
+public:
+  /**
+   * Receives rows [y, y + numRows) of the output once they are compared, in order: numRows rows of
+   * the format of Options::outputFormat, without padding, i.e. width * 4 bytes per row with
+   * OutputFormat::Rgba. Pixels left undrawn, e.g. with Options::diffMask, are zero.
+   */
+  using OutputRowsFn = std::function<void(int y, int numRows, span<const uint8_t> rows)>;
+
+  /**
+   * Creates a comparator for two images of \ref width x \ref height pixels. If a precondition of
+   * \ref pixelmatch on the size or the options fails, every call to \ref pushRows returns -1.
+   *
+   * @param options Comparison options, as for \ref pixelmatch. Options::ignoreMask and
+   *                Options::img1Pyramid, if set, cover the whole images.
+   * @param onOutputRows (Optional) Receives the output rows, or nullptr to only count differences.
+   */
+  StreamingComparator(int width, int height, Options options = Options(),
+                      OutputRowsFn onOutputRows = nullptr);
+  ~StreamingComparator();
+
+  StreamingComparator(StreamingComparator&&) noexcept;
+  StreamingComparator& operator=(StreamingComparator&&) noexcept;
+
+  int width() const;         //!< Width of the images, in pixels.
+  int height() const;        //!< Height of the images, in pixels.
+  int rowsPushed() const;    //!< Number of rows pushed so far.
+  int rowsCompared() const;  //!< Number of rows compared, and passed to the output, so far.
+
+  /// Number of different pixels in the rows compared so far, as returned by \ref pixelmatch.
+  int numDiffPixels() const;
+
+  /**
+   * Appends the next rows of both images, comparing the bands that they complete. The rows are
+   * copied, so they may be reused once this returns.
+   *
+   * @param img1Rows \ref numRows rows of the first image, strideInPixels * numRows * 4 bytes long,
+   *                 or ending with the last pixel of the last row, see \ref isImageSize.
+   * @param img2Rows The same rows of the second image, the same size as img1Rows.
+   * @param numRows Number of rows; the rows pushed in total must not exceed \ref height.
+   * @param strideInPixels Stride of the rows, in pixels, must be >= width.
+   * @return The number of rows compared so far, which is \ref height once all rows are pushed, or
+   *         -1 if a precondition fails.
+   */
+  int pushRows(span<const uint8_t> img1Rows, span<const uint8_t> img2Rows, int numRows,
+               size_t strideInPixels);
+
+  /**
+   * Returns the statistics of the comparison, as the \ref DiffResult overload of \ref pixelmatch,
+   * once all rows have been pushed. Otherwise, or if a precondition failed,
+   * DiffResult::numDiffPixels is -1 and the other fields are left empty.
+   */
+  DiffResult result() const;
+
+private:
+  struct Impl;
+
+  std::unique_ptr<Impl> impl_;
+};
+
 }  // namespace pixelmatch
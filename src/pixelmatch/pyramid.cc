@@ -0,0 +1,236 @@
+#include "pixelmatch/pyramid.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "pixelmatch/yiq.h"
+
+namespace pixelmatch {
+
+namespace detail {
+
+namespace {
+
+constexpr ColorRange kEmptyRange = {{255, 255, 255}, {0, 0, 0}};
+
+/// Index of the first range of each level in a tile.
+constexpr int kLevelOffsets[kPyramidLevels] = {0, 256, 320, 336, 340};
+
+// Coefficients of the Y, I and Q differences, applied to the differences of the R, G and B
+// channels.
+constexpr double kY[3] = {kRgb2Y[0], kRgb2Y[1], kRgb2Y[2]};
+constexpr double kI[3] = {kRgb2I[0], -kRgb2I[1], -kRgb2I[2]};
+constexpr double kQ[3] = {kRgb2Q[0], -kRgb2Q[1], kRgb2Q[2]};
+
+// Added to the bounds before comparing them to the threshold. colorDelta() computes the delta in
+// float, which rounds it by less than 0.1 from the exact value bounded below.
+constexpr double kBoundMargin = 1.0;
+
+/// Largest magnitude of the linear combination \ref k of channel differences in [lo, hi].
+double maxMagnitude(const double k[3], const int lo[3], const int hi[3]) {
+  double low = 0.0;
+  double high = 0.0;
+  for (int c = 0; c < 3; ++c) {
+    low += std::min(k[c] * lo[c], k[c] * hi[c]);
+    high += std::max(k[c] * lo[c], k[c] * hi[c]);
+  }
+  return std::max(-low, high);
+}
+
+/// Upper bound of the color delta between any color of \ref a and any color of \ref b. Each of the
+/// Y, I and Q terms is maximized on its own, so the bound may not be reached.
+double maxColorDelta(const ColorRange& a, const ColorRange& b) {
+  int lo[3];
+  int hi[3];
+  for (int c = 0; c < 3; ++c) {
+    lo[c] = int(a.min[c]) - int(b.max[c]);
+    hi[c] = int(a.max[c]) - int(b.min[c]);
+  }
+
+  const double y = maxMagnitude(kY, lo, hi);
+  const double i = maxMagnitude(kI, lo, hi);
+  const double q = maxMagnitude(kQ, lo, hi);
+  return kDeltaWeights[0] * y * y + kDeltaWeights[1] * i * i + kDeltaWeights[2] * q * q;
+}
+
+/// Folds \ref size bytes into their running minimum and maximum. A constant size, as for full
+/// tiles, lets the compiler vectorize the loop without a remainder.
+template <size_t kSize>
+void reduceBytes(const uint8_t* bytes, uint8_t* min, uint8_t* max) {
+  for (size_t i = 0; i < kSize; ++i) {
+    min[i] = std::min(min[i], bytes[i]);
+    max[i] = std::max(max[i], bytes[i]);
+  }
+}
+
+void reduceBytes(const uint8_t* bytes, size_t size, uint8_t* min, uint8_t* max) {
+  for (size_t i = 0; i < size; ++i) {
+    min[i] = std::min(min[i], bytes[i]);
+    max[i] = std::max(max[i], bytes[i]);
+  }
+}
+
+void descend(const ColorRange* ranges1, const ColorRange* ranges2, float maxDelta, int level,
+             int blockX, int blockY, uint16_t* flagged) {
+  const int blocks = kPyramidTileBlocks >> level;
+  const int index = kLevelOffsets[level] + blockY * blocks + blockX;
+  const ColorRange& range1 = ranges1[index];
+  const ColorRange& range2 = ranges2[index];
+  if (range1.min[0] > range1.max[0] ||
+      maxColorDelta(range1, range2) + kBoundMargin <= maxDelta) {
+    return;
+  }
+
+  if (level == 0) {
+    flagged[blockY] |= uint16_t(1) << blockX;
+    return;
+  }
+
+  for (int dy = 0; dy < 2; ++dy) {
+    for (int dx = 0; dx < 2; ++dx) {
+      descend(ranges1, ranges2, maxDelta, level - 1, blockX * 2 + dx, blockY * 2 + dy, flagged);
+    }
+  }
+}
+
+}  // namespace
+
+void computeTileRanges(const uint8_t* tile, int columns, int rows, size_t strideInPixels,
+                       ColorRange* ranges) {
+  std::fill(ranges, ranges + kPyramidTileRanges, kEmptyRange);
+
+  const size_t rowBytes = static_cast<size_t>(columns) * 4;
+  for (int y = 0; y < rows; y += kPyramidBlockSize) {
+    ColorRange* blocks = ranges + (y / kPyramidBlockSize) * kPyramidTileBlocks;
+    const int blockRows = std::min(kPyramidBlockSize, rows - y);
+    const uint8_t* firstRow = tile + y * strideInPixels * 4;
+
+    // Reduce the rows of the blocks first, byte by byte, which vectorizes. Columns past the edge
+    // of the image hold the identity values, so that the blocks there stay empty.
+    uint8_t columnMin[kPyramidTileSize * 4];
+    uint8_t columnMax[kPyramidTileSize * 4];
+    std::memcpy(columnMin, firstRow, rowBytes);
+    std::memcpy(columnMax, firstRow, rowBytes);
+    std::memset(columnMin + rowBytes, 255, sizeof(columnMin) - rowBytes);
+    std::memset(columnMax + rowBytes, 0, sizeof(columnMax) - rowBytes);
+    for (int row = 1; row < blockRows; ++row) {
+      const uint8_t* pixels = firstRow + row * strideInPixels * 4;
+      if (rowBytes == sizeof(columnMin)) {
+        reduceBytes<sizeof(columnMin)>(pixels, columnMin, columnMax);
+      } else {
+        reduceBytes(pixels, rowBytes, columnMin, columnMax);
+      }
+    }
+
+    // Then the columns of each block, including alpha.
+    uint8_t blockMin[kPyramidTileBlocks * 4];
+    uint8_t blockMax[kPyramidTileBlocks * 4];
+    for (int block = 0; block < kPyramidTileBlocks; ++block) {
+      for (int c = 0; c < 4; ++c) {
+        const uint8_t* min = columnMin + block * kPyramidBlockSize * 4 + c;
+        const uint8_t* max = columnMax + block * kPyramidBlockSize * 4 + c;
+        blockMin[block * 4 + c] = std::min(std::min(min[0], min[4]), std::min(min[8], min[12]));
+        blockMax[block * 4 + c] = std::max(std::max(max[0], max[4]), std::max(max[8], max[12]));
+      }
+    }
+    static_assert(kPyramidBlockSize == 4, "Blocks are reduced 4 columns at a time");
+
+    for (int block = 0; block < kPyramidTileBlocks; ++block) {
+      ColorRange& range = blocks[block];
+      if (blockMin[block * 4 + 3] == 255) {
+        // Opaque pixels are compared as they are.
+        for (int c = 0; c < 3; ++c) {
+          range.min[c] = blockMin[block * 4 + c];
+          range.max[c] = blockMax[block * 4 + c];
+        }
+        continue;
+      }
+
+      // Blend each pixel with a white background, as colorDelta() does.
+      const int columnBegin = block * kPyramidBlockSize;
+      const int columnEnd = std::min(columnBegin + kPyramidBlockSize, columns);
+      for (int row = 0; row < blockRows; ++row) {
+        const uint8_t* pixels = firstRow + row * strideInPixels * 4;
+        for (int column = columnBegin; column < columnEnd; ++column) {
+          const uint8_t* pixel = pixels + column * 4;
+          uint8_t rgb[3] = {pixel[0], pixel[1], pixel[2]};
+          if (pixel[3] < 255) {
+            const float alpha = pixel[3] / 255.0f;
+            for (uint8_t& channel : rgb) {
+              channel = blend(channel, alpha);
+            }
+          }
+
+          for (int c = 0; c < 3; ++c) {
+            range.min[c] = std::min(range.min[c], rgb[c]);
+            range.max[c] = std::max(range.max[c], rgb[c]);
+          }
+        }
+      }
+    }
+  }
+
+  // Each coarser block covers 2x2 blocks of the level below; empty blocks do not widen it.
+  for (int level = 1; level < kPyramidLevels; ++level) {
+    const ColorRange* fine = ranges + kLevelOffsets[level - 1];
+    ColorRange* coarse = ranges + kLevelOffsets[level];
+    const int fineBlocks = kPyramidTileBlocks >> (level - 1);
+    const int coarseBlocks = fineBlocks / 2;
+    for (int y = 0; y < coarseBlocks; ++y) {
+      for (int x = 0; x < coarseBlocks; ++x) {
+        ColorRange& range = coarse[y * coarseBlocks + x];
+        for (int dy = 0; dy < 2; ++dy) {
+          for (int dx = 0; dx < 2; ++dx) {
+            const ColorRange& child = fine[(y * 2 + dy) * fineBlocks + x * 2 + dx];
+            for (int c = 0; c < 3; ++c) {
+              range.min[c] = std::min(range.min[c], child.min[c]);
+              range.max[c] = std::max(range.max[c], child.max[c]);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+void findCandidateBlocks(const ColorRange* ranges1, const ColorRange* ranges2, float maxDelta,
+                         uint16_t flagged[kPyramidTileBlocks]) {
+  std::fill(flagged, flagged + kPyramidTileBlocks, uint16_t(0));
+  descend(ranges1, ranges2, maxDelta, kPyramidLevels - 1, 0, 0, flagged);
+}
+
+}  // namespace detail
+
+ImagePyramid::ImagePyramid(span<const uint8_t> img, int width, int height,
+                           size_t strideInPixels) {
+  // Leave the pyramid empty if a precondition fails, so that comparisons using it return -1.
+  if (width <= 0 || height <= 0 || strideInPixels < static_cast<size_t>(width) ||
+      !isImageSize(img.size(), width, height, strideInPixels)) {
+    assert(width > 0);
+    assert(height > 0);
+    assert(strideInPixels >= static_cast<size_t>(width) && "Stride must be greater than width");
+    assert(isImageSize(img.size(), width, height, strideInPixels) &&
+           "Image data size does not match width/height");
+    return;
+  }
+
+  width_ = width;
+  height_ = height;
+  tileColumns_ = (width + detail::kPyramidTileSize - 1) / detail::kPyramidTileSize;
+  const int tileRows = (height + detail::kPyramidTileSize - 1) / detail::kPyramidTileSize;
+  ranges_.resize(static_cast<size_t>(tileColumns_) * tileRows * detail::kPyramidTileRanges);
+  for (int tileY = 0; tileY < tileRows; ++tileY) {
+    for (int tileX = 0; tileX < tileColumns_; ++tileX) {
+      const int x = tileX * detail::kPyramidTileSize;
+      const int y = tileY * detail::kPyramidTileSize;
+      const size_t tile = static_cast<size_t>(tileY) * tileColumns_ + tileX;
+      detail::computeTileRanges(img.data() + (y * strideInPixels + x) * 4,
+                                std::min(detail::kPyramidTileSize, width - x),
+                                std::min(detail::kPyramidTileSize, height - y), strideInPixels,
+                                ranges_.data() + tile * detail::kPyramidTileRanges);
+    }
+  }
+}
+
+}  // namespace pixelmatch
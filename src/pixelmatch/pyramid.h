@@ -0,0 +1,100 @@
+#pragma once
+
+#include <pixelmatch/pixelmatch.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace pixelmatch {
+
+namespace detail {
+
+/// Per-channel range of the colors of a block of pixels, blended with white as in colorDelta().
+/// Empty, with min > max, for blocks outside of the image.
+struct ColorRange {
+  uint8_t min[3];
+  uint8_t max[3];
+};
+
+/// Size of the square tiles that the pyramid is split into, matching the bands of pixelmatch().
+constexpr int kPyramidTileSize = 64;
+/// Size of the blocks of the finest level, the granularity of the fine comparison.
+constexpr int kPyramidBlockSize = 4;
+/// Number of levels, from blocks of kPyramidBlockSize to a single block per tile.
+constexpr int kPyramidLevels = 5;
+/// Number of ranges per tile, over all levels: 16x16, 8x8, 4x4, 2x2 and 1x1 blocks.
+constexpr int kPyramidTileRanges = 256 + 64 + 16 + 4 + 1;
+/// Number of block rows and columns of the finest level of a tile.
+constexpr int kPyramidTileBlocks = kPyramidTileSize / kPyramidBlockSize;
+
+static_assert(kPyramidBlockSize << (kPyramidLevels - 1) == kPyramidTileSize,
+              "The coarsest level must have a single block per tile");
+
+/**
+ * Computes the ranges of all levels of a tile of an image, in the layout of
+ * \ref ImagePyramid::tileRanges.
+ *
+ * @param tile Top-left pixel of the tile.
+ * @param columns Width of the tile, clamped to the image, at most kPyramidTileSize.
+ * @param rows Height of the tile, clamped to the image, at most kPyramidTileSize.
+ * @param strideInPixels Stride of the image, in pixels.
+ * @param[out] ranges kPyramidTileRanges ranges.
+ */
+void computeTileRanges(const uint8_t* tile, int columns, int rows, size_t strideInPixels,
+                       ColorRange* ranges);
+
+/**
+ * Finds the blocks of the finest level of a tile where a pixel of img1 and the pixel of img2 at
+ * the same position may have a color delta above \ref maxDelta, descending from the coarsest level
+ * into the blocks that cannot be ruled out.
+ *
+ * The bound is the largest delta of any pair of colors in the ranges of the two blocks, so a block
+ * that is not flagged is guaranteed to hold no pixel above the threshold.
+ *
+ * @param ranges1 Ranges of the tile in img1, from \ref computeTileRanges.
+ * @param ranges2 Ranges of the same tile in img2.
+ * @param[out] flagged Bit x of flagged[y] is set for each flagged block (x, y) of the finest level.
+ */
+void findCandidateBlocks(const ColorRange* ranges1, const ColorRange* ranges2, float maxDelta,
+                         uint16_t flagged[kPyramidTileBlocks]);
+
+}  // namespace detail
+
+/**
+ * Coarse levels of an image for Engine::CoarseToFine: the per-channel minimum and maximum of its
+ * colors over blocks of 4x4, 8x8, 16x16, 32x32 and 64x64 pixels.
+ *
+ * Building the pyramid reads the whole image once. For a golden image compared against many
+ * candidates, build it once and pass it as Options::img1Pyramid, so that each comparison only
+ * computes the blocks of the candidate that differ from the golden image.
+ */
+class ImagePyramid {
+public:
+  ImagePyramid() = default;
+
+  /**
+   * Builds the pyramid of an image, with the same requirements as the arguments of
+   * \ref pixelmatch. Leaves the pyramid empty if a precondition fails.
+   */
+  ImagePyramid(span<const uint8_t> img, int width, int height, size_t strideInPixels);
+
+  int width() const { return width_; }    //!< Width of the image, in pixels.
+  int height() const { return height_; }  //!< Height of the image, in pixels.
+  bool empty() const { return ranges_.empty(); }
+
+  /// Returns the kPyramidTileRanges ranges of tile (\ref tileX, \ref tileY): the finest level
+  /// first, each level in row-major order.
+  const detail::ColorRange* tileRanges(int tileX, int tileY) const {
+    return ranges_.data() +
+           (static_cast<size_t>(tileY) * tileColumns_ + tileX) * detail::kPyramidTileRanges;
+  }
+
+private:
+  int width_ = 0;
+  int height_ = 0;
+  int tileColumns_ = 0;
+  std::vector<detail::ColorRange> ranges_;
+};
+
+}  // namespace pixelmatch
@@ -0,0 +1,260 @@
+#include "pixelmatch/signature.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+
+#include "pixelmatch/yiq.h"
+
+namespace pixelmatch {
+
+namespace detail {
+
+namespace {
+
+// Multiplier and shift of MurmurHash64A, mixing each 8-byte word into the hash.
+constexpr uint64_t kMultiplier = 0xc6a4a7935bd1e995ULL;
+constexpr int kShift = 47;
+constexpr uint64_t kSeed = 0x9e3779b97f4a7c15ULL;
+
+// Words of a row are spread across this many independent hashes, so that their multiplications
+// overlap rather than wait on each other.
+constexpr int kLanes = 4;
+
+// Square root of the largest possible color delta, 35215, rounded up.
+constexpr double kMaxDeltaNorm = 187.7;
+// Relative margin on the square root of maxDelta, covering the rounding of the float deltas and
+// the error of Engine::FixedPoint, below 1% of the delta.
+constexpr double kThresholdMargin = 1.01;
+// Absolute margin on the norm of the difference of the means, covering their rounding to float.
+constexpr double kMeanMargin = 0.05;
+
+uint64_t loadLittleEndian(const uint8_t* bytes, int numBytes) {
+  uint64_t value = 0;
+  for (int i = 0; i < numBytes; ++i) {
+    value |= uint64_t(bytes[i]) << (8 * i);
+  }
+  return value;
+}
+
+uint64_t mix(uint64_t hash, uint64_t word) {
+  word *= kMultiplier;
+  word ^= word >> kShift;
+  word *= kMultiplier;
+  hash ^= word;
+  return hash * kMultiplier;
+}
+
+uint64_t finalize(uint64_t hash) {
+  hash ^= hash >> kShift;
+  hash *= kMultiplier;
+  return hash ^ (hash >> kShift);
+}
+
+}  // namespace
+
+uint64_t hashTile(const uint8_t* tile, int columns, int rows, size_t strideInPixels) {
+  uint64_t lanes[kLanes];
+  for (int lane = 0; lane < kLanes; ++lane) {
+    lanes[lane] = kSeed + lane;
+  }
+
+  const size_t rowBytes = static_cast<size_t>(columns) * 4;
+  for (int y = 0; y < rows; ++y) {
+    const uint8_t* row = tile + y * strideInPixels * 4;
+    size_t i = 0;
+    for (; i + 8 * kLanes <= rowBytes; i += 8 * kLanes) {
+      for (int lane = 0; lane < kLanes; ++lane) {
+        lanes[lane] = mix(lanes[lane], loadLittleEndian(row + i + 8 * lane, 8));
+      }
+    }
+    for (int lane = 0; i + 8 <= rowBytes; i += 8, ++lane) {
+      lanes[lane] = mix(lanes[lane], loadLittleEndian(row + i, 8));
+    }
+    // The last pixel of rows of an odd number of pixels.
+    if (i < rowBytes) {
+      lanes[0] = mix(lanes[0], loadLittleEndian(row + i, 4));
+    }
+  }
+
+  uint64_t hash = mix(kSeed, (uint64_t(uint32_t(columns)) << 32) | uint32_t(rows));
+  for (int lane = 0; lane < kLanes; ++lane) {
+    hash = mix(hash, lanes[lane]);
+  }
+  return finalize(hash);
+}
+
+MeanYiq meanTileYiq(const uint8_t* tile, int columns, int rows, size_t strideInPixels) {
+  double y = 0.0;
+  double i = 0.0;
+  double q = 0.0;
+  for (int row = 0; row < rows; ++row) {
+    const uint8_t* pixel = tile + row * strideInPixels * 4;
+    for (int x = 0; x < columns; ++x, pixel += 4) {
+      uint8_t r = pixel[0];
+      uint8_t g = pixel[1];
+      uint8_t b = pixel[2];
+      if (pixel[3] < 255) {
+        const float alpha = pixel[3] / 255.0f;
+        r = blend(r, alpha);
+        g = blend(g, alpha);
+        b = blend(b, alpha);
+      }
+      y += rgb2y(r, g, b);
+      i += rgb2i(r, g, b);
+      q += rgb2q(r, g, b);
+    }
+  }
+
+  const double numPixels = double(columns) * rows;
+  return MeanYiq{float(y / numPixels), float(i / numPixels), float(q / numPixels)};
+}
+
+int minPixelsAboveThreshold(const MeanYiq& mean1, const MeanYiq& mean2, int numPixels,
+                            float maxDelta) {
+  const double y = double(mean1.y) - mean2.y;
+  const double i = double(mean1.i) - mean2.i;
+  const double q = double(mean1.q) - mean2.q;
+  const double meanNorm =
+      std::sqrt(kDeltaWeights[0] * y * y + kDeltaWeights[1] * i * i + kDeltaWeights[2] * q * q) -
+      kMeanMargin;
+  const double thresholdNorm = std::sqrt(double(maxDelta)) * kThresholdMargin;
+  if (meanNorm <= thresholdNorm || thresholdNorm >= kMaxDeltaNorm) {
+    return 0;
+  }
+  return static_cast<int>(numPixels * (meanNorm - thresholdNorm) / (kMaxDeltaNorm - thresholdNorm));
+}
+
+}  // namespace detail
+
+namespace {
+
+// Serialized signatures start with this magic and version, followed by the width, the height and
+// the hash, then the hash and mean YIQ of each tile.
+constexpr uint8_t kMagic[4] = {'P', 'X', 'S', 'G'};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kHeaderBytes = 4 + 4 + 4 + 4 + 8;
+constexpr size_t kTileBytes = 8 + 3 * 4;
+
+void appendLittleEndian(std::vector<uint8_t>& bytes, uint64_t value, int numBytes) {
+  for (int i = 0; i < numBytes; ++i) {
+    bytes.push_back(uint8_t(value >> (8 * i)));
+  }
+}
+
+void appendFloat(std::vector<uint8_t>& bytes, float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  appendLittleEndian(bytes, bits, 4);
+}
+
+float readFloat(const uint8_t* bytes) {
+  const uint32_t bits = static_cast<uint32_t>(detail::loadLittleEndian(bytes, 4));
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+}  // namespace
+
+ImageSignature::ImageSignature(span<const uint8_t> img, int width, int height,
+                               size_t strideInPixels) {
+  // Leave the signature empty if a precondition fails, so that comparisons using it return -1.
+  if (width <= 0 || height <= 0 || strideInPixels < static_cast<size_t>(width) ||
+      !isImageSize(img.size(), width, height, strideInPixels)) {
+    assert(width > 0);
+    assert(height > 0);
+    assert(strideInPixels >= static_cast<size_t>(width) && "Stride must be greater than width");
+    assert(isImageSize(img.size(), width, height, strideInPixels) &&
+           "Image data size does not match width/height");
+    return;
+  }
+
+  width_ = width;
+  height_ = height;
+  tileColumns_ = (width + detail::kSignatureTileSize - 1) / detail::kSignatureTileSize;
+  tileRows_ = (height + detail::kSignatureTileSize - 1) / detail::kSignatureTileSize;
+  tiles_.resize(static_cast<size_t>(tileColumns_) * tileRows_);
+  for (int tileY = 0; tileY < tileRows_; ++tileY) {
+    for (int tileX = 0; tileX < tileColumns_; ++tileX) {
+      const int x = tileX * detail::kSignatureTileSize;
+      const int y = tileY * detail::kSignatureTileSize;
+      const uint8_t* pixels = img.data() + (y * strideInPixels + x) * 4;
+      const int columns = std::min(detail::kSignatureTileSize, width - x);
+      const int rows = std::min(detail::kSignatureTileSize, height - y);
+      Tile& tile = tiles_[static_cast<size_t>(tileY) * tileColumns_ + tileX];
+      tile.hash = detail::hashTile(pixels, columns, rows, strideInPixels);
+      tile.mean = detail::meanTileYiq(pixels, columns, rows, strideInPixels);
+    }
+  }
+  computeHash();
+}
+
+void ImageSignature::computeHash() {
+  const uint64_t size = (uint64_t(uint32_t(width_)) << 32) | uint32_t(height_);
+  uint64_t hash = detail::mix(detail::kSeed, size);
+  for (const Tile& tile : tiles_) {
+    hash = detail::mix(hash, tile.hash);
+  }
+  hash_ = detail::finalize(hash);
+}
+
+std::vector<uint8_t> ImageSignature::serialize() const {
+  std::vector<uint8_t> bytes(std::begin(kMagic), std::end(kMagic));
+  bytes.reserve(kHeaderBytes + tiles_.size() * kTileBytes);
+  appendLittleEndian(bytes, kVersion, 4);
+  appendLittleEndian(bytes, uint32_t(width_), 4);
+  appendLittleEndian(bytes, uint32_t(height_), 4);
+  appendLittleEndian(bytes, hash_, 8);
+  for (const Tile& tile : tiles_) {
+    appendLittleEndian(bytes, tile.hash, 8);
+    appendFloat(bytes, tile.mean.y);
+    appendFloat(bytes, tile.mean.i);
+    appendFloat(bytes, tile.mean.q);
+  }
+  return bytes;
+}
+
+std::optional<ImageSignature> ImageSignature::deserialize(span<const uint8_t> bytes) {
+  if (bytes.size() < kHeaderBytes || std::memcmp(bytes.data(), kMagic, sizeof(kMagic)) != 0 ||
+      detail::loadLittleEndian(bytes.data() + 4, 4) != kVersion) {
+    return std::nullopt;
+  }
+
+  const int64_t width = static_cast<int32_t>(detail::loadLittleEndian(bytes.data() + 8, 4));
+  const int64_t height = static_cast<int32_t>(detail::loadLittleEndian(bytes.data() + 12, 4));
+  if (width <= 0 || height <= 0) {
+    return std::nullopt;
+  }
+  const int64_t tileColumns = (width + detail::kSignatureTileSize - 1) / detail::kSignatureTileSize;
+  const int64_t tileRows = (height + detail::kSignatureTileSize - 1) / detail::kSignatureTileSize;
+  const uint64_t numTiles = static_cast<uint64_t>(tileColumns * tileRows);
+  if ((bytes.size() - kHeaderBytes) / kTileBytes != numTiles ||
+      (bytes.size() - kHeaderBytes) % kTileBytes != 0) {
+    return std::nullopt;
+  }
+
+  ImageSignature signature;
+  signature.width_ = static_cast<int>(width);
+  signature.height_ = static_cast<int>(height);
+  signature.tileColumns_ = static_cast<int>(tileColumns);
+  signature.tileRows_ = static_cast<int>(tileRows);
+  signature.tiles_.resize(numTiles);
+  const uint8_t* tileBytes = bytes.data() + kHeaderBytes;
+  for (Tile& tile : signature.tiles_) {
+    tile.hash = detail::loadLittleEndian(tileBytes, 8);
+    tile.mean = {readFloat(tileBytes + 8), readFloat(tileBytes + 12), readFloat(tileBytes + 16)};
+    tileBytes += kTileBytes;
+  }
+
+  // The hash of the whole image doubles as a checksum of the tile hashes.
+  signature.computeHash();
+  if (signature.hash_ != detail::loadLittleEndian(bytes.data() + 16, 8)) {
+    return std::nullopt;
+  }
+  return signature;
+}
+
+}  // namespace pixelmatch
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <pixelmatch/pixelmatch.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace pixelmatch {
+
+namespace detail {
+
+/// Size of the square tiles of a signature, matching the bands and tiles of pixelmatch().
+constexpr int kSignatureTileSize = 64;
+
+/// Mean brightness and chrominance of the pixels of a tile, blended with white as in colorDelta().
+struct MeanYiq {
+  float y;
+  float i;
+  float q;
+};
+
+/**
+ * Hashes the pixels of a tile of an image, row by row, without the padding of the stride. The hash
+ * only depends on the bytes of the pixels, so that it is the same on all platforms.
+ *
+ * @param tile Top-left pixel of the tile.
+ * @param columns Width of the tile, clamped to the image.
+ * @param rows Height of the tile, clamped to the image.
+ * @param strideInPixels Stride of the image, in pixels.
+ */
+uint64_t hashTile(const uint8_t* tile, int columns, int rows, size_t strideInPixels);
+
+/// Computes the mean YIQ of the pixels of a tile, with the same arguments as \ref hashTile.
+MeanYiq meanTileYiq(const uint8_t* tile, int columns, int rows, size_t strideInPixels);
+
+/**
+ * Returns a lower bound of the number of pixels of a tile with a color delta above \ref maxDelta,
+ * given the mean YIQ of the tile in both images.
+ *
+ * The square root of the delta is a norm of the YIQ difference, so its mean over the tile is at
+ * least the norm of the difference of the means. Pixels below the threshold contribute at most
+ * sqrt(maxDelta) to that mean, and the others at most sqrt(35215), bounding how many there are.
+ * The bound is loose enough to hold with Engine::FixedPoint.
+ */
+int minPixelsAboveThreshold(const MeanYiq& mean1, const MeanYiq& mean2, int numPixels,
+                            float maxDelta);
+
+}  // namespace detail
+
+/**
+ * Signature of an image: a hash of the whole image, and the hash and mean YIQ of each tile of 64x64
+ * pixels.
+ *
+ * Computing the signature reads the whole image once. For a golden image compared against many
+ * candidates, compute it once, or serialize it next to the golden image, and pass it as
+ * Options::img1Signature. Comparisons then hash the tiles of the candidate instead of comparing
+ * them to the golden image, skip the tiles whose hash matches without reading the golden image, and
+ * with Options::maxDiffs and Options::includeAA, reject candidates whose tile means are too far
+ * apart before comparing any pixel.
+ *
+ * The hashes are not cryptographic: two different tiles have the same hash with a probability of
+ * about 2^-64, in which case their differences are missed.
+ */
+class ImageSignature {
+public:
+  ImageSignature() = default;
+
+  /**
+   * Computes the signature of an image, with the same requirements as the arguments of
+   * \ref pixelmatch. Leaves the signature empty if a precondition fails.
+   */
+  ImageSignature(span<const uint8_t> img, int width, int height, size_t strideInPixels);
+
+  /// Parses a signature written by \ref serialize. Returns nullopt if the bytes are not a valid
+  /// signature.
+  static std::optional<ImageSignature> deserialize(span<const uint8_t> bytes);
+
+  /// Writes the signature as bytes, in the same little-endian format on all platforms.
+  std::vector<uint8_t> serialize() const;
+
+  int width() const { return width_; }    //!< Width of the image, in pixels.
+  int height() const { return height_; }  //!< Height of the image, in pixels.
+  bool empty() const { return tiles_.empty(); }
+
+  /// Hash of the whole image, combining its size and the hashes of its tiles.
+  uint64_t hash() const { return hash_; }
+
+  int tileColumns() const { return tileColumns_; }  //!< Number of tiles per row.
+  int tileRows() const { return tileRows_; }        //!< Number of rows of tiles.
+
+  /// Hash of tile (\ref tileX, \ref tileY), see detail::hashTile().
+  uint64_t tileHash(int tileX, int tileY) const { return tile(tileX, tileY).hash; }
+
+  /// Mean YIQ of tile (\ref tileX, \ref tileY), see detail::meanTileYiq().
+  const detail::MeanYiq& tileMean(int tileX, int tileY) const { return tile(tileX, tileY).mean; }
+
+  /// Returns true if both signatures are of images of the same size with the same hash, without
+  /// reading the images: with the probability of a hash collision, if the images are identical.
+  bool operator==(const ImageSignature& other) const {
+    return width_ == other.width_ && height_ == other.height_ && hash_ == other.hash_;
+  }
+  bool operator!=(const ImageSignature& other) const { return !(*this == other); }
+
+private:
+  struct Tile {
+    uint64_t hash;
+    detail::MeanYiq mean;
+  };
+
+  const Tile& tile(int tileX, int tileY) const {
+    return tiles_[static_cast<size_t>(tileY) * tileColumns_ + tileX];
+  }
+
+  /// Combines the size and the tile hashes into \ref hash_.
+  void computeHash();
+
+  int width_ = 0;
+  int height_ = 0;
+  int tileColumns_ = 0;
+  int tileRows_ = 0;
+  uint64_t hash_ = 0;
+  std::vector<Tile> tiles_;
+};
+
+}  // namespace pixelmatch
@@ -0,0 +1,267 @@
+#include "pixelmatch/simd.h"
+
+#include <cmath>
+
+#include "pixelmatch/simd_kernels.h"
+#include "pixelmatch/yiq.h"
+
+#if defined(PIXELMATCH_SIMD_X86)
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(PIXELMATCH_SIMD_NEON)
+#include <arm_neon.h>
+#endif
+
+#if defined(PIXELMATCH_SIMD_WASM)
+#include <wasm_simd128.h>
+#endif
+
+namespace pixelmatch::detail {
+
+namespace {
+
+template <bool kOpaque>
+bool colorDeltaRowScalar(const uint8_t* row1, const uint8_t* row2, size_t count, float maxDelta,
+                         float* deltas) {
+  bool above = false;
+  for (size_t x = 0; x < count; ++x) {
+    deltas[x] = colorDeltaOf<false, kOpaque>(row1 + x * 4, row2 + x * 4);
+    above |= std::abs(deltas[x]) > maxDelta;
+  }
+
+  return above;
+}
+
+constexpr SimdKernels kScalarKernels{"scalar", &colorDeltaRowScalar<false>,
+                                     &colorDeltaRowScalar<true>};
+
+#if defined(PIXELMATCH_SIMD_X86)
+
+struct Sse2Ops {
+  using F = __m128;
+  using M = __m128;
+  using I = __m128i;
+
+  static constexpr size_t kLanes = 4;
+
+  static I load(const uint8_t* pixels) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels));
+  }
+
+  template <int kShift>
+  static F channel(I px) {
+    return _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, kShift), _mm_set1_epi32(0xFF)));
+  }
+
+  static F set1(float value) { return _mm_set1_ps(value); }
+  static F add(F a, F b) { return _mm_add_ps(a, b); }
+  static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+  static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+  static F div(F a, F b) { return _mm_div_ps(a, b); }
+  static F abs(F a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+  static F negate(F a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+  static F truncate(F a) { return _mm_cvtepi32_ps(_mm_cvttps_epi32(a)); }
+
+  static M greater(F a, F b) { return _mm_cmpgt_ps(a, b); }
+  static F select(M mask, F a, F b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+  }
+  static M noneMask() { return _mm_setzero_ps(); }
+  static M orMask(M a, M b) { return _mm_or_ps(a, b); }
+  static bool any(M mask) { return _mm_movemask_ps(mask) != 0; }
+
+  static void store(float* dest, F value) { _mm_storeu_ps(dest, value); }
+};
+
+template <bool kOpaque>
+bool colorDeltaRowSse2(const uint8_t* row1, const uint8_t* row2, size_t count, float maxDelta,
+                       float* deltas) {
+  return ColorDeltaKernel<Sse2Ops>::template row<kOpaque>(row1, row2, count, maxDelta, deltas);
+}
+
+constexpr SimdKernels kSse2Kernels{"sse2", &colorDeltaRowSse2<false>,
+                                   &colorDeltaRowSse2<true>};
+
+bool cpuSupportsAvx2() {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_cpu_supports("avx2");
+#elif defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return false;
+  }
+
+  // AVX2 also requires the OS to save the YMM registers on context switches.
+  __cpuid(info, 1);
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+  const bool avx = (info[2] & (1 << 28)) != 0;
+  if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+    return false;
+  }
+
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  return false;
+#endif
+}
+
+#endif  // PIXELMATCH_SIMD_X86
+
+#if defined(PIXELMATCH_SIMD_NEON)
+
+struct NeonOps {
+  using F = float32x4_t;
+  using M = uint32x4_t;
+  using I = uint32x4_t;
+
+  static constexpr size_t kLanes = 4;
+
+  static I load(const uint8_t* pixels) { return vreinterpretq_u32_u8(vld1q_u8(pixels)); }
+
+  template <int kShift>
+  static F channel(I px) {
+    if constexpr (kShift == 0) {
+      return vcvtq_f32_u32(vandq_u32(px, vdupq_n_u32(0xFF)));
+    } else {
+      return vcvtq_f32_u32(vandq_u32(vshrq_n_u32(px, kShift), vdupq_n_u32(0xFF)));
+    }
+  }
+
+  static F set1(float value) { return vdupq_n_f32(value); }
+  static F add(F a, F b) { return vaddq_f32(a, b); }
+  static F sub(F a, F b) { return vsubq_f32(a, b); }
+  static F mul(F a, F b) { return vmulq_f32(a, b); }
+  static F div(F a, F b) { return vdivq_f32(a, b); }
+  static F abs(F a) { return vabsq_f32(a); }
+  static F negate(F a) { return vnegq_f32(a); }
+  static F truncate(F a) { return vcvtq_f32_s32(vcvtq_s32_f32(a)); }
+
+  static M greater(F a, F b) { return vcgtq_f32(a, b); }
+  static F select(M mask, F a, F b) { return vbslq_f32(mask, a, b); }
+  static M noneMask() { return vdupq_n_u32(0); }
+  static M orMask(M a, M b) { return vorrq_u32(a, b); }
+  static bool any(M mask) { return vmaxvq_u32(mask) != 0; }
+
+  static void store(float* dest, F value) { vst1q_f32(dest, value); }
+};
+
+template <bool kOpaque>
+bool colorDeltaRowNeon(const uint8_t* row1, const uint8_t* row2, size_t count, float maxDelta,
+                       float* deltas) {
+  return ColorDeltaKernel<NeonOps>::template row<kOpaque>(row1, row2, count, maxDelta, deltas);
+}
+
+constexpr SimdKernels kNeonKernels{"neon", &colorDeltaRowNeon<false>,
+                                   &colorDeltaRowNeon<true>};
+
+#endif  // PIXELMATCH_SIMD_NEON
+
+#if defined(PIXELMATCH_SIMD_WASM)
+
+struct WasmSimd128Ops {
+  using F = v128_t;
+  using M = v128_t;
+  using I = v128_t;
+
+  static constexpr size_t kLanes = 4;
+
+  static I load(const uint8_t* pixels) { return wasm_v128_load(pixels); }
+
+  template <int kShift>
+  static F channel(I px) {
+    return wasm_f32x4_convert_u32x4(
+        wasm_v128_and(wasm_u32x4_shr(px, kShift), wasm_i32x4_splat(0xFF)));
+  }
+
+  static F set1(float value) { return wasm_f32x4_splat(value); }
+  static F add(F a, F b) { return wasm_f32x4_add(a, b); }
+  static F sub(F a, F b) { return wasm_f32x4_sub(a, b); }
+  static F mul(F a, F b) { return wasm_f32x4_mul(a, b); }
+  static F div(F a, F b) { return wasm_f32x4_div(a, b); }
+  static F abs(F a) { return wasm_f32x4_abs(a); }
+  static F negate(F a) { return wasm_f32x4_neg(a); }
+  // Blended channels are within [0, 255], so saturation never applies.
+  static F truncate(F a) { return wasm_f32x4_convert_i32x4(wasm_i32x4_trunc_sat_f32x4(a)); }
+
+  static M greater(F a, F b) { return wasm_f32x4_gt(a, b); }
+  static F select(M mask, F a, F b) { return wasm_v128_bitselect(a, b, mask); }
+  static M noneMask() { return wasm_i32x4_splat(0); }
+  static M orMask(M a, M b) { return wasm_v128_or(a, b); }
+  static bool any(M mask) { return wasm_v128_any_true(mask); }
+
+  static void store(float* dest, F value) { wasm_v128_store(dest, value); }
+};
+
+template <bool kOpaque>
+bool colorDeltaRowWasmSimd128(const uint8_t* row1, const uint8_t* row2, size_t count,
+                              float maxDelta, float* deltas) {
+  return ColorDeltaKernel<WasmSimd128Ops>::template row<kOpaque>(row1, row2, count, maxDelta,
+                                                                  deltas);
+}
+
+constexpr SimdKernels kWasmSimd128Kernels{"wasm_simd128", &colorDeltaRowWasmSimd128<false>,
+                                          &colorDeltaRowWasmSimd128<true>};
+
+#endif  // PIXELMATCH_SIMD_WASM
+
+}  // namespace
+
+const SimdKernels& scalarKernels() {
+  return kScalarKernels;
+}
+
+const SimdKernels* sse2Kernels() {
+#if defined(PIXELMATCH_SIMD_X86)
+  return &kSse2Kernels;
+#else
+  return nullptr;
+#endif
+}
+
+const SimdKernels* neonKernels() {
+#if defined(PIXELMATCH_SIMD_NEON)
+  return &kNeonKernels;
+#else
+  return nullptr;
+#endif
+}
+
+const SimdKernels* wasmSimd128Kernels() {
+#if defined(PIXELMATCH_SIMD_WASM)
+  return &kWasmSimd128Kernels;
+#else
+  return nullptr;
+#endif
+}
+
+std::vector<const SimdKernels*> supportedKernels() {
+  std::vector<const SimdKernels*> result;
+
+#if defined(PIXELMATCH_SIMD_X86)
+  if (avx2Kernels() && cpuSupportsAvx2()) {
+    result.push_back(avx2Kernels());
+  }
+#endif
+
+  for (const SimdKernels* kernels : {sse2Kernels(), neonKernels(), wasmSimd128Kernels()}) {
+    if (kernels) {
+      result.push_back(kernels);
+    }
+  }
+
+  result.push_back(&scalarKernels());
+  return result;
+}
+
+const SimdKernels& bestKernels() {
+  static const SimdKernels* const kBest = supportedKernels().front();
+  return *kBest;
+}
+
+}  // namespace pixelmatch::detail
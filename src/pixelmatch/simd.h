@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PIXELMATCH_SIMD_X86 1  //!< SSE2 is always available, AVX2 is detected at runtime.
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define PIXELMATCH_SIMD_NEON 1  //!< NEON is always available on AArch64.
+#endif
+
+#if defined(__wasm_simd128__)
+#define PIXELMATCH_SIMD_WASM 1  //!< SIMD128 is enabled at compile time, with -msimd128.
+#endif
+
+namespace pixelmatch::detail {
+
+/**
+ * Computes colorDelta() for a run of consecutive pixels.
+ *
+ * @param row1 First run of RGBA-encoded pixels, \ref count * 4 bytes long.
+ * @param row2 Second run of pixels, same size as \ref row1.
+ * @param count Number of pixels in the run.
+ * @param maxDelta Threshold for the magnitude of the delta.
+ * @param deltas Destination for \ref count deltas, bit-identical to colorDelta() with yOnly=false.
+ * @return true if the magnitude of any of the deltas is above \ref maxDelta.
+ */
+using ColorDeltaRowFn = bool (*)(const uint8_t* row1, const uint8_t* row2, size_t count,
+                                 float maxDelta, float* deltas);
+
+/**
+ * A set of kernels targeting one instruction set.
+ */
+struct SimdKernels {
+  const char* name;               //!< Instruction set name, for tests and benchmarks.
+  ColorDeltaRowFn colorDeltaRow;  //!< Per-pixel color delta and threshold check.
+  /// Same as \ref colorDeltaRow, for runs where the pixels of both rows are all opaque, skipping
+  /// the blend with white.
+  ColorDeltaRowFn colorDeltaRowOpaque;
+};
+
+/// Returns the portable scalar kernels, which are always available.
+const SimdKernels& scalarKernels();
+
+/// Returns the SSE2 kernels, or nullptr if they are not compiled into this build.
+const SimdKernels* sse2Kernels();
+
+/// Returns the AVX2 kernels, or nullptr if they are not compiled into this build.
+const SimdKernels* avx2Kernels();
+
+/// Returns the NEON kernels, or nullptr if they are not compiled into this build.
+const SimdKernels* neonKernels();
+
+/// Returns the WebAssembly SIMD128 kernels, or nullptr if they are not compiled into this build.
+const SimdKernels* wasmSimd128Kernels();
+
+/// Returns all kernels that can run on this CPU, best first. The last entry is always
+/// \ref scalarKernels().
+std::vector<const SimdKernels*> supportedKernels();
+
+/// Returns the best kernels for this CPU, detected once on first use.
+const SimdKernels& bestKernels();
+
+}  // namespace pixelmatch::detail
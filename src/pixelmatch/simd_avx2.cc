@@ -0,0 +1,96 @@
+#include "pixelmatch/simd.h"
+
+// Included ahead of the AVX2 target region below, so that only the kernels are compiled for AVX2.
+#include "pixelmatch/yiq.h"
+
+#if defined(PIXELMATCH_SIMD_X86)
+
+#include <immintrin.h>
+
+// Compile this file's kernels for AVX2 regardless of the build flags, they are only called once
+// bestKernels() has checked that the CPU supports them. MSVC accepts AVX2 intrinsics without this.
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+#include "pixelmatch/simd_kernels.h"
+
+namespace pixelmatch::detail {
+
+namespace {
+
+struct Avx2Ops {
+  using F = __m256;
+  using M = __m256;
+  using I = __m256i;
+
+  static constexpr size_t kLanes = 8;
+
+  static I load(const uint8_t* pixels) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels));
+  }
+
+  template <int kShift>
+  static F channel(I px) {
+    return _mm256_cvtepi32_ps(
+        _mm256_and_si256(_mm256_srli_epi32(px, kShift), _mm256_set1_epi32(0xFF)));
+  }
+
+  static F set1(float value) { return _mm256_set1_ps(value); }
+  static F add(F a, F b) { return _mm256_add_ps(a, b); }
+  static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+  static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+  static F div(F a, F b) { return _mm256_div_ps(a, b); }
+  static F abs(F a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+  static F negate(F a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+  static F truncate(F a) { return _mm256_cvtepi32_ps(_mm256_cvttps_epi32(a)); }
+
+  static M greater(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+  static F select(M mask, F a, F b) { return _mm256_blendv_ps(b, a, mask); }
+  static M noneMask() { return _mm256_setzero_ps(); }
+  static M orMask(M a, M b) { return _mm256_or_ps(a, b); }
+  static bool any(M mask) { return _mm256_movemask_ps(mask) != 0; }
+
+  static void store(float* dest, F value) { _mm256_storeu_ps(dest, value); }
+};
+
+template <bool kOpaque>
+bool colorDeltaRowAvx2(const uint8_t* row1, const uint8_t* row2, size_t count, float maxDelta,
+                       float* deltas) {
+  return ColorDeltaKernel<Avx2Ops>::template row<kOpaque>(row1, row2, count, maxDelta, deltas);
+}
+
+}  // namespace
+
+}  // namespace pixelmatch::detail
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+namespace pixelmatch::detail {
+
+const SimdKernels* avx2Kernels() {
+  static constexpr SimdKernels kAvx2Kernels{"avx2", &colorDeltaRowAvx2<false>,
+                                            &colorDeltaRowAvx2<true>};
+  return &kAvx2Kernels;
+}
+
+}  // namespace pixelmatch::detail
+
+#else
+
+namespace pixelmatch::detail {
+
+const SimdKernels* avx2Kernels() {
+  return nullptr;
+}
+
+}  // namespace pixelmatch::detail
+
+#endif  // PIXELMATCH_SIMD_X86
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <pixelmatch/yiq.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace pixelmatch::detail {
+
+/**
+ * Vectorized kernels, written once against a minimal vector interface and instantiated for each
+ * instruction set in simd.cc and simd_avx2.cc.
+ *
+ * \tparam Ops Vector operations for one instruction set, with the following members:
+ *   - `F` (a vector of floats), `M` (a lane mask) and `I` (a vector of RGBA pixels).
+ *   - `kLanes`, the number of pixels per vector.
+ *   - `load(const uint8_t*)`, unaligned load of `kLanes` pixels.
+ *   - `channel<kShift>(I)`, the byte at bit offset `kShift` of each pixel, converted to float.
+ *   - `set1`, `add`, `sub`, `mul`, `div`, `abs`, `negate` and `truncate` (round toward zero).
+ *   - `greater(F, F)`, `select(M, F, F)`, `noneMask()`, `orMask(M, M)` and `any(M)`.
+ *   - `store(float*, F)`, unaligned store.
+ *
+ * Every operation must round exactly like its scalar counterpart in yiq.h, so the kernels never
+ * fuse multiplies and adds. Translation units including this header may be compiled for a wider
+ * instruction set than the rest of the library; they must not odr-use any of the non-template
+ * inline functions in yiq.h.
+ */
+template <typename Ops>
+struct ColorDeltaKernel {
+  using F = typename Ops::F;
+  using M = typename Ops::M;
+  using I = typename Ops::I;
+
+  static constexpr size_t kLanes = Ops::kLanes;
+
+  struct Yiq {
+    F y;
+    F i;
+    F q;
+  };
+
+  /// Matches blend(): for opaque pixels alpha is exactly 1 and this is a no-op, so the scalar
+  /// alpha check does not need a branch.
+  static F blend(F c, F alpha) {
+    const F white = Ops::set1(255.0f);
+    return Ops::truncate(Ops::add(white, Ops::mul(Ops::sub(c, white), alpha)));
+  }
+
+  static F term(F channel, float coefficient) {
+    return Ops::mul(channel, Ops::set1(coefficient));
+  }
+
+  /// With \ref kOpaque, every pixel must be opaque, and the blend is skipped.
+  template <bool kOpaque>
+  static Yiq toYiq(I px) {
+    F r = Ops::template channel<0>(px);
+    F g = Ops::template channel<8>(px);
+    F b = Ops::template channel<16>(px);
+    if constexpr (!kOpaque) {
+      const F alpha = Ops::div(Ops::template channel<24>(px), Ops::set1(255.0f));
+      r = blend(r, alpha);
+      g = blend(g, alpha);
+      b = blend(b, alpha);
+    }
+
+    Yiq result;
+    result.y = Ops::add(Ops::add(term(r, kRgb2Y[0]), term(g, kRgb2Y[1])), term(b, kRgb2Y[2]));
+    result.i = Ops::sub(Ops::sub(term(r, kRgb2I[0]), term(g, kRgb2I[1])), term(b, kRgb2I[2]));
+    result.q = Ops::add(Ops::sub(term(r, kRgb2Q[0]), term(g, kRgb2Q[1])), term(b, kRgb2Q[2]));
+    return result;
+  }
+
+  static F weighted(F value, float weight) {
+    return Ops::mul(Ops::mul(Ops::set1(weight), value), value);
+  }
+
+  /// Computes the deltas of \ref kLanes pixels and returns the mask of those above \ref maxDelta.
+  template <bool kOpaque>
+  static M block(const uint8_t* px1, const uint8_t* px2, F maxDelta, float* deltas) {
+    const Yiq c1 = toYiq<kOpaque>(Ops::load(px1));
+    const Yiq c2 = toYiq<kOpaque>(Ops::load(px2));
+
+    const F y = Ops::sub(c1.y, c2.y);
+    const F i = Ops::sub(c1.i, c2.i);
+    const F q = Ops::sub(c1.q, c2.q);
+
+    const F delta =
+        Ops::add(Ops::add(weighted(y, kDeltaWeights[0]), weighted(i, kDeltaWeights[1])),
+                 weighted(q, kDeltaWeights[2]));
+
+    // Encode whether the pixel lightens or darkens in the sign.
+    const F signedDelta = Ops::select(Ops::greater(c1.y, c2.y), Ops::negate(delta), delta);
+    Ops::store(deltas, signedDelta);
+    return Ops::greater(Ops::abs(signedDelta), maxDelta);
+  }
+
+  /// Implements \ref ColorDeltaRowFn, processing two vectors per iteration. With \ref kOpaque, all
+  /// pixels of both rows must be opaque.
+  template <bool kOpaque>
+  static bool row(const uint8_t* row1, const uint8_t* row2, size_t count, float maxDelta,
+                  float* deltas) {
+    const F max = Ops::set1(maxDelta);
+    M above = Ops::noneMask();
+
+    size_t x = 0;
+    for (; x + 2 * kLanes <= count; x += 2 * kLanes) {
+      above = Ops::orMask(above, block<kOpaque>(row1 + x * 4, row2 + x * 4, max, deltas + x));
+      above = Ops::orMask(above, block<kOpaque>(row1 + (x + kLanes) * 4, row2 + (x + kLanes) * 4,
+                                                max, deltas + x + kLanes));
+    }
+
+    for (; x + kLanes <= count; x += kLanes) {
+      above = Ops::orMask(above, block<kOpaque>(row1 + x * 4, row2 + x * 4, max, deltas + x));
+    }
+
+    if (x < count) {
+      // Pad the tail with transparent black; identical pixels have a delta of zero, so the padding
+      // never crosses the threshold.
+      uint8_t tail1[kLanes * 4] = {};
+      uint8_t tail2[kLanes * 4] = {};
+      float tailDeltas[kLanes];
+      for (size_t i = 0; i < (count - x) * 4; ++i) {
+        tail1[i] = row1[x * 4 + i];
+        tail2[i] = row2[x * 4 + i];
+      }
+
+      above = Ops::orMask(above, block<kOpaque>(tail1, tail2, max, tailDeltas));
+      for (size_t i = 0; i < count - x; ++i) {
+        deltas[x + i] = tailDeltas[i];
+      }
+    }
+
+    return Ops::any(above);
+  }
+};
+
+}  // namespace pixelmatch::detail
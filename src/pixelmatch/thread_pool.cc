@@ -0,0 +1,96 @@
+#include "pixelmatch/thread_pool.h"
+
+#include <algorithm>
+
+namespace pixelmatch::detail {
+
+ThreadPool::ThreadPool(int numThreads) {
+  const int resolved = resolveNumThreads(numThreads);
+  workers_.reserve(resolved - 1);
+  for (int i = 1; i < resolved; ++i) {
+    workers_.emplace_back([this, i] { workerLoop(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+
+  wake_.notify_all();
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::parallelFor(size_t count, const Task& task) {
+  if (workers_.empty() || count <= 1) {
+    for (size_t i = 0; i < count; ++i) {
+      task(i, 0);
+    }
+    return;
+  }
+
+  std::lock_guard<std::mutex> jobLock(jobMutex_);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &task;
+    count_ = count;
+    next_ = 0;
+    pendingWorkers_ = workers_.size();
+    ++generation_;
+  }
+
+  wake_.notify_all();
+  runTasks(0);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this] { return pendingWorkers_ == 0; });
+  task_ = nullptr;
+}
+
+int ThreadPool::resolveNumThreads(int numThreads) {
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+  // WebAssembly builds without -pthread cannot start threads, so the calling thread runs all tasks.
+  return 1;
+#endif
+
+  if (numThreads > 0) {
+    return numThreads;
+  }
+
+  return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+void ThreadPool::workerLoop(size_t thread) {
+  uint64_t seenGeneration = 0;
+
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [&] { return stop_ || generation_ != seenGeneration; });
+      if (stop_) {
+        return;
+      }
+
+      seenGeneration = generation_;
+    }
+
+    runTasks(thread);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--pendingWorkers_ == 0) {
+      done_.notify_one();
+    }
+  }
+}
+
+void ThreadPool::runTasks(size_t thread) {
+  for (size_t i = next_.fetch_add(1); i < count_; i = next_.fetch_add(1)) {
+    (*task_)(i, thread);
+  }
+}
+
+}  // namespace pixelmatch::detail
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pixelmatch::detail {
+
+/**
+ * A fixed-size pool of worker threads, used to split comparisons across cores.
+ *
+ * Runs one \ref parallelFor at a time; concurrent callers are serialized.
+ */
+class ThreadPool {
+public:
+  /**
+   * Task callback, called with the task index and the index of the thread it runs on, which is in
+   * the range [0, numThreads()) and can be used to select per-thread scratch data.
+   */
+  using Task = std::function<void(size_t index, size_t thread)>;
+
+  /**
+   * Creates a pool.
+   *
+   * @param numThreads Total number of threads, including the thread calling \ref parallelFor. 0
+   *                   uses the hardware concurrency.
+   */
+  explicit ThreadPool(int numThreads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /// Returns the number of threads that run tasks, including the calling thread.
+  size_t numThreads() const { return workers_.size() + 1; }
+
+  /**
+   * Runs \ref task for each index in [0, count) and waits for all of them to finish. The calling
+   * thread runs tasks too, as thread 0.
+   */
+  void parallelFor(size_t count, const Task& task);
+
+  /// Resolves a requested thread count, where 0 means the hardware concurrency. Always 1 in
+  /// WebAssembly builds without pthreads.
+  static int resolveNumThreads(int numThreads);
+
+private:
+  void workerLoop(size_t thread);
+  void runTasks(size_t thread);
+
+  std::mutex jobMutex_;  //!< Serializes parallelFor() calls.
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  const Task* task_ = nullptr;
+  size_t count_ = 0;
+  std::atomic<size_t> next_{0};
+  size_t pendingWorkers_ = 0;
+  uint64_t generation_ = 0;
+  bool stop_ = false;
+
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace pixelmatch::detail
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <pixelmatch/pixelmatch.h>
+
+#include <cstdint>
+
+namespace pixelmatch::detail {
+
+// YIQ conversion coefficients, shared by the scalar helpers below and the vectorized kernels in
+// simd_kernels.h so that both round identically.
+inline constexpr float kRgb2Y[3] = {0.29889531f, 0.58662247f, 0.11448223f};
+inline constexpr float kRgb2I[3] = {0.59597799f, 0.27417610f, 0.32180189f};
+inline constexpr float kRgb2Q[3] = {0.21147017f, 0.52261711f, 0.31114694f};
+
+// Weights of the Y, I and Q components in the perceptual delta.
+inline constexpr float kDeltaWeights[3] = {0.5053f, 0.299f, 0.1957f};
+
+inline float rgb2y(uint8_t r, uint8_t g, uint8_t b) {
+  return r * kRgb2Y[0] + g * kRgb2Y[1] + b * kRgb2Y[2];
+}
+
+inline float rgb2i(uint8_t r, uint8_t g, uint8_t b) {
+  return r * kRgb2I[0] - g * kRgb2I[1] - b * kRgb2I[2];
+}
+
+inline float rgb2q(uint8_t r, uint8_t g, uint8_t b) {
+  return r * kRgb2Q[0] - g * kRgb2Q[1] + b * kRgb2Q[2];
+}
+
+/**
+ * Blend semi-transparent color with white.
+ *
+ * @param color The color to blend.
+ * @param alpha The alpha value of the color, between 0 and 1.
+ * @return The blended color.
+ */
+inline uint8_t blend(uint8_t c, float a) {
+  return static_cast<uint8_t>(255.0f + (static_cast<float>(c) - 255.0f) * a);
+}
+
+/**
+ * Brightness of an RGBA-encoded pixel blended with white, exactly as computed by colorDelta().
+ *
+ * @param pixel The pixel, with unpremultiplied alpha.
+ */
+inline float blendedY(const uint8_t* pixel) {
+  uint8_t r = pixel[0];
+  uint8_t g = pixel[1];
+  uint8_t b = pixel[2];
+  if (pixel[3] < 255) {
+    const float alpha = pixel[3] / 255.0f;
+    r = blend(r, alpha);
+    g = blend(g, alpha);
+    b = blend(b, alpha);
+  }
+
+  return rgb2y(r, g, b);
+}
+
+/**
+ * Implements colorDelta() for two RGBA-encoded pixels, with its flags fixed at compile time.
+ *
+ * \tparam kYOnly Check for brightness difference only.
+ * \tparam kOpaque Both pixels are opaque, so that they need not be blended with white.
+ */
+template <bool kYOnly, bool kOpaque>
+inline float colorDeltaOf(const uint8_t* px1, const uint8_t* px2) {
+  uint8_t r1 = px1[0];
+  uint8_t g1 = px1[1];
+  uint8_t b1 = px1[2];
+  const uint8_t a1 = px1[3];
+
+  uint8_t r2 = px2[0];
+  uint8_t g2 = px2[1];
+  uint8_t b2 = px2[2];
+  const uint8_t a2 = px2[3];
+
+  if (r1 == r2 && g1 == g2 && b1 == b2 && a1 == a2) {
+    return 0;
+  }
+
+  // If there's alpha, blend with a white background.
+  if (!kOpaque && a1 < 255) {
+    const float alpha = a1 / 255.0f;
+    r1 = blend(r1, alpha);
+    g1 = blend(g1, alpha);
+    b1 = blend(b1, alpha);
+  }
+
+  if (!kOpaque && a2 < 255) {
+    const float alpha = a2 / 255.0f;
+    r2 = blend(r2, alpha);
+    g2 = blend(g2, alpha);
+    b2 = blend(b2, alpha);
+  }
+
+  const float y1 = rgb2y(r1, g1, b1);
+  const float y2 = rgb2y(r2, g2, b2);
+  const float y = y1 - y2;
+
+  if (kYOnly) {
+    return y;  // Brightness difference only.
+  }
+
+  const float i = rgb2i(r1, g1, b1) - rgb2i(r2, g2, b2);
+  const float q = rgb2q(r1, g1, b1) - rgb2q(r2, g2, b2);
+
+  const float delta =
+      kDeltaWeights[0] * y * y + kDeltaWeights[1] * i * i + kDeltaWeights[2] * q * q;
+
+  // Encode whether the pixel lightens or darkens in the sign.
+  return y1 > y2 ? -delta : delta;
+}
+
+/**
+ * Calculate color difference according to the paper "Measuring perceived color difference
+ * using YIQ NTSC transmission color space in mobile applications" by Y. Kotsarenko and F. Ramos
+ *
+ * @param img1 The first image, with RGBA-encoded pixels with unpremultiplied alpha.
+ * @param img2 The second image with the same size and format as img1.
+ * @param pos1 The position in the \ref img1 buffer to start, in bytes. Should point to the start of
+ *              an RGBA-encoded pixel.
+ * @param pos2 The position in the \ref img2 buffer, same as \ref pos1.
+ * @param yOnly Check for brightness difference only.
+ * @return the delta, with sign indicating whether the pixel lightens or darkens the pixel lightens
+ *          or darkens (positive if img2 lightens). Returns 0 if the pixels are identical.
+ */
+inline float colorDelta(span<const uint8_t> img1, span<const uint8_t> img2, size_t pos1,
+                        size_t pos2, bool yOnly) {
+  return yOnly ? colorDeltaOf<true, false>(&img1[pos1], &img2[pos2])
+               : colorDeltaOf<false, false>(&img1[pos1], &img2[pos2]);
+}
+
+}  // namespace pixelmatch::detail
@@ -4,19 +4,50 @@ from pathlib import Path
 
 from ._core import (
     Color,
+    Comparator,
+    DiffResult,
+    Engine,
+    FilePairResult,
+    ImagePyramid,
+    ImageSignature,
+    IncrementalComparator,
+    Instrumentation,
     Options,
+    OutputFormat,
+    PngEncodeOptions,
+    PngFilter,
+    PngRowDecoder,
+    Rect,
+    StreamingComparator,
     __doc__,
     __version__,
+    encode_png,
+    gpu_available,
     pixelmatch,
+    pixelmatch_batch,
+    pixelmatch_device,
+    pixelmatch_files,
+    pixelmatch_stats,
+    read_png,
+    read_raw,
     rgb2yiq,
+    write_png,
+    write_raw,
 )
 
 
 def read_image(path):
+    assert Path(path).is_file(), f"{path} does not exist"
+    if str(path).lower().endswith(".png"):
+        # Decoded natively, straight into the returned array.
+        return read_png(str(path))
+    if str(path).lower().endswith(".rgba"):
+        # Memory-mapped and read-only, see write_raw().
+        return read_raw(str(path))
+
     import cv2
     import numpy as np
 
-    assert Path(path).is_file(), f"{path} does not exist"
     img = cv2.imread(path, cv2.IMREAD_UNCHANGED)
     if img.shape[2] == 3:
         B, G, R = cv2.split(img)
@@ -27,14 +58,26 @@ def read_image(path):
     return img
 
 
-def write_image(path, img):
+def write_image(path, img, options=None):
+    Path(path).resolve().parent.mkdir(parents=True, exist_ok=True)
+    if str(path).lower().endswith(".png") and img.shape[2] == 4:
+        # Encoded natively, see PngEncodeOptions for the speed and size trade-off.
+        if not write_png(str(path), img, options=options or PngEncodeOptions()):
+            msg = f"failed to write {path}"
+            raise OSError(msg)
+        return
+    if str(path).lower().endswith(".rgba"):
+        if not write_raw(str(path), img):
+            msg = f"failed to write {path}"
+            raise OSError(msg)
+        return
+
     import cv2
 
     if img.shape[2] == 3:
         img = cv2.cvtColor(img, cv2.COLOR_RGB2BGR)
     else:
         img = cv2.cvtColor(img, cv2.COLOR_RGBA2BGRA)
-    Path(path).resolve().parent.mkdir(parents=True, exist_ok=True)
     cv2.imwrite(path, img)
 
 
@@ -58,10 +101,34 @@ __all__ = [
     "__doc__",
     "__version__",
     "Color",
+    "Comparator",
+    "DiffResult",
+    "encode_png",
+    "Engine",
+    "FilePairResult",
+    "gpu_available",
+    "ImagePyramid",
+    "ImageSignature",
+    "IncrementalComparator",
+    "Instrumentation",
     "normalize_color",
     "Options",
+    "OutputFormat",
+    "PngEncodeOptions",
+    "PngFilter",
+    "PngRowDecoder",
+    "Rect",
     "rgb2yiq",
     "pixelmatch",
+    "pixelmatch_batch",
+    "pixelmatch_device",
+    "pixelmatch_files",
+    "pixelmatch_stats",
     "read_image",
+    "read_png",
+    "read_raw",
+    "StreamingComparator",
     "write_image",
+    "write_png",
+    "write_raw",
 ]
@@ -1,10 +1,33 @@
 from __future__ import annotations
 
+from pathlib import Path
 from typing import Optional
 
 import numpy as np
 
-from . import Color, Options, normalize_color, pixelmatch, read_image, write_image
+from . import (
+    Color,
+    Engine,
+    Options,
+    normalize_color,
+    pixelmatch,
+    pixelmatch_files,
+    read_image,
+    write_image,
+)
+
+
+def compare_directories(dir1: Path, dir2: Path, output: Path, options: Options, maxPairsInFlight):
+    names = sorted(p.name for p in dir1.glob("*.png") if (dir2 / p.name).is_file())
+    output.mkdir(parents=True, exist_ok=True)
+    pairs = [(str(dir1 / name), str(dir2 / name), str(output / name)) for name in names]
+    results = pixelmatch_files(pairs, options=options, maxPairsInFlight=maxPairsInFlight)
+    for name, result in zip(names, results):
+        if result.error:
+            print(f"{name}: {result.error}")  # noqa: T201
+        else:
+            print(f"{name}: #differente_pixels: {result.numDiffPixels}")  # noqa: T201
+    print(f"compared {len(names)} pairs, wrote to {output}")  # noqa: T201
 
 
 def main(
@@ -19,10 +42,18 @@ def main(
     diffColor: Color = "rgba(255,0,0,255)",
     diffColorAlt: Optional[Color] = None,  # noqa: UP007
     diffMask: bool = False,
+    numThreads: int = 1,
+    maxDiffs: Optional[int] = None,  # noqa: UP007
+    engine: str = "Float",
+    maxPairsInFlight: int = 0,
 ):
     """
     Compares two images and generates a difference image.
 
+    If img1 and img2 are directories, compares every PNG of img1 with the PNG of the same name in
+    img2 and writes the diffs into the output directory, overlapping decoding, comparing and
+    encoding of different pairs on numThreads threads.
+
     Parameters
     ----------
     img1 : str
@@ -49,6 +80,18 @@ def main(
     diffMask : bool, optional
         Whether to draw the diff over a transparent background (a mask).
         Defaults to False.
+    numThreads : int, optional
+        Number of threads to split the comparison across; 0 uses all cores.
+        Defaults to 1.
+    maxDiffs : Optional[int], optional
+        If set, stops once more than this many different pixels are found
+        and reports maxDiffs + 1; the diff image is then incomplete. Defaults to None.
+    engine : str, optional
+        Color delta implementation, "Float" or the faster but approximate "FixedPoint".
+        Defaults to "Float".
+    maxPairsInFlight : int, optional
+        When comparing directories, the maximum number of pairs held in memory at once;
+        0 uses numThreads. Defaults to 0.
     """
     options = Options()
     options.threshold = threshold
@@ -58,8 +101,15 @@ def main(
     options.diffColor = normalize_color(diffColor)
     options.diffColorAlt = normalize_color(diffColorAlt)
     options.diffMask = diffMask
+    options.numThreads = numThreads
+    options.maxDiffs = maxDiffs
+    options.engine = Engine.__members__[engine]
     print(f"options: {options}")  # noqa: T201
 
+    if Path(img1).is_dir() and Path(img2).is_dir():
+        compare_directories(Path(img1), Path(img2), Path(output), options, maxPairsInFlight)
+        return
+
     i1 = read_image(img1)
     i2 = read_image(img2)
     assert i1.shape == i2.shape, f"image size mismatch: {i1.shape} != {i2.shape}"
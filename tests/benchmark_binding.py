@@ -0,0 +1,161 @@
+"""Benchmarks of the _core binding, run with pytest-benchmark.
+
+Not collected by a plain `pytest` run; see `make benchmark_python` and `make benchmark_compare`,
+which save and compare results under build/benchmarks.
+"""
+
+from __future__ import annotations
+
+from concurrent.futures import ThreadPoolExecutor
+from pathlib import Path
+
+import numpy as np
+import pytest
+
+from pybind11_pixelmatch import (
+    Comparator,
+    Options,
+    pixelmatch,
+    pixelmatch_batch,
+    pixelmatch_stats,
+    read_image,
+)
+
+THREAD_COUNTS = [1, 2, 4, 0]
+
+
+def synthetic_pair(height, width):
+    """A textured image and a copy with a changed box, both (H, W, 4) uint8."""
+    ys, xs = np.mgrid[0:height, 0:width]
+    img1 = np.empty((height, width, 4), dtype=np.uint8)
+    img1[..., 0] = (xs // 4 + ys // 16) % 256
+    img1[..., 1] = (ys // 4) % 256
+    img1[..., 2] = ((xs + ys) // 8) % 256
+    img1[..., 3] = 255
+    img2 = img1.copy()
+    img2[height // 4 : height // 2, width // 4 : width // 2, 0] ^= 0xFF
+    return img1, img2
+
+
+@pytest.fixture(scope="module")
+def pics():
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    img1 = read_image(f"{project_source_dir}/data/pic1.png")
+    img2 = read_image(f"{project_source_dir}/data/pic2.png")
+    return img1, img2
+
+
+def report_throughput(benchmark, img, count=1):
+    height, width = img.shape[:2]
+    benchmark.extra_info["megapixels"] = width * height * count / 1e6
+
+
+# Per-call overhead: buffer requests, validation and overload resolution dominate on tiny images.
+@pytest.mark.parametrize("size", [1, 8, 64])
+def test_overhead_pixelmatch(benchmark, size):
+    benchmark.group = f"overhead {size}x{size}"
+    img1, img2 = synthetic_pair(size, size)
+    benchmark(pixelmatch, img1, img2)
+
+
+@pytest.mark.parametrize("size", [1, 8, 64])
+def test_overhead_pixelmatch_output(benchmark, size):
+    benchmark.group = f"overhead {size}x{size}"
+    img1, img2 = synthetic_pair(size, size)
+    diff = np.zeros(img1.shape, dtype=img1.dtype)
+    benchmark(pixelmatch, img1, img2, output=diff)
+
+
+@pytest.mark.parametrize("size", [1, 8, 64])
+def test_overhead_pixelmatch_options(benchmark, size):
+    benchmark.group = f"overhead {size}x{size}"
+    img1, img2 = synthetic_pair(size, size)
+    opt = Options()
+    benchmark(pixelmatch, img1, img2, options=opt)
+
+
+@pytest.mark.parametrize("size", [1, 8, 64])
+def test_overhead_pixelmatch_stats(benchmark, size):
+    benchmark.group = f"overhead {size}x{size}"
+    img1, img2 = synthetic_pair(size, size)
+    benchmark(pixelmatch_stats, img1, img2)
+
+
+@pytest.mark.parametrize("size", [1, 8, 64])
+def test_overhead_comparator(benchmark, size):
+    benchmark.group = f"overhead {size}x{size}"
+    img1, img2 = synthetic_pair(size, size)
+    comparator = Comparator()
+    benchmark(comparator.compare, img1, img2)
+
+
+@pytest.mark.parametrize("size", [8, 64])
+def test_overhead_strided_copy(benchmark, size):
+    benchmark.group = f"overhead {size}x{size}"
+    img1, img2 = synthetic_pair(size, size + 1)
+    # Crops with different row strides are copied before comparing.
+    benchmark(pixelmatch, img1[:, :size], np.ascontiguousarray(img2[:, :size]))
+
+
+# Throughput on large images; extra_info["megapixels"] divided by the mean time gives MP/s.
+def test_throughput_pics(benchmark, pics):
+    benchmark.group = "throughput"
+    img1, img2 = pics
+    report_throughput(benchmark, img1)
+    assert benchmark(pixelmatch, img1, img2) == 163889
+
+
+def test_throughput_pics_output(benchmark, pics):
+    benchmark.group = "throughput"
+    img1, img2 = pics
+    diff = np.zeros(img1.shape, dtype=img1.dtype)
+    report_throughput(benchmark, img1)
+    assert benchmark(pixelmatch, img1, img2, output=diff) == 163889
+
+
+@pytest.mark.parametrize(("height", "width"), [(1080, 1920), (2160, 3840)])
+def test_throughput_synthetic(benchmark, height, width):
+    benchmark.group = "throughput"
+    img1, img2 = synthetic_pair(height, width)
+    report_throughput(benchmark, img1)
+    benchmark(pixelmatch, img1, img2)
+
+
+# Scaling with options.numThreads (0 uses every hardware thread).
+@pytest.mark.parametrize("num_threads", THREAD_COUNTS)
+def test_scaling_threads(benchmark, num_threads):
+    benchmark.group = "scaling threads"
+    img1, img2 = synthetic_pair(2160, 3840)
+    comparator = Comparator()
+    opt = comparator.options
+    opt.numThreads = num_threads
+    comparator.options = opt
+    report_throughput(benchmark, img1)
+    benchmark(comparator.compare, img1, img2)
+
+
+@pytest.mark.parametrize("num_threads", THREAD_COUNTS)
+def test_scaling_batch(benchmark, pics, num_threads):
+    benchmark.group = "scaling batch"
+    img1, img2 = pics
+    imgs1 = np.stack([img1, img2] * 4)
+    imgs2 = np.stack([img2, img1] * 4)
+    opt = Options()
+    opt.numThreads = num_threads
+    report_throughput(benchmark, img1, count=len(imgs1))
+    assert benchmark(pixelmatch_batch, imgs1, imgs2, options=opt) == [163889] * 8
+
+
+@pytest.mark.parametrize("workers", [1, 2, 4])
+def test_scaling_python_threads(benchmark, pics, workers):
+    benchmark.group = "scaling python threads"
+    img1, img2 = pics
+    report_throughput(benchmark, img1, count=8)
+
+    # pixelmatch() releases the GIL, so calls from Python threads overlap.
+    with ThreadPoolExecutor(max_workers=workers) as executor:
+
+        def run():
+            return list(executor.map(lambda _: pixelmatch(img1, img2), range(8)))
+
+        assert benchmark(run) == [163889] * 8
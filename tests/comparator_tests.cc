@@ -0,0 +1,145 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "pixelmatch/image_utils.h"
+#include "pixelmatch/pixelmatch.h"
+#include "tests/test_support.h"
+
+namespace {
+
+// Counts heap allocations across all threads, to check that comparisons do not allocate.
+std::atomic<size_t> gAllocations{0};
+
+}  // namespace
+
+void* operator new(size_t size) {
+  gAllocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+// Not inlined, or GCC sees std::free() release memory from operator new and warns with
+// -Wmismatched-new-delete.
+[[gnu::noinline]] void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+[[gnu::noinline]] void operator delete(void* ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+namespace pixelmatch {
+
+namespace {
+
+Options defaultTestOptions() {
+  Options result;
+  result.threshold = 0.05f;
+  return result;
+}
+
+}  // namespace
+
+TEST(Comparator, MatchesPixelmatch) {
+  const std::array<std::pair<const char*, const char*>, 3> testCases = {{
+      {"tests/testdata/1a.png", "tests/testdata/1b.png"},
+      {"tests/testdata/4a.png", "tests/testdata/4b.png"},
+      {"tests/testdata/6a.png", "tests/testdata/6b.png"},
+  }};
+
+  for (const int numThreads : {1, 3}) {
+    Options options = defaultTestOptions();
+    options.numThreads = numThreads;
+    Comparator comparator(options);
+
+    // Compare images of different sizes with the same comparator.
+    for (const auto& [filename1, filename2] : testCases) {
+      SCOPED_TRACE(testing::Message() << filename1 << " numThreads=" << numThreads);
+      auto maybeImg1 = readRgbaImageFromPngFile(filename1);
+      auto maybeImg2 = readRgbaImageFromPngFile(filename2);
+      ASSERT_TRUE(maybeImg1.has_value() && maybeImg2.has_value());
+      const Image& img1 = maybeImg1.value();
+      const Image& img2 = maybeImg2.value();
+
+      std::vector<uint8_t> expectedDiff(img1.data.size());
+      const int expected = pixelmatch(img1.data, img2.data, expectedDiff, img1.width, img1.height,
+                                      img1.strideInPixels, options);
+      ASSERT_GT(expected, 0);
+
+      std::vector<uint8_t> diff(img1.data.size());
+      EXPECT_EQ(
+          comparator.compare(img1.data, img2.data, diff, img1.width, img1.height,
+                             img1.strideInPixels),
+          expected);
+      EXPECT_TRUE(diff == expectedDiff);
+
+      const DiffResult result =
+          comparator.compare(img1.data, img2.data, img1.width, img1.height, img1.strideInPixels);
+      EXPECT_EQ(result.numDiffPixels, expected);
+      EXPECT_EQ(result.numDarkerPixels + result.numLighterPixels, expected);
+    }
+  }
+}
+
+TEST(Comparator, SetOptions) {
+  auto maybeImg1 = readRgbaImageFromPngFile("tests/testdata/4a.png");
+  auto maybeImg2 = readRgbaImageFromPngFile("tests/testdata/4b.png");
+  ASSERT_TRUE(maybeImg1.has_value() && maybeImg2.has_value());
+  const Image& img1 = maybeImg1.value();
+  const Image& img2 = maybeImg2.value();
+
+  Comparator comparator(defaultTestOptions());
+  EXPECT_EQ(comparator.compare(img1.data, img2.data, span<uint8_t>(), img1.width, img1.height,
+                               img1.strideInPixels),
+            36049);
+
+  Options options = defaultTestOptions();
+  options.numThreads = 2;
+  options.maxDiffs = 10;
+  comparator.setOptions(options);
+  EXPECT_EQ(comparator.options().numThreads, 2);
+  EXPECT_EQ(comparator.compare(img1.data, img2.data, span<uint8_t>(), img1.width, img1.height,
+                               img1.strideInPixels),
+            11);
+
+  Comparator moved = std::move(comparator);
+  EXPECT_EQ(moved.compare(img1.data, img2.data, span<uint8_t>(), img1.width, img1.height,
+                          img1.strideInPixels),
+            11);
+}
+
+TEST(Comparator, SteadyStateDoesNotAllocate) {
+  constexpr int width = 1920;
+  constexpr int height = 1080;
+  const std::vector<uint8_t> img1 = generateFrame(width, height, false);
+  const std::vector<uint8_t> img2 = generateFrame(width, height, true);
+  std::vector<uint8_t> diff(img1.size());
+
+  for (const int numThreads : {1, 3}) {
+    SCOPED_TRACE(testing::Message() << "numThreads=" << numThreads);
+    Options options;
+    options.numThreads = numThreads;
+    Comparator comparator(options);
+
+    const int expected = comparator.compare(img1, img2, diff, width, height, width);
+    ASSERT_GT(expected, 0);
+    ASSERT_EQ(comparator.compare(img1, img2, span<uint8_t>(), width, height, width), expected);
+
+    const size_t allocationsBefore = gAllocations.load();
+    for (int i = 0; i < 3; ++i) {
+      EXPECT_EQ(comparator.compare(img1, img2, diff, width, height, width), expected);
+      EXPECT_EQ(comparator.compare(img1, img2, span<uint8_t>(), width, height, width), expected);
+      EXPECT_EQ(comparator.compare(img1, img2, width, height, width).numDiffPixels, expected);
+    }
+    EXPECT_EQ(gAllocations.load(), allocationsBefore);
+  }
+}
+
+}  // namespace pixelmatch
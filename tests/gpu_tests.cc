@@ -0,0 +1,133 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest-death-test.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "pixelmatch/gpu.h"
+#include "pixelmatch/gpu_kernels.h"
+#include "pixelmatch/image_utils.h"
+#include "pixelmatch/pixelmatch.h"
+#include "tests/test_support.h"
+
+namespace pixelmatch {
+
+namespace {
+
+/// Runs the per-pixel steps of the GPU kernel over every pixel on the host, in place of the
+/// device grid, with a serial reduction of the counts.
+DiffResult emulateDevice(const Image& img1, const Image& img2, uint8_t* output,
+                         const Options& options) {
+  const detail::gpu::GpuComparison c =
+      detail::gpu::comparisonFor(img1.data.data(), img2.data.data(), output, img1.width,
+                                 img1.height, img1.strideInPixels, options);
+  detail::gpu::GpuCounts counts = detail::gpu::emptyCounts();
+  for (int y = 0; y < img1.height; ++y) {
+    for (int x = 0; x < img1.width; ++x) {
+      const detail::gpu::PixelClass pixelClass = detail::gpu::classifyPixel(c, x, y);
+      detail::gpu::drawPixel(c, x, y, pixelClass);
+      switch (pixelClass) {
+        case detail::gpu::PixelClass::Similar:
+          continue;
+        case detail::gpu::PixelClass::Antialiased:
+          ++counts.antialiased;
+          continue;
+        case detail::gpu::PixelClass::Darker:
+          ++counts.darker;
+          break;
+        case detail::gpu::PixelClass::Lighter:
+          ++counts.lighter;
+          break;
+      }
+      counts.minX = std::min(counts.minX, x);
+      counts.minY = std::min(counts.minY, y);
+      counts.maxX = std::max(counts.maxX, x);
+      counts.maxY = std::max(counts.maxY, y);
+    }
+  }
+  return detail::gpu::toDiffResult(counts);
+}
+
+}  // namespace
+
+TEST(GpuKernels, MatchPixelmatchOnTestdata) {
+  std::vector<Options> variants(4);
+  variants[1].threshold = 0.05f;
+  variants[1].includeAA = true;
+  variants[2].diffMask = true;
+  variants[2].diffColorAlt = Color{0, 255, 0, 255};
+  variants[3].alpha = 0.5f;
+  variants[3].diffColorAlt = Color{0, 0, 255, 255};
+
+  for (const int i : {1, 2, 3, 4, 5, 6, 7}) {
+    auto img1 = readRgbaImageFromPngFile(testdata(i, 'a').c_str());
+    auto img2 = readRgbaImageFromPngFile(testdata(i, 'b').c_str());
+    ASSERT_TRUE(img1.has_value() && img2.has_value());
+
+    for (size_t v = 0; v < variants.size(); ++v) {
+      SCOPED_TRACE(testdata(i, 'a') + ", variant " + std::to_string(v));
+      const Options& options = variants[v];
+      std::vector<uint8_t> expectedOutput(img1->data.size(), 7);
+      const int expectedDiffs = pixelmatch(img1->data, img2->data, expectedOutput, img1->width,
+                                           img1->height, img1->strideInPixels, options);
+      const DiffResult expected = pixelmatch(img1->data, img2->data, img1->width, img1->height,
+                                             img1->strideInPixels, options);
+      ASSERT_EQ(expected.numDiffPixels, expectedDiffs);
+
+      std::vector<uint8_t> output(img1->data.size(), 7);
+      const DiffResult actual = emulateDevice(*img1, *img2, output.data(), options);
+      EXPECT_EQ(actual.numDiffPixels, expected.numDiffPixels);
+      EXPECT_EQ(actual.numAntialiasedPixels, expected.numAntialiasedPixels);
+      EXPECT_EQ(actual.numDarkerPixels, expected.numDarkerPixels);
+      EXPECT_EQ(actual.numLighterPixels, expected.numLighterPixels);
+      ASSERT_EQ(actual.bounds.has_value(), expected.bounds.has_value());
+      if (actual.bounds) {
+        EXPECT_EQ(actual.bounds->x, expected.bounds->x);
+        EXPECT_EQ(actual.bounds->y, expected.bounds->y);
+        EXPECT_EQ(actual.bounds->width, expected.bounds->width);
+        EXPECT_EQ(actual.bounds->height, expected.bounds->height);
+      }
+      EXPECT_TRUE(output == expectedOutput);
+    }
+  }
+}
+
+TEST(GpuKernels, IdenticalImages) {
+  auto img = readRgbaImageFromPngFile(testdata(5, 'a').c_str());
+  ASSERT_TRUE(img.has_value());
+  std::vector<uint8_t> expectedOutput(img->data.size());
+  pixelmatch(img->data, img->data, expectedOutput, img->width, img->height, img->strideInPixels);
+
+  std::vector<uint8_t> output(img->data.size());
+  const DiffResult result = emulateDevice(*img, *img, output.data(), Options());
+  EXPECT_EQ(result.numDiffPixels, 0);
+  EXPECT_FALSE(result.bounds.has_value());
+  EXPECT_TRUE(output == expectedOutput);
+}
+
+TEST(GpuDeathTest, InvalidArguments) {
+  std::vector<uint8_t> img(16);
+  {
+    Options options;
+    options.maxDiffs = 10;
+    EXPECT_DEBUG_DEATH(detail::checkDeviceArguments(img.data(), img.data(), 2, 2, 2, options),
+                       "maxDiffs is not supported on the GPU");
+  }
+  {
+    Options options;
+    options.outputFormat = OutputFormat::ByteMask;
+    EXPECT_DEBUG_DEATH(detail::checkDeviceArguments(img.data(), img.data(), 2, 2, 2, options),
+                       "Only OutputFormat::Rgba is supported on the GPU");
+  }
+  EXPECT_DEBUG_DEATH(detail::checkDeviceArguments(img.data(), img.data(), 2, 2, 1, Options()),
+                     "Stride must be greater than width");
+  EXPECT_TRUE(detail::checkDeviceArguments(img.data(), img.data(), 2, 2, 2, Options()));
+
+  if (!gpuAvailable()) {
+    EXPECT_EQ(pixelmatchDevice(img.data(), img.data(), nullptr, 2, 2, 2).numDiffPixels, -1);
+  }
+}
+
+}  // namespace pixelmatch
@@ -5,6 +5,9 @@
 #include <array>
 #include <filesystem>
 #include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
 
 #include "pixelmatch/image_utils.h"
 
@@ -76,6 +79,107 @@ TEST(ImageUtils, ReadInvalidPng) {
   EXPECT_FALSE(maybeReadImg.has_value());
 }
 
+TEST(ImageUtils, DecodeMatchesRead) {
+  auto decoded = decodeRgbaPngFile("tests/testdata/1a.png");
+  auto image = readRgbaImageFromPngFile("tests/testdata/1a.png");
+  ASSERT_TRUE(decoded.has_value());
+  ASSERT_TRUE(image.has_value());
+
+  EXPECT_EQ(decoded->width, image->width);
+  EXPECT_EQ(decoded->height, image->height);
+  EXPECT_TRUE(
+      imageEquals(span<const uint8_t>(decoded->pixels.get(), image->data.size()), image->data,
+                  image->width, image->height, image->strideInPixels));
+
+  EXPECT_FALSE(decodeRgbaPngFile("tests/testdata/missing.png").has_value());
+}
+
+TEST(ImageUtils, EncodeOptionsRoundTrip) {
+  auto image = readRgbaImageFromPngFile("tests/testdata/1a.png");
+  ASSERT_TRUE(image.has_value());
+
+  // A flat image with a small changed square, like a diff.
+  constexpr int kFlatSize = 300;
+  std::vector<uint8_t> flat(kFlatSize * kFlatSize * 4, 0);
+  for (int y = 100; y < 120; ++y) {
+    for (int x = 100; x < 120; ++x) {
+      flat[(y * kFlatSize + x) * 4 + 0] = 255;
+      flat[(y * kFlatSize + x) * 4 + 3] = 255;
+    }
+  }
+
+  std::filesystem::path savedFilename = std::filesystem::temp_directory_path() / "encoded.png";
+  auto autodelete = AutodeleteFile(savedFilename);
+
+  std::vector<uint8_t> png;
+  for (int level : {0, 1, 2, 9}) {
+    for (PngFilter filter : {PngFilter::None, PngFilter::Sub, PngFilter::Up, PngFilter::Average,
+                             PngFilter::Paeth, PngFilter::Adaptive}) {
+      SCOPED_TRACE("level=" + std::to_string(level) +
+                   ", filter=" + std::to_string(static_cast<int>(filter)));
+      PngEncodeOptions options;
+      options.compressionLevel = level;
+      options.filter = filter;
+
+      EXPECT_TRUE(writeRgbaPixelsToPngFile(savedFilename.c_str(), image->data, image->width,
+                                           image->height, image->strideInPixels, options));
+      auto reloaded = readRgbaImageFromPngFile(savedFilename.c_str());
+      ASSERT_TRUE(reloaded.has_value());
+      ASSERT_EQ(reloaded->width, image->width);
+      ASSERT_EQ(reloaded->height, image->height);
+      EXPECT_TRUE(
+          imageEquals(reloaded->data, image->data, image->width, image->height, image->width));
+
+      ASSERT_TRUE(encodeRgbaPng(flat, kFlatSize, kFlatSize, kFlatSize, png, options));
+      if (level > 0) {
+        EXPECT_LT(png.size(), flat.size() / 50);
+      }
+    }
+  }
+}
+
+TEST(ImageUtils, EncodeLevels) {
+  auto image = readRgbaImageFromPngFile("tests/testdata/4a.png");
+  ASSERT_TRUE(image.has_value());
+
+  // Each level searches further back for matches than the previous one.
+  std::vector<uint8_t> png;
+  size_t previousSize = 0;
+  for (int level = 2; level <= 9; ++level) {
+    SCOPED_TRACE("level=" + std::to_string(level));
+    PngEncodeOptions options;
+    options.compressionLevel = level;
+    ASSERT_TRUE(encodeRgbaPng(image->data, image->width, image->height, image->strideInPixels, png,
+                              options));
+    if (level > 2) {
+      EXPECT_LE(png.size(), previousSize);
+    }
+    previousSize = png.size();
+  }
+}
+
+TEST(ImageUtils, EncodeIntoBuffer) {
+  std::array<uint8_t, 16> img{};
+  img[4] = 200;
+  img[7] = 255;
+
+  std::vector<uint8_t> png(1000, 0xAA);
+  ASSERT_TRUE(encodeRgbaPng(img, 2, 2, 2, png));
+  ASSERT_GT(png.size(), 8u);
+  EXPECT_EQ(png[0], 0x89);
+  EXPECT_EQ(png[1], 'P');
+
+  // The buffer is reused for the next image.
+  const size_t capacity = png.capacity();
+  ASSERT_TRUE(encodeRgbaPng(span<const uint8_t>(img.data(), 8), 1, 1, 2, png));
+  EXPECT_EQ(png.capacity(), capacity);
+
+  PngEncodeOptions options;
+  options.compressionLevel = 10;
+  EXPECT_DEBUG_DEATH(EXPECT_FALSE(encodeRgbaPng(img, 2, 2, 2, png, options)),
+                     "compressionLevel must be between 0 and 9");
+}
+
 TEST(ImageUtils, WriteInvalidFilename) {
   std::filesystem::path directoryName = std::filesystem::temp_directory_path();
 
@@ -83,6 +187,184 @@ TEST(ImageUtils, WriteInvalidFilename) {
   EXPECT_FALSE(writeRgbaPixelsToPngFile(directoryName.c_str(), img, 1, 1, 1));
 }
 
+TEST(ImageUtils, RawRoundTrip) {
+  const std::filesystem::path filename =
+      std::filesystem::temp_directory_path() / "pixelmatch_raw_round_trip.rgba";
+
+  // 3x2 image with a stride of 4 pixels.
+  std::vector<uint8_t> img(4 * 2 * 4);
+  for (size_t i = 0; i < img.size(); ++i) {
+    img[i] = static_cast<uint8_t>(i * 7);
+  }
+  ASSERT_TRUE(writeRawRgbaFile(filename.c_str(), img, 3, 2, 4));
+  EXPECT_EQ(std::filesystem::file_size(filename), kRawRgbaHeaderSize + img.size());
+
+  std::optional<MappedImage> mapped = MappedImage::open(filename.c_str());
+  ASSERT_TRUE(mapped.has_value());
+  EXPECT_EQ(mapped->width(), 3);
+  EXPECT_EQ(mapped->height(), 2);
+  EXPECT_EQ(mapped->strideInPixels(), 4u);
+  ASSERT_EQ(mapped->data().size(), img.size());
+  EXPECT_TRUE(imageEquals(mapped->data(), img, 3, 2, 4));
+
+  // The pixels stay valid when the mapping is moved.
+  const uint8_t* pixels = mapped->data().data();
+  MappedImage moved = std::move(*mapped);
+  EXPECT_EQ(moved.data().data(), pixels);
+  EXPECT_EQ(moved.data()[7], img[7]);
+
+  std::filesystem::remove(filename);
+}
+
+TEST(ImageUtils, RawInvalidFiles) {
+  const std::filesystem::path filename =
+      std::filesystem::temp_directory_path() / "pixelmatch_raw_invalid.rgba";
+
+  EXPECT_FALSE(MappedImage::open("tests/testdata/missing.rgba").has_value());
+  // A PNG has the wrong magic.
+  EXPECT_FALSE(MappedImage::open("tests/testdata/1a.png").has_value());
+
+  std::array<uint8_t, 16> img{};
+  ASSERT_TRUE(writeRawRgbaFile(filename.c_str(), img, 2, 2, 2));
+  ASSERT_TRUE(MappedImage::open(filename.c_str()).has_value());
+
+  // Truncated rows, and a header alone.
+  std::filesystem::resize_file(filename, kRawRgbaHeaderSize + img.size() - 1);
+  EXPECT_FALSE(MappedImage::open(filename.c_str()).has_value());
+  std::filesystem::resize_file(filename, 8);
+  EXPECT_FALSE(MappedImage::open(filename.c_str()).has_value());
+
+  std::filesystem::remove(filename);
+}
+
+/// Decodes a PNG with a PngRowDecoder, \ref rowsPerRead rows at a time, checking that reads stop at
+/// the last row. Returns the pixels, or an empty vector if the file could not be decoded.
+std::vector<uint8_t> decodeRows(const char* filename, int rowsPerRead) {
+  auto decoder = PngRowDecoder::open(filename);
+  if (!decoder) {
+    return {};
+  }
+
+  const size_t rowBytes = static_cast<size_t>(decoder->width()) * 4;
+  std::vector<uint8_t> pixels(rowBytes * decoder->height());
+  std::vector<uint8_t> rows(rowBytes * rowsPerRead);
+  for (int y = 0; y < decoder->height();) {
+    const int read = decoder->readRows(rows, rowsPerRead);
+    if (read <= 0) {
+      return {};
+    }
+    std::copy(rows.begin(), rows.begin() + read * rowBytes, pixels.begin() + y * rowBytes);
+    y += read;
+    EXPECT_EQ(decoder->rowsRead(), y);
+  }
+  EXPECT_EQ(decoder->readRows(rows, rowsPerRead), 0);
+  return pixels;
+}
+
+TEST(ImageUtils, PngRowDecoderMatchesDecode) {
+  std::vector<std::string> filenames;
+  for (int i = 1; i <= 7; ++i) {
+    filenames.push_back("tests/testdata/" + std::to_string(i) + "a.png");
+    filenames.push_back("tests/testdata/" + std::to_string(i) + "diff.png");
+  }
+  // Each color type and bit depth, with tRNS chunks, split IDAT chunks and every filter.
+  for (const char* format :
+       {"gray1", "gray2_trns", "gray4", "gray8_trns", "gray16_trns", "graya8", "graya16",
+        "rgb8_trns", "rgb16", "palette1", "palette4_trns", "palette8_trns", "rgba16",
+        "rgba8_large"}) {
+    filenames.push_back(std::string("tests/testdata/png_") + format + ".png");
+  }
+
+  for (const std::string& filename : filenames) {
+    SCOPED_TRACE(filename);
+    auto expected = decodeRgbaPngFile(filename.c_str());
+    ASSERT_TRUE(expected.has_value());
+    auto decoder = PngRowDecoder::open(filename.c_str());
+    ASSERT_TRUE(decoder.has_value());
+    EXPECT_EQ(decoder->width(), expected->width);
+    EXPECT_EQ(decoder->height(), expected->height);
+
+    const size_t bytes = static_cast<size_t>(expected->width) * expected->height * 4;
+    const span<const uint8_t> expectedPixels(expected->pixels.get(), bytes);
+    for (const int rowsPerRead : {1, 7, expected->height}) {
+      const std::vector<uint8_t> pixels = decodeRows(filename.c_str(), rowsPerRead);
+      ASSERT_EQ(pixels.size(), bytes);
+      EXPECT_TRUE(imageEquals(pixels, expectedPixels, expected->width, expected->height,
+                              expected->width))
+          << "rowsPerRead=" << rowsPerRead;
+    }
+  }
+}
+
+TEST(ImageUtils, PngRowDecoderEncodeOptions) {
+  auto image = readRgbaImageFromPngFile("tests/testdata/4a.png");
+  ASSERT_TRUE(image.has_value());
+
+  std::filesystem::path savedFilename = std::filesystem::temp_directory_path() / "rows.png";
+  auto autodelete = AutodeleteFile(savedFilename);
+
+  for (int level : {0, 1, 2, 9}) {
+    for (PngFilter filter : {PngFilter::None, PngFilter::Average, PngFilter::Adaptive}) {
+      SCOPED_TRACE("level=" + std::to_string(level) +
+                   ", filter=" + std::to_string(static_cast<int>(filter)));
+      PngEncodeOptions options;
+      options.compressionLevel = level;
+      options.filter = filter;
+      ASSERT_TRUE(writeRgbaPixelsToPngFile(savedFilename.c_str(), image->data, image->width,
+                                           image->height, image->strideInPixels, options));
+      const std::vector<uint8_t> pixels = decodeRows(savedFilename.c_str(), 16);
+      ASSERT_EQ(pixels.size(), image->data.size());
+      EXPECT_TRUE(
+          imageEquals(pixels, image->data, image->width, image->height, image->strideInPixels));
+    }
+  }
+}
+
+TEST(ImageUtils, PngRowDecoderInvalidFiles) {
+  EXPECT_FALSE(PngRowDecoder::open("tests/testdata/missing.png").has_value());
+
+  std::ifstream input("tests/testdata/1a.png", std::ios::binary);
+  const std::string png((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+  ASSERT_GT(png.size(), 100u);
+
+  std::filesystem::path savedFilename = std::filesystem::temp_directory_path() / "invalid.png";
+  auto autodelete = AutodeleteFile(savedFilename);
+  auto save = [&](const std::string& contents) {
+    std::ofstream file(savedFilename.c_str(), std::ios::binary);
+    file << contents;
+  };
+
+  save("invalid");
+  EXPECT_FALSE(PngRowDecoder::open(savedFilename.c_str()).has_value());
+
+  // The interlace method is the last byte of the IHDR chunk.
+  std::string interlaced = png;
+  interlaced[28] = 1;
+  save(interlaced);
+  EXPECT_FALSE(PngRowDecoder::open(savedFilename.c_str()).has_value());
+
+  // A truncated file opens, but fails once the data runs out.
+  save(png.substr(0, png.size() / 2));
+  auto decoder = PngRowDecoder::open(savedFilename.c_str());
+  ASSERT_TRUE(decoder.has_value());
+  std::vector<uint8_t> rows(static_cast<size_t>(decoder->width()) * 4 * decoder->height());
+  EXPECT_EQ(decoder->readRows(rows, decoder->height()), -1);
+  EXPECT_EQ(decoder->readRows(span<uint8_t>(rows.data(), decoder->width() * 4), 1), -1);
+
+  // Corrupt compressed data.
+  std::string corrupt = png;
+  for (size_t i = 60; i < corrupt.size() - 20; i += 7) {
+    corrupt[i] = static_cast<char>(~corrupt[i]);
+  }
+  save(corrupt);
+  EXPECT_TRUE(decodeRows(savedFilename.c_str(), 8).empty());
+
+  decoder = PngRowDecoder::open("tests/testdata/1a.png");
+  ASSERT_TRUE(decoder.has_value());
+  EXPECT_DEBUG_DEATH(decoder->readRows(span<uint8_t>(rows.data(), 3), 1),
+                     "Rows data size does not match numRows");
+}
+
 TEST(ImageUtils, ImageEquals) {
   std::filesystem::path directoryName = std::filesystem::temp_directory_path();
 
@@ -0,0 +1,234 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest-death-test.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "pixelmatch/image_utils.h"
+#include "pixelmatch/pixelmatch.h"
+#include "tests/test_support.h"
+
+namespace pixelmatch {
+
+namespace {
+
+/// Size of the output of \ref pixelmatch for \ref img.
+size_t outputSize(const Image& img, OutputFormat format) {
+  switch (format) {
+    case OutputFormat::Rgba:
+      return img.data.size();
+    case OutputFormat::ByteMask:
+      return static_cast<size_t>(img.width) * img.height;
+    case OutputFormat::BitMask:
+      return (static_cast<size_t>(img.width) + 7) / 8 * img.height;
+  }
+  return 0;
+}
+
+/// Copies the pixels of \ref source within \ref rect, clamped to the image, into \ref dest.
+void copyRect(const Image& source, const Rect& rect, Image& dest) {
+  const int x0 = std::max(rect.x, 0);
+  const int x1 = std::min(rect.x + rect.width, source.width);
+  for (int y = std::max(rect.y, 0); y < std::min(rect.y + rect.height, source.height); ++y) {
+    const size_t pos = (y * source.strideInPixels + x0) * 4;
+    std::copy_n(source.data.begin() + pos, (x1 - x0) * 4, dest.data.begin() + pos);
+  }
+}
+
+/// Checks that \ref actual and \ref output match comparing \ref img1 and \ref img2 in full.
+void expectMatchesPixelmatch(const Image& img1, const Image& img2, const Options& options,
+                             const DiffResult& actual, const std::vector<uint8_t>& output) {
+  std::vector<uint8_t> expectedOutput(outputSize(img1, options.outputFormat));
+  const int expectedDiffs = pixelmatch(img1.data, img2.data, expectedOutput, img1.width,
+                                       img1.height, img1.strideInPixels, options);
+  const DiffResult expected =
+      pixelmatch(img1.data, img2.data, img1.width, img1.height, img1.strideInPixels, options);
+  ASSERT_EQ(expected.numDiffPixels, expectedDiffs);
+
+  EXPECT_EQ(actual.numDiffPixels, expected.numDiffPixels);
+  EXPECT_EQ(actual.numAntialiasedPixels, expected.numAntialiasedPixels);
+  EXPECT_EQ(actual.numDarkerPixels, expected.numDarkerPixels);
+  EXPECT_EQ(actual.numLighterPixels, expected.numLighterPixels);
+  EXPECT_EQ(actual.bounds.has_value(), expected.bounds.has_value());
+  if (actual.bounds && expected.bounds) {
+    EXPECT_EQ(actual.bounds->x, expected.bounds->x);
+    EXPECT_EQ(actual.bounds->y, expected.bounds->y);
+    EXPECT_EQ(actual.bounds->width, expected.bounds->width);
+    EXPECT_EQ(actual.bounds->height, expected.bounds->height);
+  }
+  EXPECT_EQ(actual.tileColumns, expected.tileColumns);
+  EXPECT_EQ(actual.tileCounts, expected.tileCounts);
+  EXPECT_TRUE(output == expectedOutput);
+}
+
+/// Starts from two copies of \ref img1, then pastes rectangles of \ref img2 into the second one,
+/// and some of \ref img1 back, updating the comparison after each step.
+void expectUpdatesMatch(const Image& img1, const Image& img2, const Options& options) {
+  IncrementalComparator comparator(options);
+  Image current = img1;
+  std::vector<uint8_t> output(outputSize(img1, options.outputFormat));
+  DiffResult result = comparator.compare(img1.data, current.data, output, img1.width, img1.height,
+                                         img1.strideInPixels);
+  expectMatchesPixelmatch(img1, current, options, result, output);
+
+  const int w = img1.width;
+  const int h = img1.height;
+  const std::vector<std::pair<Rect, const Image*>> steps = {
+      {Rect{0, 0, w / 2, h / 3}, &img2},
+      {Rect{w / 3, h / 4, w / 2, h / 2}, &img2},
+      {Rect{w - 7, -3, 20, h / 2}, &img2},
+      {Rect{w / 8, h / 8, w / 4, h / 4}, &img1},
+      {Rect{5, h - 1, w, 1}, &img2},
+      {Rect{0, 0, w, h}, &img2},
+      {Rect{w / 2, 0, w, h}, &img1},
+  };
+  for (size_t i = 0; i < steps.size(); ++i) {
+    SCOPED_TRACE("step " + std::to_string(i));
+    const auto& [rect, source] = steps[i];
+    copyRect(*source, rect, current);
+    // An empty rectangle is skipped.
+    const std::vector<Rect> dirtyRects = {rect, Rect{10, 10, 0, 5}};
+    result = comparator.update(img1.data, current.data, output, img1.width, img1.height,
+                               img1.strideInPixels, dirtyRects);
+    expectMatchesPixelmatch(img1, current, options, result, output);
+  }
+}
+
+}  // namespace
+
+TEST(IncrementalComparator, MatchesPixelmatch) {
+  for (const int i : {1, 3, 6}) {
+    auto img1 = readRgbaImageFromPngFile(testdata(i, 'a').c_str());
+    auto img2 = readRgbaImageFromPngFile(testdata(i, 'b').c_str());
+    ASSERT_TRUE(img1.has_value() && img2.has_value());
+
+    for (const int numThreads : {1, 3}) {
+      SCOPED_TRACE(testdata(i, 'a') + ", numThreads=" + std::to_string(numThreads));
+      Options options;
+      options.threshold = 0.05f;
+      options.numThreads = numThreads;
+      options.countTiles = true;
+      expectUpdatesMatch(*img1, *img2, options);
+    }
+  }
+}
+
+TEST(IncrementalComparator, MatchesPixelmatchWithOptions) {
+  auto img1 = readRgbaImageFromPngFile(testdata(1, 'a').c_str());
+  auto img2 = readRgbaImageFromPngFile(testdata(1, 'b').c_str());
+  ASSERT_TRUE(img1.has_value() && img2.has_value());
+
+  std::vector<uint8_t> ignoreMask(static_cast<size_t>(img1->width) * img1->height);
+  std::fill(ignoreMask.begin(), ignoreMask.begin() + ignoreMask.size() / 3, 1);
+
+  std::vector<Options> variants(8);
+  variants[0].includeAA = true;
+  variants[1].diffMask = true;
+  variants[1].diffColorAlt = Color{0, 255, 0, 255};
+  variants[2].outputFormat = OutputFormat::ByteMask;
+  variants[3].outputFormat = OutputFormat::BitMask;
+  variants[4].ignoreRegions = {Rect{10, 100, 200, 300}, Rect{-5, 50, 40, 1000}};
+  variants[5].ignoreMask = ignoreMask;
+  variants[6].engine = Engine::CoarseToFine;
+  variants[7].engine = Engine::FixedPoint;
+
+  for (size_t i = 0; i < variants.size(); ++i) {
+    SCOPED_TRACE("variant " + std::to_string(i));
+    expectUpdatesMatch(*img1, *img2, variants[i]);
+  }
+}
+
+TEST(IncrementalComparator, HaloCoversAntialiasingDetection) {
+  auto img1 = readRgbaImageFromPngFile(testdata(1, 'a').c_str());
+  auto img2 = readRgbaImageFromPngFile(testdata(1, 'b').c_str());
+  ASSERT_TRUE(img1.has_value() && img2.has_value());
+
+  Options options;
+  options.collectAntialiasedPixels = true;
+  const DiffResult initial =
+      pixelmatch(img1->data, img2->data, img1->width, img1->height, img1->strideInPixels, options);
+  ASSERT_GT(initial.antialiasedPixels.size(), 0u);
+
+  // Change single pixels of both images next to anti-aliased pixels, which the detection of their
+  // neighbors reads up to two pixels away.
+  options.collectAntialiasedPixels = false;
+  IncrementalComparator comparator(options);
+  Image current1 = *img1;
+  Image current2 = *img2;
+  std::vector<uint8_t> output(img1->data.size());
+  comparator.compare(current1.data, current2.data, output, img1->width, img1->height,
+                     img1->strideInPixels);
+
+  for (const DiffPixel& pixel : initial.antialiasedPixels) {
+    for (int offset = 0; offset < 25; ++offset) {
+      const Rect dirty{pixel.x + offset % 5 - 2, pixel.y + offset / 5 - 2, 1, 1};
+      if (dirty.x < 0 || dirty.y < 0 || dirty.x >= img1->width || dirty.y >= img1->height) {
+        continue;
+      }
+
+      SCOPED_TRACE(testing::Message() << "pixel " << dirty.x << ", " << dirty.y);
+      const size_t pos = (dirty.y * img1->strideInPixels + dirty.x) * 4;
+      for (Image* img : {&current1, &current2}) {
+        std::fill_n(img->data.begin() + pos, 4, uint8_t(255));
+      }
+      const std::vector<Rect> dirtyRects = {dirty};
+      const DiffResult result = comparator.update(current1.data, current2.data, output,
+                                                  img1->width, img1->height,
+                                                  img1->strideInPixels, dirtyRects);
+      expectMatchesPixelmatch(current1, current2, options, result, output);
+    }
+  }
+}
+
+TEST(IncrementalComparator, UpdateWithoutPreviousResult) {
+  auto img1 = readRgbaImageFromPngFile(testdata(4, 'a').c_str());
+  auto img2 = readRgbaImageFromPngFile(testdata(4, 'b').c_str());
+  ASSERT_TRUE(img1.has_value() && img2.has_value());
+
+  // Without a previous result for images of this size, the images are compared in full.
+  const Options options;
+  IncrementalComparator comparator(options);
+  std::vector<uint8_t> output(img1->data.size());
+  const std::vector<Rect> noRects;
+  const DiffResult result = comparator.update(img1->data, img2->data, output, img1->width,
+                                              img1->height, img1->strideInPixels, noRects);
+  expectMatchesPixelmatch(*img1, *img2, options, result, output);
+
+  // Nothing changed.
+  const DiffResult unchanged = comparator.update(img1->data, img2->data, output, img1->width,
+                                                 img1->height, img1->strideInPixels, noRects);
+  expectMatchesPixelmatch(*img1, *img2, options, unchanged, output);
+}
+
+TEST(IncrementalComparatorDeathTest, InvalidArguments) {
+  std::vector<uint8_t> img(16);
+  const std::vector<Rect> rects = {Rect{0, 0, 1, 1}};
+
+  {
+    Options options;
+    options.maxDiffs = 10;
+    IncrementalComparator comparator(options);
+    EXPECT_DEBUG_DEATH(comparator.compare(img, img, span<uint8_t>(), 2, 2, 2),
+                       "maxDiffs is not supported");
+  }
+
+  {
+    Options options;
+    options.collectDiffPixels = true;
+    IncrementalComparator comparator(options);
+    EXPECT_DEBUG_DEATH(comparator.compare(img, img, span<uint8_t>(), 2, 2, 2),
+                       "collectDiffPixels is not supported");
+  }
+
+  IncrementalComparator comparator;
+  EXPECT_EQ(comparator.compare(img, img, span<uint8_t>(), 2, 2, 2).numDiffPixels, 0);
+  EXPECT_DEBUG_DEATH(comparator.update(img, span<const uint8_t>(img.data(), 8), span<uint8_t>(),
+                                       2, 2, 2, rects),
+                     "Image data size does not match width/height");
+  EXPECT_DEBUG_DEATH(comparator.update(img, img, span<uint8_t>(), 2, 2, 1, rects),
+                     "Stride must be greater than width");
+}
+
+}  // namespace pixelmatch
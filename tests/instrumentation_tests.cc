@@ -0,0 +1,103 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "pixelmatch/pixelmatch.h"
+#include "tests/test_support.h"
+
+namespace pixelmatch {
+
+namespace {
+
+constexpr int kWidth = 640;
+constexpr int kHeight = 480;  // The box of generateFrame() spans 4 tiles.
+
+}  // namespace
+
+TEST(Instrumentation, IdenticalImages) {
+  const std::vector<uint8_t> img = generateFrame(kWidth, kHeight, false);
+  Options options;
+  const DiffResult result = pixelmatch(img, img, kWidth, kHeight, kWidth, options);
+  ASSERT_TRUE(result.instrumentation.has_value());
+  EXPECT_TRUE(result.instrumentation->identicalImages);
+  EXPECT_EQ(result.instrumentation->pixelsCompared, 0);
+  EXPECT_GT(result.instrumentation->totalNanoseconds, 0);
+  EXPECT_LE(result.instrumentation->identicalCheckNanoseconds,
+            result.instrumentation->totalNanoseconds);
+}
+
+TEST(Instrumentation, CountsMatchResult) {
+  const std::vector<uint8_t> img1 = generateFrame(kWidth, kHeight, false);
+  const std::vector<uint8_t> img2 = generateFrame(kWidth, kHeight, true);
+
+  for (const int numThreads : {1, 3}) {
+    for (const bool includeAA : {false, true}) {
+      SCOPED_TRACE(testing::Message()
+                   << "numThreads=" << numThreads << ", includeAA=" << includeAA);
+      Options options;
+      options.numThreads = numThreads;
+      options.includeAA = includeAA;
+      const DiffResult result = pixelmatch(img1, img2, kWidth, kHeight, kWidth, options);
+      ASSERT_TRUE(result.instrumentation.has_value());
+      const Instrumentation& counters = *result.instrumentation;
+
+      // The box covers 4 of the 10 x 8 tiles, which are compared in full.
+      EXPECT_FALSE(counters.identicalImages);
+      EXPECT_EQ(counters.tilesSkipped, 76);
+      EXPECT_EQ(counters.pixelsCompared, 4 * 64 * 64);
+      EXPECT_EQ(counters.pixelsAboveThreshold,
+                result.numDiffPixels + result.numAntialiasedPixels);
+      EXPECT_EQ(counters.bandsStoppedEarly, 0);
+      EXPECT_GT(counters.colorDeltaNanoseconds, 0);
+      EXPECT_GT(counters.totalNanoseconds, 0);
+
+      // Each pixel above the threshold is checked in one or both images, unless includeAA is set.
+      if (includeAA) {
+        EXPECT_EQ(counters.antialiasingChecks, 0);
+        EXPECT_EQ(counters.antialiasingNanoseconds, 0);
+      } else {
+        EXPECT_GE(counters.antialiasingChecks, counters.pixelsAboveThreshold);
+        EXPECT_LE(counters.antialiasingChecks, 2 * counters.pixelsAboveThreshold);
+        EXPECT_LE(counters.siblingChecks, 4 * counters.antialiasingChecks);
+        EXPECT_LE(counters.antialiasingNanoseconds, counters.pixelLoopNanoseconds);
+      }
+    }
+  }
+}
+
+TEST(Instrumentation, MaxDiffsStopsBandsEarly) {
+  const std::vector<uint8_t> img1 = generateFrame(kWidth, kHeight, false);
+  const std::vector<uint8_t> img2 = generateFrame(kWidth, kHeight, true);
+  Options options;
+  options.numThreads = 1;
+  options.maxDiffs = 10;
+  const DiffResult result = pixelmatch(img1, img2, kWidth, kHeight, kWidth, options);
+  ASSERT_TRUE(result.instrumentation.has_value());
+  EXPECT_EQ(result.numDiffPixels, 11);
+  // The band of rows [192, 256) finds the 11th different pixel, and the 4 bands below it stop
+  // without comparing anything.
+  EXPECT_EQ(result.instrumentation->bandsStoppedEarly, 5);
+}
+
+TEST(Instrumentation, IncrementalUpdateOnlyComparesDirtyRectangles) {
+  const std::vector<uint8_t> img1 = generateFrame(kWidth, kHeight, false);
+  std::vector<uint8_t> img2 = generateFrame(kWidth, kHeight, true);
+  IncrementalComparator comparator;
+  const DiffResult compared =
+      comparator.compare(img1, img2, span<uint8_t>(), kWidth, kHeight, kWidth);
+  ASSERT_TRUE(compared.instrumentation.has_value());
+  EXPECT_EQ(compared.instrumentation->pixelsCompared, 4 * 64 * 64);
+
+  // A single pixel is compared with its halo.
+  img2[(10 * kWidth + 10) * 4] ^= 0xFF;
+  const std::vector<Rect> dirtyRects = {Rect{10, 10, 1, 1}};
+  const DiffResult updated =
+      comparator.update(img1, img2, span<uint8_t>(), kWidth, kHeight, kWidth, dirtyRects);
+  ASSERT_TRUE(updated.instrumentation.has_value());
+  const int side = 2 * IncrementalComparator::kHaloPixels + 1;
+  EXPECT_EQ(updated.instrumentation->pixelsCompared, side * side);
+  EXPECT_EQ(updated.numDiffPixels, compared.numDiffPixels + 1);
+}
+
+}  // namespace pixelmatch
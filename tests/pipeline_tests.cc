@@ -0,0 +1,88 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "pixelmatch/image_utils.h"
+#include "pixelmatch/pipeline.h"
+#include "pixelmatch/pixelmatch.h"
+#include "tests/test_support.h"
+
+namespace pixelmatch {
+
+TEST(Pipeline, MatchesPixelmatch) {
+  const std::filesystem::path outputDir =
+      std::filesystem::temp_directory_path() / "pixelmatch_pipeline";
+  std::filesystem::create_directories(outputDir);
+
+  std::vector<FilePair> pairs;
+  for (int i = 1; i <= 7; ++i) {
+    pairs.push_back(
+        FilePair{testdata(i, 'a'), testdata(i, 'b'), (outputDir / (std::to_string(i) + ".png"))});
+  }
+  // Count only, without writing a diff.
+  pairs.push_back(FilePair{testdata(1, 'a'), testdata(1, 'b'), ""});
+
+  Options options;
+  options.threshold = 0.05f;
+
+  for (int numThreads : {1, 3}) {
+    for (int maxPairsInFlight : {0, 1, 2}) {
+      options.numThreads = numThreads;
+      const std::vector<FilePairResult> results = pixelmatchFiles(pairs, options, maxPairsInFlight);
+      ASSERT_EQ(results.size(), pairs.size());
+
+      for (size_t i = 0; i < pairs.size(); ++i) {
+        SCOPED_TRACE(pairs[i].img1 + ", numThreads=" + std::to_string(numThreads) +
+                     ", maxPairsInFlight=" + std::to_string(maxPairsInFlight));
+        EXPECT_EQ(results[i].error, "");
+
+        auto img1 = readRgbaImageFromPngFile(pairs[i].img1.c_str());
+        auto img2 = readRgbaImageFromPngFile(pairs[i].img2.c_str());
+        ASSERT_TRUE(img1.has_value() && img2.has_value());
+
+        Options single = options;
+        single.numThreads = 1;
+        std::vector<uint8_t> expectedDiff(img1->data.size());
+        EXPECT_EQ(results[i].numDiffPixels,
+                  pixelmatch(img1->data, img2->data, expectedDiff, img1->width, img1->height,
+                             img1->strideInPixels, single));
+
+        if (!pairs[i].output.empty()) {
+          auto diff = readRgbaImageFromPngFile(pairs[i].output.c_str());
+          ASSERT_TRUE(diff.has_value());
+          EXPECT_TRUE(imageEquals(diff->data, expectedDiff, diff->width, diff->height,
+                                  diff->strideInPixels));
+        }
+      }
+    }
+  }
+
+  std::filesystem::remove_all(outputDir);
+}
+
+TEST(Pipeline, ReportsErrors) {
+  const std::vector<FilePair> pairs = {
+      {testdata(1, 'a'), "tests/testdata/missing.png", ""},
+      {testdata(1, 'a'), testdata(2, 'a'), ""},
+      {testdata(1, 'a'), testdata(1, 'b'), "/nonexistent-dir/diff.png"},
+      {testdata(1, 'a'), testdata(1, 'a'), ""},
+  };
+
+  const std::vector<FilePairResult> results = pixelmatchFiles(pairs);
+  ASSERT_EQ(results.size(), pairs.size());
+  EXPECT_EQ(results[0].numDiffPixels, -1);
+  EXPECT_EQ(results[0].error, "Could not read tests/testdata/missing.png");
+  EXPECT_EQ(results[1].numDiffPixels, -1);
+  EXPECT_EQ(results[1].error, "Image sizes do not match");
+  EXPECT_GT(results[2].numDiffPixels, 0);
+  EXPECT_EQ(results[2].error, "Could not write /nonexistent-dir/diff.png");
+  EXPECT_EQ(results[3].numDiffPixels, 0);
+  EXPECT_EQ(results[3].error, "");
+
+  EXPECT_TRUE(pixelmatchFiles({}).empty());
+}
+
+}  // namespace pixelmatch
@@ -0,0 +1,222 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "pixelmatch/image_utils.h"
+#include "pixelmatch/pixelmatch.h"
+#include "pixelmatch/pyramid.h"
+
+namespace pixelmatch {
+
+namespace {
+
+/// Kinds of synthetic image pairs.
+enum class Case {
+  Identical,    //!< Bit-identical images, covering the fast paths.
+  SparseDiff,   //!< A few small changed boxes, as in typical screenshot tests.
+  DenseDiff,    //!< Every pixel changed.
+  Antialiased,  //!< Shifted anti-aliased stripes, where most differences go through AA detection.
+  Alpha,        //!< Semi-transparent pixels everywhere, with small color changes.
+  Noise,        //!< Color changes below the threshold everywhere, as from a different renderer,
+                //!< plus the boxes of SparseDiff.
+};
+
+constexpr const char* kCaseNames[] = {"identical", "sparse", "dense", "aa", "alpha", "noise"};
+
+struct Size {
+  int width;
+  int height;
+};
+
+constexpr Size kSizes[] = {{256, 256}, {1024, 1024}, {1920, 1080}, {3840, 2160}, {7680, 4320}};
+
+struct ImagePairData {
+  int width;
+  int height;
+  std::vector<uint8_t> img1;
+  std::vector<uint8_t> img2;
+};
+
+/// Generates a textured base image, so that neighbors differ as in real images.
+std::vector<uint8_t> generateBase(Size size, bool alpha) {
+  std::vector<uint8_t> pixels(static_cast<size_t>(size.width) * size.height * 4);
+  for (int y = 0; y < size.height; ++y) {
+    for (int x = 0; x < size.width; ++x) {
+      const size_t pos = (static_cast<size_t>(y) * size.width + x) * 4;
+      pixels[pos + 0] = static_cast<uint8_t>(x / 4 + y / 16);
+      pixels[pos + 1] = static_cast<uint8_t>(y / 4 + (x * 7 + y * 3) % 5);
+      pixels[pos + 2] = static_cast<uint8_t>((x + y) / 8);
+      pixels[pos + 3] = alpha ? static_cast<uint8_t>(64 + (x + 2 * y) % 160) : 255;
+    }
+  }
+  return pixels;
+}
+
+/// Draws vertical stripes with one-pixel anti-aliased edges, shifted right by \ref shift.
+void drawStripes(Size size, int shift, std::vector<uint8_t>& pixels) {
+  constexpr int kPeriod = 12;
+  for (int y = 0; y < size.height; ++y) {
+    for (int x = 0; x < size.width; ++x) {
+      const int phase = (x + kPeriod - shift) % kPeriod;
+      const uint8_t value = phase < 4 ? 32 : phase == 4 || phase == kPeriod - 1 ? 140 : 240;
+      const size_t pos = (static_cast<size_t>(y) * size.width + x) * 4;
+      pixels[pos + 0] = value;
+      pixels[pos + 1] = value;
+      pixels[pos + 2] = value;
+      pixels[pos + 3] = 255;
+    }
+  }
+}
+
+ImagePairData generatePair(Size size, Case kind) {
+  ImagePairData result{size.width, size.height, {}, {}};
+  result.img1 = generateBase(size, kind == Case::Alpha);
+  result.img2 = result.img1;
+
+  if (kind == Case::Noise) {
+    for (size_t pos = 0; pos < result.img2.size(); pos += 4) {
+      result.img2[pos + 1] = static_cast<uint8_t>(result.img2[pos + 1] + (pos / 4) % 3);
+    }
+  }
+
+  switch (kind) {
+    case Case::Identical: break;
+    case Case::Noise:
+    case Case::SparseDiff: {
+      // 16 boxes of 24x24 pixels, spread over the image.
+      for (int box = 0; box < 16; ++box) {
+        const int x0 = (box % 4) * size.width / 4 + size.width / 16;
+        const int y0 = (box / 4) * size.height / 4 + size.height / 16;
+        for (int y = y0; y < std::min(y0 + 24, size.height); ++y) {
+          for (int x = x0; x < std::min(x0 + 24, size.width); ++x) {
+            const size_t pos = (static_cast<size_t>(y) * size.width + x) * 4;
+            result.img2[pos + 0] = 255 - result.img2[pos + 0];
+          }
+        }
+      }
+      break;
+    }
+    case Case::DenseDiff:
+      for (size_t pos = 0; pos < result.img2.size(); pos += 4) {
+        result.img2[pos + 0] = 255 - result.img2[pos + 0];
+        result.img2[pos + 2] = 255 - result.img2[pos + 2];
+      }
+      break;
+    case Case::Antialiased:
+      drawStripes(size, 0, result.img1);
+      drawStripes(size, 1, result.img2);
+      break;
+    case Case::Alpha:
+      for (size_t pos = 0; pos < result.img2.size(); pos += 4) {
+        result.img2[pos + 1] = static_cast<uint8_t>(result.img2[pos + 1] + 48);
+      }
+      break;
+  }
+
+  return result;
+}
+
+/// Returns the synthetic image pair for \ref size and \ref kind, generated once.
+const ImagePairData& syntheticPair(int sizeIndex, Case kind) {
+  static std::map<std::tuple<int, Case>, ImagePairData> cache;
+  const auto key = std::make_tuple(sizeIndex, kind);
+  auto it = cache.find(key);
+  if (it == cache.end()) {
+    // Keep a single pair alive, since 8K pairs take hundreds of megabytes.
+    cache.clear();
+    it = cache.emplace(key, generatePair(kSizes[sizeIndex], kind)).first;
+  }
+  return it->second;
+}
+
+/// Runs pixelmatch() on the images, reporting the throughput in megapixels per second.
+void runPixelmatch(benchmark::State& state, span<const uint8_t> img1, span<const uint8_t> img2,
+                   int width, int height, bool withOutput, const Options& options) {
+  std::vector<uint8_t> output(withOutput ? img1.size() : 0);
+  int diff = 0;
+  for (auto _ : state) {
+    diff = pixelmatch(img1, img2, output, width, height, width, options);
+    benchmark::DoNotOptimize(diff);
+    benchmark::ClobberMemory();
+  }
+
+  const double pixels = static_cast<double>(width) * height;
+  state.counters["megapixels"] = benchmark::Counter(pixels * state.iterations() / 1e6,
+                                                    benchmark::Counter::kIsRate);
+  state.counters["diff"] = diff;
+}
+
+/// Synthetic images: args are the size index, the case and whether to draw the output.
+void BM_Synthetic(benchmark::State& state) {
+  const int sizeIndex = static_cast<int>(state.range(0));
+  const Case kind = static_cast<Case>(state.range(1));
+  const bool withOutput = state.range(2) != 0;
+  const ImagePairData& pair = syntheticPair(sizeIndex, kind);
+
+  state.SetLabel(std::to_string(pair.width) + "x" + std::to_string(pair.height) + "/" +
+                 kCaseNames[state.range(1)] + (withOutput ? "/output" : "/count"));
+  runPixelmatch(state, pair.img1, pair.img2, pair.width, pair.height, withOutput, Options());
+}
+
+BENCHMARK(BM_Synthetic)
+    ->ArgNames({"size", "case", "output"})
+    ->ArgsProduct({{0, 1, 2, 3, 4}, {0, 1, 2, 3, 4, 5}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+/// Engine::CoarseToFine on synthetic images: args are the size index, the case and whether the
+/// pyramid of img1 is cached, as for a golden image.
+void BM_CoarseToFine(benchmark::State& state) {
+  const int sizeIndex = static_cast<int>(state.range(0));
+  const Case kind = static_cast<Case>(state.range(1));
+  const bool cached = state.range(2) != 0;
+  const ImagePairData& pair = syntheticPair(sizeIndex, kind);
+  const ImagePyramid pyramid(pair.img1, pair.width, pair.height, pair.width);
+
+  Options options;
+  options.engine = Engine::CoarseToFine;
+  options.img1Pyramid = cached ? &pyramid : nullptr;
+  state.SetLabel(std::to_string(pair.width) + "x" + std::to_string(pair.height) + "/" +
+                 kCaseNames[state.range(1)] + (cached ? "/cached" : "/uncached"));
+  runPixelmatch(state, pair.img1, pair.img2, pair.width, pair.height, false, options);
+}
+
+BENCHMARK(BM_CoarseToFine)
+    ->ArgNames({"size", "case", "cached"})
+    ->ArgsProduct({{2, 3}, {1, 3, 4, 5}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+/// The testdata pairs: args are the index of the pair and whether to draw the output.
+void BM_Testdata(benchmark::State& state) {
+  const std::string prefix = "tests/testdata/" + std::to_string(state.range(0));
+  auto maybeImg1 = readRgbaImageFromPngFile((prefix + "a.png").c_str());
+  auto maybeImg2 = readRgbaImageFromPngFile((prefix + "b.png").c_str());
+  if (!maybeImg1 || !maybeImg2 || maybeImg1->width != maybeImg2->width ||
+      maybeImg1->height != maybeImg2->height) {
+    state.SkipWithError("Could not load testdata, run from the repository root");
+    return;
+  }
+
+  const Image& img1 = *maybeImg1;
+  const Image& img2 = *maybeImg2;
+  const bool withOutput = state.range(1) != 0;
+  state.SetLabel(prefix + (withOutput ? "/output" : "/count"));
+
+  Options options;
+  options.threshold = 0.05f;
+  runPixelmatch(state, img1.data, img2.data, img1.width, img1.height, withOutput, options);
+}
+
+BENCHMARK(BM_Testdata)
+    ->ArgNames({"pair", "output"})
+    ->ArgsProduct({{1, 2, 3, 4, 5, 6, 7}, {0, 1}})
+    ->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+
+}  // namespace pixelmatch
+
+BENCHMARK_MAIN();
@@ -2,11 +2,16 @@
 #include <gtest/gtest-death-test.h>
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstring>
 #include <filesystem>
 
 #include "pixelmatch/image_utils.h"
 #include "pixelmatch/pixelmatch.h"
+#include "pixelmatch/pyramid.h"
+#include "pixelmatch/signature.h"
 
 namespace pixelmatch {
 
@@ -28,7 +33,15 @@ std::ostream& operator<<(std::ostream& os, const Options& options) {
   return os << "Options{threshold=" << options.threshold << ", includeAA=" << options.includeAA
             << ", alpha=" << options.alpha << ", aaColor=" << options.aaColor
             << ", diffColor=" << options.diffColor << ", diffColorAlt=" << options.diffColorAlt
-            << ", diffMask=" << options.diffMask << "}";
+            << ", diffMask=" << options.diffMask << ", numThreads=" << options.numThreads
+            << ", maxDiffs=" << options.maxDiffs
+            << ", ignoreRegions=" << options.ignoreRegions.size()
+            << ", ignoreMask=" << options.ignoreMask.size()
+            << ", engine=" << static_cast<int>(options.engine)
+            << ", countTiles=" << options.countTiles
+            << ", collectDiffPixels=" << options.collectDiffPixels
+            << ", collectAntialiasedPixels=" << options.collectAntialiasedPixels
+            << ", outputFormat=" << static_cast<int>(options.outputFormat) << "}";
 }
 
 std::string escapeFilename(std::string filename) {
@@ -82,6 +95,12 @@ void diffTest(const char* filename1, const char* filename2, const char* diffFile
   const int mismatchWithoutDiff = pixelmatch(img1.data, img2.data, span<uint8_t>(), img1.width,
                                              img1.height, img1.strideInPixels, options);
 
+  Options threadedOptions = options;
+  threadedOptions.numThreads = 3;
+  std::vector<uint8_t> threadedDiff(diff.size());
+  const int threadedMismatch = pixelmatch(img1.data, img2.data, threadedDiff, img1.width,
+                                          img1.height, img1.strideInPixels, threadedOptions);
+
   if (std::getenv("UPDATE_TEST_IMAGES") != nullptr) {
     writeRgbaPixelsToPngFile(diffFilename, diff, img1.width, img1.height, img1.strideInPixels);
   } else {
@@ -113,6 +132,8 @@ void diffTest(const char* filename1, const char* filename2, const char* diffFile
   EXPECT_EQ(mismatch, expectedMismatch) << "Different number of mismatched pixels";
   EXPECT_EQ(mismatch, mismatchWithoutDiff)
       << "Mismatched pixels differ when diff output is disabled";
+  EXPECT_EQ(mismatch, threadedMismatch) << "Mismatched pixels differ when using multiple threads";
+  EXPECT_TRUE(diff == threadedDiff) << "Diff output differs when using multiple threads";
 }
 
 /**
@@ -262,6 +283,846 @@ TEST(Pixelmatch, WithStride) {
   }
 }
 
+TEST(Pixelmatch, HardwareConcurrency) {
+  Options options = defaultTestOptions();
+  options.numThreads = 0;
+
+  diffTest("tests/testdata/4a.png", "tests/testdata/4b.png", "tests/testdata/4diff.png", options,
+           36049);
+}
+
+TEST(Pixelmatch, MaxDiffs) {
+  auto maybeImg1 = readRgbaImageFromPngFile("tests/testdata/4a.png");
+  auto maybeImg2 = readRgbaImageFromPngFile("tests/testdata/4b.png");
+  ASSERT_TRUE(maybeImg1.has_value() && maybeImg2.has_value());
+  const Image img1 = std::move(maybeImg1.value());
+  const Image img2 = std::move(maybeImg2.value());
+
+  auto compare = [&](std::optional<int> maxDiffs, int numThreads) {
+    Options options = defaultTestOptions();
+    options.maxDiffs = maxDiffs;
+    options.numThreads = numThreads;
+    return pixelmatch(img1.data, img2.data, pixelmatch::span<uint8_t>(), img1.width, img1.height,
+                      img1.strideInPixels, options);
+  };
+
+  for (const int numThreads : {1, 3}) {
+    SCOPED_TRACE(testing::Message() << "numThreads=" << numThreads);
+    EXPECT_EQ(compare(std::nullopt, numThreads), 36049);
+    EXPECT_EQ(compare(0, numThreads), 1);
+    EXPECT_EQ(compare(100, numThreads), 101);
+    EXPECT_EQ(compare(36048, numThreads), 36049);
+    EXPECT_EQ(compare(36049, numThreads), 36049);
+    EXPECT_EQ(compare(1000000, numThreads), 36049);
+  }
+
+  // Identical images never hit the limit.
+  Options options = defaultTestOptions();
+  options.maxDiffs = 0;
+  EXPECT_EQ(pixelmatch(img1.data, img1.data, pixelmatch::span<uint8_t>(), img1.width,
+                       img1.height, img1.strideInPixels, options),
+            0);
+}
+
+TEST(Pixelmatch, IgnoreRegions) {
+  auto maybeImg1 = readRgbaImageFromPngFile("tests/testdata/4a.png");
+  auto maybeImg2 = readRgbaImageFromPngFile("tests/testdata/4b.png");
+  ASSERT_TRUE(maybeImg1.has_value() && maybeImg2.has_value());
+  const Image img1 = std::move(maybeImg1.value());
+  const Image img2 = std::move(maybeImg2.value());
+  const int width = img1.width;
+  const int height = img1.height;
+
+  const Options options = defaultTestOptions();
+  std::vector<uint8_t> fullDiff(img1.data.size());
+  ASSERT_EQ(pixelmatch(img1.data, img2.data, fullDiff, width, height, img1.strideInPixels,
+                       options),
+            36049);
+
+  // Overlapping regions, one of them extending past the edges of the image.
+  const std::vector<Rect> regions = {
+      {-10, -10, width / 2 + 10, height / 3 + 10},
+      {width / 3, height / 4, width, height / 4},
+      {width / 4, height / 3, width / 8, height / 8},
+  };
+  auto isIgnored = [&](int x, int y) {
+    for (const Rect& rect : regions) {
+      if (x >= rect.x && x < rect.x + rect.width && y >= rect.y && y < rect.y + rect.height) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  // Pixels outside the regions are compared as before, and ignored pixels are drawn as background.
+  int expectedMismatch = 0;
+  std::vector<uint8_t> expectedDiff = fullDiff;
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const size_t pos = (y * img1.strideInPixels + x) * 4;
+      const bool isDiff = fullDiff[pos] == options.diffColor.r &&
+                          fullDiff[pos + 1] == options.diffColor.g &&
+                          fullDiff[pos + 2] == options.diffColor.b;
+      if (!isIgnored(x, y)) {
+        expectedMismatch += isDiff ? 1 : 0;
+      } else if (fullDiff[pos] != fullDiff[pos + 1] || fullDiff[pos] != fullDiff[pos + 2]) {
+        // Redraw differences and anti-aliased pixels as gray, by diffing against itself.
+        std::array<uint8_t, 4> gray{};
+        pixelmatch::span<const uint8_t> source(&img1.data[pos], 4);
+        pixelmatch(source, source, gray, 1, 1, 1, options);
+        std::copy(gray.begin(), gray.end(), &expectedDiff[pos]);
+      }
+    }
+  }
+  ASSERT_GT(expectedMismatch, 0);
+  ASSERT_LT(expectedMismatch, 36049);
+
+  std::vector<uint8_t> ignoreMask(static_cast<size_t>(width) * height);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      ignoreMask[y * width + x] = isIgnored(x, y) ? 1 : 0;
+    }
+  }
+
+  Options regionOptions = options;
+  regionOptions.ignoreRegions = regions;
+  Options maskOptions = options;
+  maskOptions.ignoreMask = ignoreMask;
+
+  for (const Options& ignoreOptions : {regionOptions, maskOptions}) {
+    for (const int numThreads : {1, 3}) {
+      SCOPED_TRACE(testing::Message() << ignoreOptions);
+      Options threadOptions = ignoreOptions;
+      threadOptions.numThreads = numThreads;
+
+      std::vector<uint8_t> diff(img1.data.size());
+      EXPECT_EQ(pixelmatch(img1.data, img2.data, diff, width, height, img1.strideInPixels,
+                           threadOptions),
+                expectedMismatch);
+      EXPECT_TRUE(diff == expectedDiff);
+      EXPECT_EQ(pixelmatch(img1.data, img2.data, pixelmatch::span<uint8_t>(), width, height,
+                           img1.strideInPixels, threadOptions),
+                expectedMismatch);
+    }
+  }
+
+  Options everything = options;
+  everything.ignoreRegions = {{0, 0, width, height}};
+  EXPECT_EQ(pixelmatch(img1.data, img2.data, pixelmatch::span<uint8_t>(), width, height,
+                       img1.strideInPixels, everything),
+            0);
+}
+
+TEST(Pixelmatch, SparseDifferencesAcrossTiles) {
+  constexpr int width = 130;
+  constexpr int height = 130;
+  std::vector<uint8_t> img1(width * height * 4);
+  for (size_t i = 0; i < img1.size(); ++i) {
+    img1[i] = i % 4 == 3 ? 255 : static_cast<uint8_t>(i * 7 % 13 + 100);
+  }
+
+  // Change pixels on both sides of the tile boundaries.
+  const std::array<std::pair<int, int>, 6> changes = {
+      {{0, 0}, {63, 63}, {64, 64}, {64, 0}, {129, 70}, {5, 129}}};
+  std::vector<uint8_t> img2 = img1;
+  for (const auto& [x, y] : changes) {
+    std::fill_n(&img2[(y * width + x) * 4], 3, 0);
+  }
+
+  Options options;
+  options.includeAA = true;
+  std::vector<uint8_t> expectedDiff(img1.size());
+  ASSERT_EQ(pixelmatch(img1, img1, expectedDiff, width, height, width, options), 0);
+  for (const auto& [x, y] : changes) {
+    const size_t pos = (y * width + x) * 4;
+    expectedDiff[pos + 0] = options.diffColor.r;
+    expectedDiff[pos + 1] = options.diffColor.g;
+    expectedDiff[pos + 2] = options.diffColor.b;
+    expectedDiff[pos + 3] = options.diffColor.a;
+  }
+
+  for (const int numThreads : {1, 3}) {
+    options.numThreads = numThreads;
+    std::vector<uint8_t> diff(img1.size());
+    EXPECT_EQ(pixelmatch(img1, img2, diff, width, height, width, options),
+              static_cast<int>(changes.size()));
+    EXPECT_TRUE(diff == expectedDiff);
+    EXPECT_EQ(pixelmatch(img1, img2, span<uint8_t>(), width, height, width, options),
+              static_cast<int>(changes.size()));
+  }
+}
+
+TEST(Pixelmatch, DiffResultMatchesDiffOutput) {
+  auto maybeImg1 = readRgbaImageFromPngFile("tests/testdata/3a.png");
+  auto maybeImg2 = readRgbaImageFromPngFile("tests/testdata/3b.png");
+  ASSERT_TRUE(maybeImg1.has_value() && maybeImg2.has_value());
+  const Image img1 = std::move(maybeImg1.value());
+  const Image img2 = std::move(maybeImg2.value());
+  const int width = img1.width;
+  const int height = img1.height;
+
+  Options options = defaultTestOptions();
+  options.diffColorAlt = Color{0, 255, 0, 255};
+  options.countTiles = true;
+  std::vector<uint8_t> diff(img1.data.size());
+  const int numDiffPixels =
+      pixelmatch(img1.data, img2.data, diff, width, height, img1.strideInPixels, options);
+
+  // Gather the same statistics from the diff output, where gray pixels never match these colors.
+  DiffResult expected;
+  expected.numDiffPixels = numDiffPixels;
+  expected.tileColumns = (width + DiffResult::kTileSize - 1) / DiffResult::kTileSize;
+  expected.tileCounts.resize(expected.tileColumns *
+                             ((height + DiffResult::kTileSize - 1) / DiffResult::kTileSize));
+  int minX = width;
+  int minY = height;
+  int maxX = -1;
+  int maxY = -1;
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const uint8_t* pixel = &diff[(y * img1.strideInPixels + x) * 4];
+      const auto is = [&](Color color) {
+        return pixel[0] == color.r && pixel[1] == color.g && pixel[2] == color.b;
+      };
+
+      if (is(options.aaColor)) {
+        ++expected.numAntialiasedPixels;
+      } else if (is(options.diffColor) || is(*options.diffColorAlt)) {
+        ++(is(options.diffColor) ? expected.numLighterPixels : expected.numDarkerPixels);
+        ++expected.tileCounts[(y / DiffResult::kTileSize) * expected.tileColumns +
+                              x / DiffResult::kTileSize];
+        minX = std::min(minX, x);
+        minY = std::min(minY, y);
+        maxX = std::max(maxX, x);
+        maxY = std::max(maxY, y);
+      }
+    }
+  }
+
+  ASSERT_GT(expected.numDarkerPixels, 0);
+  ASSERT_GT(expected.numLighterPixels, 0);
+  ASSERT_GT(expected.numAntialiasedPixels, 0);
+  EXPECT_EQ(expected.numDarkerPixels + expected.numLighterPixels, numDiffPixels);
+
+  for (const int numThreads : {1, 3}) {
+    SCOPED_TRACE(testing::Message() << "numThreads=" << numThreads);
+    options.numThreads = numThreads;
+    const DiffResult result =
+        pixelmatch(img1.data, img2.data, width, height, img1.strideInPixels, options);
+    EXPECT_EQ(result.numDiffPixels, expected.numDiffPixels);
+    EXPECT_EQ(result.numAntialiasedPixels, expected.numAntialiasedPixels);
+    EXPECT_EQ(result.numDarkerPixels, expected.numDarkerPixels);
+    EXPECT_EQ(result.numLighterPixels, expected.numLighterPixels);
+    ASSERT_TRUE(result.bounds.has_value());
+    EXPECT_EQ(result.bounds->x, minX);
+    EXPECT_EQ(result.bounds->y, minY);
+    EXPECT_EQ(result.bounds->width, maxX - minX + 1);
+    EXPECT_EQ(result.bounds->height, maxY - minY + 1);
+    EXPECT_EQ(result.tileColumns, expected.tileColumns);
+    EXPECT_THAT(result.tileCounts, testing::ElementsAreArray(expected.tileCounts));
+  }
+
+  // Tiles are only counted on request.
+  options.countTiles = false;
+  const DiffResult result =
+      pixelmatch(img1.data, img2.data, width, height, img1.strideInPixels, options);
+  EXPECT_EQ(result.numDiffPixels, numDiffPixels);
+  EXPECT_TRUE(result.tileCounts.empty());
+}
+
+TEST(Pixelmatch, DiffResultListsPixels) {
+  auto maybeImg1 = readRgbaImageFromPngFile("tests/testdata/3a.png");
+  auto maybeImg2 = readRgbaImageFromPngFile("tests/testdata/3b.png");
+  ASSERT_TRUE(maybeImg1.has_value() && maybeImg2.has_value());
+  const Image img1 = std::move(maybeImg1.value());
+  const Image img2 = std::move(maybeImg2.value());
+  const int width = img1.width;
+  const int height = img1.height;
+
+  Options options = defaultTestOptions();
+  options.diffColorAlt = Color{0, 255, 0, 255};
+  std::vector<uint8_t> diff(img1.data.size());
+  ASSERT_GT(pixelmatch(img1.data, img2.data, diff, width, height, img1.strideInPixels, options),
+            0);
+
+  options.collectDiffPixels = true;
+  options.collectAntialiasedPixels = true;
+  for (const int numThreads : {1, 3}) {
+    SCOPED_TRACE(testing::Message() << "numThreads=" << numThreads);
+    options.numThreads = numThreads;
+    const DiffResult result =
+        pixelmatch(img1.data, img2.data, width, height, img1.strideInPixels, options);
+    ASSERT_EQ(result.diffPixels.size(), static_cast<size_t>(result.numDiffPixels));
+    ASSERT_EQ(result.antialiasedPixels.size(), static_cast<size_t>(result.numAntialiasedPixels));
+
+    // Render the listed pixels over the background of the diff, which should reproduce it.
+    std::vector<uint8_t> rendered = diff;
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        uint8_t* pixel = &rendered[(y * img1.strideInPixels + x) * 4];
+        if (pixel[0] != pixel[1] || pixel[1] != pixel[2]) {
+          std::fill_n(pixel, 4, 0);
+        }
+      }
+    }
+
+    const auto draw = [&](const DiffPixel& pixel, Color color) {
+      uint8_t* dest = &rendered[(pixel.y * img1.strideInPixels + pixel.x) * 4];
+      dest[0] = color.r;
+      dest[1] = color.g;
+      dest[2] = color.b;
+      dest[3] = color.a;
+    };
+    for (const DiffPixel& pixel : result.diffPixels) {
+      draw(pixel, pixel.delta < 0.0f ? *options.diffColorAlt : options.diffColor);
+    }
+    for (const DiffPixel& pixel : result.antialiasedPixels) {
+      draw(pixel, options.aaColor);
+    }
+    EXPECT_TRUE(rendered == diff);
+
+    const auto rowMajor = [](const DiffPixel& a, const DiffPixel& b) {
+      return a.y != b.y ? a.y < b.y : a.x < b.x;
+    };
+    EXPECT_TRUE(std::is_sorted(result.diffPixels.begin(), result.diffPixels.end(), rowMajor));
+    EXPECT_TRUE(std::is_sorted(result.antialiasedPixels.begin(), result.antialiasedPixels.end(),
+                               rowMajor));
+  }
+}
+
+TEST(Pixelmatch, DeltaMap) {
+  for (const char* name : {"3", "5"}) {
+    const std::string path = std::string("tests/testdata/") + name;
+    auto maybeImg1 = readRgbaImageFromPngFile((path + "a.png").c_str());
+    auto maybeImg2 = readRgbaImageFromPngFile((path + "b.png").c_str());
+    ASSERT_TRUE(maybeImg1.has_value() && maybeImg2.has_value());
+    const Image img1 = std::move(maybeImg1.value());
+    const Image img2 = std::move(maybeImg2.value());
+    const int width = img1.width;
+    const int height = img1.height;
+    const size_t numPixels = static_cast<size_t>(width) * height;
+
+    Options options = defaultTestOptions();
+    options.collectDiffPixels = true;
+    options.collectAntialiasedPixels = true;
+    const DiffResult listed =
+        pixelmatch(img1.data, img2.data, width, height, img1.strideInPixels, options);
+
+    std::vector<float> expectedMap;
+    for (const Engine engine : {Engine::Float, Engine::CoarseToFine}) {
+      for (const int numThreads : {1, 3}) {
+        SCOPED_TRACE(testing::Message() << name << ", engine=" << static_cast<int>(engine)
+                                        << ", numThreads=" << numThreads);
+        std::vector<float> deltaMap(numPixels, -1.0f);
+        options.engine = engine;
+        options.numThreads = numThreads;
+        options.deltaMap = deltaMap;
+        const DiffResult result =
+            pixelmatch(img1.data, img2.data, width, height, img1.strideInPixels, options);
+        EXPECT_EQ(result.numDiffPixels, listed.numDiffPixels);
+
+        // The listed pixels have their delta in the map, and all others are below the threshold.
+        const float maxDelta = 35215.0f * options.threshold * options.threshold;
+        std::vector<bool> isListed(numPixels);
+        for (const auto* pixels : {&listed.diffPixels, &listed.antialiasedPixels}) {
+          for (const DiffPixel& pixel : *pixels) {
+            isListed[size_t(pixel.y) * width + pixel.x] = true;
+            EXPECT_EQ(deltaMap[size_t(pixel.y) * width + pixel.x], pixel.delta);
+          }
+        }
+        for (int y = 0; y < height; ++y) {
+          for (int x = 0; x < width; ++x) {
+            const float delta = deltaMap[size_t(y) * width + x];
+            const size_t pos = (y * img1.strideInPixels + x) * 4;
+            if (std::memcmp(&img1.data[pos], &img2.data[pos], 4) == 0) {
+              ASSERT_EQ(delta, 0.0f) << "x=" << x << ", y=" << y;
+            } else if (!isListed[size_t(y) * width + x]) {
+              ASSERT_LE(std::abs(delta), maxDelta) << "x=" << x << ", y=" << y;
+            }
+          }
+        }
+
+        // The map does not depend on the engine, since Engine::CoarseToFine then compares every
+        // changed tile, nor on the number of threads.
+        if (expectedMap.empty()) {
+          expectedMap = deltaMap;
+        } else {
+          EXPECT_TRUE(deltaMap == expectedMap);
+        }
+      }
+    }
+
+    // Ignored pixels are 0, and so is the map of identical images.
+    std::vector<float> deltaMap(numPixels, -1.0f);
+    std::vector<uint8_t> ignoreMask(numPixels);
+    std::fill(ignoreMask.begin(), ignoreMask.begin() + numPixels / 2, 1);
+    Options ignored = defaultTestOptions();
+    ignored.ignoreRegions = {Rect{0, height / 2, width / 2, height}};
+    ignored.ignoreMask = ignoreMask;
+    ignored.deltaMap = deltaMap;
+    pixelmatch(img1.data, img2.data, width, height, img1.strideInPixels, ignored);
+    for (size_t i = 0; i < numPixels; ++i) {
+      const bool inRegion = int(i / width) >= height / 2 && int(i % width) < width / 2;
+      ASSERT_EQ(deltaMap[i], ignoreMask[i] || inRegion ? 0.0f : expectedMap[i]) << "i=" << i;
+    }
+
+    std::fill(deltaMap.begin(), deltaMap.end(), -1.0f);
+    Options identical = defaultTestOptions();
+    identical.deltaMap = deltaMap;
+    std::vector<uint8_t> diff(img1.data.size());
+    pixelmatch(img1.data, img1.data, diff, width, height, img1.strideInPixels, identical);
+    EXPECT_TRUE(std::all_of(deltaMap.begin(), deltaMap.end(), [](float d) { return d == 0.0f; }));
+  }
+}
+
+TEST(Pixelmatch, MaskOutputFormats) {
+  auto maybeImg1 = readRgbaImageFromPngFile("tests/testdata/3a.png");
+  auto maybeImg2 = readRgbaImageFromPngFile("tests/testdata/3b.png");
+  ASSERT_TRUE(maybeImg1.has_value() && maybeImg2.has_value());
+  const Image img1 = std::move(maybeImg1.value());
+  const Image img2 = std::move(maybeImg2.value());
+  // Leave out the last columns, so that the last byte of each row of the bit mask is partial.
+  const int width = img1.width - 3;
+  const int height = img1.height;
+  const size_t rowBytes = (width + 7) / 8;
+
+  Options options = defaultTestOptions();
+  std::vector<uint8_t> diff(img1.data.size());
+  const int expected =
+      pixelmatch(img1.data, img2.data, diff, width, height, img1.strideInPixels, options);
+  ASSERT_GT(expected, 0);
+
+  std::vector<uint8_t> expectedBytes(static_cast<size_t>(width) * height);
+  std::vector<uint8_t> expectedBits(rowBytes * height);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const uint8_t* pixel = &diff[(y * img1.strideInPixels + x) * 4];
+      if (pixel[0] == options.diffColor.r && pixel[1] == options.diffColor.g &&
+          pixel[2] == options.diffColor.b) {
+        expectedBytes[y * width + x] = 1;
+        expectedBits[y * rowBytes + x / 8] |= 1 << (x % 8);
+      } else if (pixel[0] == options.aaColor.r && pixel[1] == options.aaColor.g &&
+                 pixel[2] == options.aaColor.b) {
+        expectedBytes[y * width + x] = 2;
+      }
+    }
+  }
+
+  for (const int numThreads : {1, 3}) {
+    SCOPED_TRACE(testing::Message() << "numThreads=" << numThreads);
+    options.numThreads = numThreads;
+
+    // Every byte is written, whatever the buffer held before.
+    options.outputFormat = OutputFormat::ByteMask;
+    std::vector<uint8_t> bytes(expectedBytes.size(), 0xFF);
+    EXPECT_EQ(pixelmatch(img1.data, img2.data, bytes, width, height, img1.strideInPixels, options),
+              expected);
+    EXPECT_TRUE(bytes == expectedBytes);
+
+    options.outputFormat = OutputFormat::BitMask;
+    std::vector<uint8_t> bits(expectedBits.size(), 0xFF);
+    EXPECT_EQ(pixelmatch(img1.data, img2.data, bits, width, height, img1.strideInPixels, options),
+              expected);
+    EXPECT_TRUE(bits == expectedBits);
+
+    std::fill(bits.begin(), bits.end(), 0xFF);
+    EXPECT_EQ(pixelmatch(img1.data, img1.data, bits, width, height, img1.strideInPixels, options),
+              0);
+    EXPECT_THAT(bits, testing::Each(0));
+  }
+}
+
+TEST(Pixelmatch, DiffResultOfIdenticalImages) {
+  auto maybeImg1 = readRgbaImageFromPngFile("tests/testdata/3a.png");
+  ASSERT_TRUE(maybeImg1.has_value());
+  const Image img1 = std::move(maybeImg1.value());
+
+  Options options = defaultTestOptions();
+  options.countTiles = true;
+  const DiffResult result =
+      pixelmatch(img1.data, img1.data, img1.width, img1.height, img1.strideInPixels, options);
+  EXPECT_EQ(result.numDiffPixels, 0);
+  EXPECT_EQ(result.numAntialiasedPixels, 0);
+  EXPECT_EQ(result.numDarkerPixels, 0);
+  EXPECT_EQ(result.numLighterPixels, 0);
+  EXPECT_FALSE(result.bounds.has_value());
+  EXPECT_THAT(result.tileCounts, testing::Each(0));
+  EXPECT_FALSE(result.tileCounts.empty());
+}
+
+/**
+ * Measures how far the fixed-point engine diverges from the float engine on all test images.
+ */
+TEST(Pixelmatch, FixedPointEngineDivergence) {
+  for (int i = 1; i <= 7; ++i) {
+    const std::string filename1 = "tests/testdata/" + std::to_string(i) + "a.png";
+    const std::string filename2 = "tests/testdata/" + std::to_string(i) + "b.png";
+    auto maybeImg1 = readRgbaImageFromPngFile(filename1.c_str());
+    auto maybeImg2 = readRgbaImageFromPngFile(filename2.c_str());
+    ASSERT_TRUE(maybeImg1.has_value() && maybeImg2.has_value()) << "Failed to load " << filename1;
+    const Image img1 = std::move(maybeImg1.value());
+    const Image img2 = std::move(maybeImg2.value());
+
+    for (const float threshold : {0.0f, 0.05f, 0.1f, 0.2f}) {
+      for (const bool includeAA : {false, true}) {
+        SCOPED_TRACE(testing::Message() << filename1 << " threshold=" << threshold
+                                        << " includeAA=" << includeAA);
+        Options options;
+        options.threshold = threshold;
+        options.includeAA = includeAA;
+        std::vector<uint8_t> floatDiff(img1.data.size());
+        const int floatMismatch = pixelmatch(img1.data, img2.data, floatDiff, img1.width,
+                                             img1.height, img1.strideInPixels, options);
+
+        options.engine = Engine::FixedPoint;
+        std::vector<uint8_t> fixedDiff(img1.data.size());
+        const int fixedMismatch = pixelmatch(img1.data, img2.data, fixedDiff, img1.width,
+                                             img1.height, img1.strideInPixels, options);
+
+        size_t differentPixels = 0;
+        for (size_t pos = 0; pos < floatDiff.size(); pos += 4) {
+          differentPixels += std::memcmp(&floatDiff[pos], &fixedDiff[pos], 4) != 0 ? 1 : 0;
+        }
+
+        // On this data, the engines disagree on at most ~1% of the different pixels, all of them
+        // close to the threshold.
+        EXPECT_LE(std::abs(fixedMismatch - floatMismatch), floatMismatch * 15 / 1000 + 1)
+            << floatMismatch << " vs " << fixedMismatch;
+        EXPECT_LE(differentPixels, img1.data.size() / 4 / 1000)
+            << differentPixels << " pixels of the diff output differ";
+      }
+    }
+  }
+}
+
+/**
+ * Checks that the coarse-to-fine engine gives the same results as the float engine, with and
+ * without a cached pyramid of img1.
+ */
+TEST(Pixelmatch, CoarseToFineMatchesFloat) {
+  for (int i = 1; i <= 7; ++i) {
+    const std::string filename1 = "tests/testdata/" + std::to_string(i) + "a.png";
+    const std::string filename2 = "tests/testdata/" + std::to_string(i) + "b.png";
+    auto maybeImg1 = readRgbaImageFromPngFile(filename1.c_str());
+    auto maybeImg2 = readRgbaImageFromPngFile(filename2.c_str());
+    ASSERT_TRUE(maybeImg1.has_value() && maybeImg2.has_value()) << "Failed to load " << filename1;
+    const Image img1 = std::move(maybeImg1.value());
+    const Image img2 = std::move(maybeImg2.value());
+    const ImagePyramid pyramid(img1.data, img1.width, img1.height, img1.strideInPixels);
+
+    for (const float threshold : {0.0f, 0.05f, 0.1f, 0.3f}) {
+      for (const bool includeAA : {false, true}) {
+        for (const bool cached : {false, true}) {
+          SCOPED_TRACE(testing::Message() << filename1 << " threshold=" << threshold
+                                          << " includeAA=" << includeAA << " cached=" << cached);
+          Options options;
+          options.threshold = threshold;
+          options.includeAA = includeAA;
+          std::vector<uint8_t> floatDiff(img1.data.size());
+          const int floatMismatch = pixelmatch(img1.data, img2.data, floatDiff, img1.width,
+                                               img1.height, img1.strideInPixels, options);
+          const DiffResult floatResult =
+              pixelmatch(img1.data, img2.data, img1.width, img1.height, img1.strideInPixels,
+                         options);
+
+          options.engine = Engine::CoarseToFine;
+          options.img1Pyramid = cached ? &pyramid : nullptr;
+          std::vector<uint8_t> coarseDiff(img1.data.size());
+          EXPECT_EQ(pixelmatch(img1.data, img2.data, coarseDiff, img1.width, img1.height,
+                               img1.strideInPixels, options),
+                    floatMismatch);
+          EXPECT_TRUE(imageEquals(coarseDiff, floatDiff, img1.width, img1.height,
+                                  img1.strideInPixels));
+
+          const DiffResult coarseResult =
+              pixelmatch(img1.data, img2.data, img1.width, img1.height, img1.strideInPixels,
+                         options);
+          EXPECT_EQ(coarseResult.numDiffPixels, floatResult.numDiffPixels);
+          EXPECT_EQ(coarseResult.numAntialiasedPixels, floatResult.numAntialiasedPixels);
+          EXPECT_EQ(coarseResult.numDarkerPixels, floatResult.numDarkerPixels);
+        }
+      }
+    }
+  }
+}
+
+TEST(Pixelmatch, CoarseToFineSkipsBlocksBelowThreshold) {
+  constexpr int kWidth = 70;
+  constexpr int kHeight = 66;
+  std::vector<uint8_t> img1(kWidth * kHeight * 4);
+  for (size_t pos = 0; pos < img1.size(); pos += 4) {
+    const int x = static_cast<int>(pos / 4) % kWidth;
+    img1[pos + 0] = static_cast<uint8_t>(100 + x % 4);
+    img1[pos + 1] = 120;
+    img1[pos + 2] = 140;
+    img1[pos + 3] = 255;
+  }
+
+  // Shift every pixel by a delta well below the threshold, and change one pixel above it.
+  std::vector<uint8_t> img2 = img1;
+  for (size_t pos = 0; pos < img2.size(); pos += 4) {
+    ++img2[pos + 1];
+  }
+  img2[(5 * kWidth + 9) * 4] = 250;
+
+  const ImagePyramid pyramid1(img1, kWidth, kHeight, kWidth);
+  const ImagePyramid pyramid2(img2, kWidth, kHeight, kWidth);
+  ASSERT_FALSE(pyramid1.empty());
+  EXPECT_EQ(pyramid1.width(), kWidth);
+  EXPECT_EQ(pyramid1.height(), kHeight);
+
+  const float maxDelta = 35215.0f * 0.1f * 0.1f;
+  uint16_t flagged[detail::kPyramidTileBlocks];
+  detail::findCandidateBlocks(pyramid1.tileRanges(0, 0), pyramid2.tileRanges(0, 0), maxDelta,
+                              flagged);
+  // Only the block of pixel (9, 5) may be above the threshold.
+  for (int row = 0; row < detail::kPyramidTileBlocks; ++row) {
+    EXPECT_EQ(flagged[row], row == 1 ? 1 << 2 : 0) << "row " << row;
+  }
+
+  // The partial tiles along the edges are skipped entirely.
+  for (const auto& [tileX, tileY] : {std::pair{1, 0}, std::pair{0, 1}, std::pair{1, 1}}) {
+    detail::findCandidateBlocks(pyramid1.tileRanges(tileX, tileY),
+                                pyramid2.tileRanges(tileX, tileY), maxDelta, flagged);
+    EXPECT_THAT(flagged, testing::Each(0));
+  }
+
+  Options options;
+  options.engine = Engine::CoarseToFine;
+  options.img1Pyramid = &pyramid1;
+  EXPECT_EQ(pixelmatch(img1, img2, span<uint8_t>(), kWidth, kHeight, kWidth, options), 1);
+}
+
+/**
+ * Checks that comparisons against a signature of img1 give the same results as without it.
+ */
+TEST(Pixelmatch, SignatureMatchesMemcmp) {
+  for (int i = 1; i <= 7; ++i) {
+    const std::string filename1 = "tests/testdata/" + std::to_string(i) + "a.png";
+    const std::string filename2 = "tests/testdata/" + std::to_string(i) + "b.png";
+    auto maybeImg1 = readRgbaImageFromPngFile(filename1.c_str());
+    auto maybeImg2 = readRgbaImageFromPngFile(filename2.c_str());
+    ASSERT_TRUE(maybeImg1.has_value() && maybeImg2.has_value()) << "Failed to load " << filename1;
+    const Image img1 = std::move(maybeImg1.value());
+    const Image img2 = std::move(maybeImg2.value());
+    const ImageSignature signature(img1.data, img1.width, img1.height, img1.strideInPixels);
+    ASSERT_FALSE(signature.empty());
+    EXPECT_TRUE(imageEquals(signature, img1.data, img1.width, img1.height, img1.strideInPixels));
+    EXPECT_EQ(imageEquals(signature, img2.data, img2.width, img2.height, img2.strideInPixels),
+              imageEquals(img1.data, img2.data, img1.width, img1.height, img1.strideInPixels));
+
+    for (const float threshold : {0.0f, 0.1f}) {
+      for (const bool includeAA : {false, true}) {
+        SCOPED_TRACE(testing::Message() << filename1 << " threshold=" << threshold
+                                        << " includeAA=" << includeAA);
+        Options options;
+        options.threshold = threshold;
+        options.includeAA = includeAA;
+        std::vector<uint8_t> expectedDiff(img1.data.size());
+        const int expectedMismatch = pixelmatch(img1.data, img2.data, expectedDiff, img1.width,
+                                                img1.height, img1.strideInPixels, options);
+
+        options.img1Signature = &signature;
+        std::vector<uint8_t> diff(img1.data.size());
+        EXPECT_EQ(pixelmatch(img1.data, img2.data, diff, img1.width, img1.height,
+                             img1.strideInPixels, options),
+                  expectedMismatch);
+        EXPECT_TRUE(
+            imageEquals(diff, expectedDiff, img1.width, img1.height, img1.strideInPixels));
+
+        // The bound of the different pixels never rejects a pair within maxDiffs.
+        options.maxDiffs = expectedMismatch;
+        EXPECT_EQ(pixelmatch(img1.data, img2.data, img1.width, img1.height, img1.strideInPixels,
+                             options)
+                      .numDiffPixels,
+                  expectedMismatch);
+      }
+    }
+  }
+}
+
+TEST(Pixelmatch, SignatureSkipsMatchingTiles) {
+  constexpr int kWidth = 130;
+  constexpr int kHeight = 70;
+  constexpr size_t kStride = 132;
+  std::vector<uint8_t> img1(kStride * kHeight * 4);
+  for (size_t pos = 0; pos < img1.size(); pos += 4) {
+    img1[pos + 0] = static_cast<uint8_t>(pos / 4 % 251);
+    img1[pos + 1] = static_cast<uint8_t>(pos / 8 % 241);
+    img1[pos + 2] = 140;
+    img1[pos + 3] = 255;
+  }
+  const ImageSignature signature(img1, kWidth, kHeight, kStride);
+  EXPECT_EQ(signature.width(), kWidth);
+  EXPECT_EQ(signature.height(), kHeight);
+  EXPECT_EQ(signature.tileColumns(), 3);
+  EXPECT_EQ(signature.tileRows(), 2);
+
+  // The padding of the stride is not part of the signature.
+  std::vector<uint8_t> img2 = img1;
+  img2[(kWidth + 1) * 4] = 0;
+  EXPECT_EQ(ImageSignature(img2, kWidth, kHeight, kStride), signature);
+  EXPECT_TRUE(imageEquals(signature, img2, kWidth, kHeight, kStride));
+
+  // Only the tiles that differ are compared, whatever img1 holds in the others.
+  img2[(66 * kStride + 129) * 4] = 255;
+  img2[(66 * kStride + 129) * 4 + 2] = 0;
+  EXPECT_NE(ImageSignature(img2, kWidth, kHeight, kStride), signature);
+  EXPECT_FALSE(imageEquals(signature, img2, kWidth, kHeight, kStride));
+  std::vector<uint8_t> img1Changed = img1;
+  img1Changed[(3 * kStride + 3) * 4] ^= 0xFF;
+  Options options;
+  options.img1Signature = &signature;
+  EXPECT_EQ(pixelmatch(img1Changed, img2, span<uint8_t>(), kWidth, kHeight, kStride, options), 1);
+}
+
+TEST(Pixelmatch, SignatureRejectsDifferentImages) {
+  constexpr int kWidth = 100;
+  constexpr int kHeight = 100;
+  std::vector<uint8_t> img1(kWidth * kHeight * 4, 255);
+  std::vector<uint8_t> img2(kWidth * kHeight * 4, 0);
+  for (size_t pos = 3; pos < img2.size(); pos += 4) {
+    img2[pos] = 255;
+  }
+  const ImageSignature signature1(img1, kWidth, kHeight, kWidth);
+  const ImageSignature signature2(img2, kWidth, kHeight, kWidth);
+
+  // White and black differ at every pixel, so the bound is close to the number of pixels.
+  const int bound = detail::minPixelsAboveThreshold(signature1.tileMean(0, 0),
+                                                    signature2.tileMean(0, 0), 64 * 64,
+                                                    35215.0f * 0.1f * 0.1f);
+  EXPECT_GT(bound, 64 * 64 * 9 / 10);
+  EXPECT_LE(bound, 64 * 64);
+  EXPECT_EQ(detail::minPixelsAboveThreshold(signature1.tileMean(0, 0), signature1.tileMean(1, 1),
+                                            64 * 36, 0.0f),
+            0);
+
+  // Rejected from the tile means alone, so img1 is not read.
+  Options options;
+  options.img1Signature = &signature1;
+  options.maxDiffs = 1000;
+  const std::vector<uint8_t> unread(img1.size());
+  EXPECT_EQ(pixelmatch(unread, img2, kWidth, kHeight, kWidth, options).numDiffPixels, 1001);
+
+  options.maxDiffs.reset();
+  EXPECT_EQ(pixelmatch(img1, img2, kWidth, kHeight, kWidth, options).numDiffPixels,
+            kWidth * kHeight);
+}
+
+TEST(Pixelmatch, SignatureSerialization) {
+  constexpr int kWidth = 70;
+  constexpr int kHeight = 3;
+  std::vector<uint8_t> img(kWidth * kHeight * 4);
+  for (size_t pos = 0; pos < img.size(); ++pos) {
+    img[pos] = static_cast<uint8_t>(pos * 7);
+  }
+  const ImageSignature signature(img, kWidth, kHeight, kWidth);
+  std::vector<uint8_t> bytes = signature.serialize();
+
+  const std::optional<ImageSignature> parsed = ImageSignature::deserialize(bytes);
+  ASSERT_TRUE(parsed.has_value());
+  EXPECT_EQ(*parsed, signature);
+  EXPECT_EQ(parsed->hash(), signature.hash());
+  for (int tileX = 0; tileX < signature.tileColumns(); ++tileX) {
+    EXPECT_EQ(parsed->tileHash(tileX, 0), signature.tileHash(tileX, 0));
+    EXPECT_EQ(parsed->tileMean(tileX, 0).y, signature.tileMean(tileX, 0).y);
+  }
+  EXPECT_TRUE(imageEquals(*parsed, img, kWidth, kHeight, kWidth));
+
+  EXPECT_FALSE(ImageSignature::deserialize(span<const uint8_t>(bytes.data(), bytes.size() - 1)));
+  bytes[30] ^= 1;
+  EXPECT_FALSE(ImageSignature::deserialize(bytes));
+  EXPECT_FALSE(ImageSignature::deserialize(span<const uint8_t>()));
+}
+
+TEST(Pixelmatch, ImagesEndingWithLastRow) {
+  // A 3x2 view of the bottom-right corner of a 5x4 image ends with the last pixel of the image.
+  constexpr int kWidth = 3;
+  constexpr int kHeight = 2;
+  constexpr size_t kStride = 5;
+  constexpr size_t kViewSize = ((kHeight - 1) * kStride + kWidth) * 4;
+  EXPECT_TRUE(isImageSize(kViewSize, kWidth, kHeight, kStride));
+  EXPECT_TRUE(isImageSize(kStride * kHeight * 4, kWidth, kHeight, kStride));
+  EXPECT_FALSE(isImageSize(kViewSize - 4, kWidth, kHeight, kStride));
+  EXPECT_FALSE(isImageSize(kStride * kHeight * 4 + 4, kWidth, kHeight, kStride));
+
+  std::vector<uint8_t> img1(kStride * 4 * 4, 255);
+  std::vector<uint8_t> img2 = img1;
+  std::vector<uint8_t> output(img1.size(), 7);
+  const size_t viewStart = (2 * kStride + 2) * 4;
+  img2[viewStart + (kStride + 2) * 4] = 0;
+  const span<const uint8_t> view1(img1.data() + viewStart, kViewSize);
+  const span<const uint8_t> view2(img2.data() + viewStart, kViewSize);
+  const span<uint8_t> outputView(output.data() + viewStart, kViewSize);
+  EXPECT_EQ(pixelmatch(view1, view2, outputView, kWidth, kHeight, kStride), 1);
+
+  // Only the pixels of the view are drawn.
+  for (size_t pos = 0; pos < output.size(); pos += 4) {
+    const size_t x = pos / 4 % kStride;
+    const size_t y = pos / 4 / kStride;
+    const bool inView = x >= 2 && y >= 2;
+    EXPECT_EQ(output[pos] != 7, inView) << "pixel " << x << ", " << y;
+  }
+
+  EXPECT_FALSE(ImagePyramid(view1, kWidth, kHeight, kStride).empty());
+  EXPECT_FALSE(ImageSignature(view1, kWidth, kHeight, kStride).empty());
+}
+
+TEST(Pixelmatch, Batch) {
+  struct TestCase {
+    const char* filename1;
+    const char* filename2;
+    int expectedMismatch;
+  };
+
+  const std::array<TestCase, 5> testCases = {{
+      {"tests/testdata/1a.png", "tests/testdata/1b.png", 143},
+      {"tests/testdata/3a.png", "tests/testdata/3b.png", 212},
+      {"tests/testdata/4a.png", "tests/testdata/4b.png", 36049},
+      {"tests/testdata/5a.png", "tests/testdata/5b.png", 0},
+      {"tests/testdata/6a.png", "tests/testdata/6b.png", 51},
+  }};
+
+  std::vector<Image> images;
+  for (const TestCase& testCase : testCases) {
+    for (const char* filename : {testCase.filename1, testCase.filename2}) {
+      auto maybeImg = readRgbaImageFromPngFile(filename);
+      ASSERT_TRUE(maybeImg.has_value()) << "Failed to load: " << filename;
+      images.push_back(std::move(maybeImg.value()));
+    }
+  }
+
+  std::vector<std::vector<uint8_t>> outputs(testCases.size());
+  std::vector<ImagePair> pairs;
+  for (size_t i = 0; i < testCases.size(); ++i) {
+    const Image& img1 = images[i * 2];
+    const Image& img2 = images[i * 2 + 1];
+    outputs[i].resize(img1.data.size());
+    pairs.push_back(ImagePair{img1.data, img2.data, outputs[i], img1.width, img1.height,
+                              img1.strideInPixels});
+  }
+
+  Options options = defaultTestOptions();
+  options.numThreads = 3;
+  const std::vector<int> results = pixelmatchBatch(pairs, options);
+  ASSERT_EQ(results.size(), testCases.size());
+
+  for (size_t i = 0; i < testCases.size(); ++i) {
+    SCOPED_TRACE(testing::Message() << "Comparing " << testCases[i].filename1 << " to "
+                                    << testCases[i].filename2);
+    EXPECT_EQ(results[i], testCases[i].expectedMismatch);
+
+    const ImagePair& pair = pairs[i];
+    std::vector<uint8_t> expectedOutput(pair.img1.size());
+    EXPECT_EQ(pixelmatch(pair.img1, pair.img2, expectedOutput, pair.width, pair.height,
+                         pair.strideInPixels, defaultTestOptions()),
+              results[i]);
+    EXPECT_TRUE(outputs[i] == expectedOutput) << "Batch diff output differs from pixelmatch()";
+  }
+
+  EXPECT_TRUE(pixelmatchBatch(span<const ImagePair>(), options).empty());
+}
+
 TEST(PixelmatchDeathTest, NegativeDimensions) {
   std::array<uint8_t, 8> img1;
   std::array<uint8_t, 8> img2;
@@ -295,6 +1156,16 @@ TEST(PixelmatchDeathTest, InvalidOutputSize) {
                      "img1\\.size\\(\\) == output\\.size\\(\\)");
 }
 
+TEST(PixelmatchDeathTest, InvalidMaskOutputSize) {
+  std::array<uint8_t, 8> img1;
+  std::array<uint8_t, 8> img2;
+  std::array<uint8_t, 3> output;
+  Options options;
+  options.outputFormat = OutputFormat::ByteMask;
+  EXPECT_DEBUG_DEATH(pixelmatch(img1, img2, output, 2, 1, 2, options),
+                     "Mask output size does not match width/height");
+}
+
 TEST(PixelmatchDeathTest, InvalidStride) {
   std::array<uint8_t, 48> img1;
   std::array<uint8_t, 48> img2;
@@ -302,6 +1173,65 @@ TEST(PixelmatchDeathTest, InvalidStride) {
                      "Stride must be greater than width");
 }
 
+TEST(PixelmatchDeathTest, InvalidNumThreads) {
+  std::array<uint8_t, 8> img1;
+  std::array<uint8_t, 8> img2;
+  Options options;
+  options.numThreads = -1;
+  EXPECT_DEBUG_DEATH(pixelmatch(img1, img2, pixelmatch::span<uint8_t>(), 2, 1, 2, options),
+                     "numThreads must be >= 0");
+}
+
+TEST(PixelmatchDeathTest, InvalidMaxDiffs) {
+  std::array<uint8_t, 8> img1;
+  std::array<uint8_t, 8> img2;
+  Options options;
+  options.maxDiffs = -1;
+  EXPECT_DEBUG_DEATH(pixelmatch(img1, img2, pixelmatch::span<uint8_t>(), 2, 1, 2, options),
+                     "maxDiffs must be >= 0");
+}
+
+TEST(PixelmatchDeathTest, InvalidIgnoreMaskSize) {
+  std::array<uint8_t, 8> img1;
+  std::array<uint8_t, 8> img2;
+  std::array<uint8_t, 3> ignoreMask;
+  Options options;
+  options.ignoreMask = ignoreMask;
+  EXPECT_DEBUG_DEATH(pixelmatch(img1, img2, pixelmatch::span<uint8_t>(), 2, 1, 2, options),
+                     "Ignore mask size does not match width/height");
+}
+
+TEST(PixelmatchDeathTest, InvalidDeltaMapSize) {
+  std::array<uint8_t, 8> img1;
+  std::array<uint8_t, 8> img2;
+  std::array<float, 3> deltaMap;
+  Options options;
+  options.deltaMap = deltaMap;
+  EXPECT_DEBUG_DEATH(pixelmatch(img1, img2, pixelmatch::span<uint8_t>(), 2, 1, 2, options),
+                     "Delta map size does not match width/height");
+}
+
+TEST(PixelmatchDeathTest, InvalidImg1PyramidSize) {
+  std::array<uint8_t, 8> img1;
+  std::array<uint8_t, 8> img2;
+  const ImagePyramid pyramid(span<const uint8_t>(img1.data(), 4), 1, 1, 1);
+  Options options;
+  options.engine = Engine::CoarseToFine;
+  options.img1Pyramid = &pyramid;
+  EXPECT_DEBUG_DEATH(pixelmatch(img1, img2, pixelmatch::span<uint8_t>(), 2, 1, 2, options),
+                     "img1Pyramid size does not match width/height");
+}
+
+TEST(PixelmatchDeathTest, InvalidImg1SignatureSize) {
+  std::array<uint8_t, 8> img1;
+  std::array<uint8_t, 8> img2;
+  const ImageSignature signature(span<const uint8_t>(img1.data(), 4), 1, 1, 1);
+  Options options;
+  options.img1Signature = &signature;
+  EXPECT_DEBUG_DEATH(pixelmatch(img1, img2, pixelmatch::span<uint8_t>(), 2, 1, 2, options),
+                     "img1Signature size does not match width/height");
+}
+
 TEST(Pixelmatch, SingleChannelDifferences) {
   EXPECT_TRUE(compareSinglePixel(Color{0, 0, 0, 255}, Color{0, 0, 0, 255}));
 
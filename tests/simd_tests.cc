@@ -0,0 +1,216 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "pixelmatch/fixed_point.h"
+#include "pixelmatch/simd.h"
+#include "pixelmatch/yiq.h"
+
+namespace pixelmatch::detail {
+
+namespace {
+
+uint32_t floatBits(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+/// Generates pixels that hit the interesting cases: identical, opaque, transparent and
+/// semi-transparent, with small and large channel differences.
+void generatePixels(std::mt19937& rng, size_t count, std::vector<uint8_t>& row1,
+                    std::vector<uint8_t>& row2) {
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::uniform_int_distribution<int> kind(0, 5);
+
+  row1.resize(count * 4);
+  row2.resize(count * 4);
+  for (size_t i = 0; i < count * 4; i += 4) {
+    for (size_t c = 0; c < 4; ++c) {
+      row1[i + c] = static_cast<uint8_t>(byte(rng));
+      row2[i + c] = static_cast<uint8_t>(byte(rng));
+    }
+
+    switch (kind(rng)) {
+      case 0: std::memcpy(&row2[i], &row1[i], 4); break;
+      case 1: row1[i + 3] = row2[i + 3] = 255; break;
+      case 2: row1[i + 3] = row2[i + 3] = 0; break;
+      case 3:
+        std::memcpy(&row2[i], &row1[i], 4);
+        row2[i + byte(rng) % 4] ^= 1;
+        break;
+      default: break;
+    }
+  }
+}
+
+}  // namespace
+
+TEST(Simd, ScalarKernelsAlwaysSupported) {
+  const std::vector<const SimdKernels*> kernels = supportedKernels();
+  ASSERT_FALSE(kernels.empty());
+  EXPECT_EQ(kernels.back(), &scalarKernels());
+  EXPECT_EQ(kernels.front(), &bestKernels());
+}
+
+TEST(Simd, CompiledKernelsSupported) {
+  // Kernels compiled without runtime detection always run on the target.
+  const std::vector<const SimdKernels*> kernels = supportedKernels();
+  for (const SimdKernels* compiled : {sse2Kernels(), neonKernels(), wasmSimd128Kernels()}) {
+    if (compiled) {
+      EXPECT_THAT(kernels, testing::Contains(compiled)) << compiled->name;
+    }
+  }
+}
+
+TEST(Simd, KernelsMatchColorDelta) {
+  std::mt19937 rng(42);
+  std::vector<uint8_t> row1;
+  std::vector<uint8_t> row2;
+
+  for (const SimdKernels* kernels : supportedKernels()) {
+    SCOPED_TRACE(testing::Message() << "kernels=" << kernels->name);
+
+    for (size_t count = 0; count < 70; ++count) {
+      generatePixels(rng, count, row1, row2);
+
+      const float maxDelta = 35215.0f * 0.1f * 0.1f;
+      std::vector<float> deltas(count);
+      const bool above = kernels->colorDeltaRow(row1.data(), row2.data(), count, maxDelta,
+                                                deltas.data());
+
+      bool expectedAbove = false;
+      for (size_t x = 0; x < count; ++x) {
+        const float expected = colorDelta(row1, row2, x * 4, x * 4, false);
+        expectedAbove |= std::abs(expected) > maxDelta;
+        EXPECT_EQ(floatBits(deltas[x]), floatBits(expected))
+            << "count=" << count << ", x=" << x << ", delta=" << deltas[x]
+            << ", expected=" << expected;
+      }
+
+      EXPECT_EQ(above, expectedAbove) << "count=" << count;
+    }
+  }
+}
+
+TEST(Simd, KernelsMatchColorDeltaForAllAlphas) {
+  // Every alpha value against a fixed color, to cover each blend() rounding case.
+  constexpr size_t kCount = 256;
+  std::vector<uint8_t> row1(kCount * 4);
+  std::vector<uint8_t> row2(kCount * 4);
+  for (size_t x = 0; x < kCount; ++x) {
+    row1[x * 4 + 0] = static_cast<uint8_t>(x);
+    row1[x * 4 + 1] = static_cast<uint8_t>(255 - x);
+    row1[x * 4 + 2] = 77;
+    row1[x * 4 + 3] = static_cast<uint8_t>(x);
+    row2[x * 4 + 0] = 200;
+    row2[x * 4 + 1] = 13;
+    row2[x * 4 + 2] = static_cast<uint8_t>(x * 7);
+    row2[x * 4 + 3] = 255;
+  }
+
+  for (const SimdKernels* kernels : supportedKernels()) {
+    SCOPED_TRACE(testing::Message() << "kernels=" << kernels->name);
+
+    std::vector<float> deltas(kCount);
+    kernels->colorDeltaRow(row1.data(), row2.data(), kCount, 0.0f, deltas.data());
+    for (size_t x = 0; x < kCount; ++x) {
+      EXPECT_EQ(floatBits(deltas[x]), floatBits(colorDelta(row1, row2, x * 4, x * 4, false)))
+          << "x=" << x;
+    }
+  }
+}
+
+TEST(Simd, OpaqueKernelsMatchColorDelta) {
+  std::mt19937 rng(43);
+  std::vector<uint8_t> row1;
+  std::vector<uint8_t> row2;
+
+  std::vector<const SimdKernels*> allKernels = supportedKernels();
+  allKernels.push_back(&fixedPointKernels());
+  for (const SimdKernels* kernels : allKernels) {
+    SCOPED_TRACE(testing::Message() << "kernels=" << kernels->name);
+
+    for (size_t count = 0; count < 70; ++count) {
+      generatePixels(rng, count, row1, row2);
+      for (size_t i = 3; i < count * 4; i += 4) {
+        row1[i] = row2[i] = 255;
+      }
+
+      // The opaque kernels skip the blend, which is a no-op for opaque pixels.
+      const float maxDelta = 35215.0f * 0.1f * 0.1f;
+      std::vector<float> expected(count);
+      std::vector<float> deltas(count);
+      const bool expectedAbove =
+          kernels->colorDeltaRow(row1.data(), row2.data(), count, maxDelta, expected.data());
+      const bool above =
+          kernels->colorDeltaRowOpaque(row1.data(), row2.data(), count, maxDelta, deltas.data());
+      EXPECT_EQ(above, expectedAbove) << "count=" << count;
+      for (size_t x = 0; x < count; ++x) {
+        EXPECT_EQ(floatBits(deltas[x]), floatBits(expected[x])) << "count=" << count << ", x=" << x;
+      }
+    }
+  }
+}
+
+TEST(Yiq, BlendedYMatchesColorDeltaBrightness) {
+  std::mt19937 rng(7);
+  std::vector<uint8_t> row1;
+  std::vector<uint8_t> row2;
+  generatePixels(rng, 4096, row1, row2);
+
+  for (size_t pos = 0; pos < row1.size(); pos += 4) {
+    const float expected = colorDelta(row1, row2, pos, pos, true);
+    const float actual = blendedY(&row1[pos]) - blendedY(&row2[pos]);
+    ASSERT_EQ(floatBits(actual), floatBits(expected)) << "at pixel " << pos / 4;
+  }
+}
+
+TEST(FixedPoint, ColorDeltaWithinDocumentedBound) {
+  std::mt19937 rng(11);
+  std::vector<uint8_t> row1;
+  std::vector<uint8_t> row2;
+  generatePixels(rng, 1 << 16, row1, row2);
+
+  for (size_t pos = 0; pos < row1.size(); pos += 4) {
+    const float expected = colorDelta(row1, row2, pos, pos, false);
+    bool darker = false;
+    const float actual = fixedPointColorDelta(&row1[pos], &row2[pos], darker) / 65536.0f;
+    ASSERT_NEAR(actual, std::abs(expected), std::abs(expected) * 0.01f + 0.25f)
+        << "at pixel " << pos / 4;
+  }
+}
+
+TEST(FixedPoint, RowMatchesThreshold) {
+  std::mt19937 rng(12);
+  std::vector<uint8_t> row1;
+  std::vector<uint8_t> row2;
+  generatePixels(rng, 4096, row1, row2);
+
+  for (const float maxDelta : {0.0f, 35.215f, 352.15f, 1408.6f}) {
+    SCOPED_TRACE(testing::Message() << "maxDelta=" << maxDelta);
+    const uint32_t maxFixed = fixedPointMaxDelta(maxDelta);
+
+    std::vector<float> deltas(4096);
+    const bool above =
+        colorDeltaRowFixedPoint(row1.data(), row2.data(), 4096, maxDelta, deltas.data());
+
+    bool expectedAbove = false;
+    for (size_t x = 0; x < 4096; ++x) {
+      bool darker = false;
+      const bool pixelAbove = fixedPointColorDelta(&row1[x * 4], &row2[x * 4], darker) > maxFixed;
+      expectedAbove |= pixelAbove;
+      ASSERT_EQ(std::abs(deltas[x]) > maxDelta, pixelAbove) << "x=" << x;
+      if (deltas[x] != 0.0f) {
+        EXPECT_EQ(deltas[x] < 0.0f, darker) << "x=" << x;
+      }
+    }
+    EXPECT_EQ(above, expectedAbove);
+  }
+}
+
+}  // namespace pixelmatch::detail
@@ -0,0 +1,282 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest-death-test.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <vector>
+
+#include "pixelmatch/image_utils.h"
+#include "pixelmatch/pixelmatch.h"
+#include "tests/test_support.h"
+
+namespace pixelmatch {
+
+namespace {
+
+/// Bytes per row of an output of \ref format.
+size_t outputRowBytes(OutputFormat format, int width) {
+  switch (format) {
+    case OutputFormat::Rgba:
+      return static_cast<size_t>(width) * 4;
+    case OutputFormat::ByteMask:
+      return static_cast<size_t>(width);
+    case OutputFormat::BitMask:
+      return (static_cast<size_t>(width) + 7) / 8;
+  }
+  return 0;
+}
+
+/// Result and output of a streaming comparison.
+struct StreamedDiff {
+  DiffResult result;
+  std::vector<uint8_t> output;
+};
+
+/// Compares two images with a StreamingComparator, pushing \ref rowsPerPush rows at a time, and
+/// checks that the output rows arrive in order.
+StreamedDiff streamImages(const Image& img1, const Image& img2, const Options& options,
+                          int rowsPerPush) {
+  StreamedDiff diff;
+  const size_t rowBytes = outputRowBytes(options.outputFormat, img1.width);
+  StreamingComparator comparator(
+      img1.width, img1.height, options, [&](int y, int numRows, span<const uint8_t> rows) {
+        EXPECT_EQ(static_cast<size_t>(y) * rowBytes, diff.output.size());
+        EXPECT_EQ(rows.size(), static_cast<size_t>(numRows) * rowBytes);
+        diff.output.insert(diff.output.end(), rows.data(), rows.data() + rows.size());
+      });
+
+  const size_t pushBytes = img1.strideInPixels * 4;
+  for (int y = 0; y < img1.height; y += rowsPerPush) {
+    const int numRows = std::min(rowsPerPush, img1.height - y);
+    const size_t offset = y * pushBytes;
+    const size_t size = numRows * pushBytes;
+    const int compared =
+        comparator.pushRows(span<const uint8_t>(img1.data.data() + offset, size),
+                            span<const uint8_t>(img2.data.data() + offset, size), numRows,
+                            img1.strideInPixels);
+    EXPECT_EQ(compared, comparator.rowsCompared());
+    EXPECT_LE(compared, comparator.rowsPushed());
+    EXPECT_EQ(comparator.rowsPushed(), y + numRows);
+    EXPECT_EQ(diff.output.size(), compared * rowBytes);
+  }
+
+  diff.result = comparator.result();
+  EXPECT_EQ(comparator.numDiffPixels(), diff.result.numDiffPixels);
+  return diff;
+}
+
+/// Checks that streaming two images gives the same result and output as pixelmatch().
+void expectStreamingMatches(const Image& img1, const Image& img2, const Options& options) {
+  const size_t rowBytes = outputRowBytes(options.outputFormat, img1.width);
+  std::vector<uint8_t> expectedOutput(
+      options.outputFormat == OutputFormat::Rgba ? img1.data.size() : rowBytes * img1.height);
+  const int expectedDiffs = pixelmatch(img1.data, img2.data, expectedOutput, img1.width,
+                                       img1.height, img1.strideInPixels, options);
+  const DiffResult expected =
+      pixelmatch(img1.data, img2.data, img1.width, img1.height, img1.strideInPixels, options);
+  ASSERT_EQ(expected.numDiffPixels, expectedDiffs);
+
+  // The streamed output is unpadded.
+  if (options.outputFormat == OutputFormat::Rgba && img1.strideInPixels != size_t(img1.width)) {
+    std::vector<uint8_t> unpadded;
+    for (int y = 0; y < img1.height; ++y) {
+      const auto row = expectedOutput.begin() + y * img1.strideInPixels * 4;
+      unpadded.insert(unpadded.end(), row, row + rowBytes);
+    }
+    expectedOutput = std::move(unpadded);
+  }
+
+  for (const int rowsPerPush : {1, 3, 64, 67, 1000}) {
+    SCOPED_TRACE("rowsPerPush=" + std::to_string(rowsPerPush));
+    const StreamedDiff diff = streamImages(img1, img2, options, rowsPerPush);
+    EXPECT_EQ(diff.result.numDiffPixels, expected.numDiffPixels);
+    EXPECT_EQ(diff.result.numAntialiasedPixels, expected.numAntialiasedPixels);
+    EXPECT_EQ(diff.result.numDarkerPixels, expected.numDarkerPixels);
+    EXPECT_EQ(diff.result.numLighterPixels, expected.numLighterPixels);
+    EXPECT_EQ(diff.result.bounds.has_value(), expected.bounds.has_value());
+    if (diff.result.bounds && expected.bounds) {
+      EXPECT_EQ(diff.result.bounds->x, expected.bounds->x);
+      EXPECT_EQ(diff.result.bounds->y, expected.bounds->y);
+      EXPECT_EQ(diff.result.bounds->width, expected.bounds->width);
+      EXPECT_EQ(diff.result.bounds->height, expected.bounds->height);
+    }
+    EXPECT_EQ(diff.result.tileColumns, expected.tileColumns);
+    EXPECT_EQ(diff.result.tileCounts, expected.tileCounts);
+    ASSERT_EQ(diff.result.diffPixels.size(), expected.diffPixels.size());
+    for (size_t i = 0; i < expected.diffPixels.size(); ++i) {
+      EXPECT_EQ(diff.result.diffPixels[i].x, expected.diffPixels[i].x);
+      EXPECT_EQ(diff.result.diffPixels[i].y, expected.diffPixels[i].y);
+    }
+    EXPECT_TRUE(diff.output == expectedOutput);
+  }
+}
+
+/// Returns a tall image made of \ref copies copies of \ref img stacked vertically, with the rows
+/// padded to \ref strideInPixels.
+Image stackImage(const Image& img, int copies, size_t strideInPixels) {
+  Image stacked{img.width, img.height * copies, strideInPixels, {}};
+  stacked.data.resize(strideInPixels * stacked.height * 4);
+  for (int y = 0; y < stacked.height; ++y) {
+    const auto row = img.data.begin() + (y % img.height) * img.strideInPixels * 4;
+    std::copy(row, row + img.width * 4, stacked.data.begin() + y * strideInPixels * 4);
+  }
+  return stacked;
+}
+
+}  // namespace
+
+TEST(StreamingComparator, MatchesPixelmatch) {
+  for (int i = 1; i <= 7; ++i) {
+    auto img1 = readRgbaImageFromPngFile(testdata(i, 'a').c_str());
+    auto img2 = readRgbaImageFromPngFile(testdata(i, 'b').c_str());
+    ASSERT_TRUE(img1.has_value() && img2.has_value());
+
+    for (const int numThreads : {1, 3}) {
+      SCOPED_TRACE(testdata(i, 'a') + ", numThreads=" + std::to_string(numThreads));
+      Options options;
+      options.threshold = 0.05f;
+      options.numThreads = numThreads;
+      options.countTiles = true;
+      options.collectDiffPixels = true;
+      expectStreamingMatches(*img1, *img2, options);
+    }
+  }
+}
+
+TEST(StreamingComparator, MatchesPixelmatchWithOptions) {
+  auto img1 = readRgbaImageFromPngFile(testdata(1, 'a').c_str());
+  auto img2 = readRgbaImageFromPngFile(testdata(1, 'b').c_str());
+  ASSERT_TRUE(img1.has_value() && img2.has_value());
+
+  // Many bands, with padded rows.
+  const Image tall1 = stackImage(*img1, 3, img1->width + 5);
+  const Image tall2 = stackImage(*img2, 3, img1->width + 5);
+  std::vector<uint8_t> ignoreMask(static_cast<size_t>(tall1.width) * tall1.height);
+  std::fill(ignoreMask.begin(), ignoreMask.begin() + ignoreMask.size() / 3, 1);
+
+  std::vector<Options> variants(8);
+  variants[0].includeAA = true;
+  variants[1].diffMask = true;
+  variants[2].outputFormat = OutputFormat::ByteMask;
+  variants[3].outputFormat = OutputFormat::BitMask;
+  variants[4].ignoreRegions = {Rect{10, 100, 200, 300}, Rect{-5, 500, 40, 1000}};
+  variants[5].ignoreMask = ignoreMask;
+  variants[6].engine = Engine::CoarseToFine;
+  variants[7].engine = Engine::FixedPoint;
+  variants[7].maxDiffs = 100;
+
+  for (size_t i = 0; i < variants.size(); ++i) {
+    for (const int numThreads : {1, 2}) {
+      if (variants[i].maxDiffs && numThreads > 1) {
+        // Bands stopping early in parallel count different pixels in any order.
+        continue;
+      }
+      SCOPED_TRACE("variant " + std::to_string(i) + ", numThreads=" + std::to_string(numThreads));
+      Options options = variants[i];
+      options.numThreads = numThreads;
+      expectStreamingMatches(tall1, tall2, options);
+    }
+  }
+}
+
+TEST(StreamingComparator, IdenticalImages) {
+  auto img = readRgbaImageFromPngFile(testdata(3, 'a').c_str());
+  ASSERT_TRUE(img.has_value());
+
+  for (const bool diffMask : {false, true}) {
+    Options options;
+    options.diffMask = diffMask;
+    expectStreamingMatches(*img, *img, options);
+  }
+}
+
+TEST(StreamingComparator, WithoutOutput) {
+  auto img1 = readRgbaImageFromPngFile(testdata(1, 'a').c_str());
+  auto img2 = readRgbaImageFromPngFile(testdata(1, 'b').c_str());
+  ASSERT_TRUE(img1.has_value() && img2.has_value());
+
+  StreamingComparator comparator(img1->width, img1->height);
+  EXPECT_EQ(comparator.width(), img1->width);
+  EXPECT_EQ(comparator.height(), img1->height);
+  EXPECT_EQ(comparator.result().numDiffPixels, -1);
+
+  // A band is compared once the two rows below it are pushed.
+  const size_t rowBytes = img1->strideInPixels * 4;
+  const int half = img1->height / 2;
+  const int comparedHalf = (half - 2) / 64 * 64;
+  EXPECT_EQ(comparator.pushRows(span<const uint8_t>(img1->data.data(), half * rowBytes),
+                                span<const uint8_t>(img2->data.data(), half * rowBytes), half,
+                                img1->strideInPixels),
+            comparedHalf);
+  EXPECT_EQ(comparator.result().numDiffPixels, -1);
+
+  // Pushing no rows is allowed.
+  EXPECT_EQ(comparator.pushRows(span<const uint8_t>(), span<const uint8_t>(), 0,
+                                img1->strideInPixels),
+            comparedHalf);
+
+  const int rest = img1->height - half;
+  EXPECT_EQ(comparator.pushRows(span<const uint8_t>(img1->data.data() + half * rowBytes,
+                                                    rest * rowBytes),
+                                span<const uint8_t>(img2->data.data() + half * rowBytes,
+                                                    rest * rowBytes),
+                                rest, img1->strideInPixels),
+            img1->height);
+
+  Options options;
+  EXPECT_EQ(comparator.result().numDiffPixels,
+            pixelmatch(img1->data, img2->data, span<uint8_t>(), img1->width, img1->height,
+                       img1->strideInPixels, options));
+}
+
+TEST(StreamingComparator, CroppedRows) {
+  auto img1 = readRgbaImageFromPngFile(testdata(1, 'a').c_str());
+  auto img2 = readRgbaImageFromPngFile(testdata(1, 'b').c_str());
+  ASSERT_TRUE(img1.has_value() && img2.has_value());
+
+  // Push the columns [x0, x0 + width) in place, like a cropped numpy view: each push ends with
+  // the last pixel of its last row, short of the stride.
+  const int x0 = 5;
+  const int width = img1->width - 10;
+  const size_t stride = img1->strideInPixels;
+  const auto crop = [&](const Image& img, int y, int numRows) {
+    return span<const uint8_t>(img.data.data() + (y * stride + x0) * 4,
+                               ((numRows - 1) * stride + width) * 4);
+  };
+
+  Options options;
+  const int expected = pixelmatch(crop(*img1, 0, img1->height), crop(*img2, 0, img1->height),
+                                  span<uint8_t>(), width, img1->height, stride, options);
+  StreamingComparator comparator(width, img1->height, options);
+  for (int y = 0; y < img1->height; y += 50) {
+    const int numRows = std::min(50, img1->height - y);
+    EXPECT_GE(comparator.pushRows(crop(*img1, y, numRows), crop(*img2, y, numRows), numRows,
+                                  stride),
+              0);
+  }
+  EXPECT_EQ(comparator.result().numDiffPixels, expected);
+}
+
+TEST(StreamingComparatorDeathTest, InvalidArguments) {
+  std::array<uint8_t, 16> rows{};
+  {
+    StreamingComparator comparator(2, 2);
+    EXPECT_DEBUG_DEATH(comparator.pushRows(rows, rows, 3, 2), "More rows pushed than the height");
+    EXPECT_DEBUG_DEATH(comparator.pushRows(rows, rows, 2, 1), "Stride must be greater than width");
+    EXPECT_DEBUG_DEATH(comparator.pushRows(rows, span<const uint8_t>(rows.data(), 8), 2, 2),
+                       "Rows data size does not match numRows");
+    EXPECT_EQ(comparator.rowsPushed(), 0);
+  }
+
+  {
+    Options options;
+    options.maxDiffs = -1;
+    EXPECT_DEBUG_DEATH(StreamingComparator(2, 2, options), "maxDiffs must be >= 0");
+  }
+
+  EXPECT_DEBUG_DEATH(StreamingComparator(0, 2), "width > 0");
+}
+
+}  // namespace pixelmatch
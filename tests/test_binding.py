@@ -1,16 +1,39 @@
 from __future__ import annotations
 
+from concurrent.futures import ThreadPoolExecutor
 from pathlib import Path
 
 import numpy as np
+import pytest
 
 from pybind11_pixelmatch import (
     Color,
+    Comparator,
+    Engine,
+    ImagePyramid,
+    ImageSignature,
+    IncrementalComparator,
     Options,
+    OutputFormat,
+    PngEncodeOptions,
+    PngFilter,
+    PngRowDecoder,
+    Rect,
+    StreamingComparator,
+    encode_png,
+    gpu_available,
     normalize_color,
     pixelmatch,
+    pixelmatch_batch,
+    pixelmatch_device,
+    pixelmatch_files,
+    pixelmatch_stats,
     read_image,
+    read_png,
+    read_raw,
     write_image,
+    write_png,
+    write_raw,
 )
 
 
@@ -40,6 +63,10 @@ def test_options():
     assert opt.diffColor.to_python() == [255, 0, 0, 255]
     assert opt.diffColorAlt is None
     assert not opt.diffMask
+    assert opt.numThreads == 1
+    assert opt.maxDiffs is None
+    assert opt.ignoreRegions == []
+    assert opt.engine == Engine.Float
 
     opt.threshold = 0.5
     assert opt.threshold == 0.5
@@ -67,4 +94,620 @@ def test_pixelmatch():
     diff = np.zeros(img1.shape, dtype=img1.dtype)
     num = pixelmatch(img1, img2, output=diff)
     assert num == 163889
+
+    opt = Options()
+    opt.numThreads = 0
+    threaded_diff = np.zeros(img1.shape, dtype=img1.dtype)
+    num = pixelmatch(img1, img2, output=threaded_diff, options=opt)
+    assert num == 163889
+    assert np.array_equal(diff, threaded_diff)
     write_image("diff.png", diff)
+
+
+class DLPackTensor:
+    """Exports an array only through the DLPack protocol, like torch.Tensor."""
+
+    def __init__(self, array):
+        self.array = array
+
+    def __dlpack__(self, stream=None):
+        return self.array.__dlpack__()
+
+    def __dlpack_device__(self):
+        return self.array.__dlpack_device__()
+
+
+def test_pixelmatch_dlpack():
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    img1 = read_image(f"{project_source_dir}/data/pic1.png")
+    img2 = read_image(f"{project_source_dir}/data/pic2.png")
+    expected_diff = np.zeros(img1.shape, dtype=img1.dtype)
+    expected = pixelmatch(img1, img2, output=expected_diff)
+
+    diff = np.zeros(img1.shape, dtype=img1.dtype)
+    num = pixelmatch(DLPackTensor(img1), DLPackTensor(img2), output=DLPackTensor(diff))
+    assert num == expected
+    assert np.array_equal(diff, expected_diff)
+
+    # Capsules are consumed as they are, and strided views are compared in place.
+    assert pixelmatch(img1.__dlpack__(), img2.__dlpack__()) == expected
+    crop1 = img1[100:900, 200:1200]
+    crop2 = img2[100:900, 200:1200]
+    stats = pixelmatch_stats(DLPackTensor(crop1), DLPackTensor(crop2))
+    assert stats.numDiffPixels == pixelmatch(crop1, crop2)
+
+    assert pixelmatch(DLPackTensor(img1.astype(np.int16)), DLPackTensor(img2)) == -1
+    with pytest.raises(TypeError):
+        pixelmatch(img1.tolist(), img2)
+
+
+def test_pixelmatch_torch_tensors():
+    torch = pytest.importorskip("torch")
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    img1 = read_image(f"{project_source_dir}/data/pic1.png")
+    img2 = read_image(f"{project_source_dir}/data/pic2.png")
+    expected_diff = np.zeros(img1.shape, dtype=img1.dtype)
+    expected = pixelmatch(img1, img2, output=expected_diff)
+
+    tensor1 = torch.from_numpy(img1)
+    tensor2 = torch.from_numpy(img2)
+    diff = torch.zeros_like(tensor1)
+    assert pixelmatch(tensor1, tensor2, output=diff) == expected
+    assert np.array_equal(diff.numpy(), expected_diff)
+    # Outputs of the module are NumPy arrays, which torch.from_dlpack() wraps without a copy.
+    assert torch.from_dlpack(read_png(f"{project_source_dir}/data/pic1.png")).shape == img1.shape
+
+    if torch.cuda.is_available() and gpu_available():
+        diff = torch.zeros_like(tensor1, device="cuda")
+        num = pixelmatch(tensor1.cuda(), tensor2.cuda(), output=diff)
+        assert num == expected
+        assert np.array_equal(diff.cpu().numpy(), expected_diff)
+        assert pixelmatch_stats(tensor1.cuda(), tensor2.cuda()).numDiffPixels == expected
+
+
+def test_read_png():
+    import cv2
+
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    path = f"{project_source_dir}/data/pic1.png"
+    img = read_png(path)
+    assert img.shape == (955, 1857, 4)
+    assert img.dtype == np.uint8
+    assert img.flags.c_contiguous
+    assert img.flags.writeable
+    assert not img.flags.owndata  # Owned by the decoder's buffer, through a capsule.
+
+    expected = cv2.imread(path, cv2.IMREAD_UNCHANGED)
+    if expected.shape[2] == 3:
+        expected = np.dstack([expected[..., ::-1], np.full(expected.shape[:2], 255, np.uint8)])
+    else:
+        expected = cv2.cvtColor(expected, cv2.COLOR_BGRA2RGBA)
+    assert np.array_equal(img, expected)
+    assert np.array_equal(read_image(path), img)
+
+    with pytest.raises(ValueError, match="Could not read PNG file"):
+        read_png(f"{project_source_dir}/data/missing.png")
+
+
+def test_write_png(tmp_path):
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    img = read_png(f"{project_source_dir}/data/pic1.png")
+
+    opt = PngEncodeOptions()
+    assert opt.compressionLevel == 1
+    assert opt.filter == PngFilter.Up
+    sizes = {}
+    for level in [0, 1, 6]:
+        for png_filter in [PngFilter.None_, PngFilter.Paeth, PngFilter.Adaptive]:
+            opt.compressionLevel = level
+            opt.filter = png_filter
+            path = str(tmp_path / f"{level}-{png_filter.name}.png")
+            assert write_png(path, img, options=opt)
+            assert np.array_equal(read_png(path), img)
+            sizes[level] = len(encode_png(img, options=opt))
+    assert sizes[0] > max(sizes[1], sizes[6])
+
+    # Crops are encoded in place.
+    crop = img[100:200, 300:400]
+    path = str(tmp_path / "crop.png")
+    write_image(path, crop)
+    assert np.array_equal(read_image(path), crop)
+
+    opt.compressionLevel = 10
+    with pytest.raises(ValueError, match="compressionLevel"):
+        encode_png(img, options=opt)
+    with pytest.raises(ValueError, match="uint8"):
+        encode_png(img[..., :3])
+    assert not write_png(str(tmp_path / "missing" / "dir.png"), img)
+
+
+def test_raw(tmp_path):
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    img1 = read_png(f"{project_source_dir}/data/pic1.png")
+    img2 = read_png(f"{project_source_dir}/data/pic2.png")
+
+    path = str(tmp_path / "pic1.rgba")
+    assert write_raw(path, img1)
+    mapped = read_raw(path)
+    assert mapped.shape == img1.shape
+    assert mapped.dtype == np.uint8
+    assert not mapped.flags.writeable
+    assert not mapped.flags.owndata  # Backed by the mapping.
+    assert np.array_equal(mapped, img1)
+    with pytest.raises(ValueError, match="read-only"):
+        mapped[0, 0, 0] = 0
+
+    # Views keep the mapping alive.
+    crop = mapped[10:20, 30:40]
+    del mapped
+    assert np.array_equal(crop, img1[10:20, 30:40])
+
+    assert pixelmatch(read_image(path), img2) == pixelmatch(img1, img2)
+
+    # Strided images are packed.
+    path = str(tmp_path / "strided.rgba")
+    write_image(path, img1[::2, ::3])
+    assert np.array_equal(read_image(path), img1[::2, ::3])
+
+    with pytest.raises(ValueError, match="Could not map"):
+        read_raw(f"{project_source_dir}/data/pic1.png")
+    assert not write_raw(str(tmp_path / "missing" / "dir.rgba"), img1)
+
+
+def test_pixelmatch_from_threads():
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    img1 = read_image(f"{project_source_dir}/data/pic1.png")
+    img2 = read_image(f"{project_source_dir}/data/pic2.png")
+
+    # The comparison runs without the GIL, so these overlap.
+    with ThreadPoolExecutor(max_workers=4) as executor:
+        nums = list(executor.map(lambda _: pixelmatch(img1, img2), range(8)))
+    assert nums == [163889] * 8
+
+
+def test_pixelmatch_batch():
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    img1 = read_image(f"{project_source_dir}/data/pic1.png")
+    img2 = read_image(f"{project_source_dir}/data/pic2.png")
+
+    opt = Options()
+    opt.numThreads = 0
+    imgs1 = np.stack([img1, img1, img2])
+    imgs2 = np.stack([img2, img1, img1])
+    diffs = np.zeros(imgs1.shape, dtype=imgs1.dtype)
+    nums = pixelmatch_batch(imgs1, imgs2, output=diffs, options=opt)
+    assert nums == [163889, 0, 163889]
+
+    diff = np.zeros(img1.shape, dtype=img1.dtype)
+    pixelmatch(img1, img2, output=diff)
+    assert np.array_equal(diffs[0], diff)
+
+    nums = pixelmatch_batch([(img1, img2), (img1, img2[:, :-1]), (img2, img2)], options=opt)
+    assert nums == [163889, -1, 0]
+
+
+def test_pixelmatch_files(tmp_path):
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    pic1 = f"{project_source_dir}/data/pic1.png"
+    pic2 = f"{project_source_dir}/data/pic2.png"
+    expected_diff = np.zeros(read_png(pic1).shape, dtype=np.uint8)
+    pixelmatch(read_png(pic1), read_png(pic2), output=expected_diff)
+
+    opt = Options()
+    opt.numThreads = 0
+    pairs = [(pic1, pic2, str(tmp_path / f"{i}.png")) for i in range(4)]
+    pairs.append((pic1, pic1, None))
+    pairs.append((pic1, f"{project_source_dir}/data/missing.png", None))
+    results = pixelmatch_files(pairs, options=opt, maxPairsInFlight=2)
+    assert [r.numDiffPixels for r in results] == [163889] * 4 + [0, -1]
+    assert [r.error for r in results[:5]] == [""] * 5
+    assert "missing.png" in results[5].error
+    for i in range(4):
+        assert np.array_equal(read_png(str(tmp_path / f"{i}.png")), expected_diff)
+
+
+def test_pixelmatch_max_diffs():
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    img1 = read_image(f"{project_source_dir}/data/pic1.png")
+    img2 = read_image(f"{project_source_dir}/data/pic2.png")
+
+    opt = Options()
+    opt.maxDiffs = 1000
+    assert pixelmatch(img1, img2, options=opt) == 1001
+    opt.maxDiffs = 163889
+    assert pixelmatch(img1, img2, options=opt) == 163889
+    opt.maxDiffs = None
+    assert pixelmatch(img1, img2, options=opt) == 163889
+
+
+def test_pixelmatch_stats():
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    img1 = read_image(f"{project_source_dir}/data/pic1.png")
+    img2 = read_image(f"{project_source_dir}/data/pic2.png")
+
+    opt = Options()
+    opt.diffColorAlt = Color(0, 255, 0, 255)
+    opt.countTiles = True
+    diff = np.zeros(img1.shape, dtype=img1.dtype)
+    assert pixelmatch(img1, img2, output=diff, options=opt) == 163889
+
+    stats = pixelmatch_stats(img1, img2, options=opt)
+    assert stats.numDiffPixels == 163889
+    red = np.all(diff == [255, 0, 0, 255], axis=2)
+    green = np.all(diff == [0, 255, 0, 255], axis=2)
+    yellow = np.all(diff == [255, 255, 0, 255], axis=2)
+    assert stats.numLighterPixels == red.sum()
+    assert stats.numDarkerPixels == green.sum()
+    assert stats.numAntialiasedPixels == yellow.sum()
+
+    ys, xs = np.nonzero(red | green)
+    bounds = stats.bounds
+    assert [bounds.x, bounds.y] == [xs.min(), ys.min()]
+    assert [bounds.width, bounds.height] == [xs.max() - xs.min() + 1, ys.max() - ys.min() + 1]
+
+    size = stats.kTileSize
+    tiles = np.array(stats.tileCounts).reshape(-1, stats.tileColumns)
+    assert tiles.sum() == 163889
+    assert tiles[0, 0] == (red | green)[:size, :size].sum()
+
+    assert len(stats.diffPixels) == 0
+
+    # Only gathered by builds with PIXELMATCH_ENABLE_INSTRUMENTATION.
+    counters = stats.instrumentation
+    if counters is not None:
+        assert not counters.identicalImages
+        assert counters.pixelsAboveThreshold == 163889 + stats.numAntialiasedPixels
+        assert counters.colorDeltaNanoseconds > 0
+
+    opt.collectDiffPixels = True
+    opt.collectAntialiasedPixels = True
+    stats = pixelmatch_stats(img1, img2, options=opt)
+    assert stats.diffPixels.shape == (163889, 2)
+    assert stats.diffDeltas.shape == (163889,)
+    assert np.array_equal(stats.diffPixels[:, ::-1], np.argwhere(red | green))
+    assert np.array_equal(stats.diffDeltas < 0, green[red | green])
+    assert np.array_equal(stats.antialiasedPixels[:, ::-1], np.argwhere(yellow))
+
+    assert pixelmatch_stats(img1, img1).bounds is None
+    assert pixelmatch_stats(img1, img2[:-1]).numDiffPixels == -1
+
+
+def test_pixelmatch_device():
+    if not gpu_available():
+        with pytest.raises(ValueError):
+            pixelmatch_device(1, 1, 2, 2)
+        return
+
+    cp = pytest.importorskip("cupy")
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    img1 = read_image(f"{project_source_dir}/data/pic1.png")
+    img2 = read_image(f"{project_source_dir}/data/pic2.png")
+    height, width = img1.shape[:2]
+
+    opt = Options()
+    opt.diffColorAlt = Color(0, 255, 0, 255)
+    diff = np.zeros(img1.shape, dtype=img1.dtype)
+    expected = pixelmatch(img1, img2, output=diff, options=opt)
+
+    d_img1 = cp.asarray(img1)
+    d_img2 = cp.asarray(img2)
+    d_diff = cp.zeros(img1.shape, dtype=cp.uint8)
+    stats = pixelmatch_device(
+        d_img1.data.ptr,
+        d_img2.data.ptr,
+        width,
+        height,
+        output=d_diff.data.ptr,
+        options=opt,
+    )
+    assert stats.numDiffPixels == expected
+    assert np.array_equal(cp.asnumpy(d_diff), diff)
+
+    opt.maxDiffs = 10
+    with pytest.raises(ValueError):
+        pixelmatch_device(d_img1.data.ptr, d_img2.data.ptr, width, height, options=opt)
+
+
+def test_pixelmatch_mask_output():
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    img1 = read_image(f"{project_source_dir}/data/pic1.png")
+    img2 = read_image(f"{project_source_dir}/data/pic2.png")
+    height, width = img1.shape[:2]
+
+    diff = np.zeros(img1.shape, dtype=img1.dtype)
+    assert pixelmatch(img1, img2, output=diff) == 163889
+    expected = np.zeros((height, width), dtype=np.uint8)
+    expected[np.all(diff == [255, 0, 0, 255], axis=2)] = 1
+    expected[np.all(diff == [255, 255, 0, 255], axis=2)] = 2
+
+    opt = Options()
+    opt.outputFormat = OutputFormat.ByteMask
+    mask = np.full((height, width), 255, dtype=np.uint8)
+    assert pixelmatch(img1, img2, output=mask, options=opt) == 163889
+    assert np.array_equal(mask, expected)
+    mask = np.asfortranarray(np.full((height, width), 255, dtype=np.uint8))
+    assert pixelmatch(img1, img2, output=mask, options=opt) == 163889
+    assert np.array_equal(mask, expected)
+    assert pixelmatch(img1, img2, output=diff, options=opt) == -1
+
+    opt.outputFormat = OutputFormat.BitMask
+    bits = np.zeros((height, (width + 7) // 8), dtype=np.uint8)
+    assert Comparator(opt).compare(img1, img2, output=bits) == 163889
+    assert np.array_equal(bits, np.packbits(expected == 1, axis=1, bitorder="little"))
+    assert pixelmatch(img1, img2, output=mask, options=opt) == -1
+
+
+def test_pixelmatch_fixed_point_engine():
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    img1 = read_image(f"{project_source_dir}/data/pic1.png")
+    img2 = read_image(f"{project_source_dir}/data/pic2.png")
+
+    opt = Options()
+    opt.engine = Engine.FixedPoint
+    assert "engine=FixedPoint" in str(opt)
+    num = pixelmatch(img1, img2, options=opt)
+    assert abs(num - 163889) <= 163889 // 100
+
+
+def test_pixelmatch_coarse_to_fine_engine():
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    img1 = read_image(f"{project_source_dir}/data/pic1.png")
+    img2 = read_image(f"{project_source_dir}/data/pic2.png")
+
+    opt = Options()
+    opt.engine = Engine.CoarseToFine
+    assert "engine=CoarseToFine" in str(opt)
+    pyramid = ImagePyramid(img1)
+    assert (pyramid.height, pyramid.width) == img1.shape[:2]
+
+    # Same results as the float engine, with or without the cached pyramid of img1.
+    expected_diff = np.zeros(img1.shape, dtype=img1.dtype)
+    assert pixelmatch(img1, img2, output=expected_diff) == 163889
+    for img1_pyramid in [None, pyramid]:
+        diff = np.zeros(img1.shape, dtype=img1.dtype)
+        assert pixelmatch(img1, img2, output=diff, options=opt, img1Pyramid=img1_pyramid) == 163889
+        assert np.array_equal(diff, expected_diff)
+        stats = pixelmatch_stats(img1, img2, options=opt, img1Pyramid=img1_pyramid)
+        assert stats.numDiffPixels == 163889
+
+    # A pyramid of another size is rejected.
+    assert pixelmatch(img1[:10], img2[:10], options=opt, img1Pyramid=pyramid) == -1
+    with pytest.raises(ValueError, match="uint8"):
+        ImagePyramid(img1[..., :3])
+
+
+def test_pixelmatch_image_signature():
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    img1 = read_image(f"{project_source_dir}/data/pic1.png")
+    img2 = read_image(f"{project_source_dir}/data/pic2.png")
+
+    signature = ImageSignature(img1)
+    assert (signature.height, signature.width) == img1.shape[:2]
+    assert signature.matches(img1)
+    assert not signature.matches(img2)
+    assert signature == ImageSignature(img1.copy())
+    assert signature != ImageSignature(img2)
+
+    # Same results with the signature of img1, also once serialized.
+    expected_diff = np.zeros(img1.shape, dtype=img1.dtype)
+    assert pixelmatch(img1, img2, output=expected_diff) == 163889
+    loaded = ImageSignature.deserialize(signature.serialize())
+    assert loaded == signature and loaded.hash == signature.hash
+    for img1_signature in [signature, loaded]:
+        diff = np.zeros(img1.shape, dtype=img1.dtype)
+        assert pixelmatch(img1, img2, output=diff, img1Signature=img1_signature) == 163889
+        assert np.array_equal(diff, expected_diff)
+        stats = pixelmatch_stats(img1, img2, img1Signature=img1_signature)
+        assert stats.numDiffPixels == 163889
+    assert pixelmatch(img1, img1, img1Signature=signature) == 0
+
+    # Too many differences are rejected from the signature alone.
+    opt = Options()
+    opt.maxDiffs = 100
+    opt.includeAA = True
+    assert pixelmatch(img1, img2, options=opt, img1Signature=signature) == 101
+
+    # A signature of another size is rejected.
+    assert pixelmatch(img1[:10], img2[:10], img1Signature=signature) == -1
+    with pytest.raises(ValueError, match="ImageSignature"):
+        ImageSignature.deserialize(b"PXSG")
+
+
+def test_pixelmatch_strided_views():
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    img1 = read_image(f"{project_source_dir}/data/pic1.png")
+    img2 = read_image(f"{project_source_dir}/data/pic2.png")
+
+    crop1 = img1[100:900, 200:1200]
+    crop2 = img2[100:900, 200:1200]
+    assert not crop1.flags.c_contiguous
+    expected_diff = np.zeros(crop1.shape, dtype=crop1.dtype)
+    expected = pixelmatch(
+        np.ascontiguousarray(crop1), np.ascontiguousarray(crop2), output=expected_diff
+    )
+    assert expected > 0
+
+    # Crops sharing a row stride are compared in place, including the output.
+    diff = np.zeros(img1.shape, dtype=img1.dtype)
+    assert pixelmatch(crop1, crop2, output=diff[100:900, 200:1200]) == expected
+    assert np.array_equal(diff[100:900, 200:1200], expected_diff)
+
+    # Crops reaching the bottom-right corner end with the last pixel of the parent image.
+    corner1 = img1[-300:, 500:]
+    corner2 = img2[-300:, 500:]
+    expected_corner = pixelmatch(np.ascontiguousarray(corner1), np.ascontiguousarray(corner2))
+    diff = np.zeros(img1.shape, dtype=img1.dtype)
+    assert pixelmatch(corner1, corner2, output=diff[-300:, 500:]) == expected_corner
+    assert not diff[:-300].any() and not diff[:, :500].any()
+    assert ImageSignature(corner1).matches(np.ascontiguousarray(corner1))
+    assert ImagePyramid(corner1).width == corner1.shape[1]
+
+    # Other layouts are copied.
+    assert pixelmatch(crop1, np.ascontiguousarray(crop2)) == expected
+    reversed2 = np.ascontiguousarray(crop2[..., ::-1])[..., ::-1]
+    diff = np.zeros(crop1.shape, dtype=crop1.dtype)
+    assert pixelmatch(crop1, reversed2, output=diff) == expected
+    assert np.array_equal(diff, expected_diff)
+
+    nums = pixelmatch_batch([(crop1, crop2), (crop1, reversed2)])
+    assert nums == [expected, expected]
+
+
+def test_pixelmatch_ignore_regions():
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    img1 = read_image(f"{project_source_dir}/data/pic1.png")
+    img2 = read_image(f"{project_source_dir}/data/pic2.png")
+    height, width = img1.shape[:2]
+
+    opt = Options()
+    opt.ignoreRegions = [Rect(0, 0, width, height)]
+    assert [r.to_python() for r in opt.ignoreRegions] == [[0, 0, width, height]]
+    assert pixelmatch(img1, img2, options=opt) == 0
+
+    opt.ignoreRegions = [Rect(0, 0, width // 2, height)]
+    left_ignored = pixelmatch(img1, img2, options=opt)
+    assert 0 < left_ignored < 163889
+
+    mask = np.zeros((height, width), dtype=bool)
+    mask[:, : width // 2] = True
+    assert pixelmatch(img1, img2, ignoreMask=mask) == left_ignored
+    assert pixelmatch(img1, img2, ignoreMask=np.asfortranarray(mask)) == left_ignored
+    assert pixelmatch(img1, img2, ignoreMask=mask[:-1]) == -1
+
+
+def test_pixelmatch_delta_map():
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    img1 = read_image(f"{project_source_dir}/data/pic1.png")
+    img2 = read_image(f"{project_source_dir}/data/pic2.png")
+    height, width = img1.shape[:2]
+
+    opt = Options()
+    opt.collectDiffPixels = True
+    stats = pixelmatch_stats(img1, img2, options=opt)
+    deltas = np.full((height, width), np.nan, dtype=np.float32)
+    assert pixelmatch(img1, img2, options=opt, deltaMap=deltas) == 163889
+    xs, ys = stats.diffPixels[:, 0], stats.diffPixels[:, 1]
+    assert np.array_equal(deltas[ys, xs], stats.diffDeltas)
+    assert np.all(deltas[np.all(img1 == img2, axis=2)] == 0)
+
+    # The same deltas with DLPack tensors, without deltas in ignored pixels.
+    mask = np.zeros((height, width), dtype=np.uint8)
+    mask[:, : width // 2] = 1
+    masked = np.full((height, width), np.nan, dtype=np.float32)
+    pixelmatch_stats(img1, img2, ignoreMask=mask, deltaMap=DLPackTensor(masked))
+    assert np.all(masked[:, : width // 2] == 0)
+    assert np.array_equal(masked[:, width // 2 :], deltas[:, width // 2 :])
+
+    assert pixelmatch(img1, img2, deltaMap=deltas.astype(np.float64)) == -1
+    assert pixelmatch(img1, img2, deltaMap=deltas[:-1]) == -1
+    assert pixelmatch(img1, img2, deltaMap=np.asfortranarray(deltas)) == -1
+
+
+def test_comparator():
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    img1 = read_image(f"{project_source_dir}/data/pic1.png")
+    img2 = read_image(f"{project_source_dir}/data/pic2.png")
+
+    opt = Options()
+    opt.numThreads = 2
+    comparator = Comparator(opt)
+    assert comparator.options.numThreads == 2
+
+    expected_diff = np.zeros(img1.shape, dtype=img1.dtype)
+    pixelmatch(img1, img2, output=expected_diff)
+    for _ in range(3):
+        diff = np.zeros(img1.shape, dtype=img1.dtype)
+        assert comparator.compare(img1, img2, output=diff) == 163889
+        assert np.array_equal(diff, expected_diff)
+        assert comparator.compare(img1, img2) == 163889
+
+    opt.maxDiffs = 10
+    comparator.options = opt
+    assert comparator.options.maxDiffs == 10
+    assert comparator.compare(img1, img2) == 11
+    assert comparator.compare(img1, img2[:-1]) == -1
+
+
+def test_incremental_comparator():
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    img1 = read_image(f"{project_source_dir}/data/pic1.png")
+    img2 = read_image(f"{project_source_dir}/data/pic2.png")
+
+    comparator = IncrementalComparator()
+    current = img1.copy()
+    diff = np.zeros(img1.shape, dtype=img1.dtype)
+    assert comparator.compare(img1, current, output=diff).numDiffPixels == 0
+
+    # Paste the second image in, a band of rows at a time.
+    for y in range(0, img1.shape[0], 400):
+        current[y : y + 400] = img2[y : y + 400]
+        result = comparator.update(
+            img1, current, [Rect(0, y, img1.shape[1], 400)], output=diff
+        )
+        expected_diff = np.zeros(img1.shape, dtype=img1.dtype)
+        expected = pixelmatch_stats(img1, current)
+        assert pixelmatch(img1, current, output=expected_diff) == expected.numDiffPixels
+        assert result.numDiffPixels == expected.numDiffPixels
+        assert result.numAntialiasedPixels == expected.numAntialiasedPixels
+        assert str(result.bounds) == str(expected.bounds)
+        assert np.array_equal(diff, expected_diff)
+    assert result.numDiffPixels == 163889
+
+    opt = Options()
+    opt.maxDiffs = 10
+    with pytest.raises(ValueError):
+        IncrementalComparator(opt)
+
+
+def test_streaming_comparator():
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    img1 = read_image(f"{project_source_dir}/data/pic1.png")
+    img2 = read_image(f"{project_source_dir}/data/pic2.png")
+    height, width = img1.shape[:2]
+
+    expected_diff = np.zeros(img1.shape, dtype=img1.dtype)
+    expected = pixelmatch(img1, img2, output=expected_diff)
+
+    comparator = StreamingComparator(width, height, output=True)
+    rows = []
+    for y in range(0, height, 50):
+        rows.append(comparator.push_rows(img1[y : y + 50], img2[y : y + 50]))
+        assert comparator.rows_pushed == min(y + 50, height)
+        assert sum(len(r) for r in rows) == comparator.rows_compared
+    assert comparator.rows_compared == height
+    assert comparator.num_diff_pixels == expected
+    assert comparator.result().numDiffPixels == expected
+    assert np.array_equal(np.concatenate(rows), expected_diff)
+
+    # Column crops are compared in place, with rows spaced by the stride of the full image.
+    comparator = StreamingComparator(width - 20, height)
+    for y in range(0, height, 50):
+        comparator.push_rows(img1[y : y + 50, 10:-10], img2[y : y + 50, 10:-10])
+    assert comparator.num_diff_pixels == pixelmatch(img1[:, 10:-10], img2[:, 10:-10])
+
+    opt = Options()
+    opt.outputFormat = OutputFormat.BitMask
+    comparator = StreamingComparator(width, height, options=opt)
+    assert comparator.push_rows(img1[:100], img2[:100]) is None
+    assert comparator.result().numDiffPixels == -1
+    with pytest.raises(ValueError):
+        comparator.push_rows(img1, img2)
+    with pytest.raises(ValueError):
+        comparator.push_rows(img1[100:200], img2[100:200, :-1])
+
+
+def test_png_row_decoder():
+    project_source_dir = str(Path(__file__).resolve().parent.parent)
+    path = f"{project_source_dir}/data/pic1.png"
+    expected = read_png(path)
+
+    decoder = PngRowDecoder(path)
+    assert (decoder.height, decoder.width) == expected.shape[:2]
+    rows = []
+    while decoder.rows_read < decoder.height:
+        rows.append(decoder.read_rows(100))
+    assert decoder.read_rows(100).shape == (0, decoder.width, 4)
+    assert np.array_equal(np.concatenate(rows), expected)
+
+    with pytest.raises(ValueError):
+        PngRowDecoder(f"{project_source_dir}/README.md")
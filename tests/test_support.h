@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace pixelmatch {
+
+/// Path of a testdata image, such as tests/testdata/1a.png for (1, 'a'), relative to the
+/// repository root.
+inline std::string testdata(int index, char suffix) {
+  return "tests/testdata/" + std::to_string(index) + suffix + ".png";
+}
+
+/// Generates an opaque gradient frame, with a white 40x60 box at (300, 200) if \ref changed.
+inline std::vector<uint8_t> generateFrame(int width, int height, bool changed) {
+  std::vector<uint8_t> frame(static_cast<size_t>(width) * height * 4);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const size_t pos = (static_cast<size_t>(y) * width + x) * 4;
+      const bool inBox = changed && x >= 300 && x < 340 && y >= 200 && y < 260;
+      frame[pos + 0] = inBox ? 255 : static_cast<uint8_t>(x / 8);
+      frame[pos + 1] = inBox ? 255 : static_cast<uint8_t>(y / 8);
+      frame[pos + 2] = static_cast<uint8_t>((x + y) / 16);
+      frame[pos + 3] = 255;
+    }
+  }
+  return frame;
+}
+
+}  // namespace pixelmatch